@@ -25,11 +25,16 @@
 
 #include "hydrogen/config.h"
 #include <hydrogen/object.h>
+#include <hydrogen/globals.h>
 #include <hydrogen/IO/TransportInfo.h>
 
+#include <inttypes.h>
+
 namespace H2Core
 {
 
+class Song;
+
 ///
 /// Base abstract class for audio output classes.
 ///
@@ -38,11 +43,9 @@ class AudioOutput : public H2Core::Object
 public:
 	TransportInfo m_transport;		// Transport info
 
-	AudioOutput( const char* class_name )
-			: Object( class_name )
-			, __track_out_enabled( false ) { }
+	AudioOutput( const char* class_name );
 
-	virtual ~AudioOutput() { }
+	virtual ~AudioOutput();
 
 	virtual int init( unsigned nBufferSize ) = 0;
 	virtual int connect() = 0;
@@ -59,13 +62,44 @@ public:
 	virtual void setBpm( float fBPM ) = 0;
 
 
+	/*
+	 * Track outputs, a stereo bus per instrument of the song written by
+	 * the sampler besides the main out. The drivers without ports of
+	 * their own keep them in memory, see __alloc_track_buffers().
+	 */
+
 	bool has_track_outs() {
 		return __track_out_enabled;
 	}
 
+	/// Number of track outputs.
+	virtual int getNumTracks();
+	/// Buffer of track \a nTrack for the current cycle, NULL if none.
+	virtual float* getTrackOut_L( unsigned nTrack );
+	/// Buffer of track \a nTrack for the current cycle, NULL if none.
+	virtual float* getTrackOut_R( unsigned nTrack );
+	/// Make sure there is a track output for each instrument of \a song.
+	virtual void makeTrackOutputs( Song* song );
+	/// Zero the first \a nFrames frames of the track outputs.
+	void clearTrackOuts( uint32_t nFrames );
+
 protected:
 	bool __track_out_enabled;	///< True if is capable of per-track audio output
 
+	/**
+	 * Make sure there are at least \a nTracks memory track buffers of
+	 * \a nFrames frames. They are only freed by __free_track_buffers(),
+	 * so the audio thread can go on with the ones it got.
+	 */
+	void __alloc_track_buffers( int nTracks, unsigned nFrames );
+	void __free_track_buffers();
+
+private:
+	int __track_buffer_count;				///< memory track buffers
+	unsigned __track_buffer_frames;				///< size of the memory track buffers
+	float* __track_buffers_L[ MAX_INSTRUMENTS ];		///< memory track buffers (left channel)
+	float* __track_buffers_R[ MAX_INSTRUMENTS ];		///< memory track buffers (right channel)
+
 };
 
 };
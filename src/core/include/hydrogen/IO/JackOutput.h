@@ -66,7 +66,7 @@ public:
 	void deactivate();
 	unsigned getBufferSize();
 	unsigned getSampleRate();
-	int getNumTracks();
+	virtual int getNumTracks();
 
 	jack_transport_state_t getTransportState() {
 		return m_JackTransportState;
@@ -76,7 +76,7 @@ public:
 	}
 
 
-	void makeTrackOutputs( Song * );
+	virtual void makeTrackOutputs( Song * );
 	void setTrackOutput( int, Instrument * );
 
 	void setConnectDefaults( bool flag ) {
@@ -88,8 +88,8 @@ public:
 
 	float* getOut_L();
 	float* getOut_R();
-	float* getTrackOut_L( unsigned nTrack );
-	float* getTrackOut_R( unsigned nTrack );
+	virtual float* getTrackOut_L( unsigned nTrack );
+	virtual float* getTrackOut_R( unsigned nTrack );
 
 	int init( unsigned bufferSize );
 
@@ -201,6 +201,14 @@ public:
 	bool m_bUseMetronome;		///< Use metronome?
 	float m_fMetronomeVolume;	///< Metronome volume FIXME: remove this volume!!
 	unsigned m_nMaxNotes;		///< max notes
+	unsigned m_nRenderThreads;	///< threads rendering the sampler voices, 1 renders in the audio thread only
+	int m_nVoiceStealing;		///< note faded out past max notes: 0 oldest, 1 quietest, 2 same instrument first, 3 released first
+	bool m_bSampleStreaming;	///< drumkit samples only keep their first frames in memory, the others are read from disk while playing
+	int m_nStreamingPreload;	///< milliseconds of a streamed sample kept in memory
+	int m_nSampleCacheSize;		///< megabytes of decoded drumkit samples kept on disk, 0 disables the sample cache
+	int m_nLoaderThreads;		///< threads decoding samples when loading drumkits and songs, 0 uses one per core
+	bool m_bCompactSamples;		///< drumkit samples of 16 bit files are kept as 16 bit integers instead of floats
+	bool m_bResampleSamples;	///< drumkit samples are converted to the audio driver rate when loaded
 	unsigned m_nBufferSize;		///< Audio buffer size
 	unsigned m_nSampleRate;		///< Audio sample rate
 
@@ -216,6 +224,7 @@ public:
 
 	//___  alsa audio driver properties ___
 	QString m_sAlsaAudioDevice;
+	int m_nAlsaChannels;		///< device channels, the ones after the main out get the track outputs
 
 	//___  jack driver properties ___
 	QString m_sJackPortName1;
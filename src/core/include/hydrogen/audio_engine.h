@@ -25,6 +25,8 @@
 
 #include "hydrogen/config.h"
 #include <hydrogen/object.h>
+#include <hydrogen/command_queue.h>
+#include <hydrogen/meters.h>
 #include <hydrogen/sampler/Sampler.h>
 #include <hydrogen/synth/Synth.h>
 
@@ -76,12 +78,28 @@ public:
 
 	Sampler* get_sampler();
 	Synth* get_synth();
+	CommandQueue* get_command_queue();
+	/// Levels of the engine, the GUI reads them without locking.
+	Meters* get_meters();
+
+	/**
+	 * Hand a command over to the audio thread.
+	 *
+	 * While the engine is not processing audio (or the queue is
+	 * full) the command is executed right away under the engine
+	 * lock instead. Must not be called with the engine lock held.
+	 */
+	void post_command( const Command& cmd );
+	/// Execute all pending commands. Called by the audio thread with the engine lock held.
+	void process_commands();
 
 private:
 	static AudioEngine* __instance;
 
 	Sampler* __sampler;
 	Synth* __synth;
+	CommandQueue* __commands;
+	Meters* __meters;
 
 	/// Mutex for syncronized access to the Song object and the AudioEngine.
 	pthread_mutex_t __engine_mutex;
@@ -92,7 +110,14 @@ private:
 		const char* function;
 	} __locker;
 
+	/// Heap allocations of the note pool already reported, see __report_incidents().
+	unsigned __reported_fallbacks;
+
 	AudioEngine();
+
+	void __handle_command( const Command& cmd );
+	/// Log what went wrong on the audio thread since the last call, never called by the audio thread.
+	void __report_incidents();
 };
 
 };
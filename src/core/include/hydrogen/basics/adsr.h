@@ -28,6 +28,8 @@
 namespace H2Core
 {
 
+class NotePool;
+
 /**
  * Attack Decay Sustain Release envelope.
  */
@@ -51,6 +53,19 @@ class ADSR : private Object
 		/** destructor */
 		~ADSR();
 
+		/** allocate an ADSR from the heap */
+		static void* operator new( size_t size );
+		/**
+		 * allocate an ADSR from the given pool, the heap is used if the pool is exhausted
+		 * \param size the size to allocate
+		 * \param pool the pool to allocate from
+		 */
+		static void* operator new( size_t size, NotePool* pool );
+		/** give the ADSR storage back to the pool or to the heap */
+		static void operator delete( void* ptr );
+		/** used if a pooled ADSR constructor throws */
+		static void operator delete( void* ptr, NotePool* pool );
+
 		/**
 		 * __attack setter
 		 * \param value the new value
@@ -89,6 +104,13 @@ class ADSR : private Object
 		 * \param step the increment to be added to __ticks
 		 */
 		float get_value( float step );
+		/**
+		 * compute the values of a block of frames, same as n calls to get_value()
+		 * \param step the increment to be added to __ticks for each frame
+		 * \param values the array to fill
+		 * \param n the number of frames
+		 */
+		void get_values( float step, float* values, int n );
 		/**
 		 * sets state to RELEASE,
 		 * returns 0 if the state is IDLE,
@@ -96,6 +118,17 @@ class ADSR : private Object
 		 * set state to RELEASE, save __release_value and return it.
 		 * */
 		float release();
+		/**
+		 * release within the given tick count, starting from the current value,
+		 * unless the release already ends sooner,
+		 * returns 0 if the state is IDLE, the current value otherwise.
+		 * \param ticks the tick count of the fade
+		 */
+		float fade_out( float ticks );
+		/** return true if the state is RELEASE or IDLE */
+		bool is_released() const;
+		/** return the last computed value */
+		float get_current_value() const;
 
 	private:
 		float __attack;		///< Attack tick count
@@ -158,6 +191,16 @@ inline float ADSR::get_release()
 	return __release;
 }
 
+inline bool ADSR::is_released() const
+{
+	return ( __state == RELEASE || __state == IDLE );
+}
+
+inline float ADSR::get_current_value() const
+{
+	return __value;
+}
+
 };
 
 #endif // H2C_ADRS_H
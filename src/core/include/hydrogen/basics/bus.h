@@ -0,0 +1,149 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_BUS_H
+#define H2C_BUS_H
+
+#include <hydrogen/object.h>
+#include <hydrogen/globals.h>
+
+namespace H2Core
+{
+
+/**
+ * Bus is a submix a group of instruments is routed into.
+ * The sampler applies its volume, pan and fx sends once per block
+ * instead of once per playing note.
+ */
+class Bus : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * constructor
+		 * \param name the name of the bus
+		 */
+		Bus( const QString& name );
+		/** destructor */
+		~Bus();
+
+		/** set the name of the bus */
+		void set_name( const QString& name );
+		/** get the name of the bus */
+		const QString& get_name() const;
+		/** set the volume of the bus */
+		void set_volume( float volume );
+		/** get the volume of the bus */
+		float get_volume() const;
+		/** set the left pan of the bus */
+		void set_pan_l( float val );
+		/** get the left pan of the bus */
+		float get_pan_l() const;
+		/** set the right pan of the bus */
+		void set_pan_r( float val );
+		/** get the right pan of the bus */
+		float get_pan_r() const;
+		/** set muted status of the bus */
+		void set_muted( bool muted );
+		/** get muted status of the bus */
+		bool is_muted() const;
+		/** set the fx level of the bus */
+		void set_fx_level( float level, int index );
+		/** get the fx level of the bus */
+		float get_fx_level( int index ) const;
+
+	private:
+		QString __name;             ///< name of the bus
+		float __volume;             ///< volume of the bus
+		float __pan_l;              ///< left pan of the bus
+		float __pan_r;              ///< right pan of the bus
+		bool __muted;               ///< is the bus muted?
+		float __fx_level[MAX_FX];   ///< Ladspa FX level array
+};
+
+// DEFINITIONS
+
+inline void Bus::set_name( const QString& name )
+{
+	__name = name;
+}
+
+inline const QString& Bus::get_name() const
+{
+	return __name;
+}
+
+inline void Bus::set_volume( float volume )
+{
+	__volume = volume;
+}
+
+inline float Bus::get_volume() const
+{
+	return __volume;
+}
+
+inline void Bus::set_pan_l( float val )
+{
+	__pan_l = val;
+}
+
+inline float Bus::get_pan_l() const
+{
+	return __pan_l;
+}
+
+inline void Bus::set_pan_r( float val )
+{
+	__pan_r = val;
+}
+
+inline float Bus::get_pan_r() const
+{
+	return __pan_r;
+}
+
+inline void Bus::set_muted( bool muted )
+{
+	__muted = muted;
+}
+
+inline bool Bus::is_muted() const
+{
+	return __muted;
+}
+
+inline void Bus::set_fx_level( float level, int index )
+{
+	__fx_level[index] = level;
+}
+
+inline float Bus::get_fx_level( int index ) const
+{
+	return __fx_level[index];
+}
+
+};
+
+#endif // H2C_BUS_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -30,6 +30,7 @@
 
 #define EMPTY_INSTR_ID          -1
 #define METRONOME_INSTR_ID      -2
+#define VELOCITY_LAYER_STEPS    128     ///< velocity steps of the velocity to layer table
 
 namespace H2Core
 {
@@ -37,7 +38,9 @@ namespace H2Core
 class XMLNode;
 class ADSR;
 class Drumkit;
+class SampleLoader;
 class InstrumentLayer;
+class Note;
 
 /**
 Instrument class
@@ -81,11 +84,33 @@ class Instrument : public H2Core::Object
 		 * \param is_live is it performed while playing
 		 */
 		void load_from( Drumkit* drumkit, Instrument* instrument, bool is_live = true );
+		/**
+		 * loads instrument from a given instrument into a `live` Instrument object, with the samples decoded by a SampleLoader
+		 * \param drumkit the drumkit the instrument belongs to
+		 * \param instrument to load samples and members from
+		 * \param is_live is it performed while playing
+		 * \param loader the loader the samples were queued on by queue_samples_from(), already run
+		 * \param job the value returned by queue_samples_from()
+		 */
+		void load_from( Drumkit* drumkit, Instrument* instrument, bool is_live, SampleLoader* loader, int job );
+		/**
+		 * queue the samples load_from() needs, one job per layer of \a instrument in layer order
+		 * \param loader the loader to queue the samples on
+		 * \param drumkit the drumkit the instrument belongs to
+		 * \param instrument the instrument to load samples from
+		 * \return the job of the first layer
+		 */
+		static int queue_samples_from( SampleLoader* loader, Drumkit* drumkit, Instrument* instrument );
 
 		/**
 		 * load samples data
 		 */
 		void load_samples();
+		/**
+		 * queue the loading of the samples data
+		 * \param loader the loader to queue the samples on
+		 */
+		void queue_samples( SampleLoader* loader );
 		/*
 		 * unload instrument samples
 		 */
@@ -119,11 +144,30 @@ class Instrument : public H2Core::Object
 		InstrumentLayer* get_layer( int idx );
 
 		/**
-		 * set a layer within the instrument's layer list
+		 * set a layer within the instrument's layer list, and update the velocity to layer table
 		 * \param layer the layer to be set
 		 * \param idx the index within the list
 		 */
 		void set_layer( InstrumentLayer* layer, int idx );
+		/** rebuild the velocity to layer table, to be called once the velocity range of a layer changed */
+		void update_layer_table();
+		/**
+		 * return the index of the layer to play at a given velocity, -1 if none,
+		 * chosen among the matching layers according to the sample selection algorithm
+		 * \param velocity the note velocity [0;1]
+		 */
+		int select_layer( float velocity );
+
+		/** how a layer is chosen among the layers matching a velocity */
+		enum SampleSelectionAlgo {
+			VELOCITY,       ///< the first matching layer
+			ROUND_ROBIN,    ///< each matching layer in turn
+			RANDOM          ///< a random matching layer
+		};
+		/** set the sample selection algorithm of the instrument */
+		void set_sample_selection_alg( SampleSelectionAlgo alg );
+		/** get the sample selection algorithm of the instrument */
+		SampleSelectionAlgo get_sample_selection_alg() const;
 
 		///< set the name of the instrument
 		void set_name( const QString& name );
@@ -142,11 +186,21 @@ class Instrument : public H2Core::Object
 		/** get a copy of the ADSR of the instrument */
 		ADSR* copy_adsr() const;
 
-		/** set the mute group of the instrument */
+		/** set the mute group of the instrument, -1 for none, at most MAX_MUTE_GROUPS-1 */
 		void set_mute_group( int group );
 		/** get the mute group of the instrument */
 		int get_mute_group() const;
 
+		/** set the bus the instrument is routed into, -1 for the main mix */
+		void set_bus( int bus );
+		/** get the bus the instrument is routed into */
+		int get_bus() const;
+
+		/** set the maximum number of notes of the instrument playing at once, 0 for no limit */
+		void set_max_voices( int voices );
+		/** get the maximum number of notes of the instrument playing at once */
+		int get_max_voices() const;
+
 		/** set the midi out channel of the instrument */
 		void set_midi_out_channel( int channel );
 		/** get the midi out channel of the instrument */
@@ -196,15 +250,6 @@ class Instrument : public H2Core::Object
 		/** get the filter cutoff of the instrument */
 		float get_filter_cutoff() const;
 
-		/** set the left peak of the instrument */
-		void set_peak_l( float val );
-		/** get the left peak of the instrument */
-		float get_peak_l() const;
-		/** set the right peak of the instrument */
-		void set_peak_r( float val );
-		/** get the right peak of the instrument */
-		float get_peak_r() const;
-
 		/** set the fx level of the instrument */
 		void set_fx_level( float level, int index );
 		/** get the fx level of the instrument */
@@ -231,6 +276,10 @@ class Instrument : public H2Core::Object
 		void dequeue();
 		/** get the queued status of the instrument */
 		bool is_queued() const;
+		/** get the head of the list of notes of the instrument playing in the sampler, see Note::INSTRUMENT_VOICES */
+		Note** get_voices();
+		/** return true if the sampler plays any note of the instrument */
+		bool has_voices() const;
 
 		/** set the stop notes status of the instrument */
 		void set_stop_notes( bool stopnotes );
@@ -251,8 +300,6 @@ class Instrument : public H2Core::Object
 		float __volume;			                ///< volume of the instrument
 		float __pan_l;			                ///< left pan of the instrument
 		float __pan_r;			                ///< right pan of the instrument
-		float __peak_l;			                ///< left current peak value
-		float __peak_r;			                ///< right current peak value
 		ADSR* __adsr;                           ///< attack delay sustain release instance
 		bool __filter_active;		            ///< is filter active?
 		float __filter_cutoff;		            ///< filter cutoff (0..1)
@@ -265,9 +312,16 @@ class Instrument : public H2Core::Object
 		bool __soloed;                          ///< is the instrument in solo mode?
 		bool __muted;                           ///< is the instrument muted?
 		int __mute_group;		                ///< mute group of the instrument
+		int __bus;		                        ///< index of the song bus the instrument is routed into, -1 for the main mix
+		int __max_voices;		                ///< notes of the instrument playing at once, older ones are faded out, 0 for no limit
 		int __queued;                           ///< count the number of notes queued within Sampler::__playing_notes_queue or std::priority_queue m_songNoteQueue
+		Note* __voices;                         ///< first note of the instrument playing in the sampler, maintained by the sampler
 		float __fx_level[MAX_FX];	            ///< Ladspa FX level array
 		InstrumentLayer* __layers[MAX_LAYERS];  ///< InstrumentLayer array
+		SampleSelectionAlgo __sample_selection_alg;     ///< how a layer is chosen among the matching ones
+		unsigned char __layer_table[VELOCITY_LAYER_STEPS][MAX_LAYERS];  ///< indexes of the layers matching each velocity step
+		unsigned char __layer_count[VELOCITY_LAYER_STEPS];              ///< number of layers matching each velocity step
+		unsigned char __round_robin[VELOCITY_LAYER_STEPS];              ///< next matching layer of each velocity step for ROUND_ROBIN
 };
 
 // DEFINITIONS
@@ -304,7 +358,7 @@ inline ADSR* Instrument::copy_adsr() const
 
 inline void Instrument::set_mute_group( int group )
 {
-	__mute_group = ( group<-1 ? -1 : group );
+	__mute_group = ( group<-1 ? -1 : ( group>=MAX_MUTE_GROUPS ? MAX_MUTE_GROUPS-1 : group ) );
 }
 
 inline int Instrument::get_mute_group() const
@@ -312,6 +366,21 @@ inline int Instrument::get_mute_group() const
 	return __mute_group;
 }
 
+inline int Instrument::get_bus() const
+{
+	return __bus;
+}
+
+inline void Instrument::set_max_voices( int voices )
+{
+	__max_voices = ( voices<0 ? 0 : voices );
+}
+
+inline int Instrument::get_max_voices() const
+{
+	return __max_voices;
+}
+
 inline int Instrument::get_midi_out_channel() const
 {
 	return __midi_out_channel;
@@ -420,31 +489,6 @@ inline float Instrument::get_filter_cutoff() const
 	return __filter_cutoff;
 }
 
-inline void Instrument::set_peak_l( float val )
-{
-	__peak_l = val;
-}
-
-inline float Instrument::get_peak_l() const
-{
-	return __peak_l;
-}
-
-inline void Instrument::set_peak_r( float val )
-{
-	__peak_r = val;
-}
-
-inline float Instrument::get_peak_r() const
-{
-	return __peak_r;
-}
-
-inline void Instrument::set_fx_level( float level, int index )
-{
-	__fx_level[index] = level;
-}
-
 inline float Instrument::get_fx_level( int index ) const
 {
 	return __fx_level[index];
@@ -496,6 +540,16 @@ inline bool Instrument::is_queued() const
 	return ( __queued > 0 );
 }
 
+inline Note** Instrument::get_voices()
+{
+	return &__voices;
+}
+
+inline bool Instrument::has_voices() const
+{
+	return ( __voices != 0 );
+}
+
 inline void Instrument::set_stop_notes( bool stopnotes )
 {
 	__stop_notes = stopnotes;
@@ -522,6 +576,17 @@ inline void Instrument::set_layer( InstrumentLayer* layer, int idx )
 {
 	assert( idx>=0 && idx <MAX_LAYERS );
 	__layers[ idx ] = layer;
+	update_layer_table();
+}
+
+inline void Instrument::set_sample_selection_alg( SampleSelectionAlgo alg )
+{
+	__sample_selection_alg = alg;
+}
+
+inline Instrument::SampleSelectionAlgo Instrument::get_sample_selection_alg() const
+{
+	return __sample_selection_alg;
 }
 
 inline void Instrument::set_drumkit_name( const QString& name )
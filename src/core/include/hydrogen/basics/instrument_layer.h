@@ -82,7 +82,7 @@ class InstrumentLayer : public H2Core::Object
 		Sample* get_sample() const;
 
 		/**
-		 * load the sample data
+		 * load the sample data, streamed if Preferences::m_bSampleStreaming is set
 		 */
 		void load_sample();
 		/*
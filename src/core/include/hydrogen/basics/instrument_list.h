@@ -27,6 +27,8 @@
 
 #include <hydrogen/object.h>
 
+#include <QtCore/QAtomicInt>
+
 namespace H2Core
 {
 
@@ -142,8 +144,18 @@ class InstrumentList : public H2Core::Object
 		 */
 		static InstrumentList* load_from( XMLNode* node, const QString& dk_path, const QString& dk_name );
 
+		/**
+		 * return the routing generation, increased each time an instrument list
+		 * is created, changed or deleted, or an instrument FX level is set,
+		 * anything computed from instrument indexes or FX levels is stale once it changes
+		 */
+		static int get_generation();
+		/** increase the routing generation */
+		static void bump_generation();
+
 	private:
 		std::vector<Instrument*> __instruments;            ///< the list of instruments
+		static QAtomicInt __generation;                    ///< routing generation
 };
 
 // DEFINITIONS
@@ -153,6 +165,16 @@ inline int InstrumentList::size() const
 	return __instruments.size();
 }
 
+inline int InstrumentList::get_generation()
+{
+	return __generation.fetchAndAddAcquire( 0 );
+}
+
+inline void InstrumentList::bump_generation()
+{
+	__generation.fetchAndAddRelease( 1 );
+}
+
 };
 
 #endif // H2C_INSTRUMENT_LIST_H
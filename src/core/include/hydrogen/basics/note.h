@@ -51,6 +51,7 @@ class XMLNode;
 class ADSR;
 class Instrument;
 class InstrumentList;
+class NotePool;
 
 /**
  * A note plays an associated instrument with a velocity left and right pan
@@ -63,6 +64,13 @@ class Note : public H2Core::Object
 		enum Key { C=KEY_MIN, Cs, D, Ef, E, F, Fs, G, Af, A, Bf, B };
 		/** possible octaves */
 		enum Octave { P8Z=-3, P8Y=-2, P8X=-1, P8=OCTAVE_DEFAULT, P8A=1, P8B=2, P8C=3 };
+		/** lists of playing notes kept by the sampler, a note is linked in each list at most once */
+		enum VoiceList {
+			INSTRUMENT_VOICES=0,    ///< the notes of an instrument
+			MUTE_GROUP_VOICES,      ///< the notes of a mute group
+			KEY_VOICES,             ///< the notes started by a midi key
+			VOICE_LISTS
+		};
 
 		/**
 		 * constructor
@@ -84,6 +92,19 @@ class Note : public H2Core::Object
 		/** destructor */
 		~Note();
 
+		/** allocate a note from the heap */
+		static void* operator new( size_t size );
+		/**
+		 * allocate a note from the given pool, the heap is used if the pool is exhausted
+		 * \param size the size to allocate
+		 * \param pool the pool to allocate from
+		 */
+		static void* operator new( size_t size, NotePool* pool );
+		/** give the note storage back to the pool or to the heap */
+		static void operator delete( void* ptr );
+		/** used if a pooled note constructor throws */
+		static void operator delete( void* ptr, NotePool* pool );
+
 		/*
 		 * save the note within the given XMLNode
 		 * \param node the XMLNode to feed
@@ -105,6 +126,11 @@ class Note : public H2Core::Object
 		 * \param instruments the list of instrument to look into
 		 */
 		void map_instrument( InstrumentList* instruments );
+		/**
+		 * __instrument setter, also sets __instrument_id, the ADSR is kept
+		 * \param instrument the new instrument
+		 */
+		void set_instrument( Instrument* instrument );
 		/** __instrument accessor */
 		Instrument* get_instrument();
 		/** return true if __instrument is set */
@@ -201,14 +227,27 @@ class Note : public H2Core::Object
 		float get_cut_off() const;
 		/** __resonance accessor */
 		float get_resonance() const;
-		/** __bpfb_l accessor */
-		float get_bpfb_l() const;
-		/** __bpfb_r accessor */
-		float get_bpfb_r() const;
-		/** __lpfb_l accessor */
-		float get_lpfb_l() const;
-		/** __lpfb_r accessor */
-		float get_lpfb_r() const;
+		/**
+		 * __voice setter
+		 * \param value the new value
+		 */
+		void set_voice( int value );
+		/** __voice accessor */
+		int get_voice() const;
+		/**
+		 * __stolen setter
+		 * \param value the new value
+		 */
+		void set_stolen( bool value );
+		/** __stolen accessor */
+		bool is_stolen() const;
+		/**
+		 * __selected_layer setter
+		 * \param value the new value
+		 */
+		void set_selected_layer( int value );
+		/** __selected_layer accessor */
+		int get_selected_layer() const;
 		/** __key accessor */
 		Key get_key();
 		/** __octave accessor */
@@ -263,11 +302,18 @@ class Note : public H2Core::Object
 		bool match( Instrument* instrument, Key key, Octave octave ) const;
 
 		/**
-		 * compute left and right output based on filters
-		 * \param val_l the left channel value
-		 * \param val_r the right channel value
+		 * insert the note at the head of a voice list
+		 * \param list the list to insert into
+		 * \param head the head of the list, kept until unlink_voice()
+		 */
+		void link_voice( VoiceList list, Note** head );
+		/**
+		 * remove the note from a voice list, does nothing if not linked
+		 * \param list the list to remove from
 		 */
-		void compute_lr_values( float* val_l, float* val_r );
+		void unlink_voice( VoiceList list );
+		/** return the next note of a voice list, NULL at the end */
+		Note* get_next_voice( VoiceList list ) const;
 
 	private:
 		Instrument* __instrument;   ///< the instrument to be played by this note
@@ -286,10 +332,12 @@ class Note : public H2Core::Object
 		float __resonance;          ///< filter resonant frequency [0;1]
 		int __humanize_delay;       ///< used in "humanize" function
 		float __sample_position;    ///< place marker for overlapping process() cycles
-		float __bpfb_l;             ///< left band pass filter buffer
-		float __bpfb_r;             ///< right band pass filter buffer
-		float __lpfb_l;             ///< left low pass filter buffer
-		float __lpfb_r;             ///< right low pass filter buffer
+		int __voice;                ///< sampler voice slot holding the filter state, -1 if not playing
+		bool __stolen;              ///< fading out to make room for another note, ends once its envelope is idle
+		int __selected_layer;       ///< instrument layer played, chosen by the sampler at note on, -1 if none
+		Note** __voice_head[VOICE_LISTS];   ///< head of each voice list the note is linked in, NULL if not linked
+		Note* __voice_prev[VOICE_LISTS];    ///< previous note of each voice list
+		Note* __voice_next[VOICE_LISTS];    ///< next note of each voice list
 		int __pattern_idx;          ///< index of the pattern holding this note for undo actions
 		int __midi_msg;             ///< TODO
 		bool __note_off;            ///< note type on|off
@@ -304,6 +352,12 @@ inline ADSR* Note::get_adsr() const
 	return __adsr;
 }
 
+inline void Note::set_instrument( Instrument* instrument )
+{
+	__instrument = instrument;
+	__instrument_id = instrument->get_id();
+}
+
 inline Instrument* Note::get_instrument()
 {
 	return __instrument;
@@ -434,24 +488,39 @@ inline float Note::get_resonance() const
 	return __resonance;
 }
 
-inline float Note::get_bpfb_l() const
+inline void Note::set_voice( int value )
+{
+	__voice = value;
+}
+
+inline int Note::get_voice() const
+{
+	return __voice;
+}
+
+inline void Note::set_stolen( bool value )
 {
-	return __bpfb_l;
+	__stolen = value;
 }
 
-inline float Note::get_bpfb_r() const
+inline bool Note::is_stolen() const
 {
-	return __bpfb_r;
+	return __stolen;
 }
 
-inline float Note::get_lpfb_l() const
+inline void Note::set_selected_layer( int value )
 {
-	return __lpfb_l;
+	__selected_layer = value;
 }
 
-inline float Note::get_lpfb_r() const
+inline int Note::get_selected_layer() const
 {
-	return __lpfb_r;
+	return __selected_layer;
+}
+
+inline Note* Note::get_next_voice( VoiceList list ) const
+{
+	return __voice_next[list];
 }
 
 inline Note::Key Note::get_key()
@@ -513,25 +582,6 @@ inline bool Note::match( Instrument* instrument, Key key, Octave octave ) const
 	return ( ( __instrument==instrument ) && ( __key==key ) && ( __octave==octave ) );
 }
 
-inline void Note::compute_lr_values( float* val_l, float* val_r )
-{
-	/* TODO ???
-	if( !has_instrument() ) {
-		*val_l = 0.0f;
-		*val_r = 0.0f;
-		return;
-	}
-	*/
-	float cut_off = __instrument->get_filter_cutoff();
-	float resonance = __instrument->get_filter_resonance();
-	__bpfb_l  =  resonance * __bpfb_l  + cut_off * ( *val_l - __lpfb_l );
-	__lpfb_l +=  cut_off   * __bpfb_l;
-	__bpfb_r  =  resonance * __bpfb_r  + cut_off * ( *val_r - __lpfb_r );
-	__lpfb_r +=  cut_off   * __bpfb_r;
-	*val_l = __lpfb_l;
-	*val_r = __lpfb_r;
-}
-
 };
 
 #endif // H2C_NOTE_H
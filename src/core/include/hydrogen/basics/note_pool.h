@@ -0,0 +1,153 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_NOTE_POOL_H
+#define H2C_NOTE_POOL_H
+
+#include <hydrogen/object.h>
+
+#include <cassert>
+#include <cstddef>
+
+/** slots allocated on top of Preferences::m_nMaxNotes, for the song and midi note queues */
+#define NOTE_POOL_HEADROOM      512
+
+namespace H2Core
+{
+
+/**
+ * NotePool is a fixed capacity storage for the notes the audio engine
+ * copies while playing, and for their ADSR.
+ *
+ * Allocation is done with <b>new ( NotePool::get_instance() ) Note( ... )</b>,
+ * deletion with a plain <b>delete</b>: Note and ADSR recognize their pooled
+ * storage and give it back in O(1) without touching the heap.
+ * Pooled notes must only be created and deleted by the audio thread
+ * (or with the audio engine locked), other threads hand notes over
+ * through the CommandQueue.
+ * When the pool is exhausted the heap is used and the fallback counter is increased.
+ * The pool is created and destroyed with the AudioEngine.
+ */
+class NotePool : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * create the pool
+		 * \param capacity the number of notes (and ADSR) the pool can hold
+		 */
+		static void create_instance( int capacity );
+		/** return the pool instance */
+		static NotePool* get_instance() { assert( __instance ); return __instance; }
+		/** destructor, reports the notes still allocated */
+		~NotePool();
+
+		/**
+		 * change the number of slots, only possible while no slot is used
+		 * \param capacity the number of notes (and ADSR) the pool can hold
+		 * \return false if some slots are used, the pool is unchanged then
+		 */
+		bool resize( int capacity );
+
+		/** return a free note slot or 0 if none left */
+		void* alloc_note();
+		/** return a free ADSR slot or 0 if none left */
+		void* alloc_adsr();
+		/**
+		 * give a note slot back to the pool
+		 * \param ptr the slot
+		 * \return false if ptr is not a pool slot
+		 */
+		static bool free_note( void* ptr );
+		/**
+		 * give an ADSR slot back to the pool
+		 * \param ptr the slot
+		 * \return false if ptr is not a pool slot
+		 */
+		static bool free_adsr( void* ptr );
+		/** return true if ptr is a note slot of the pool */
+		static bool is_pooled( const void* ptr );
+
+		/** return the number of slots */
+		int get_capacity() const;
+		/** return the number of notes currently allocated from the pool */
+		int get_used_notes() const;
+		/** return the number of allocations which had to use the heap */
+		unsigned get_fallback_count() const;
+		/** must be called when the pool could not serve an allocation */
+		void add_fallback();
+
+	private:
+		static NotePool* __instance;
+		int __capacity;             ///< number of slots of each kind
+		size_t __note_size;         ///< size of a note slot
+		size_t __adsr_size;         ///< size of an ADSR slot
+		char* __notes;              ///< note slots storage
+		char* __adsrs;              ///< ADSR slots storage
+		int* __free_notes;          ///< stack of free note slot indexes
+		int __free_notes_count;     ///< number of free note slots
+		int* __free_adsrs;          ///< stack of free ADSR slot indexes
+		int __free_adsrs_count;     ///< number of free ADSR slots
+		unsigned __fallback_count;  ///< allocations served by the heap
+
+		/** constructor */
+		NotePool( int capacity );
+		/** allocate the slots for __capacity notes, all free */
+		void __alloc_slots();
+		/** free the slots */
+		void __free_slots();
+};
+
+// DEFINITIONS
+
+inline bool NotePool::is_pooled( const void* ptr )
+{
+	if ( __instance==0 ) return false;
+	const char* p = ( const char* )ptr;
+	return ( p>=__instance->__notes && p<__instance->__notes + __instance->__capacity * __instance->__note_size );
+}
+
+inline int NotePool::get_capacity() const
+{
+	return __capacity;
+}
+
+inline int NotePool::get_used_notes() const
+{
+	return __capacity - __free_notes_count;
+}
+
+inline unsigned NotePool::get_fallback_count() const
+{
+	return __fallback_count;
+}
+
+inline void NotePool::add_fallback()
+{
+	__fallback_count++;
+}
+
+};
+
+#endif // H2C_NOTE_POOL_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,136 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_NOTE_QUEUE_H
+#define H2C_NOTE_QUEUE_H
+
+#include <hydrogen/object.h>
+
+#include <vector>
+
+#define NOTE_QUEUE_BUCKET_FRAMES    64      ///< frames covered by one bucket
+#define NOTE_QUEUE_BUCKETS          1024    ///< number of buckets of the wheel
+#define NOTE_QUEUE_BUCKET_SIZE      16      ///< notes a bucket can hold
+#define NOTE_QUEUE_OVERFLOW         4096    ///< notes the overflow list holds without allocating
+
+namespace H2Core
+{
+
+class Note;
+
+/**
+ * NoteQueue orders notes on the absolute frame they start at:
+ * <b>humanize delay + position * tick size</b>.
+ *
+ * It is a timing wheel: each bucket holds up to NOTE_QUEUE_BUCKET_SIZE
+ * notes of NOTE_QUEUE_BUCKET_FRAMES frames, kept sorted, the wheel covers
+ * NOTE_QUEUE_BUCKETS buckets from the earliest note. Later notes and
+ * notes which do not fit in their bucket wait in a sorted overflow list.
+ * Push and pop are amortized O(1) as long as the notes fit in the wheel,
+ * which the engine lookahead ensures.
+ * Notes with the same start frame come out in the order they were pushed.
+ *
+ * The buckets are fixed arrays, the overflow list only allocates once more
+ * than NOTE_QUEUE_OVERFLOW notes wait in it.
+ */
+class NoteQueue : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/** constructor */
+		NoteQueue();
+		/** destructor, does not delete the queued notes */
+		~NoteQueue();
+
+		/**
+		 * queue a note
+		 * \param note the note to queue
+		 */
+		void push( Note* note );
+		/** return the earliest note, the queue must not be empty */
+		Note* top();
+		/** remove the earliest note, the queue must not be empty */
+		void pop();
+		/** return true if there is no note queued */
+		bool empty() const;
+		/** return the number of queued notes */
+		unsigned size() const;
+
+		/**
+		 * set the tick size used to compute note start frames,
+		 * the queue is reordered if it changes
+		 * \param tick_size the frames per tick
+		 */
+		void set_tick_size( float tick_size );
+
+	private:
+		/** a queued note, its start frame and its push order */
+		struct Entry {
+			float key;
+			unsigned seq;
+			Note* note;
+		};
+		/** the notes of NOTE_QUEUE_BUCKET_FRAMES frames */
+		struct Bucket {
+			Entry entries[ NOTE_QUEUE_BUCKET_SIZE ];
+			unsigned size;
+		};
+		typedef std::vector<Entry> entries_t;
+
+		Bucket __buckets[ NOTE_QUEUE_BUCKETS ];     ///< the wheel
+		entries_t __overflow;                       ///< notes beyond the wheel or its full buckets, sorted
+		entries_t __scratch;                        ///< used to reorder the queue
+		long long __cursor;                         ///< absolute bucket number of the earliest note
+		unsigned __head;                            ///< entries already popped from the cursor bucket
+		unsigned __wheel_size;                      ///< number of notes in the wheel
+		unsigned __seq;                             ///< push counter, orders equal start frames
+		float __tick_size;                          ///< frames per tick
+
+		/** compute the start frame of a note */
+		float __key( Note* note ) const;
+		/** insert an entry in the wheel, return false if its bucket is full or out of the wheel */
+		bool __insert_wheel( const Entry& entry );
+		/** insert an entry in the wheel or in the overflow list */
+		void __insert( const Entry& entry );
+		/** move the cursor to the earliest bucket, return true if the overflow list holds the earliest note */
+		bool __seek();
+		/** return true if a comes out before b */
+		static bool __before( const Entry& a, const Entry& b );
+};
+
+// DEFINITIONS
+
+inline bool NoteQueue::empty() const
+{
+	return ( __wheel_size==0 && __overflow.empty() );
+}
+
+inline unsigned NoteQueue::size() const
+{
+	return __wheel_size + __overflow.size();
+}
+
+};
+
+#endif // H2C_NOTE_QUEUE_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -23,7 +23,9 @@
 #ifndef H2C_PATTERN_H
 #define H2C_PATTERN_H
 
+#include <map>
 #include <set>
+#include <vector>
 
 #include <hydrogen/object.h>
 #include <hydrogen/basics/note.h>
@@ -147,6 +149,14 @@ class Pattern : public H2Core::Object
 		 * \param instr the instrument
 		*/
 		void purge_instrument( Instrument* instr );
+		/**
+		 * find the notes referencing a replaced instrument without changing them,
+		 * the audio engine only needs to be locked while they are updated
+		 * \param replacements the replacement of each replaced instrument
+		 * \param notes the notes to update are appended to it
+		 * \param instruments the replacement of each of those notes is appended to it
+		 */
+		void find_replacements( const std::map<Instrument*, Instrument*>& replacements, std::vector<Note*>& notes, std::vector<Instrument*>& instruments ) const;
 		/**
 		 * mark all notes as old
 		 */
@@ -28,9 +28,18 @@
 
 #include <hydrogen/object.h>
 
+/** zeroed frames around the sample data, interpolation may read that far out of the sample */
+#define SAMPLE_GUARD_FRAMES     8
+/** frames a streamed sample keeps in memory at least */
+#define SAMPLE_MIN_RESIDENT_FRAMES  4096
+/** scale of the 16 bit frames of a compact sample */
+#define SAMPLE_PCM_SCALE        ( 1.0f / 32768.0f )
+
 namespace H2Core
 {
 
+class SampleBuffer;
+
 /**
  * A container for a sample, beeing able to apply modifications on it
  */
@@ -125,8 +134,8 @@ class Sample : public H2Core::Object
 		 * \param filepath the path to the sample
 		 * \param frames the number of frames per channel in the sample
 		 * \param sample_rate the sample rate of the sample
-		 * \param data_l the left channel array of data
-		 * \param data_l the right channel array of data
+		 * \param data_l the left channel array of data, allocated with alloc_data()
+		 * \param data_l the right channel array of data, allocated with alloc_data(), data_l for a mono sample
 		 */
 		Sample( const QString& filepath, int frames=0, int sample_rate=0, float* data_l=0, float* data_r=0 );
 		/** copy constructor */
@@ -145,8 +154,9 @@ class Sample : public H2Core::Object
 		/**
 		 * load a sample from a file
 		 * \param filepath the file to load audio data from
+		 * \param for_playback the sample belongs to a drumkit, see load( bool )
 		 */
-		static Sample* load( const QString& filepath );
+		static Sample* load( const QString& filepath, bool for_playback=false );
 		/**
 		 * load a sample from a file and apply the transformations to the sample data
 		 * \param filepath the file to load audio data from
@@ -159,13 +169,27 @@ class Sample : public H2Core::Object
 
 		/**
 		 * load sample data
+		 * \param for_playback the sample belongs to a drumkit: only its first frames are kept in memory if
+		 * Preferences::m_bSampleStreaming is set, the sampler reads the others from disk while playing,
+		 * the frames of a 16 bit file are kept as 16 bit integers if Preferences::m_bCompactSamples is set,
+		 * otherwise its frames are mapped from the SampleCache.
+		 * Unless streamed, the frames are converted to the playback rate if Preferences::m_bResampleSamples is set.
+		 * The frames are shared through the SamplePool with the other samples loaded from the same file.
 		 */
-		void load();
+		void load( bool for_playback=false );
 		/**
 		 * unload sample data
 		 */
 		void unload();
 
+		/**
+		 * set the rate of the audio driver, the drumkit samples are converted to when loaded
+		 * \param rate the sample rate, 0 if unknown
+		 */
+		static void set_playback_rate( int rate );
+		/** __playback_rate accessor */
+		static int get_playback_rate();
+
 		/**
 		 * apply the transformations to the sample data
 		 * \param loops transformation parameters
@@ -200,6 +224,34 @@ class Sample : public H2Core::Object
 		 */
 		bool exec_rubberband_cli( const Rubberband& rb );
 
+		/**
+		 * allocate a channel data array, surrounded by SAMPLE_GUARD_FRAMES zeroed frames on each side
+		 * \param frames the number of frames of the array
+		 */
+		static float* alloc_data( int frames );
+		/**
+		 * free a channel data array allocated with alloc_data()
+		 * \param data the array, may be null
+		 */
+		static void free_data( float* data );
+		/**
+		 * free the data channels of a sample allocated with alloc_data()
+		 * \param data_l the left channel, may be null
+		 * \param data_r the right channel, may be null or \a data_l
+		 */
+		static void free_data( float* data_l, float* data_r );
+		/**
+		 * allocate a 16 bit channel array, surrounded by SAMPLE_GUARD_FRAMES zeroed frames on each side
+		 * \param frames the number of frames of the array
+		 */
+		static short* alloc_pcm( int frames );
+		/**
+		 * free the 16 bit channels of a sample allocated with alloc_pcm()
+		 * \param pcm_l the left channel, may be null
+		 * \param pcm_r the right channel, may be null or \a pcm_l
+		 */
+		static void free_pcm( short* pcm_l, short* pcm_r );
+
 		/** return true if both data channels are null pointers */
 		bool is_empty() const;
 		/** __filepath accessor */
@@ -215,6 +267,12 @@ class Sample : public H2Core::Object
 		void set_frames( int value );
 		/** __frames accessor */
 		int get_frames() const;
+		/** __resident_frames accessor, the frames held by the data channels */
+		int get_resident_frames() const;
+		/** return true if only the first frames are held by the data channels */
+		bool is_streamed() const;
+		/** the local encoded filepath of a streamed sample, for the sampler to open it without allocating */
+		const char* get_stream_path() const;
 		/**
 		 * __sample_rate setter
 		 * \parama value the new value for __sample_rate
@@ -225,12 +283,26 @@ class Sample : public H2Core::Object
 		/** return sample duration in seconds */
 		double get_sample_duration( ) const;
 
-		/** return data size */
+		/** return the size of the data held */
 		int get_size() const;
+		/** __channels accessor */
+		int get_channels() const;
+		/** return true if both data channels share the same frames */
+		bool is_mono() const;
 		/** __data_l accessor */
 		float* get_data_l() const;
-		/** __data_r accessor */
+		/** __data_r accessor, the same as __data_l for a mono sample */
 		float* get_data_r() const;
+		/** return true if the frames are held by the 16 bit channels, the float channels are null then */
+		bool is_compact() const;
+		/** __pcm_l accessor */
+		short* get_pcm_l() const;
+		/** __pcm_r accessor, the same as __pcm_l for a mono sample */
+		short* get_pcm_r() const;
+		/** return the value of the left channel at \a frame, whatever the storage */
+		float get_value_l( int frame ) const;
+		/** return the value of the right channel at \a frame, whatever the storage */
+		float get_value_r( int frame ) const;
 		/**
 		 * __is_modified setter
 		 * \parama value the new value for __is_modified
@@ -257,9 +329,15 @@ class Sample : public H2Core::Object
 	private:
 		QString __filepath;                     ///< filepath of the sample
 		int __frames;                           ///< number of frames in this sample
+		int __resident_frames;                  ///< number of frames in the data channels, less than __frames if streamed
+		QByteArray __stream_path;               ///< local encoded __filepath, empty unless streamed
 		int __sample_rate;                      ///< samplerate for this sample
 		float* __data_l;                        ///< left channel data
-		float* __data_r;                        ///< right channel data
+		float* __data_r;                        ///< right channel data, __data_l if mono
+		int __channels;                         ///< 1 if the sample is mono, 2 otherwise
+		short* __pcm_l;                         ///< left channel 16 bit data of a compact sample
+		short* __pcm_r;                         ///< right channel 16 bit data of a compact sample, __pcm_l if mono
+		SampleBuffer* __buffer;                 ///< SamplePool frames held by the data channels, read-only, 0 if owned
 		bool __is_modified;                     ///< true if sample is modified
 		PanEnvelope __pan_envelope;             ///< pan envelope vector
 		VelocityEnvelope __velocity_envelope;   ///< velocity envelope vector
@@ -267,19 +345,55 @@ class Sample : public H2Core::Object
 		Rubberband __rubberband;                ///< set of rubberband parameters
 		/** loop modes string */
 		static const char* __loop_modes[];
+		/** rate of the audio driver, 0 if unknown */
+		static int __playback_rate;
+		/** free the data channels, or release them to the SamplePool */
+		void __free_data();
+		/**
+		 * decode the sample file into owned data channels, return false if it can't be read
+		 * \param streamed only keep the first frames
+		 * \param compact keep the frames of a 16 bit file in 16 bit channels
+		 */
+		bool __decode( bool streamed, bool compact );
+		/** use the frames of a pooled buffer, already referenced */
+		void __attach( SampleBuffer* buffer );
+		/** hand the owned data channels over to the SamplePool under the key of \a buffer */
+		void __share( SampleBuffer* buffer );
+		/** copy pooled data channels before modifying them, as floats */
+		void __detach();
+		/** give a mono sample its own right channel, before modifying the channels apart */
+		void __split_channels();
+		/** keep the owned float data channels as 16 bit channels */
+		void __compact();
+		/**
+		 * convert the frames to another sample rate with a windowed sinc filter
+		 * \param rate the new sample rate
+		 */
+		void __convert_rate( int rate );
 };
 
 // DEFINITIONS
 
 inline void Sample::unload()
 {
-	if( __data_l ) delete __data_l;
-	if( __data_r ) delete __data_r;
-	__frames = __sample_rate = 0;
+	__free_data();
+	__frames = __resident_frames = __sample_rate = 0;
 	__data_l = __data_r = 0;
+	__pcm_l = __pcm_r = 0;
+	__stream_path = QByteArray();
 	// __is_modified = false; leave this unchanged as pan, velocity, loop and rubberband are kept unchanged
 }
 
+inline void Sample::set_playback_rate( int rate )
+{
+	__playback_rate = rate;
+}
+
+inline int Sample::get_playback_rate()
+{
+	return __playback_rate;
+}
+
 inline bool Sample::is_empty() const
 {
 	return ( __data_l==__data_r==0 );
@@ -303,7 +417,7 @@ inline void Sample::set_filename( const QString& filename )
 
 inline void Sample::Sample::set_frames( int frames )
 {
-	__frames = frames;
+	__frames = __resident_frames = frames;
 }
 
 inline int Sample::get_frames() const
@@ -311,6 +425,21 @@ inline int Sample::get_frames() const
 	return __frames;
 }
 
+inline int Sample::get_resident_frames() const
+{
+	return __resident_frames;
+}
+
+inline bool Sample::is_streamed() const
+{
+	return __resident_frames < __frames;
+}
+
+inline const char* Sample::get_stream_path() const
+{
+	return __stream_path.constData();
+}
+
 inline int Sample::get_sample_rate() const
 {
 	return __sample_rate;
@@ -323,7 +452,17 @@ inline double Sample::get_sample_duration() const
 
 inline int Sample::get_size() const
 {
-	return __frames * sizeof( float ) * 2;
+	return __resident_frames * ( __pcm_l ? sizeof( short ) : sizeof( float ) ) * __channels;
+}
+
+inline int Sample::get_channels() const
+{
+	return __channels;
+}
+
+inline bool Sample::is_mono() const
+{
+	return __channels == 1;
 }
 
 inline float* Sample::get_data_l() const
@@ -336,6 +475,31 @@ inline float* Sample::get_data_r() const
 	return __data_r;
 }
 
+inline bool Sample::is_compact() const
+{
+	return __pcm_l != 0;
+}
+
+inline short* Sample::get_pcm_l() const
+{
+	return __pcm_l;
+}
+
+inline short* Sample::get_pcm_r() const
+{
+	return __pcm_r;
+}
+
+inline float Sample::get_value_l( int frame ) const
+{
+	return ( __pcm_l ? __pcm_l[ frame ] * SAMPLE_PCM_SCALE : __data_l[ frame ] );
+}
+
+inline float Sample::get_value_r( int frame ) const
+{
+	return ( __pcm_r ? __pcm_r[ frame ] * SAMPLE_PCM_SCALE : __data_r[ frame ] );
+}
+
 inline void Sample::set_is_modified( bool is_modified )
 {
 	__is_modified = is_modified;
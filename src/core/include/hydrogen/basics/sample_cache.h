@@ -0,0 +1,122 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef H2C_SAMPLE_CACHE_H
+#define H2C_SAMPLE_CACHE_H
+
+#include <hydrogen/object.h>
+
+#include <QtCore/QMutex>
+
+namespace H2Core
+{
+
+/**
+ * SampleCache keeps the decoded and deinterleaved frames of the drumkit
+ * samples on disk, in Filesystem::sample_cache_dir(), so that loading a
+ * drumkit again maps them instead of decoding the sample files.
+ *
+ * A cache file is found from the sample file path, the rate the frames
+ * were converted to and whether they were wanted compact, and is only used
+ * while the size and the modification time of the sample file are unchanged.
+ * Compact frames of a 16 bit file are stored as 16 bit integers.
+ * The least recently used files are removed once the cache grows past
+ * Preferences::m_nSampleCacheSize megabytes.
+ *
+ * The audio thread reads the mapped frames, so they are read in and
+ * locked in memory while the sample loads. If they can't be locked they
+ * are copied to the heap instead.
+ */
+class SampleCache : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * map the decoded frames of a sample file read-only
+		 * \param filepath the sample file
+		 * \param rate the sample rate the frames were converted to, 0 for the rate of the sample file
+		 * \param compact the frames of a 16 bit file are wanted as 16 bit integers
+		 * \param frames set to the number of frames
+		 * \param sample_rate set to the sample rate
+		 * \param channels set to 1 for a mono sample, 2 otherwise
+		 * \param data_l set to the left channel, surrounded by SAMPLE_GUARD_FRAMES zeroed frames
+		 * \param data_r set to the right channel, surrounded by SAMPLE_GUARD_FRAMES zeroed frames, data_l if mono
+		 * \param pcm_l set to the left channel of 16 bit frames instead of data_l, 0 otherwise
+		 * \param pcm_r set to the right channel of 16 bit frames instead of data_r, 0 otherwise
+		 * \param mapping set to the mapped memory, to be given to unmap(), 0 if the frames were copied to
+		 * channels allocated with Sample::alloc_data() or Sample::alloc_pcm()
+		 * \param mapping_size set to the size of the mapped memory
+		 * \return false if the file is not cached that way or changed since
+		 */
+		static bool map( const QString& filepath, int rate, bool compact, int* frames, int* sample_rate, int* channels, float** data_l, float** data_r, short** pcm_l, short** pcm_r, void** mapping, size_t* mapping_size );
+		/**
+		 * unmap the frames mapped by map()
+		 * \param mapping the mapped memory
+		 * \param mapping_size the size of the mapped memory
+		 */
+		static void unmap( void* mapping, size_t mapping_size );
+		/**
+		 * store the decoded frames of a sample file, then remove the least recently used files past the size cap
+		 * \param filepath the sample file
+		 * \param rate the sample rate the frames were converted to, 0 for the rate of the sample file
+		 * \param compact the frames were wanted as 16 bit integers
+		 * \param frames the number of frames
+		 * \param sample_rate the sample rate
+		 * \param source_rate the sample rate of the sample file, the frames were converted from it if it differs
+		 * \param channels 1 for a mono sample, only data_l is stored then, 2 otherwise
+		 * \param data_l the left channel, 0 for 16 bit frames
+		 * \param data_r the right channel, 0 for 16 bit frames
+		 * \param pcm_l the left channel of 16 bit frames, 0 for float frames
+		 * \param pcm_r the right channel of 16 bit frames, 0 for float frames
+		 */
+		static void store( const QString& filepath, int rate, bool compact, int frames, int sample_rate, int source_rate, int channels, const float* data_l, const float* data_r, const short* pcm_l, const short* pcm_r );
+
+	private:
+		/** header of a cache file, followed by the left then the right channel unless mono, each one surrounded by zeroed frames */
+		struct Header {
+			char magic[4];                  ///< "H2SC"
+			int version;                    ///< format version
+			int frames;                     ///< number of frames per channel
+			int sample_rate;                ///< sample rate
+			long long source_size;          ///< size of the sample file
+			long long source_time;          ///< modification time of the sample file
+			int channels;                   ///< number of channels stored
+			int source_rate;                ///< sample rate of the sample file
+			int frame_size;                 ///< size in bytes of a frame of a channel, sizeof( float ) or sizeof( short )
+			char reserved[20];              ///< keeps the frames 64 bytes aligned
+		};
+
+		static QMutex __mutex;                  ///< serializes the writers
+		/** return the cache file of a sample file converted to \a rate, compact or not */
+		static QString __cache_file( const QString& filepath, int rate, bool compact );
+		/** return the size in bytes of the cache file of a sample with \a frames frames of \a frame_size bytes and \a channels channels */
+		static size_t __file_size( int frames, int channels, int frame_size );
+		/** remove the least recently used files until the cache is at most \a max_size bytes, __mutex is locked */
+		static void __evict( long long max_size );
+};
+
+};
+
+#endif // H2C_SAMPLE_CACHE_H
+
+/* vim: set softtabstop=4 expandtab: */
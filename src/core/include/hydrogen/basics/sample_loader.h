@@ -0,0 +1,137 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_SAMPLE_LOADER_H
+#define H2C_SAMPLE_LOADER_H
+
+#include <vector>
+
+#include <hydrogen/object.h>
+#include <hydrogen/basics/sample.h>
+
+#include <QtCore/QAtomicInt>
+
+/** upper bound of Preferences::m_nLoaderThreads */
+#define SAMPLE_LOADER_MAX_THREADS   64
+
+namespace H2Core
+{
+
+/**
+ * SampleLoader decodes a batch of samples on several threads.
+ *
+ * The samples are queued with add(), each call returning the index of its
+ * job, run() decodes them on up to Preferences::m_nLoaderThreads threads and
+ * returns once every job is done, then take() hands the samples over in
+ * whatever order the caller queued them.
+ * Samples stretched with rubberband are decoded by the thread calling run(),
+ * rubberband depends on the song tempo and runs an external process.
+ */
+class SampleLoader : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/** constructor */
+		SampleLoader();
+		/** destructor, deletes the samples which have not been taken */
+		~SampleLoader();
+
+		/**
+		 * queue the loading of a sample file, see Sample::load( const QString&, bool )
+		 * \param filepath the file to load audio data from
+		 * \param for_playback the sample belongs to a drumkit
+		 * \return the job index
+		 */
+		int add( const QString& filepath, bool for_playback=false );
+		/**
+		 * queue the loading of a transformed sample file, see Sample::load( const QString&, const Loops&, ... )
+		 * \param filepath the file to load audio data from
+		 * \param loops transformation parameters
+		 * \param rubber band transformation parameters
+		 * \param velocity envelope points
+		 * \param pan envelope points
+		 * \return the job index
+		 */
+		int add( const QString& filepath, const Sample::Loops& loops, const Sample::Rubberband& rubber, const Sample::VelocityEnvelope& velocity, const Sample::PanEnvelope& pan );
+		/**
+		 * queue the loading of the data of an existing sample, see Sample::load( bool ), the sample is not owned by the loader
+		 * \param sample the sample to load
+		 * \param for_playback the sample belongs to a drumkit
+		 * \return the job index
+		 */
+		int add( Sample* sample, bool for_playback=false );
+
+		/** decode the queued samples, return once they are all done */
+		void run();
+
+		/** return the number of jobs */
+		int size() const;
+		/** return the file a job loads */
+		const QString& get_filepath( int job ) const;
+		/**
+		 * hand the sample of a job over to the caller
+		 * \param job the job index
+		 * \return the sample, or 0 if it could not be loaded
+		 */
+		Sample* take( int job );
+
+	private:
+		/** a sample to load */
+		struct Job {
+			QString filepath;                       ///< file to load
+			bool for_playback;                      ///< the sample belongs to a drumkit
+			bool transformed;                       ///< the transformations have to be applied
+			Sample::Loops loops;                    ///< loop transformation
+			Sample::Rubberband rubberband;          ///< rubberband transformation
+			Sample::VelocityEnvelope velocity;      ///< velocity envelope
+			Sample::PanEnvelope pan;                ///< pan envelope
+			Sample* sample;                         ///< the loaded sample, or the sample to load for an in place job
+			bool in_place;                          ///< load an existing sample, not owned by the loader
+		};
+		std::vector<Job> __jobs;                    ///< queued jobs
+		QAtomicInt __next_job;                      ///< next job to claim while running
+
+		/** load the jobs until none is left */
+		void __work();
+		/** load a job */
+		void __load( Job& job );
+		/** thread entry point, calls __work() */
+		static void* __worker_thread( void* param );
+};
+
+// DEFINITIONS
+
+inline int SampleLoader::size() const
+{
+	return __jobs.size();
+}
+
+inline const QString& SampleLoader::get_filepath( int job ) const
+{
+	return __jobs[job].filepath;
+}
+
+};
+
+#endif // H2C_SAMPLE_LOADER_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,144 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_SAMPLE_POOL_H
+#define H2C_SAMPLE_POOL_H
+
+#include <vector>
+
+#include <hydrogen/object.h>
+#include <hydrogen/basics/sample.h>
+
+#include <QtCore/QMutex>
+
+namespace H2Core
+{
+
+/**
+ * The frames of a sample file once loaded and transformed, shared by
+ * every Sample loaded from the same file with the same transformations.
+ * Shared frames are read-only, a Sample copies them before modifying them.
+ */
+class SampleBuffer
+{
+	public:
+		// key
+		QString filepath;                       ///< the sample file
+		bool streamed;                          ///< only the first frames are held, see Sample::is_streamed()
+		bool compact;                           ///< the frames of a 16 bit file are held as 16 bit integers, see Sample::is_compact()
+		int rate;                               ///< the sample rate the frames were converted to, 0 for the rate of the file
+		Sample::Loops loops;                    ///< loop transformation applied to the frames
+		Sample::VelocityEnvelope velocity;      ///< velocity envelope applied to the frames
+		Sample::PanEnvelope pan;                ///< pan envelope applied to the frames
+		long long source_size;                  ///< size of the sample file when loaded
+		long long source_time;                  ///< modification time of the sample file when loaded
+		// frames
+		int frames;                             ///< number of frames of the sample
+		int resident_frames;                    ///< number of frames held by the data channels
+		int sample_rate;                        ///< sample rate
+		int channels;                           ///< 1 if data_r is data_l, 2 otherwise
+		float* data_l;                          ///< left channel, allocated with Sample::alloc_data() unless mapped
+		float* data_r;                          ///< right channel, allocated with Sample::alloc_data() unless mapped
+		short* pcm_l;                           ///< left channel of compact frames, allocated with Sample::alloc_pcm()
+		short* pcm_r;                           ///< right channel of compact frames, allocated with Sample::alloc_pcm()
+		void* mapping;                          ///< SampleCache memory holding the data channels, 0 if allocated
+		size_t mapping_size;                    ///< size of mapping
+		bool is_modified;                       ///< the transformations changed the frames
+		int refs;                               ///< number of samples using the frames, guarded by SamplePool
+
+		/**
+		 * constructor, the frames are filled by the caller
+		 * \param filepath the sample file
+		 * \param streamed only the first frames will be held
+		 * \param compact the frames of a 16 bit file will be held as 16 bit integers
+		 * \param rate the sample rate the frames will be converted to, 0 for the rate of the file
+		 * \param loops loop transformation of the frames
+		 * \param velocity velocity envelope of the frames
+		 * \param pan pan envelope of the frames
+		 */
+		SampleBuffer( const QString& filepath, bool streamed, bool compact, int rate, const Sample::Loops& loops, const Sample::VelocityEnvelope& velocity, const Sample::PanEnvelope& pan );
+		/** destructor, frees or unmaps the data channels */
+		~SampleBuffer();
+};
+
+/**
+ * SamplePool shares the frames of the samples loaded several times:
+ * by several instruments, by several drumkits or songs, by the preview
+ * or the sample editor, so that memory use grows with the distinct
+ * audio files and not with the number of instruments.
+ *
+ * The buffers are reference counted, the last Sample releasing one frees it.
+ * Samples used by the sampler are deleted once the audio thread retired
+ * them through the CommandQueue, the audio thread never releases a buffer.
+ * Samples stretched with rubberband depend on the song tempo and are not pooled.
+ */
+class SamplePool : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * find the frames of a sample file loaded with the given transformations
+		 * \param filepath the sample file
+		 * \param streamed only the first frames are wanted
+		 * \param compact the frames of a 16 bit file are wanted as 16 bit integers
+		 * \param rate the sample rate the frames are wanted at, 0 for the rate of the file
+		 * \param loops loop transformation
+		 * \param velocity velocity envelope
+		 * \param pan pan envelope
+		 * \return a buffer referenced once more, or 0 if none or if the file changed since
+		 */
+		static SampleBuffer* acquire( const QString& filepath, bool streamed, bool compact, int rate, const Sample::Loops& loops, const Sample::VelocityEnvelope& velocity, const Sample::PanEnvelope& pan );
+		/**
+		 * share freshly loaded frames
+		 * \param buffer the frames, referenced by the caller, the pool takes its ownership
+		 * \return \a buffer, or an equal buffer shared meanwhile in which case \a buffer is deleted
+		 */
+		static SampleBuffer* share( SampleBuffer* buffer );
+		/**
+		 * reference a buffer once more
+		 * \param buffer a buffer returned by acquire() or share()
+		 */
+		static void retain( SampleBuffer* buffer );
+		/**
+		 * drop a reference to a buffer, the last one frees it
+		 * \param buffer a buffer returned by acquire() or share()
+		 */
+		static void release( SampleBuffer* buffer );
+		/** return the number of pooled buffers */
+		static int get_buffer_count();
+		/** return the number of pooled buffers holding a single channel */
+		static int get_mono_buffer_count();
+		/** return the size in bytes of the pooled frames */
+		static long long get_size();
+
+	private:
+		static QMutex __mutex;                          ///< guards __buffers and the buffers refs
+		static std::vector<SampleBuffer*> __buffers;    ///< pooled buffers
+		/** return true if \a buffer holds the frames of the given file and transformations */
+		static bool __matches( const SampleBuffer* buffer, const QString& filepath, bool streamed, bool compact, int rate, const Sample::Loops& loops, const Sample::VelocityEnvelope& velocity, const Sample::PanEnvelope& pan );
+};
+
+};
+
+#endif // H2C_SAMPLE_POOL_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -30,6 +30,7 @@
 #include <map>
 
 #include <hydrogen/object.h>
+#include <hydrogen/globals.h>
 
 class TiXmlNode;
 
@@ -44,6 +45,7 @@ class InstrumentList;
 class Pattern;
 class Song;
 class PatternList;
+class Bus;
 
 /**
 \ingroup H2CORE
@@ -86,6 +88,10 @@ class Song : public H2Core::Object
 		  The function is real-time safe (it locks the audio data while deleting notes)
 		*/
 		void purge_instrument( Instrument* I );
+		/**
+		 * find the notes of every pattern referencing a replaced instrument, see Pattern::find_replacements()
+		 */
+		void find_replacements( const std::map<Instrument*, Instrument*>& replacements, std::vector<Note*>& notes, std::vector<Instrument*>& instruments ) const;
 
 		void set_volume( float volume ) {
 			__volume = volume;
@@ -125,6 +131,23 @@ class Song : public H2Core::Object
 			__instrument_list = list;
 		}
 
+		/** get the number of buses of the song */
+		int get_bus_count() {
+			return __bus_count;
+		}
+		/** get a bus of the song, NULL if the index is out of range */
+		Bus* get_bus( int idx ) {
+			return ( idx>=0 && idx<__bus_count ? __buses[idx] : NULL );
+		}
+		/**
+		 * append a bus to the song, the song owns it.
+		 * Buses are never removed while the song exists, so the sampler can
+		 * resolve the bus of an instrument without locking.
+		 * 
+eturn the index of the bus, -1 if MAX_BUSES is reached
+		 */
+		int add_bus( Bus* bus );
+
 
 		void set_notes( const QString& notes ) {
 			__notes = notes;
@@ -194,6 +217,8 @@ class Song : public H2Core::Object
 		PatternList* __pattern_list;				///< Pattern list
 		std::vector<PatternList*>* __pattern_group_sequence;	///< Sequence of pattern groups
 		InstrumentList* __instrument_list;			///< Instrument list
+		Bus* __buses[MAX_BUSES];				///< group buses instruments are routed into
+		int __bus_count;					///< number of buses in __buses
 		QString __filename;
 		bool __is_loop_enabled;
 		float __humanize_time_value;
@@ -0,0 +1,179 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <hydrogen/object.h>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+
+#define MAX_COMMANDS 1024
+
+namespace H2Core
+{
+
+class Note;
+class Sample;
+class Instrument;
+class InstrumentLayer;
+
+enum CommandType {
+	COMMAND_NONE,
+	COMMAND_NOTE_ON,			///< start Command::note (ownership passes to the sampler)
+	COMMAND_NOTE_OFF,			///< release the voices of Command::note's instrument
+	COMMAND_MIDI_KEYBOARD_NOTE_OFF,		///< release the voices started by midi key Command::value
+	COMMAND_STOP_PLAYING_NOTES,		///< stop the voices of Command::instrument (all voices if NULL)
+	COMMAND_PREVIEW_SAMPLE,			///< play Command::sample through the preview instrument
+	COMMAND_PREVIEW_INSTRUMENT,		///< replace the preview instrument with Command::instrument and play it
+	COMMAND_SET_LAYER,			///< put Command::layer in slot Command::value of Command::instrument
+	COMMAND_RETIRE_INSTRUMENT,		///< retire Command::instrument, taken out of the song, once none of its notes is queued or playing
+	COMMAND_REALTIME_NOTE			///< play a note recorded by Hydrogen::addRealtimeNote() with instrument Command::value of the song
+};
+
+/**
+ * A request posted to the audio thread.
+ * Only the fields needed by #type are meaningful.
+ */
+class Command
+{
+public:
+	CommandType type;
+	Note* note;
+	Sample* sample;
+	Instrument* instrument;
+	InstrumentLayer* layer;
+	int value;
+	int key;		///< midi key of a realtime note, -1 if none
+	unsigned position;	///< tick of a realtime note
+	float velocity;		///< velocity of a realtime note
+	float pan_l;		///< left pan of a realtime note
+	float pan_r;		///< right pan of a realtime note
+
+	Command()
+		: type( COMMAND_NONE )
+		, note( NULL )
+		, sample( NULL )
+		, instrument( NULL )
+		, layer( NULL )
+		, value( 0 )
+		, key( 0 )
+		, position( 0 )
+		, velocity( 0.0 )
+		, pan_l( 0.0 )
+		, pan_r( 0.0 ) { }
+};
+
+///
+/// Command queue: is the way the GUI and MIDI threads talk to the engine.
+///
+/// Any number of threads may push commands, only the audio thread pops them,
+/// and popping never takes a lock. Objects the audio thread takes out of use
+/// (replaced layers, samples, instruments and notes) are handed back through
+/// a second ring and deleted by the next producer, so the audio thread never
+/// frees memory itself. While the ring is full they wait in a list only the
+/// audio thread uses and are moved to the ring on later cycles.
+///
+class CommandQueue : public H2Core::Object
+{
+	H2_OBJECT
+public:
+	enum RetiredType {
+		RETIRED_NOTE,
+		RETIRED_SAMPLE,
+		RETIRED_LAYER,
+		RETIRED_INSTRUMENT
+	};
+
+	/// Trouble met by the audio thread, counted there and logged by report_incidents().
+	enum Incident {
+		INCIDENT_RETIRED_LEAKED,	///< retired object leaked, the ring and the list were full
+		INCIDENT_INSTRUMENT_LEAKED,	///< retired instrument leaked, too many of them playing
+		INCIDENT_UNEXPECTED_COMMAND,	///< command of an unknown type ignored
+		INCIDENT_NOTE_DROPPED,		///< note dropped for want of a voice slot
+		INCIDENT_LATE_JOB,		///< render threads late by more than a period
+		INCIDENT_COUNT
+	};
+
+	CommandQueue();
+	~CommandQueue();
+
+	/**
+	 * queue a command for the audio thread
+	 * \return false if the queue is full
+	 */
+	bool push_command( const Command& cmd );
+	/**
+	 * fetch the next command, audio thread only
+	 * \return false if there is none
+	 */
+	bool pop_command( Command& cmd );
+
+	/**
+	 * hand an object over for deletion outside of the audio thread, audio thread only
+	 * \param type what kind of object \a ptr is
+	 * \param ptr the object, may be NULL
+	 */
+	void retire( RetiredType type, void* ptr );
+	/** move the objects retired while the ring was full to the ring, audio thread only */
+	void flush_retired();
+	/** return the number of objects waiting for room in the ring */
+	int get_deferred_count() const { return __deferred_count; }
+	/** delete every retired object, never called by the audio thread */
+	void collect_garbage();
+
+	/** count an incident, lock free so that the audio thread can call it */
+	void count_incident( Incident incident ) {
+		__incidents[ incident ].fetchAndAddOrdered( 1 );
+	}
+	/** log the incidents counted since the last call, never called by the audio thread */
+	void report_incidents();
+
+private:
+	struct Retired {
+		RetiredType type;
+		void* ptr;
+	};
+
+	/// Serializes the producers and the garbage collector, never taken by the audio thread.
+	QMutex __producer_mutex;
+
+	QAtomicInt __read_index;	///< next command to pop, written by the audio thread
+	QAtomicInt __write_index;	///< next free command slot, written by the producers
+	Command __commands[ MAX_COMMANDS ];
+
+	QAtomicInt __retired_read_index;	///< next object to delete, written by the collector
+	QAtomicInt __retired_write_index;	///< next free slot, written by the audio thread
+	Retired __retired[ MAX_COMMANDS ];
+
+	Retired __deferred[ MAX_COMMANDS ];	///< retired while the ring was full, audio thread only
+	int __deferred_count;
+
+	QAtomicInt __incidents[ INCIDENT_COUNT ];	///< counted since the last report
+
+	void __delete_retired( const Retired& r );
+};
+
+};
+
+#endif
@@ -27,6 +27,8 @@
 #include <hydrogen/basics/note.h>
 #include <cassert>
 
+#include <QtCore/QAtomicInt>
+
 #define MAX_EVENTS 1024
 
 namespace H2Core
@@ -88,7 +90,17 @@ public:
 				bool b_isInstrumentMode;
 				bool b_noteExist;
 		};
-		std::vector<AddMidiNoteVector> m_addMidiNoteVector;
+		/**
+		 * queue a recorded note for the undo stack of the GUI, dropped if the queue is full
+		 * the callers (the audio thread and the recording threads) hold the engine lock, so
+		 * there is a single producer at a time, and it never allocates
+		 */
+		void push_add_midi_note( const AddMidiNoteVector& noteAction );
+		/**
+		 * fetch the next recorded note, GUI thread only, reports the dropped notes
+		 * \return false if there is none
+		 */
+		bool pop_add_midi_note( AddMidiNoteVector& noteAction );
 
 private:
 	EventQueue();
@@ -97,6 +109,11 @@ private:
 	int __read_index;
 	int __write_index;
 	Event __events_buffer[ MAX_EVENTS ];
+
+	QAtomicInt __add_midi_note_read_index;	///< next recorded note to pop, written by the GUI thread
+	QAtomicInt __add_midi_note_write_index;	///< next free slot, written by the recording thread
+	AddMidiNoteVector __add_midi_notes[ MAX_EVENTS ];
+	QAtomicInt __add_midi_notes_dropped;	///< recorded notes dropped since the last report
 };
 
 };
@@ -30,6 +30,10 @@
 
 #define MAX_FX		        4
 
+#define MAX_BUSES               16
+
+#define MAX_MUTE_GROUPS         MAX_INSTRUMENTS
+
 #define MAX_BUFFER_SIZE         8192
 
 #define MIDI_OUT_NOTE_MIN       0
@@ -79,6 +79,8 @@ class Filesystem : public H2Core::Object
 		static QString demos_dir();
 		/** returns system xsd path */
 		static QString xsd_dir();
+		/** returns user decoded samples cache path */
+		static QString sample_cache_dir();
 		/** returns temp path */
 		static QString tmp_dir();
 		/**
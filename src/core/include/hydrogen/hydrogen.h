@@ -83,16 +83,10 @@ public:
 	Song* getSong();
 	void removeSong();
 
+	/// Record a note now, the audio thread plays it at its next cycle.
 	void addRealtimeNote ( int instrument, float velocity, float pan_L=1.0, float pan_R=1.0, float pitch=0.0, bool noteoff=false, bool forcePlay=false, int msg1=0 );
-
-	float getMasterPeak_L();
-	void setMasterPeak_L( float value );
-
-	float getMasterPeak_R();
-	void setMasterPeak_R( float value );
-
-	void getLadspaFXPeak( int nFX, float *fL, float *fR );
-	void setLadspaFXPeak( int nFX, float fL, float fR );
+	/// Play a note recorded by addRealtimeNote(), called with the engine locked by the audio thread. \a msg1 is -1 without midi info.
+	void playRealtimeNote( int instrument, unsigned position, float velocity, float pan_L, float pan_R, int msg1 );
 
 
 	unsigned long getTickPosition();
@@ -115,7 +109,8 @@ public:
 
 		void restartDrivers();
 
-	void startExportSong( const QString& filename, int rate, int depth  );
+	/// \param stems also write each track output to its own file, see DiskWriterDriver
+	void startExportSong( const QString& filename, int rate, int depth, bool stems = false );
 		void stopExportSong( bool reconnectOldDriver );
 
 	AudioOutput* getAudioOutput();
@@ -170,9 +165,8 @@ public:
 
 	int getSelectedInstrumentNumber();
 	void setSelectedInstrumentNumber( int nInstrument );
-#ifdef H2CORE_HAVE_JACK
+	/// Create or rename the track outputs of the audio driver after the instruments changed.
 	void renameJackPorts();
-#endif
 
 	///playlist vector
 	struct HPlayListNode
@@ -0,0 +1,156 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef METERS_H
+#define METERS_H
+
+#include <hydrogen/object.h>
+#include <hydrogen/globals.h>
+
+#include <QtCore/QAtomicInt>
+
+#define METER_TRUE_PEAK_TAPS	12	///< length of the interpolation filter of the true peak meter, a multiple of 4
+#define METER_TRUE_PEAK_PHASES	3	///< points computed between two frames by the true peak meter
+
+namespace H2Core
+{
+
+/** level of a stereo signal over the frames metered since the previous reading */
+struct MeterLevel {
+	float peak_l;		///< greatest absolute value (left channel)
+	float peak_r;		///< greatest absolute value (right channel)
+	float rms_l;		///< root mean square (left channel)
+	float rms_r;		///< root mean square (right channel)
+};
+
+/** all the levels published at once by the audio thread */
+struct MeterLevels {
+	int instruments;			///< number of meaningful entries of #instrument
+	int buses;				///< number of meaningful entries of #bus
+	MeterLevel instrument[ MAX_INSTRUMENTS ];	///< instruments, by index in the song, before the bus
+	MeterLevel bus[ MAX_BUSES ];		///< song buses, after their fader
+	MeterLevel fx[ MAX_FX ];		///< LADSPA FX returns
+	MeterLevel master;			///< main output
+	float true_peak_l;			///< main output peak between the frames (left channel)
+	float true_peak_r;			///< main output peak between the frames (right channel)
+};
+
+///
+/// Meters: levels of the engine for the GUI.
+///
+/// The audio thread adds each cycle to running levels and publishes
+/// them through a triple buffer at the end of the cycle. The reader
+/// takes the newest levels without a lock and without touching any
+/// engine object; the running levels restart once it has taken them,
+/// so a peak is never lost between two readings.
+///
+/// There must be a single reader.
+///
+class Meters : public H2Core::Object
+{
+	H2_OBJECT
+public:
+	Meters();
+	~Meters();
+
+	/**
+	 * start metering a cycle, audio thread only
+	 * \param nFrames the number of frames of the cycle
+	 */
+	void begin_cycle( int nFrames );
+	/**
+	 * meter the output of an instrument, it may be called from any render
+	 * thread as long as an instrument is only metered by one of them
+	 * \param nInstrument the index of the instrument in the song
+	 */
+	void meter_instrument( int nInstrument, const float* pL, const float* pR, int nFrames );
+	/**
+	 * meter a bus, the gains are those applied when it is mixed down
+	 * \param nBus the index of the bus in the song
+	 */
+	void meter_bus( int nBus, const float* pL, const float* pR, float fGain_L, float fGain_R, int nFrames );
+	/** meter the return of a LADSPA FX */
+	void meter_fx( int nFX, const float* pL, const float* pR, int nFrames );
+	/** meter the main output, true peak included */
+	void meter_master( const float* pL, const float* pR, int nFrames );
+	/**
+	 * publish the levels of the cycles metered since the reader took the last ones, audio thread only
+	 * \param nInstruments the number of instruments of the song
+	 * \param nBuses the number of buses of the song
+	 */
+	void publish( int nInstruments, int nBuses );
+
+	/**
+	 * take the newest published levels, reader only
+	 * \return false if nothing was published since the previous call
+	 */
+	bool update_levels();
+	/** levels taken by the last update_levels(), reader only */
+	const MeterLevels& get_levels() const;
+
+private:
+	/// running level of a meter
+	struct Accumulator {
+		float peak_l;
+		float peak_r;
+		float sum_l;		///< sum of the squared frames (left channel)
+		float sum_r;		///< sum of the squared frames (right channel)
+	};
+
+	Accumulator __instruments[ MAX_INSTRUMENTS ];
+	Accumulator __buses[ MAX_BUSES ];
+	Accumulator __fx[ MAX_FX ];
+	Accumulator __master;
+	float __true_peak_l;
+	float __true_peak_r;
+	int __frames;			///< frames metered by the accumulators
+
+	/// frames of the previous cycles followed by the current one, for the true peak filter
+	float* __true_peak_history_L;
+	float* __true_peak_history_R;
+	float __true_peak_taps[ METER_TRUE_PEAK_PHASES ][ METER_TRUE_PEAK_TAPS ];
+
+	MeterLevels __levels[ 3 ];	///< triple buffer
+	int __back;			///< levels written by the audio thread
+	int __front;			///< levels read by the reader
+	QAtomicInt __middle;		///< last published levels, with __fresh_bit until the reader takes them
+
+	static const int __fresh_bit = 4;
+
+	void __clear();
+	void __accumulate( Accumulator& acc, const float* pL, const float* pR, float fGain_L, float fGain_R, int nFrames );
+	float __true_peak( const float* pIn, float* pHistory, int nFrames, float fPeak );
+	void __level( const Accumulator& acc, MeterLevel& level );
+};
+
+// DEFINITIONS
+
+inline const MeterLevels& Meters::get_levels() const
+{
+	return __levels[ __front ];
+}
+
+};
+
+#endif
+
+/* vim: set softtabstop=4 expandtab: */
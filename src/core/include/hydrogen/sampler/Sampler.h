@@ -28,8 +28,23 @@
 #include <hydrogen/globals.h>
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <vector>
 
+#include <QtCore/QAtomicInt>
+
+#ifdef Q_OS_MACX
+#include <mach/mach.h>
+#else
+#include <semaphore.h>
+#endif
+
+#define SAMPLER_MAX_RENDER_THREADS  16      ///< upper bound of Preferences::m_nRenderThreads
+#define SAMPLER_RENDER_SPINS        20000   ///< checks for a new job before a render thread goes to sleep
+#define SAMPLER_STEAL_FADE          256     ///< frames a stolen voice takes to fade out
+#define SAMPLER_MIDI_KEYS           128     ///< midi keys with a list of the notes they started
+#define SAMPLER_FILTER_VOICES       4       ///< filtered voices of an instrument rendered before the filter runs on all of them
+
 
 namespace H2Core
 {
@@ -39,6 +54,8 @@ class Song;
 class Sample;
 class Instrument;
 class AudioOutput;
+class Command;
+class SampleStreamer;
 
 ///
 /// Waveform based sampler.
@@ -55,30 +72,61 @@ public:
 
 	void process( uint32_t nFrames, Song* pSong );
 
+	/*
+	 * The following methods work on the playing notes directly and
+	 * are meant for the audio thread (or a thread holding the engine
+	 * lock). Other threads use the queue_* variants which post a
+	 * Command to the audio thread instead.
+	 */
+
 	/// Start playing a note
 	void note_on( Note *note );
 
-	/// Stop playing a note.
+	/// Stop playing a note. The caller keeps ownership of \a note.
 	void note_off( Note *note );
 	void midi_keyboard_note_off( int key );
 
 	void stop_playing_notes( Instrument *instr = NULL );
 
+	/// Thread safe note_on(), takes ownership of \a note.
+	void queue_note_on( Note *note );
+	/// Thread safe note_off(), takes ownership of \a note.
+	void queue_note_off( Note *note );
+	/// Thread safe midi_keyboard_note_off().
+	void queue_midi_keyboard_note_off( int key );
+	/// Thread safe stop_playing_notes().
+	void queue_stop_playing_notes( Instrument *instr = NULL );
+
+	/// Execute a command posted by one of the queue_* or preview_* methods.
+	void handle_command( const Command& cmd );
+
+	/**
+	 * Have a voice slot for \a nVoices playing notes, the slots are never
+	 * added by the audio thread. Only called while the audio driver is
+	 * stopped.
+	 */
+	void reserve_voices( int nVoices );
+
 	int get_playing_notes_number() {
 		return __playing_notes_queue.size();
 	}
 
+	/// Thread safe, takes ownership of \a sample.
 	void preview_sample( Sample* sample, int length );
+	/// Thread safe, takes ownership of \a instr.
 	void preview_instrument( Instrument* instr );
 
 	void setPlayingNotelength( Instrument* instrument, unsigned long ticks, unsigned long noteOnTick );
 	bool is_instrument_playing( Instrument* pInstr );
+	/// Return the index in the song of the instrument of a playing \a note, -1 if not in the song.
+	int get_voice_track( Note* note );
 
 		enum InterpolateMode { LINEAR,
 							   COSINE,
 							   THIRD,
 							   CUBIC,
-							   HERMITE };
+							   HERMITE,
+							   SINC };
 
 		void setInterpolateMode( InterpolateMode mode ){
 				 __interpolateMode = mode;
@@ -86,14 +134,216 @@ public:
 
 		InterpolateMode getInterpolateMode(){ return __interpolateMode; }
 
+	/// Reader of the streamed samples, NULL unless Preferences::m_bSampleStreaming is set.
+	SampleStreamer* get_streamer() {
+		return __streamer;
+	}
+
+	/// Voice chosen to fade out when too many notes play, see Preferences::m_nVoiceStealing.
+	enum VoiceStealing {
+		STEAL_OLDEST = 0,		///< the oldest playing note
+		STEAL_QUIETEST,			///< the note with the lowest envelope value times velocity
+		STEAL_SAME_INSTRUMENT,		///< the oldest note of the starting note instrument, the oldest otherwise
+		STEAL_RELEASED			///< the oldest released note, the oldest otherwise
+	};
+
 private:
 	std::vector<Note*> __playing_notes_queue;
 	std::vector<Note*> __queuedNoteOffs;
 
 	/// Instrument used for the preview feature.
 	Instrument* __preview_instrument;
-
-	unsigned __render_note( Note* pNote, unsigned nBufferSize, Song* pSong );
+	/// The preview instrument once all posted commands are executed, only used by the posting thread.
+	Instrument* __posted_preview_instrument;
+	/// Instruments taken out of the song, retired once their notes are done.
+	std::vector<Instrument*> __dying_instruments;
+
+	/// A voice rendered into a filter lane, scattered once filtered, see __filter_voices().
+	struct FilteredVoice {
+		Note* note;
+		int track;
+		int buffer_pos;
+		int frames;
+		int channels;
+		float cost_L;
+		float cost_R;
+		float cost_track_L;
+		float cost_track_R;
+	};
+
+	/// Buffers the voices are rendered into, one per rendering thread.
+	struct RenderTarget {
+		float *main_L;			///< main mix (left channel)
+		float *main_R;			///< main mix (right channel)
+		float *fx_L[ MAX_FX ];		///< FX sends (left channel)
+		float *fx_R[ MAX_FX ];		///< FX sends (right channel)
+		float *bus_L[ MAX_BUSES ];	///< song buses (left channel)
+		float *bus_R[ MAX_BUSES ];	///< song buses (right channel)
+		bool bus_used[ MAX_BUSES ];	///< bus buffers holding voices of the current job, the others are not cleared
+		float *envelope;		///< envelope of the voice being rendered
+		float *voice_L;			///< voice being rendered (left channel)
+		float *voice_R;			///< voice being rendered (right channel)
+		float *resampled_L;		///< resampled voice before the envelope (left channel)
+		float *resampled_R;		///< resampled voice before the envelope (right channel)
+		float *instrument_L;		///< voices of the instrument being rendered (left channel)
+		float *instrument_R;		///< voices of the instrument being rendered (right channel)
+		float *filter_L[ SAMPLER_FILTER_VOICES ];	///< voices waiting for the filter (left channel)
+		float *filter_R[ SAMPLER_FILTER_VOICES ];	///< voices waiting for the filter (right channel)
+		float *filter_pad;		///< silent lane completing the last group of lanes
+		FilteredVoice filtered[ SAMPLER_FILTER_VOICES ];	///< voices waiting for the filter
+		int filtered_count;		///< number of voices waiting for the filter
+		bool filter_voice;		///< the voice being rendered goes to the next filter lanes
+		std::vector< std::pair<int, unsigned> > voices;	///< (instrument index, playing note index) of the notes to render, sorted
+		std::vector<Note*> midi_notes;	///< starting notes, sent to the midi output once all voices are rendered
+	};
+
+	/// Render thread, rendering the voices assigned to its target.
+	struct Worker {
+		Sampler* sampler;
+		int index;			///< index of its target, 0 is the audio thread
+		pthread_t thread;
+		QAtomicInt sleeping;		///< 1 once the worker is going to wait on wake, cleared by whoever posts or cancels
+		int driver_generation;		///< Sampler::__driver_generation whose scheduling it follows
+#ifdef Q_OS_MACX
+		semaphore_t wake;		///< posted once per sleep, no lock involved
+#else
+		sem_t wake;			///< posted once per sleep, no lock involved
+#endif
+	};
+
+	std::vector<RenderTarget*> __targets;	///< one per rendering thread, the first one mixes into __main_out_*
+	std::vector<Worker*> __workers;		///< render threads besides the audio thread
+	std::vector<unsigned> __voice_results;	///< __render_note() result of each playing note
+	std::vector<int> __key_targets;		///< target of each track (instrument index) for the current job
+	std::vector<int> __target_loads;	///< number of playing notes assigned to each target
+	uint32_t __job_frames;			///< frames to render in the current job
+	Song* __job_song;			///< song of the current job
+	QAtomicInt __job;			///< increased to start a job
+	QAtomicInt __next_target;		///< next target of the current job nobody took yet
+	QAtomicInt __targets_done;		///< targets of the current job rendered
+	QAtomicInt __quit;			///< ask the workers to exit
+#ifdef Q_OS_MACX
+	semaphore_t __job_finished;		///< posted by the worker rendering the last target of a job
+#else
+	sem_t __job_finished;			///< posted by the worker rendering the last target of a job
+#endif
+	pthread_t __driver_thread;		///< thread of the last parallel job, written by it only
+	QAtomicInt __driver_generation;		///< increased when __driver_thread changes, 0 before the first job
+
+	RenderTarget* __create_target( bool own_outputs );
+	void __delete_target( RenderTarget* target, bool own_outputs );
+	/// Share the playing notes among the targets, return false if the first one gets them all.
+	bool __assign_voices( Song* pSong );
+	/// Render the playing notes assigned to \a nTarget, an instrument at a time.
+	void __render_voices( int nTarget );
+	/// Render the targets of the current job nobody took yet, return true if the last one rendered finished the job.
+	bool __render_targets();
+	/// Wait for a worker to finish the current job, counting it late after a period of \a nFrames.
+	void __wait_job( uint32_t nFrames, unsigned nSampleRate );
+	/// Give the calling worker the scheduling of the driver thread, one step lower, if it changed.
+	static void __follow_driver( Worker* worker );
+	/// Add the voices of an instrument to the main mix (or to bus \a nBus) and meter them.
+	void __mix_instrument( int nInstrument, int nBus, uint32_t nFrames, RenderTarget* target );
+	static void* __worker_thread( void* param );
+	/// Wake a worker if it sleeps, lock free so the audio thread can call it.
+	static void __wake_worker( Worker* worker );
+
+	/*
+	 * Resonant filter state of the playing notes, one entry per voice
+	 * slot (Note::get_voice()), kept apart from the notes so that the
+	 * filter works on local copies instead of the note members.
+	 * Sized by the constructor and reserve_voices(), never by the audio thread.
+	 */
+	std::vector<float> __filter_bp_L;	///< band pass buffers (left channel)
+	std::vector<float> __filter_bp_R;	///< band pass buffers (right channel)
+	std::vector<float> __filter_lp_L;	///< low pass buffers (left channel)
+	std::vector<float> __filter_lp_R;	///< low pass buffers (right channel)
+	std::vector<int> __free_voices;		///< free voice slots
+
+	/*
+	 * Heads of the lists of playing notes (see Note::VoiceList), so that
+	 * mute groups and note offs only touch the notes involved.
+	 * The instrument lists are held by the instruments.
+	 */
+	Note* __mute_group_voices[ MAX_MUTE_GROUPS ];	///< notes of each mute group
+	Note* __key_voices[ SAMPLER_MIDI_KEYS ];	///< notes started by each midi key
+
+	/// Give \a note a voice slot with a cleared filter state and link it in the voice lists, return false if none is free.
+	bool __alloc_voice( Note* note );
+	/// Give the voice slot of \a note back and unlink it from the voice lists.
+	void __free_voice( Note* note );
+	/// Retire the dying instruments none of whose notes is queued or playing any more.
+	void __retire_instruments();
+	/// Keep the voice rendered into the filter lanes of \a target for __filter_voices(), the arguments are those of __scatter_voice().
+	void __queue_filtered_voice( Note *pNote, int nTrack, int nBufferPos, int nFrames, int nChannels, float cost_L, float cost_R, float cost_track_L, float cost_track_R, RenderTarget* target );
+	/**
+	 * Apply the low pass resonant filters of the voices waiting in the
+	 * filter lanes of \a target, MIX_FILTER_LANES channels at once, then
+	 * scatter them.
+	 */
+	void __filter_voices( Song* pSong, RenderTarget* target );
+
+	/// Where a playing note goes in the song, see InstrumentList::get_generation().
+	struct VoiceRoute {
+		int generation;			///< routing generation it was resolved for, -1 to resolve it again
+		int instrument;			///< index of the instrument in the song, -1 if not in it
+		int bus;			///< index of the song bus of the instrument, -1 for the main mix
+		float fx_level[ MAX_FX ];	///< FX send levels of the instrument
+	};
+
+	std::vector<VoiceRoute> __voice_routes;	///< route of each voice slot
+	std::vector<float*> __track_out_L;	///< track outputs of the current cycle, NULL if none (left channel)
+	std::vector<float*> __track_out_R;	///< track outputs of the current cycle, NULL if none (right channel)
+
+	/// Resolve the route of \a note again unless it was resolved for \a nGeneration.
+	void __route_voice( Note* note, Song* pSong, int nGeneration );
+
+	int __stolen_voices;			///< playing notes fading out after being stolen
+
+	SampleStreamer* __streamer;		///< reads the frames of the streamed samples, one stream per voice slot
+
+	/// Return the number of notes of \a instrument playing and not stolen, all notes if NULL.
+	int __count_voices( Instrument* instrument );
+	/**
+	 * Return the note to steal, NULL if none.
+	 * \param instrument the instrument of the starting note, NULL if none
+	 * \param same_instrument_only only look at the notes of \a instrument
+	 */
+	Note* __find_victim( Instrument* instrument, bool same_instrument_only );
+	/// Fade \a note out quickly, it ends once silent.
+	void __steal_voice( Note* note );
+	/// Steal voices until \a instrument and the whole sampler have room for another note.
+	void __make_room( Instrument* instrument );
+
+	unsigned __render_note( Note* pNote, unsigned nBufferSize, Song* pSong, RenderTarget* target );
+
+	/// Add the buses used in this cycle to the main mix and to their FX sends.
+	void __mix_buses( Song* pSong, uint32_t nFrames );
+
+	/**
+	 * Add the voice rendered in \a pVoice_L and \a pVoice_R to the instrument
+	 * buffer of \a target, to track output \a nTrack and to the FX sends of
+	 * \a pNote, reading it once.
+	 * The FX sends of an instrument routed into a bus are applied by
+	 * __mix_buses().
+	 * A mono voice (\a nChannels 1) is only rendered in the left voice
+	 * buffer, which is panned into both channels of every destination.
+	 */
+	void __scatter_voice(
+		Note *pNote,
+		const float* pVoice_L,
+		const float* pVoice_R,
+		int nTrack,
+		int nBufferPos,
+		int nFrames,
+		int nChannels,
+		float cost_L,
+		float cost_R,
+		float cost_track_L,
+		float cost_track_R,
+		Song* pSong,
+		RenderTarget* target
+	);
 
 		InterpolateMode __interpolateMode;
 
@@ -197,6 +447,36 @@ private:
 				return( a0 * mu * mu2 + a1 * mu2 + a2 * mu + a3 );
 		};
 
+	/// Interpolate the sample value at \a p + \a mu, \a p[-1] to \a p[2] must be readable.
+	template<InterpolateMode mode>
+	static float __interpolate( const float* p, double mu );
+
+	/// Interpolate the 16 bit frames of a compact sample, widened to float and scaled by SAMPLE_PCM_SCALE.
+	template<InterpolateMode mode>
+	static float __interpolate( const short* p, double mu );
+
+	/// Resample \a nFrames frames from \a fSamplePos, return the next sample position.
+	/// With \a nChannels 1 only the left channel is read and written, \a pData_R and \a pOut_R are unused.
+	/// \a T is float, or short for the frames of a compact sample.
+	template<InterpolateMode mode, int nChannels, typename T>
+	static double __resample( const T* pData_L, const T* pData_R, int nSampleFrames, double fSamplePos, float fStep, float* pOut_L, float* pOut_R, int nFrames );
+
+	typedef double (*resample_fn)( const float*, const float*, int, double, float, float*, float*, int );
+	typedef double (*resample_pcm_fn)( const short*, const short*, int, double, float, float*, float*, int );
+
+	/// Return the __resample() kernel of \a mode for a sample of \a nChannels channels.
+	static resample_fn __get_resample( InterpolateMode mode, int nChannels );
+	/// Return the __resample() kernel of \a mode for a compact sample of \a nChannels channels.
+	static resample_pcm_fn __get_resample_pcm( InterpolateMode mode, int nChannels );
+
+	/**
+	 * Resample \a nFrames frames of streamed \a pSample into the resampled
+	 * buffers of \a target, from its resident frames then from the stream
+	 * of \a pNote. Frames not read from disk yet are silent.
+	 * \return the next sample position
+	 */
+	double __read_stream( Sample* pSample, Note* pNote, double fSamplePos, float fStep, resample_fn resample, int nFrames, RenderTarget* target );
+
 	int __render_note_no_resample(
 		Sample *pSample,
 		Note *pNote,
@@ -206,7 +486,8 @@ private:
 		float cost_R,
 		float cost_track_L,
 			float cost_track_R,
-		Song* pSong
+		Song* pSong,
+		RenderTarget* target
 	);
 
 	int __render_note_resample(
@@ -219,7 +500,8 @@ private:
 		float cost_track_L,
 		float cost_track_R,
 			float fLayerPitch,
-		Song* pSong
+		Song* pSong,
+		RenderTarget* target
 	);
 };
 
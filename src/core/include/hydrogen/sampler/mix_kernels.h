@@ -0,0 +1,136 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_MIX_KERNELS_H
+#define H2C_MIX_KERNELS_H
+
+/*
+ * Block kernels used by the sampler to render a voice.
+ * They use SSE or NEON when the compiler targets it, a plain loop otherwise.
+ * Each output value is computed with the same operations in the same order
+ * whatever the implementation, so the rendering does not depend on it.
+ * Buffers do not need any particular alignment.
+ */
+
+namespace H2Core
+{
+
+/**
+ * out[i] = in[i] * env[i]
+ * \param in the source frames
+ * \param env the envelope values
+ * \param out the destination, can't overlap in or env
+ * \param n the number of frames
+ */
+void mix_apply_envelope( const float* in, const float* env, float* out, int n );
+
+/**
+ * out[i] = ( in[i] * scale ) * env[i], the 16 bit frames are widened to
+ * float as they are loaded
+ * \param in the source frames
+ * \param scale the scale of the source frames
+ * \param env the envelope values
+ * \param out the destination, can't overlap env
+ * \param n the number of frames
+ */
+void mix_apply_envelope_s16( const short* in, float scale, const float* env, float* out, int n );
+
+/**
+ * out[i] += in[i] * gain
+ * \param in the source frames
+ * \param gain the gain applied to every frame
+ * \param out the destination, can't overlap in
+ * \param n the number of frames
+ */
+void mix_add( const float* in, float gain, float* out, int n );
+
+/** destination of mix_scatter() */
+struct MixSend {
+	float* out;		///< the destination, can't overlap the source
+	float gain;		///< the gain applied to every frame
+};
+
+/**
+ * sends[k].out[i] += in[i] * sends[k].gain for every send, reading the
+ * source once
+ * \param in the source frames
+ * \param sends the destinations, they can't overlap each other
+ * \param nSends the number of sends, at least 1
+ * \param n the number of frames
+ */
+void mix_scatter( const float* in, const MixSend* sends, int nSends, int n );
+
+/**
+ * add a block to a meter: the greatest |in[i]| and the sum of in[i] * in[i]
+ * \param in the source frames
+ * \param n the number of frames
+ * \param peak the peak so far, updated
+ * \param sum_squares the sum of squares so far, updated
+ */
+void mix_meter( const float* in, int n, float* peak, float* sum_squares );
+
+/**
+ * return the sum of a[i] * b[i]
+ * \param a the first vector
+ * \param b the second vector
+ * \param n the number of values, a multiple of 4
+ */
+float mix_dot( const float* a, const float* b, int n );
+
+/**
+ * return the sum of a[i] * b[i], the 16 bit values of a are widened to
+ * float as they are loaded
+ * \param a the first vector
+ * \param b the second vector
+ * \param n the number of values, a multiple of 4
+ */
+float mix_dot_s16( const short* a, const float* b, int n );
+
+#define MIX_FILTER_LANES 4	///< channels filtered at once by mix_filter_lanes()
+
+/** a channel filtered by mix_filter_lanes() */
+struct MixFilterLane {
+	float* buffer;		///< the frames, filtered in place
+	float cutoff;		///< cutoff of the filter
+	float resonance;	///< resonance of the filter
+	float bp;		///< band pass state, updated
+	float lp;		///< low pass state, updated
+};
+
+/**
+ * the resonant low pass filter of the sampler, on MIX_FILTER_LANES
+ * channels at once, each one with its own parameters and state:
+ * bp = resonance * bp + cutoff * ( buffer[i] - lp ), lp = lp + cutoff * bp,
+ * buffer[i] = lp
+ * \param lanes MIX_FILTER_LANES channels, their buffers can't overlap
+ * \param n the number of frames of every lane
+ */
+void mix_filter_lanes( MixFilterLane* lanes, int n );
+
+/** return the name of the kernels implementation compiled in */
+const char* mix_kernels_name();
+
+};
+
+#endif // H2C_MIX_KERNELS_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,169 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef H2C_SAMPLE_STREAMER_H
+#define H2C_SAMPLE_STREAMER_H
+
+#include <hydrogen/object.h>
+#include <hydrogen/basics/sample.h>
+
+#include <vector>
+#include <pthread.h>
+#include <sndfile.h>
+
+#include <QtCore/QAtomicInt>
+
+#define STREAM_RING_FRAMES      16384   ///< frames buffered per voice, a power of 2
+#define STREAM_MIRROR_FRAMES    1024    ///< first ring frames repeated after its end, so that reads don't wrap
+#define STREAM_CHUNK_FRAMES     4096    ///< frames read from disk at once
+#define STREAM_OVERLAP_FRAMES   ( 4 * SAMPLE_GUARD_FRAMES )     ///< resident frames streamed again, for the interpolation to cross over
+#define STREAM_PATH_MAX         4096    ///< longest streamed file path
+#define STREAM_IDLE_USLEEP      2000    ///< sleep of the I/O thread once no ring needs data
+
+namespace H2Core
+{
+
+/**
+ * SampleStreamer reads the frames of streamed samples (see Sample::is_streamed())
+ * past their resident frames into a ring buffer per voice slot.
+ *
+ * The audio and render threads post a request per voice with open() and close(),
+ * a background I/O thread opens the files and keeps the rings filled ahead of
+ * the reading position given to get_data(). Nothing is locked or allocated by
+ * the reading side, a voice reaching frames not read yet stays silent until
+ * they are there and the underrun is counted.
+ */
+class SampleStreamer : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/**
+		 * constructor, starts the I/O thread
+		 * \param streams the number of voice slots
+		 */
+		SampleStreamer( int streams );
+		/** destructor, stops the I/O thread */
+		~SampleStreamer();
+
+		/**
+		 * start streaming a sample for a voice, audio or render thread only
+		 * \param stream the voice slot
+		 * \param sample the streamed sample played by the voice
+		 */
+		void open( int stream, const Sample* sample );
+		/**
+		 * stop streaming for a voice, audio or render thread only
+		 * \param stream the voice slot
+		 */
+		void close( int stream );
+		/** return the sample last opened for a voice, NULL if none */
+		const Sample* get_sample( int stream ) const;
+		/**
+		 * get the ring frames from a position on, frames before it may be overwritten from now on
+		 * \param stream the voice slot
+		 * \param from the first frame needed, not before the first streamed frame
+		 * \param data_l set to frame \a from (left channel)
+		 * \param data_r set to frame \a from (right channel)
+		 * \return the number of contiguous frames read from \a from on, 0 if none yet
+		 */
+		int get_data( int stream, int from, const float** data_l, const float** data_r );
+		/** count a voice missing frames not read in time */
+		void report_underrun();
+
+		/** return the number of voices missing frames since startup */
+		int get_underruns() const;
+		/** return the lowest number of frames buffered ahead of a voice reading from disk, 0 if none does */
+		int get_prefetch_frames() const;
+		/** return the number of files read from */
+		int get_active_streams() const;
+
+	private:
+		struct Stream {
+			// the request, posted by the reading side
+			QAtomicInt request;             ///< odd while being posted, increased by 2 per request
+			const Sample* sample;           ///< sample last opened, only used by the reading side
+			char path[ STREAM_PATH_MAX ];   ///< file to read, empty to close it
+			int start;                      ///< first frame to stream
+			int frames;                     ///< number of frames of the sample
+			QAtomicInt read_pos;            ///< first frame the voice may still read
+			// the ring, filled by the I/O thread
+			QAtomicInt served;              ///< request the ring holds the frames of
+			QAtomicInt write_pos;           ///< frame after the last one in the ring
+			float* ring_l;                  ///< STREAM_RING_FRAMES + STREAM_MIRROR_FRAMES frames (left channel)
+			float* ring_r;                  ///< STREAM_RING_FRAMES + STREAM_MIRROR_FRAMES frames (right channel)
+			// I/O thread state
+			SNDFILE* file;                  ///< file being read, NULL once read up to the end
+			int channels;                   ///< channels of the file
+			int end;                        ///< number of frames to read
+		};
+
+		int __stream_count;
+		Stream* __streams;
+		QAtomicInt __quit;                      ///< ask the I/O thread to exit
+		pthread_t __thread_handle;
+		QAtomicInt __underruns;
+		QAtomicInt __prefetch_frames;
+		QAtomicInt __active_streams;
+		std::vector<float> __buffer;            ///< interleaved frames read from a file, I/O thread only
+
+		static void* __io_thread( void* param );
+		/** serve the requests and fill the rings until asked to quit */
+		void __run();
+		/** open the file of a new request or read a chunk into the ring, return false if there was nothing to do */
+		bool __service( Stream* stream );
+		/** write a frame at a ring position, and at its mirror */
+		static void __write_frame( Stream* stream, int pos, float l, float r );
+};
+
+// DEFINITIONS
+
+inline const Sample* SampleStreamer::get_sample( int stream ) const
+{
+	return ( stream < __stream_count ? __streams[ stream ].sample : 0 );
+}
+
+inline void SampleStreamer::report_underrun()
+{
+	__underruns.fetchAndAddRelaxed( 1 );
+}
+
+inline int SampleStreamer::get_underruns() const
+{
+	return ( int )__underruns;
+}
+
+inline int SampleStreamer::get_prefetch_frames() const
+{
+	return ( int )__prefetch_frames;
+}
+
+inline int SampleStreamer::get_active_streams() const
+{
+	return ( int )__active_streams;
+}
+
+};
+
+#endif // H2C_SAMPLE_STREAMER_H
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,99 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef H2C_SINC_TABLE_H
+#define H2C_SINC_TABLE_H
+
+#include <hydrogen/object.h>
+
+#include <cassert>
+
+#define SINC_TAPS       16      ///< filter length, must be a multiple of 4 and at most 2 * SAMPLE_GUARD_FRAMES
+#define SINC_PHASES     512     ///< number of fractional positions of each table
+#define SINC_CUTOFFS    8       ///< number of tables, each one for a range of resampling steps
+
+namespace H2Core
+{
+
+/**
+ * SincTable holds the polyphase coefficients of a Blackman windowed sinc
+ * used to resample with little aliasing.
+ *
+ * The frame at position <b>p + mu</b> is the inner product of
+ * <b>p[1-SINC_TAPS/2]</b> ... <b>p[SINC_TAPS/2]</b> with get_row( table, mu ).
+ * Each table lowers the cutoff for a range of resampling steps, so that
+ * playing a sample faster than its rate does not fold back above nyquist.
+ * Tables are normalized frequencies, they don't depend on the sample rates,
+ * those are part of the step.
+ */
+class SincTable : public H2Core::Object
+{
+		H2_OBJECT
+	public:
+		/** build the tables, done once at startup */
+		static void create_instance();
+		/** return the instance */
+		static SincTable* get_instance() { assert( __instance ); return __instance; }
+		/** destructor */
+		~SincTable();
+
+		/**
+		 * return the table to use for a resampling step
+		 * \param step input frames per output frame
+		 */
+		int get_table( float step ) const;
+		/**
+		 * return the SINC_TAPS coefficients of a fractional position
+		 * \param table a table returned by get_table()
+		 * \param mu the fractional position [0;1[
+		 */
+		const float* get_row( int table, double mu ) const;
+
+	private:
+		static SincTable* __instance;
+		float* __coefficients;      ///< SINC_CUTOFFS * ( SINC_PHASES + 1 ) rows of SINC_TAPS coefficients
+
+		/** constructor */
+		SincTable();
+};
+
+// DEFINITIONS
+
+inline int SincTable::get_table( float step ) const
+{
+	// table n is meant for steps up to 1 + n/2
+	if ( step <= 1.0 ) return 0;
+	int table = ( int )( ( step - 1.0 ) * 2.0 + 0.999 );
+	return ( table < SINC_CUTOFFS ? table : SINC_CUTOFFS - 1 );
+}
+
+inline const float* SincTable::get_row( int table, double mu ) const
+{
+	int phase = ( int )( mu * SINC_PHASES + 0.5 );
+	return __coefficients + ( table * ( SINC_PHASES + 1 ) + phase ) * SINC_TAPS;
+}
+
+};
+
+#endif // H2C_SINC_TABLE_H
+
+/* vim: set softtabstop=4 expandtab: */
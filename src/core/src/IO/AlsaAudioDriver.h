@@ -45,6 +45,7 @@ public:
 	float* m_pOut_L;
 	float* m_pOut_R;
 	int m_nXRuns;
+	int m_nChannels;		///< channels of the device, the track outputs follow the main out
 	QString m_sAlsaAudioDevice;
 	audioProcessCallback m_processCallback;
 
@@ -58,6 +59,7 @@ public:
 	virtual unsigned getSampleRate();
 	virtual float* getOut_L();
 	virtual float* getOut_R();
+	virtual void makeTrackOutputs( Song* song );
 
 	virtual void updateTransportInfo();
 	virtual void play();
@@ -51,7 +51,11 @@ class DiskWriterDriver : public AudioOutput
 		float* m_pOut_L;
 		float* m_pOut_R;
 
-		DiskWriterDriver( audioProcessCallback processCallback, unsigned nSamplerate, const QString& sFilename, int nSampleDepth );
+		/**
+		 * \param bStems also write each track output to its own file,
+		 * named after \a sFilename and the instrument
+		 */
+		DiskWriterDriver( audioProcessCallback processCallback, unsigned nSamplerate, const QString& sFilename, int nSampleDepth, bool bStems = false );
 		~DiskWriterDriver();
 
 		int init( unsigned nBufferSize );
@@ -61,6 +65,9 @@ class DiskWriterDriver : public AudioOutput
 
 		void write( float* buffer_L, float* buffer_R, unsigned int bufferSize );
 
+		/// File name of the stem of track \a nTrack, playing \a sInstrument.
+		QString getStemFilename( int nTrack, const QString& sInstrument );
+
 				void audioEngine_process_checkBPMChanged();
 
 		unsigned getBufferSize() {
@@ -38,7 +38,8 @@ class FakeDriver : public AudioOutput
 {
 	H2_OBJECT
 public:
-	FakeDriver( audioProcessCallback processCallback );
+	/// \param bTrackOuts render the track outputs too, in memory
+	FakeDriver( audioProcessCallback processCallback, bool bTrackOuts = false );
 	~FakeDriver();
 
 	int init( unsigned nBufferSize );
@@ -73,8 +73,9 @@ void* alsaAudioDriver_processCaller( void* param )
 	}
 
 	int nFrames = pDriver->m_nBufferSize;
+	int nChannels = pDriver->m_nChannels;
 // 	_INFOLOG( "nFrames: " + to_string( nFrames ) );
-	short pBuffer[ nFrames * 2 ];
+	short pBuffer[ nFrames * nChannels ];
 
 	float *pOut_L = pDriver->m_pOut_L;
 	float *pOut_R = pDriver->m_pOut_R;
@@ -84,8 +85,17 @@ void* alsaAudioDriver_processCaller( void* param )
 		pDriver->m_processCallback( nFrames, NULL );
 
 		for ( int i = 0; i < nFrames; ++i ) {
-			pBuffer[ i * 2 ] = ( short )( pOut_L[ i ] * 32768.0 );
-			pBuffer[ i * 2 + 1 ] = ( short )( pOut_R[ i ] * 32768.0 );
+			pBuffer[ i * nChannels ] = ( short )( pOut_L[ i ] * 32768.0 );
+			pBuffer[ i * nChannels + 1 ] = ( short )( pOut_R[ i ] * 32768.0 );
+		}
+		// a channel pair per track output, silent if there is no such track
+		for ( int nChannel = 2; nChannel + 1 < nChannels; nChannel += 2 ) {
+			float *pTrack_L = pDriver->getTrackOut_L( nChannel / 2 - 1 );
+			float *pTrack_R = pDriver->getTrackOut_R( nChannel / 2 - 1 );
+			for ( int i = 0; i < nFrames; ++i ) {
+				pBuffer[ i * nChannels + nChannel ] = ( pTrack_L ? ( short )( pTrack_L[ i ] * 32768.0 ) : 0 );
+				pBuffer[ i * nChannels + nChannel + 1 ] = ( pTrack_R ? ( short )( pTrack_R[ i ] * 32768.0 ) : 0 );
+			}
 		}
 
 		if ( ( err = snd_pcm_writei( pDriver->m_pPlayback_handle, pBuffer, nFrames ) ) < 0 ) {
@@ -122,6 +132,10 @@ AlsaAudioDriver::AlsaAudioDriver( audioProcessCallback processCallback )
 	INFOLOG( "INIT" );
 	m_nSampleRate = Preferences::get_instance()->m_nSampleRate;
 	m_sAlsaAudioDevice = Preferences::get_instance()->m_sAlsaAudioDevice;
+	// main out and track outputs come in pairs
+	m_nChannels = Preferences::get_instance()->m_nAlsaChannels & ~1;
+	if ( m_nChannels < 2 ) m_nChannels = 2;
+	__track_out_enabled = ( m_nChannels > 2 );
 }
 
 AlsaAudioDriver::~AlsaAudioDriver()
@@ -145,7 +159,7 @@ int AlsaAudioDriver::init( unsigned nBufferSize )
 int AlsaAudioDriver::connect()
 {
 	INFOLOG( "alsa device: " + m_sAlsaAudioDevice );
-	int nChannels = 2;
+	int nChannels = m_nChannels;
 	int period_size = m_nBufferSize / 2;
 
 	int err;
@@ -195,7 +209,14 @@ int AlsaAudioDriver::connect()
 
 	snd_pcm_hw_params_set_rate_near( m_pPlayback_handle, hw_params, &m_nSampleRate, 0 );
 
-	if ( ( err = snd_pcm_hw_params_set_channels( m_pPlayback_handle, hw_params, nChannels ) ) < 0 ) {
+	if ( ( err = snd_pcm_hw_params_set_channels( m_pPlayback_handle, hw_params, nChannels ) ) < 0 && nChannels > 2 ) {
+		// no room for the track outputs, fall back to the main out
+		WARNINGLOG( QString( "Can't open %1 channels, track outputs disabled: %2" ).arg( nChannels ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
+		m_nChannels = nChannels = 2;
+		__track_out_enabled = false;
+		err = snd_pcm_hw_params_set_channels( m_pPlayback_handle, hw_params, nChannels );
+	}
+	if ( err < 0 ) {
 		ERRORLOG( QString( "error in snd_pcm_hw_params_set_channels: %1" ).arg( QString::fromLocal8Bit(snd_strerror(err)) ) );
 		return 1;
 	}
@@ -243,6 +264,9 @@ int AlsaAudioDriver::connect()
 	memset( m_pOut_L, 0, m_nBufferSize * sizeof( float ) );
 	memset( m_pOut_R, 0, m_nBufferSize * sizeof( float ) );
 
+	// as many track outputs as the device has channels for
+	__alloc_track_buffers( m_nChannels / 2 - 1, m_nBufferSize );
+
 	m_bIsRunning = true;
 
 	// start the main thread
@@ -271,6 +295,8 @@ void AlsaAudioDriver::disconnect()
 
 	delete[] m_pOut_R;
 	m_pOut_R = NULL;
+
+	__free_track_buffers();
 }
 
 unsigned AlsaAudioDriver::getBufferSize()
@@ -293,6 +319,11 @@ float* AlsaAudioDriver::getOut_R()
 	return m_pOut_R;
 }
 
+void AlsaAudioDriver::makeTrackOutputs( Song* /*song*/ )
+{
+	// the track outputs are bound to the device channels, made by connect()
+}
+
 
 void AlsaAudioDriver::updateTransportInfo()
 {
@@ -0,0 +1,123 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/IO/AudioOutput.h>
+
+#include <cstring>
+
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/instrument_list.h>
+
+namespace H2Core
+{
+
+AudioOutput::AudioOutput( const char* class_name )
+		: Object( class_name )
+		, __track_out_enabled( false )
+		, __track_buffer_count( 0 )
+		, __track_buffer_frames( 0 )
+{
+	for ( int i = 0; i < MAX_INSTRUMENTS; ++i ) {
+		__track_buffers_L[ i ] = NULL;
+		__track_buffers_R[ i ] = NULL;
+	}
+}
+
+AudioOutput::~AudioOutput()
+{
+	__free_track_buffers();
+}
+
+int AudioOutput::getNumTracks()
+{
+	return __track_buffer_count;
+}
+
+float* AudioOutput::getTrackOut_L( unsigned nTrack )
+{
+	if ( nTrack >= ( unsigned )__track_buffer_count ) return NULL;
+	return __track_buffers_L[ nTrack ];
+}
+
+float* AudioOutput::getTrackOut_R( unsigned nTrack )
+{
+	if ( nTrack >= ( unsigned )__track_buffer_count ) return NULL;
+	return __track_buffers_R[ nTrack ];
+}
+
+void AudioOutput::makeTrackOutputs( Song* song )
+{
+	if ( !__track_out_enabled || song == NULL ) return;
+	__alloc_track_buffers( song->get_instrument_list()->size(), getBufferSize() );
+}
+
+void AudioOutput::clearTrackOuts( uint32_t nFrames )
+{
+	if ( !__track_out_enabled ) return;
+	int nTracks = getNumTracks();
+	for ( int nTrack = 0; nTrack < nTracks; ++nTrack ) {
+		float* pBuf = getTrackOut_L( nTrack );
+		if ( pBuf ) {
+			memset( pBuf, 0, nFrames * sizeof( float ) );
+		}
+		pBuf = getTrackOut_R( nTrack );
+		if ( pBuf ) {
+			memset( pBuf, 0, nFrames * sizeof( float ) );
+		}
+	}
+}
+
+void AudioOutput::__alloc_track_buffers( int nTracks, unsigned nFrames )
+{
+	if ( nFrames == 0 ) return;	// not connected yet
+	if ( nTracks > MAX_INSTRUMENTS ) nTracks = MAX_INSTRUMENTS;
+	if ( nFrames > __track_buffer_frames ) {
+		// the buffer size only changes when the driver is connected again
+		__free_track_buffers();
+		__track_buffer_frames = nFrames;
+	}
+	for ( int n = __track_buffer_count; n < nTracks; ++n ) {
+		__track_buffers_L[ n ] = new float[ __track_buffer_frames ];
+		__track_buffers_R[ n ] = new float[ __track_buffer_frames ];
+		memset( __track_buffers_L[ n ], 0, __track_buffer_frames * sizeof( float ) );
+		memset( __track_buffers_R[ n ], 0, __track_buffer_frames * sizeof( float ) );
+		// the buffers are there before the audio thread can see them
+		__track_buffer_count = n + 1;
+	}
+}
+
+void AudioOutput::__free_track_buffers()
+{
+	int nTracks = __track_buffer_count;
+	__track_buffer_count = 0;
+	for ( int n = 0; n < nTracks; ++n ) {
+		delete[] __track_buffers_L[ n ];
+		delete[] __track_buffers_R[ n ];
+		__track_buffers_L[ n ] = NULL;
+		__track_buffers_R[ n ] = NULL;
+	}
+	__track_buffer_frames = 0;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
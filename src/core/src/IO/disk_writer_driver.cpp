@@ -28,14 +28,30 @@
 #include <hydrogen/basics/pattern.h>
 #include <hydrogen/basics/pattern_list.h>
 
+#include <hydrogen/basics/song.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_list.h>
+
 #include <pthread.h>
 #include <cassert>
+#include <vector>
 
 namespace H2Core
 {
 
 pthread_t diskWriterDriverThread;
 
+/// Interleave \a nFrames frames of a stereo buffer, clipped to [-1,1].
+static void interleave_clipped( const float* pData_L, const float* pData_R, float* pData, unsigned nFrames )
+{
+	for ( unsigned i = 0; i < nFrames; i++ ) {
+		float fL = pData_L[i];
+		float fR = pData_R[i];
+		pData[i * 2] = ( fL > 1 ? 1 : ( fL < -1 ? -1 : fL ) );
+		pData[i * 2 + 1] = ( fR > 1 ? 1 : ( fR < -1 ? -1 : fR ) );
+	}
+}
+
 void* diskWriterDriver_thread( void* param )
 {
 
@@ -129,6 +145,21 @@ void* diskWriterDriver_thread( void* param )
 
 	SNDFILE* m_file = sf_open( pDriver->m_sFilename.toLocal8Bit(), SFM_WRITE, &soundInfo );
 
+	// a file per track output, written in the same pass
+	std::vector<SNDFILE*> stemFiles;
+	if ( pDriver->has_track_outs() ) {
+		InstrumentList* pInstrList = Hydrogen::get_instance()->getSong()->get_instrument_list();
+		int nTracks = pDriver->getNumTracks();
+		for ( int nTrack = 0; nTrack < nTracks && nTrack < pInstrList->size(); ++nTrack ) {
+			QString sStem = pDriver->getStemFilename( nTrack, pInstrList->get( nTrack )->get_name() );
+			SNDFILE* pStem = sf_open( sStem.toLocal8Bit(), SFM_WRITE, &soundInfo );
+			if ( pStem == NULL ) {
+				__ERRORLOG( QString( "Can't open %1" ).arg( sStem ) );
+			}
+			stemFiles.push_back( pStem );
+		}
+	}
+
 	float *pData = new float[ pDriver->m_nBufferSize * 2 ];	// always stereo
 
 	float *pData_L = pDriver->m_pOut_L;
@@ -204,31 +235,21 @@ void* diskWriterDriver_thread( void* param )
 						frameNumber += usedBuffer;
 						int ret = pDriver->m_processCallback( usedBuffer, NULL );
 
-						for ( unsigned i = 0; i < usedBuffer; i++ ) {
-								if(pData_L[i] > 1){
-										pData[i * 2] = 1;
-								}
-								else if(pData_L[i] < -1){
-										pData[i * 2] = -1;
-								}else
-								{
-										pData[i * 2] = pData_L[i];
-								}
-
-								if(pData_R[i] > 1){
-										pData[i * 2 + 1] = 1;
-								}
-								else if(pData_R[i] < -1){
-										pData[i * 2 + 1] = -1;
-								}else
-								{
-										pData[i * 2 + 1] = pData_R[i];
-								}
-						}
+						interleave_clipped( pData_L, pData_R, pData, usedBuffer );
 						int res = sf_writef_float( m_file, pData, usedBuffer );
 						if ( res != ( int )usedBuffer ) {
 								__ERRORLOG( "Error during sf_write_float" );
 						}
+
+						for ( unsigned nTrack = 0; nTrack < stemFiles.size(); ++nTrack ) {
+								float *pTrack_L = pDriver->getTrackOut_L( nTrack );
+								float *pTrack_R = pDriver->getTrackOut_R( nTrack );
+								if ( stemFiles[ nTrack ] == NULL || pTrack_L == NULL || pTrack_R == NULL ) continue;
+								interleave_clipped( pTrack_L, pTrack_R, pData, usedBuffer );
+								if ( sf_writef_float( stemFiles[ nTrack ], pData, usedBuffer ) != ( int )usedBuffer ) {
+										__ERRORLOG( "Error during sf_write_float" );
+								}
+						}
 				}
 
 				// this progress bar methode is not exact but ok enough to give users a usable visible progress feedback
@@ -240,6 +261,9 @@ void* diskWriterDriver_thread( void* param )
 	pData = NULL;
 
 	sf_close( m_file );
+	for ( unsigned nTrack = 0; nTrack < stemFiles.size(); ++nTrack ) {
+		if ( stemFiles[ nTrack ] ) sf_close( stemFiles[ nTrack ] );
+	}
 
 	__INFOLOG( "DiskWriterDriver thread end" );
 
@@ -252,7 +276,7 @@ void* diskWriterDriver_thread( void* param )
 
 const char* DiskWriterDriver::__class_name = "DiskWriterDriver";
 
-DiskWriterDriver::DiskWriterDriver( audioProcessCallback processCallback, unsigned nSamplerate, const QString& sFilename, int nSampleDepth )
+DiskWriterDriver::DiskWriterDriver( audioProcessCallback processCallback, unsigned nSamplerate, const QString& sFilename, int nSampleDepth, bool bStems )
 		: AudioOutput( __class_name )
 		, m_nSampleRate( nSamplerate )
 		, m_sFilename( sFilename )
@@ -260,6 +284,7 @@ DiskWriterDriver::DiskWriterDriver( audioProcessCallback processCallback, unsign
 		, m_processCallback( processCallback )
 {
 	INFOLOG( "INIT" );
+	__track_out_enabled = bStems;
 }
 
 
@@ -313,6 +338,24 @@ void DiskWriterDriver::disconnect()
 	delete[] m_pOut_R;
 	m_pOut_R = NULL;
 
+	__free_track_buffers();
+}
+
+
+
+QString DiskWriterDriver::getStemFilename( int nTrack, const QString& sInstrument )
+{
+	// song.wav -> song-01-Kick.wav
+	QString sBase = m_sFilename;
+	QString sExt;
+	int nDot = m_sFilename.lastIndexOf( "." );
+	if ( nDot > m_sFilename.lastIndexOf( "/" ) ) {
+		sBase = m_sFilename.left( nDot );
+		sExt = m_sFilename.mid( nDot );
+	}
+	QString sName = sInstrument;
+	sName.replace( "/", "_" );
+	return QString( "%1-%2-%3%4" ).arg( sBase ).arg( nTrack + 1, 2, 10, QChar( '0' ) ).arg( sName ).arg( sExt );
 }
 
 
@@ -27,13 +27,14 @@ namespace H2Core
 
 const char* FakeDriver::__class_name = "FakeDiskDriver";
 
-FakeDriver::FakeDriver( audioProcessCallback processCallback )
+FakeDriver::FakeDriver( audioProcessCallback processCallback, bool bTrackOuts )
 		: AudioOutput( __class_name )
 		, m_processCallback( processCallback )
 		, m_pOut_L( NULL )
 		, m_pOut_R( NULL )
 {
 	INFOLOG( "INIT" );
+	__track_out_enabled = bTrackOuts;
 }
 
 
@@ -75,6 +76,8 @@ void FakeDriver::disconnect()
 
 	delete[] m_pOut_R;
 	m_pOut_R = NULL;
+
+	__free_track_buffers();
 }
 
 
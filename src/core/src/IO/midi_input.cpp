@@ -271,7 +271,7 @@ void MidiInput::handleNoteOffMessage( const MidiMessage& msg )
 	bool use_note_off = AudioEngine::get_instance()->get_sampler()->is_instrument_playing( pInstr );
 	if(use_note_off){
 		if ( Preferences::get_instance()->__playselectedinstrument ){
-			AudioEngine::get_instance()->get_sampler()->midi_keyboard_note_off( msg.m_nData1 );
+			AudioEngine::get_instance()->get_sampler()->queue_midi_keyboard_note_off( msg.m_nData1 );
 		}else
 		{
 			if ( pSong->get_instrument_list()->size() < nInstrument +1 )
@@ -284,8 +284,7 @@ void MidiInput::handleNoteOffMessage( const MidiMessage& msg )
 						-1,
 						0 );
 			offnote->set_note_off( true );
-			AudioEngine::get_instance()->get_sampler()->note_on( offnote );
-			delete offnote;
+			AudioEngine::get_instance()->get_sampler()->queue_note_on( offnote );
 		}
 		if(Preferences::get_instance()->getRecordEvents())
 			AudioEngine::get_instance()->get_sampler()->setPlayingNotelength( pInstr, notelength * fStep, __noteOnTick );
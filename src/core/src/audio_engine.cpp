@@ -24,6 +24,10 @@
 
 #include <hydrogen/fx/Effects.h>
 #include <hydrogen/sampler/Sampler.h>
+#include <hydrogen/sampler/sinc_table.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/note_pool.h>
+#include <hydrogen/Preferences.h>
 
 #include <hydrogen/hydrogen.h>	// TODO: remove this line as soon as possible
 #include <cassert>
@@ -47,12 +51,20 @@ AudioEngine::AudioEngine()
 		: Object( __class_name )
 		, __sampler( NULL )
 		, __synth( NULL )
+		, __commands( NULL )
+		, __meters( NULL )
+		, __reported_fallbacks( 0 )
 {
 	__instance = this;
 	INFOLOG( "INIT" );
 
 	pthread_mutex_init( &__engine_mutex, NULL );
 
+	__commands = new CommandQueue;
+	__meters = new Meters;
+	// notes copied while playing, only resized when the drivers are restarted
+	NotePool::create_instance( Preferences::get_instance()->m_nMaxNotes + NOTE_POOL_HEADROOM );
+	SincTable::create_instance();
 	__sampler = new Sampler;
 	__synth = new Synth;
 
@@ -71,9 +83,19 @@ AudioEngine::~AudioEngine()
 	delete Effects::get_instance();
 #endif
 
+	// nothing will drain the queue anymore
+	lock( RIGHT_HERE );
+	process_commands();
+	unlock();
+
 //	delete Sequencer::get_instance();
 	delete __sampler;
 	delete __synth;
+	delete SincTable::get_instance();
+	delete __commands;
+	delete __meters;
+	// after the sampler and the queue, which may still hold pooled notes
+	delete NotePool::get_instance();
 }
 
 
@@ -93,6 +115,83 @@ Synth* AudioEngine::get_synth()
 	return __synth;
 }
 
+
+
+CommandQueue* AudioEngine::get_command_queue()
+{
+	assert(__commands);
+	return __commands;
+}
+
+
+
+Meters* AudioEngine::get_meters()
+{
+	assert(__meters);
+	return __meters;
+}
+
+
+
+void AudioEngine::post_command( const Command& cmd )
+{
+	__commands->collect_garbage();
+	__report_incidents();
+
+	if ( Hydrogen::get_instance()->getState() < STATE_READY
+	     || !__commands->push_command( cmd ) ) {
+		lock( RIGHT_HERE );
+		process_commands();	// keep the order of what is still queued
+		__handle_command( cmd );
+		unlock();
+		__commands->collect_garbage();
+	}
+}
+
+
+
+void AudioEngine::process_commands()
+{
+	Command cmd;
+	while ( __commands->pop_command( cmd ) ) {
+		__handle_command( cmd );
+	}
+	__commands->flush_retired();
+}
+
+
+
+void AudioEngine::__handle_command( const Command& cmd )
+{
+	switch ( cmd.type ) {
+	case COMMAND_SET_LAYER:
+		__commands->retire( CommandQueue::RETIRED_LAYER, cmd.instrument->get_layer( cmd.value ) );
+		cmd.instrument->set_layer( cmd.layer, cmd.value );
+		break;
+	case COMMAND_REALTIME_NOTE:
+		Hydrogen::get_instance()->playRealtimeNote( cmd.value, cmd.position, cmd.velocity, cmd.pan_l, cmd.pan_r, cmd.key );
+		break;
+	case COMMAND_NONE:
+		break;
+	default:
+		__sampler->handle_command( cmd );
+	}
+}
+
+void AudioEngine::__report_incidents()
+{
+	__commands->report_incidents();
+
+	// the note pool was too small for this song, notes came from the heap
+	unsigned nFallbacks = NotePool::get_instance()->get_fallback_count();
+	if ( nFallbacks != __reported_fallbacks ) {
+		WARNINGLOG( QString( "%1 note allocations fell back to the heap (pool of %2 notes)" )
+			    .arg( nFallbacks - __reported_fallbacks )
+			    .arg( NotePool::get_instance()->get_capacity() ) );
+		__reported_fallbacks = nFallbacks;
+	}
+}
+
 void AudioEngine::lock( const char* file, unsigned int line, const char* function )
 {
 	pthread_mutex_lock( &__engine_mutex );
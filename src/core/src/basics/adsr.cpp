@@ -21,6 +21,7 @@
  */
 
 #include <hydrogen/basics/adsr.h>
+#include <hydrogen/basics/note_pool.h>
 
 #include "exponential_tables.h"
 
@@ -58,6 +59,31 @@ ADSR::ADSR( const ADSR* other ) : Object( __class_name ),
 
 ADSR::~ADSR() { }
 
+void* ADSR::operator new( size_t size )
+{
+	return ::operator new( size );
+}
+
+void* ADSR::operator new( size_t size, NotePool* pool )
+{
+	void* ptr = pool->alloc_adsr();
+	if ( ptr==0 ) {
+		pool->add_fallback();
+		ptr = ::operator new( size );
+	}
+	return ptr;
+}
+
+void ADSR::operator delete( void* ptr )
+{
+	if ( !NotePool::free_adsr( ptr ) ) ::operator delete( ptr );
+}
+
+void ADSR::operator delete( void* ptr, NotePool* pool )
+{
+	ADSR::operator delete( ptr );
+}
+
 float ADSR::get_value( float step )
 {
 	switch ( __state ) {
@@ -111,6 +137,82 @@ float ADSR::get_value( float step )
 	return __value;
 }
 
+void ADSR::get_values( float step, float* values, int n )
+{
+	int i = 0;
+	// the state is only checked at segment boundaries
+	while ( i < n ) {
+		switch ( __state ) {
+		case ATTACK:
+			if ( __attack == 0 ) {
+				values[i++] = __value = 1.0;
+				__ticks += step;
+				if ( __ticks > __attack ) {
+					__state = DECAY;
+					__ticks = 0;
+				}
+				break;
+			}
+			while ( i < n ) {
+				values[i++] = __value = convex_exponant( linear_interpolation( 0.0, 1.0, ( __ticks * 1.0 / __attack ) ) );
+				__ticks += step;
+				if ( __ticks > __attack ) {
+					__state = DECAY;
+					__ticks = 0;
+					break;
+				}
+			}
+			break;
+
+		case DECAY:
+			if ( __decay == 0 ) {
+				values[i++] = __value = __sustain;
+				__ticks += step;
+				if ( __ticks > __decay ) {
+					__state = SUSTAIN;
+					__ticks = 0;
+				}
+				break;
+			}
+			while ( i < n ) {
+				values[i++] = __value = concave_exponant( linear_interpolation( 1.0, __sustain, ( __ticks * 1.0 / __decay ) ) );
+				__ticks += step;
+				if ( __ticks > __decay ) {
+					__state = SUSTAIN;
+					__ticks = 0;
+					break;
+				}
+			}
+			break;
+
+		case SUSTAIN:
+			__value = __sustain;
+			while ( i < n ) values[i++] = __value;
+			break;
+
+		case RELEASE:
+			if ( __release < 256 ) {
+				__release = 256;
+			}
+			while ( i < n ) {
+				values[i++] = __value = concave_exponant( linear_interpolation( __release_value, 0.0, ( __ticks * 1.0 / __release ) ) );
+				__ticks += step;
+				if ( __ticks > __release ) {
+					__state = IDLE;
+					__ticks = 0;
+					break;
+				}
+			}
+			break;
+
+		case IDLE:
+		default:
+			__value = 0;
+			while ( i < n ) values[i++] = 0;
+		};
+	}
+}
+
 void ADSR::attack()
 {
 	__state = ATTACK;
@@ -127,6 +229,17 @@ float ADSR::release()
 	return __release_value;
 }
 
+float ADSR::fade_out( float ticks )
+{
+	if ( __state == IDLE ) return 0;
+	if ( __state == RELEASE && ( __release - __ticks ) <= ticks ) return __value;
+	__release_value = __value;
+	__release = ticks;
+	__state = RELEASE;
+	__ticks = 0;
+	return __release_value;
+}
+
 };
 
 /* vim: set softtabstop=4 expandtab: */
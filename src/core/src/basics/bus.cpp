@@ -0,0 +1,47 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/basics/bus.h>
+
+namespace H2Core
+{
+
+const char* Bus::__class_name = "Bus";
+
+Bus::Bus( const QString& name )
+	: Object( __class_name )
+	, __name( name )
+	, __volume( 1.0 )
+	, __pan_l( 1.0 )
+	, __pan_r( 1.0 )
+	, __muted( false )
+{
+	for ( int i=0; i<MAX_FX; i++ ) __fx_level[i] = 0.0;
+}
+
+Bus::~Bus()
+{
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
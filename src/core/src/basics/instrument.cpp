@@ -23,6 +23,7 @@
 #include <hydrogen/basics/instrument.h>
 
 #include <cassert>
+#include <cstdlib>
 
 #include <hydrogen/audio_engine.h>
 
@@ -31,6 +32,7 @@
 
 #include <hydrogen/basics/adsr.h>
 #include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/sample_loader.h>
 #include <hydrogen/basics/drumkit.h>
 #include <hydrogen/basics/instrument_list.h>
 #include <hydrogen/basics/instrument_layer.h>
@@ -48,8 +50,6 @@ Instrument::Instrument( const int id, const QString& name, ADSR* adsr )
 	, __volume( 1.0 )
 	, __pan_l( 1.0 )
 	, __pan_r( 1.0 )
-	, __peak_l( 0.0 )
-	, __peak_r( 0.0 )
 	, __adsr( adsr )
 	, __filter_active( false )
 	, __filter_cutoff( 1.0 )
@@ -62,11 +62,16 @@ Instrument::Instrument( const int id, const QString& name, ADSR* adsr )
 	, __soloed( false )
 	, __muted( false )
 	, __mute_group( -1 )
+	, __bus( -1 )
+	, __max_voices( 0 )
 	, __queued( 0 )
+	, __voices( 0 )
+	, __sample_selection_alg( VELOCITY )
 {
 	if ( __adsr==0 ) __adsr = new ADSR();
 	for ( int i=0; i<MAX_FX; i++ ) __fx_level[i] = 0.0;
 	for ( int i=0; i<MAX_LAYERS; i++ ) __layers[i] = NULL;
+	update_layer_table();
 }
 
 Instrument::Instrument( Instrument* other )
@@ -77,8 +82,6 @@ Instrument::Instrument( Instrument* other )
 	, __volume( other->get_volume() )
 	, __pan_l( other->get_pan_l() )
 	, __pan_r( other->get_pan_r() )
-	, __peak_l( other->get_peak_l() )
-	, __peak_r( other->get_peak_r() )
 	, __adsr( new ADSR( *( other->get_adsr() ) ) )
 	, __filter_active( other->is_filter_active() )
 	, __filter_cutoff( other->get_filter_cutoff() )
@@ -91,7 +94,11 @@ Instrument::Instrument( Instrument* other )
 	, __soloed( other->is_soloed() )
 	, __muted( other->is_muted() )
 	, __mute_group( other->get_mute_group() )
+	, __bus( other->get_bus() )
+	, __max_voices( other->get_max_voices() )
 	, __queued( other->is_queued() )
+	, __voices( 0 )
+	, __sample_selection_alg( other->get_sample_selection_alg() )
 {
 	for ( int i=0; i<MAX_FX; i++ ) __fx_level[i] = other->get_fx_level( i );
 
@@ -103,6 +110,7 @@ Instrument::Instrument( Instrument* other )
 			__layers[i] = 0;
 		}
 	}
+	update_layer_table();
 }
 
 Instrument::~Instrument()
@@ -122,36 +130,50 @@ Instrument* Instrument::load_instrument( const QString& drumkit_name, const QStr
 	return i;
 }
 
+int Instrument::queue_samples_from( SampleLoader* loader, Drumkit* drumkit, Instrument* instrument )
+{
+	int job = loader->size();
+	for ( int i=0; i<MAX_LAYERS; i++ ) {
+		InstrumentLayer* src_layer = instrument->get_layer( i );
+		if( src_layer!=0 ) loader->add( drumkit->get_path() + "/" + src_layer->get_sample()->get_filename(), true );
+	}
+	return job;
+}
+
 void Instrument::load_from( Drumkit* drumkit, Instrument* instrument, bool is_live )
+{
+	SampleLoader loader;
+	int job = queue_samples_from( &loader, drumkit, instrument );
+	loader.run();
+	load_from( drumkit, instrument, is_live, &loader, job );
+}
+
+void Instrument::load_from( Drumkit* drumkit, Instrument* instrument, bool is_live, SampleLoader* loader, int job )
 {
 	for ( int i=0; i<MAX_LAYERS; i++ ) {
 		InstrumentLayer* src_layer = instrument->get_layer( i );
-		InstrumentLayer* my_layer = this->get_layer( i );
-		if( src_layer==0 ) {
-			if ( is_live )
-				AudioEngine::get_instance()->lock( RIGHT_HERE );
-			this->set_layer( NULL, i );
-			if ( is_live )
-				AudioEngine::get_instance()->unlock();
-		} else {
-			QString sample_path =  drumkit->get_path() + "/" + src_layer->get_sample()->get_filename();
-			Sample* sample = Sample::load( sample_path );
+		InstrumentLayer* new_layer = 0;
+		if( src_layer!=0 ) {
+			Sample* sample = loader->take( job );
 			if ( sample==0 ) {
-				_ERRORLOG( QString( "Error loading sample %1. Creating a new empty layer." ).arg( sample_path ) );
-				if ( is_live )
-					AudioEngine::get_instance()->lock( RIGHT_HERE );
-				this->set_layer( NULL, i );
-				if ( is_live )
-					AudioEngine::get_instance()->unlock();
+				_ERRORLOG( QString( "Error loading sample %1. Creating a new empty layer." ).arg( loader->get_filepath( job ) ) );
 			} else {
-				if ( is_live )
-					AudioEngine::get_instance()->lock( RIGHT_HERE );
-				this->set_layer( new InstrumentLayer( src_layer, sample ), i );
-				if ( is_live )
-					AudioEngine::get_instance()->unlock();
+				new_layer = new InstrumentLayer( src_layer, sample );
 			}
+			job++;
+		}
+		if ( is_live ) {
+			// the audio thread swaps the layer and hands the old one back for deletion
+			Command cmd;
+			cmd.type = COMMAND_SET_LAYER;
+			cmd.instrument = this;
+			cmd.layer = new_layer;
+			cmd.value = i;
+			AudioEngine::get_instance()->post_command( cmd );
+		} else {
+			delete this->get_layer( i );
+			this->set_layer( new_layer, i );
 		}
-		delete my_layer;
 	}
 	if ( is_live )
 		AudioEngine::get_instance()->lock( RIGHT_HERE );
@@ -170,6 +192,8 @@ void Instrument::load_from( Drumkit* drumkit, Instrument* instrument, bool is_li
 	this->set_random_pitch_factor( instrument->get_random_pitch_factor() );
 	this->set_muted( instrument->is_muted() );
 	this->set_mute_group( instrument->get_mute_group() );
+	this->set_max_voices( instrument->get_max_voices() );
+	this->set_sample_selection_alg( instrument->get_sample_selection_alg() );
 	this->set_midi_out_channel( instrument->get_midi_out_channel() );
 	this->set_midi_out_note( instrument->get_midi_out_note() );
 	if ( is_live )
@@ -214,6 +238,15 @@ Instrument* Instrument::load_from( XMLNode* node, const QString& dk_path, const
 	instrument->set_midi_out_channel( node->read_int( "midiOutChannel", -1, true, false ) );
 	instrument->set_midi_out_note( node->read_int( "midiOutNote", MIDI_MIDDLE_C, true, false ) );
 	instrument->set_stop_notes( node->read_bool( "isStopNote", true ,false ) );
+	instrument->set_max_voices( node->read_int( "maxVoices", 0, true, false ) );
+	QString sample_selection = node->read_string( "sampleSelectionAlgo", "VELOCITY", true, false );
+	if ( sample_selection=="ROUND_ROBIN" ) {
+		instrument->set_sample_selection_alg( ROUND_ROBIN );
+	} else if ( sample_selection=="RANDOM" ) {
+		instrument->set_sample_selection_alg( RANDOM );
+	} else {
+		instrument->set_sample_selection_alg( VELOCITY );
+	}
 	for ( int i=0; i<MAX_FX; i++ ) {
 		instrument->set_fx_level( node->read_float( QString( "FX%1Level" ).arg( i+1 ), 0.0 ), i );
 	}
@@ -232,10 +265,17 @@ Instrument* Instrument::load_from( XMLNode* node, const QString& dk_path, const
 }
 
 void Instrument::load_samples()
+{
+	SampleLoader loader;
+	queue_samples( &loader );
+	loader.run();
+}
+
+void Instrument::queue_samples( SampleLoader* loader )
 {
 	for ( int i=0; i<MAX_LAYERS; i++ ) {
 		InstrumentLayer* layer = get_layer( i );
-		if( layer ) layer->load_sample( );
+		if( layer && layer->get_sample() ) loader->add( layer->get_sample(), true );
 	}
 }
 
@@ -269,6 +309,17 @@ void Instrument::save_to( XMLNode* node )
 	instrument_node.write_int( "midiOutChannel", __midi_out_channel );
 	instrument_node.write_int( "midiOutNote", __midi_out_note );
 	instrument_node.write_bool( "isStopNote", __stop_notes );
+	instrument_node.write_int( "maxVoices", __max_voices );
+	switch ( __sample_selection_alg ) {
+	case ROUND_ROBIN:
+		instrument_node.write_string( "sampleSelectionAlgo", "ROUND_ROBIN" );
+		break;
+	case RANDOM:
+		instrument_node.write_string( "sampleSelectionAlgo", "RANDOM" );
+		break;
+	default:
+		instrument_node.write_string( "sampleSelectionAlgo", "VELOCITY" );
+	}
 	for ( int i=0; i<MAX_FX; i++ ) {
 		instrument_node.write_float( QString( "FX%1Level" ).arg( i+1 ), __fx_level[i] );
 	}
@@ -281,6 +332,57 @@ void Instrument::save_to( XMLNode* node )
 	node->appendChild( instrument_node );
 }
 
+void Instrument::set_fx_level( float level, int index )
+{
+	__fx_level[index] = level;
+	// the sampler caches the levels of the playing notes
+	InstrumentList::bump_generation();
+}
+
+void Instrument::set_bus( int bus )
+{
+	__bus = ( bus<-1 ? -1 : bus );
+	// the sampler caches the bus of the playing notes
+	InstrumentList::bump_generation();
+}
+
+void Instrument::update_layer_table()
+{
+	for ( int step=0; step<VELOCITY_LAYER_STEPS; step++ ) {
+		float velocity = ( float )step / ( VELOCITY_LAYER_STEPS - 1 );
+		int count = 0;
+		for ( int i=0; i<MAX_LAYERS; i++ ) {
+			InstrumentLayer* layer = __layers[i];
+			if ( layer && velocity>=layer->get_start_velocity() && velocity<=layer->get_end_velocity() ) {
+				__layer_table[step][count++] = i;
+			}
+		}
+		__layer_count[step] = count;
+		__round_robin[step] = 0;
+	}
+}
+
+int Instrument::select_layer( float velocity )
+{
+	int step = ( int )( velocity * ( VELOCITY_LAYER_STEPS - 1 ) + 0.5 );
+	if ( step<0 ) step = 0;
+	if ( step>=VELOCITY_LAYER_STEPS ) step = VELOCITY_LAYER_STEPS - 1;
+	int count = __layer_count[step];
+	if ( count==0 ) return -1;
+	switch ( __sample_selection_alg ) {
+	case ROUND_ROBIN: {
+		int n = __round_robin[step];
+		if ( n>=count ) n = 0;
+		__round_robin[step] = n + 1;
+		return __layer_table[step][n];
+	}
+	case RANDOM:
+		return __layer_table[step][ rand() % count ];
+	default:
+		return __layer_table[step][0];
+	}
+}
+
 void Instrument::set_adsr( ADSR* adsr )
 {
 	if( __adsr ) delete __adsr;
@@ -65,7 +65,7 @@ InstrumentLayer::~InstrumentLayer()
 
 void InstrumentLayer::load_sample()
 {
-	if( __sample ) __sample->load();
+	if( __sample ) __sample->load( true );
 }
 
 void InstrumentLayer::unload_sample()
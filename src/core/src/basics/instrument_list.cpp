@@ -24,14 +24,17 @@
 
 #include <hydrogen/helpers/xml.h>
 #include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/sample_loader.h>
 
 namespace H2Core
 {
 
 const char* InstrumentList::__class_name = "InstrumentList";
+QAtomicInt InstrumentList::__generation( 0 );
 
 InstrumentList::InstrumentList() : Object( __class_name )
 {
+	bump_generation();
 }
 
 InstrumentList::InstrumentList( InstrumentList* other ) : Object( __class_name )
@@ -40,6 +43,7 @@ InstrumentList::InstrumentList( InstrumentList* other ) : Object( __class_name )
 	for ( int i=0; i<other->size(); i++ ) {
 		( *this ) << ( new Instrument( ( *other )[i] ) );
 	}
+	bump_generation();
 }
 
 InstrumentList::~InstrumentList()
@@ -47,13 +51,17 @@ InstrumentList::~InstrumentList()
 	for ( int i = 0; i < __instruments.size(); ++i ) {
 		delete __instruments[i];
 	}
+	bump_generation();
 }
 
 void InstrumentList::load_samples()
 {
+	// every sample of every instrument at once
+	SampleLoader loader;
 	for( int i=0; i<__instruments.size(); i++ ) {
-		__instruments[i]->load_samples();
+		__instruments[i]->queue_samples( &loader );
 	}
+	loader.run();
 }
 
 void InstrumentList::unload_samples()
@@ -102,6 +110,7 @@ void InstrumentList::operator<<( Instrument* instrument )
 		if( __instruments[i]==instrument ) return;
 	}
 	__instruments.push_back( instrument );
+	bump_generation();
 }
 
 void InstrumentList::add( Instrument* instrument )
@@ -111,6 +120,7 @@ void InstrumentList::add( Instrument* instrument )
 		if( __instruments[i]==instrument ) return;
 	}
 	__instruments.push_back( instrument );
+	bump_generation();
 }
 
 void InstrumentList::insert( int idx, Instrument* instrument )
@@ -120,6 +130,7 @@ void InstrumentList::insert( int idx, Instrument* instrument )
 		if( __instruments[i]==instrument ) return;
 	}
 	__instruments.insert( __instruments.begin() + idx, instrument );
+	bump_generation();
 }
 
 Instrument* InstrumentList::operator[]( int idx )
@@ -171,6 +182,7 @@ Instrument* InstrumentList::del( int idx )
 	assert( idx >= 0 && idx < __instruments.size() );
 	Instrument* instrument = __instruments[idx];
 	__instruments.erase( __instruments.begin() + idx );
+	bump_generation();
 	return instrument;
 }
 
@@ -179,6 +191,7 @@ Instrument* InstrumentList::del( Instrument* instrument )
 	for( int i=0; i<__instruments.size(); i++ ) {
 		if( __instruments[i]==instrument ) {
 			__instruments.erase( __instruments.begin() + i );
+			bump_generation();
 			return instrument;
 		}
 	}
@@ -194,6 +207,7 @@ void InstrumentList::swap( int idx_a, int idx_b )
 	Instrument* tmp = __instruments[idx_a];
 	__instruments[idx_a] = __instruments[idx_b];
 	__instruments[idx_b] = tmp;
+	bump_generation();
 }
 
 void InstrumentList::move( int idx_a, int idx_b )
@@ -205,6 +219,7 @@ void InstrumentList::move( int idx_a, int idx_b )
 	Instrument* tmp = __instruments[idx_a];
 	__instruments.erase( __instruments.begin() + idx_a );
 	__instruments.insert( __instruments.begin() + idx_b, tmp );
+	bump_generation();
 }
 
 };
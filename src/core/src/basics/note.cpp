@@ -27,6 +27,7 @@
 #include <hydrogen/helpers/xml.h>
 
 #include <hydrogen/basics/adsr.h>
+#include <hydrogen/basics/note_pool.h>
 #include <hydrogen/basics/instrument.h>
 #include <hydrogen/basics/instrument_list.h>
 
@@ -36,6 +37,15 @@ namespace H2Core
 const char* Note::__class_name = "Note";
 const char* Note::__key_str[] = { "C", "Cs", "D", "Ef", "E", "F", "Fs", "G", "Af", "A", "Bf", "B" };
 
+/** pooled notes get a pooled ADSR */
+static inline ADSR* copy_adsr( const Note* note, const Instrument* instrument )
+{
+	if ( NotePool::is_pooled( note ) ) {
+		return new ( NotePool::get_instance() ) ADSR( instrument->get_adsr() );
+	}
+	return instrument->copy_adsr();
+}
+
 Note::Note( Instrument* instrument, int position, float velocity, float pan_l, float pan_r, int length, float pitch )
 	: Object( __class_name ),
 	  __instrument( instrument ),
@@ -54,19 +64,23 @@ Note::Note( Instrument* instrument, int position, float velocity, float pan_l, f
 	  __resonance( 0.0 ),
 	  __humanize_delay( 0 ),
 	  __sample_position( 0.0 ),
-	  __bpfb_l( 0.0 ),
-	  __bpfb_r( 0.0 ),
-	  __lpfb_l( 0.0 ),
-	  __lpfb_r( 0.0 ),
+	  __voice( -1 ),
+	  __stolen( false ),
+	  __selected_layer( -1 ),
 	  __pattern_idx( 0 ),
 	  __midi_msg( -1 ),
 	  __note_off( false ),
 	  __just_recorded( false )
 {
 	if ( __instrument != 0 ) {
-		__adsr = __instrument->copy_adsr();
+		__adsr = copy_adsr( this, __instrument );
 		__instrument_id = __instrument->get_id();
 	}
+	for ( int i=0; i<VOICE_LISTS; i++ ) {
+		__voice_head[i] = 0;
+		__voice_prev[i] = 0;
+		__voice_next[i] = 0;
+	}
 }
 
 Note::Note( Note* other, Instrument* instrument )
@@ -87,10 +101,9 @@ Note::Note( Note* other, Instrument* instrument )
 	  __resonance( other->get_resonance() ),
 	  __humanize_delay( other->get_humanize_delay() ),
 	  __sample_position( other->get_sample_position() ),
-	  __bpfb_l( other->get_bpfb_l() ),
-	  __bpfb_r( other->get_bpfb_r() ),
-	  __lpfb_l( other->get_lpfb_l() ),
-	  __lpfb_r( other->get_lpfb_r() ),
+	  __voice( -1 ),
+	  __stolen( false ),
+	  __selected_layer( -1 ),
 	  __pattern_idx( other->get_pattern_idx() ),
 	  __midi_msg( other->get_midi_msg() ),
 	  __note_off( other->get_note_off() ),
@@ -98,9 +111,14 @@ Note::Note( Note* other, Instrument* instrument )
 {
 	if ( instrument != 0 ) __instrument = instrument;
 	if ( __instrument != 0 ) {
-		__adsr = __instrument->copy_adsr();
+		__adsr = copy_adsr( this, __instrument );
 		__instrument_id = __instrument->get_id();
 	}
+	for ( int i=0; i<VOICE_LISTS; i++ ) {
+		__voice_head[i] = 0;
+		__voice_prev[i] = 0;
+		__voice_next[i] = 0;
+	}
 }
 
 Note::~Note()
@@ -109,6 +127,31 @@ Note::~Note()
 	__adsr = 0;
 }
 
+void* Note::operator new( size_t size )
+{
+	return ::operator new( size );
+}
+
+void* Note::operator new( size_t size, NotePool* pool )
+{
+	void* ptr = pool->alloc_note();
+	if ( ptr==0 ) {
+		pool->add_fallback();
+		ptr = ::operator new( size );
+	}
+	return ptr;
+}
+
+void Note::operator delete( void* ptr )
+{
+	if ( !NotePool::free_note( ptr ) ) ::operator delete( ptr );
+}
+
+void Note::operator delete( void* ptr, NotePool* pool )
+{
+	Note::operator delete( ptr );
+}
+
 static inline float check_boundary( float v, float min, float max )
 {
 	if ( v>max ) return max;
@@ -172,6 +215,30 @@ void Note::set_key_octave( const QString& str )
 	___ERRORLOG( "Unhandled key: " + s_key );
 }
 
+void Note::link_voice( VoiceList list, Note** head )
+{
+	assert( __voice_head[list]==0 );
+	__voice_head[list] = head;
+	__voice_prev[list] = 0;
+	__voice_next[list] = *head;
+	if ( *head ) ( *head )->__voice_prev[list] = this;
+	*head = this;
+}
+
+void Note::unlink_voice( VoiceList list )
+{
+	if ( __voice_head[list]==0 ) return;
+	if ( __voice_prev[list] ) {
+		__voice_prev[list]->__voice_next[list] = __voice_next[list];
+	} else {
+		*__voice_head[list] = __voice_next[list];
+	}
+	if ( __voice_next[list] ) __voice_next[list]->__voice_prev[list] = __voice_prev[list];
+	__voice_head[list] = 0;
+	__voice_prev[list] = 0;
+	__voice_next[list] = 0;
+}
+
 void Note::dump()
 {
 	INFOLOG( QString( "Note : pos: %1\t humanize offset%2\t instr: %3\t key: %4\t pitch: %5" )
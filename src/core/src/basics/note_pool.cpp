@@ -0,0 +1,133 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/basics/note_pool.h>
+
+#include <hydrogen/basics/adsr.h>
+#include <hydrogen/basics/note.h>
+
+#include <new>
+
+namespace H2Core
+{
+
+const char* NotePool::__class_name = "NotePool";
+NotePool* NotePool::__instance = 0;
+
+/** round a slot size up so that every slot stays suitably aligned */
+static inline size_t slot_size( size_t size )
+{
+	return ( size + 15 ) & ~( ( size_t )15 );
+}
+
+void NotePool::create_instance( int capacity )
+{
+	if ( __instance==0 ) {
+		__instance = new NotePool( capacity );
+	}
+}
+
+NotePool::NotePool( int capacity )
+	: Object( __class_name ),
+	  __capacity( capacity ),
+	  __note_size( slot_size( sizeof( Note ) ) ),
+	  __adsr_size( slot_size( sizeof( ADSR ) ) ),
+	  __fallback_count( 0 )
+{
+	INFOLOG( QString( "%1 slots" ).arg( capacity ) );
+	__alloc_slots();
+}
+
+NotePool::~NotePool()
+{
+	if ( __free_notes_count!=__capacity ) {
+		ERRORLOG( QString( "%1 notes still allocated" ).arg( __capacity - __free_notes_count ) );
+	}
+	__instance = 0;
+	__free_slots();
+}
+
+bool NotePool::resize( int capacity )
+{
+	if ( capacity==__capacity ) return true;
+	if ( __free_notes_count!=__capacity || __free_adsrs_count!=__capacity ) return false;
+	INFOLOG( QString( "%1 slots instead of %2" ).arg( capacity ).arg( __capacity ) );
+	__free_slots();
+	__capacity = capacity;
+	__alloc_slots();
+	return true;
+}
+
+void NotePool::__alloc_slots()
+{
+	__notes = ( char* )::operator new( __capacity * __note_size );
+	__adsrs = ( char* )::operator new( __capacity * __adsr_size );
+	__free_notes = new int[ __capacity ];
+	__free_adsrs = new int[ __capacity ];
+	// lowest slots on top of the stacks
+	for ( int i=0; i<__capacity; i++ ) {
+		__free_notes[i] = __capacity - 1 - i;
+		__free_adsrs[i] = __capacity - 1 - i;
+	}
+	__free_notes_count = __capacity;
+	__free_adsrs_count = __capacity;
+}
+
+void NotePool::__free_slots()
+{
+	::operator delete( __notes );
+	::operator delete( __adsrs );
+	delete[] __free_notes;
+	delete[] __free_adsrs;
+}
+
+void* NotePool::alloc_note()
+{
+	if ( __free_notes_count==0 ) return 0;
+	return __notes + __free_notes[ --__free_notes_count ] * __note_size;
+}
+
+void* NotePool::alloc_adsr()
+{
+	if ( __free_adsrs_count==0 ) return 0;
+	return __adsrs + __free_adsrs[ --__free_adsrs_count ] * __adsr_size;
+}
+
+bool NotePool::free_note( void* ptr )
+{
+	if ( !is_pooled( ptr ) ) return false;
+	__instance->__free_notes[ __instance->__free_notes_count++ ] = ( ( char* )ptr - __instance->__notes ) / __instance->__note_size;
+	return true;
+}
+
+bool NotePool::free_adsr( void* ptr )
+{
+	if ( __instance==0 ) return false;
+	char* p = ( char* )ptr;
+	if ( p<__instance->__adsrs || p>=__instance->__adsrs + __instance->__capacity * __instance->__adsr_size ) return false;
+	__instance->__free_adsrs[ __instance->__free_adsrs_count++ ] = ( p - __instance->__adsrs ) / __instance->__adsr_size;
+	return true;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,188 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/basics/note_queue.h>
+
+#include <hydrogen/basics/note.h>
+
+#include <cassert>
+#include <cmath>
+
+namespace H2Core
+{
+
+const char* NoteQueue::__class_name = "NoteQueue";
+
+/** return the absolute bucket number of a start frame */
+static inline long long bucket_of( float key )
+{
+	return ( long long )floor( key / NOTE_QUEUE_BUCKET_FRAMES );
+}
+
+/** return the wheel slot of an absolute bucket number */
+static inline int slot_of( long long bucket )
+{
+	int slot = bucket % NOTE_QUEUE_BUCKETS;
+	return ( slot<0 ? slot + NOTE_QUEUE_BUCKETS : slot );
+}
+
+NoteQueue::NoteQueue()
+	: Object( __class_name ),
+	  __cursor( 0 ),
+	  __head( 0 ),
+	  __wheel_size( 0 ),
+	  __seq( 0 ),
+	  __tick_size( 1.0 )
+{
+	for ( int i=0; i<NOTE_QUEUE_BUCKETS; i++ ) __buckets[i].size = 0;
+	// avoid allocations on the audio thread
+	__overflow.reserve( NOTE_QUEUE_OVERFLOW );
+	__scratch.reserve( NOTE_QUEUE_BUCKETS * NOTE_QUEUE_BUCKET_SIZE + NOTE_QUEUE_OVERFLOW );
+}
+
+NoteQueue::~NoteQueue()
+{
+}
+
+inline float NoteQueue::__key( Note* note ) const
+{
+	return ( note->get_humanize_delay() + note->get_position() * __tick_size );
+}
+
+inline bool NoteQueue::__before( const Entry& a, const Entry& b )
+{
+	return ( a.key<b.key || ( a.key==b.key && a.seq<b.seq ) );
+}
+
+bool NoteQueue::__insert_wheel( const Entry& entry )
+{
+	long long bucket = bucket_of( entry.key );
+	if ( bucket<__cursor ) bucket = __cursor;
+	if ( bucket>=__cursor + NOTE_QUEUE_BUCKETS ) return false;
+	Bucket& b = __buckets[ slot_of( bucket ) ];
+	if ( b.size==NOTE_QUEUE_BUCKET_SIZE ) return false;
+	// notes mostly arrive in order, look from the end
+	unsigned from = ( bucket==__cursor ? __head : 0 );
+	unsigned pos = b.size;
+	while ( pos>from && __before( entry, b.entries[pos-1] ) ) {
+		b.entries[pos] = b.entries[pos-1];
+		pos--;
+	}
+	b.entries[pos] = entry;
+	b.size++;
+	__wheel_size++;
+	return true;
+}
+
+void NoteQueue::__insert( const Entry& entry )
+{
+	if ( __insert_wheel( entry ) ) return;
+	unsigned pos = __overflow.size();
+	while ( pos>0 && __before( entry, __overflow[pos-1] ) ) pos--;
+	__overflow.insert( __overflow.begin() + pos, entry );
+}
+
+void NoteQueue::push( Note* note )
+{
+	Entry entry;
+	entry.key = __key( note );
+	entry.note = note;
+	if ( empty() ) {
+		__buckets[ slot_of( __cursor ) ].size = 0;
+		__head = 0;
+		__seq = 0;
+		__cursor = bucket_of( entry.key );
+	}
+	entry.seq = __seq++;
+	__insert( entry );
+}
+
+bool NoteQueue::__seek()
+{
+	while ( true ) {
+		Bucket& current = __buckets[ slot_of( __cursor ) ];
+		if ( __head<current.size ) {
+			// full buckets spill, an overflowing note may still come first
+			return ( !__overflow.empty() && __before( __overflow[0], current.entries[ __head ] ) );
+		}
+		current.size = 0;
+		__head = 0;
+		if ( __wheel_size==0 ) {
+			if ( __overflow.empty() ) return false;
+			// nothing close, jump to the first overflowing note
+			__cursor = bucket_of( __overflow[0].key );
+		} else {
+			__cursor++;
+		}
+		// move the notes within the wheel range to the wheel, as far as their bucket has room
+		unsigned n = 0, kept = 0;
+		while ( n<__overflow.size() && bucket_of( __overflow[n].key )<__cursor + NOTE_QUEUE_BUCKETS ) {
+			if ( !__insert_wheel( __overflow[n] ) ) __overflow[ kept++ ] = __overflow[n];
+			n++;
+		}
+		if ( n>kept ) {
+			while ( n<__overflow.size() ) __overflow[ kept++ ] = __overflow[ n++ ];
+			__overflow.resize( kept );
+		}
+	}
+}
+
+Note* NoteQueue::top()
+{
+	assert( !empty() );
+	if ( __seek() ) return __overflow[0].note;
+	return __buckets[ slot_of( __cursor ) ].entries[ __head ].note;
+}
+
+void NoteQueue::pop()
+{
+	assert( !empty() );
+	if ( __seek() ) {
+		__overflow.erase( __overflow.begin() );
+		return;
+	}
+	__head++;
+	__wheel_size--;
+}
+
+void NoteQueue::set_tick_size( float tick_size )
+{
+	if ( tick_size==__tick_size ) return;
+	__tick_size = tick_size;
+	if ( empty() ) return;
+	// start frames moved, requeue everything in the current order
+	__scratch.clear();
+	while ( !empty() ) {
+		Entry entry;
+		entry.note = top();
+		entry.key = 0;
+		entry.seq = 0;
+		__scratch.push_back( entry );
+		pop();
+	}
+	for ( unsigned i=0; i<__scratch.size(); i++ ) push( __scratch[i].note );
+	__scratch.clear();
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
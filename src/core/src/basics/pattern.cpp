@@ -242,6 +242,18 @@ void Pattern::purge_instrument( Instrument* instr )
 	}
 }
 
+void Pattern::find_replacements( const std::map<Instrument*, Instrument*>& replacements, std::vector<Note*>& notes, std::vector<Instrument*>& instruments ) const
+{
+	for( notes_cst_it_t it=__notes.begin(); it!=__notes.end(); it++ ) {
+		Note* note = it->second;
+		std::map<Instrument*, Instrument*>::const_iterator found = replacements.find( note->get_instrument() );
+		if ( found!=replacements.end() ) {
+			notes.push_back( note );
+			instruments.push_back( found->second );
+		}
+	}
+}
+
 void Pattern::set_to_old()
 {
 	for( notes_cst_it_t it=__notes.begin(); it!=__notes.end(); it++ ) {
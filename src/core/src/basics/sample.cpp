@@ -22,10 +22,13 @@
 
 #include <hydrogen/basics/sample.h>
 
+#include <cmath>
 #include <limits>
 
 #include <hydrogen/hydrogen.h>
 #include <hydrogen/Preferences.h>
+#include <hydrogen/basics/sample_cache.h>
+#include <hydrogen/basics/sample_pool.h>
 #include <hydrogen/helpers/filesystem.h>
 #ifdef H2CORE_HAVE_RUBBERBAND
 #include <rubberband/RubberBandStretcher.h>
@@ -33,11 +36,16 @@
 #define RUBBERBAND_DEBUG            0
 #endif
 
+#define RESAMPLE_HALF_TAPS      32      ///< input frames on each side of an output frame read by the load time resampler
+#define RESAMPLE_PHASES         256     ///< fractional positions of its filter table, interpolated in between
+#define RESAMPLE_BANDWIDTH      0.95    ///< its cutoff relative to the lower nyquist frequency
+
 namespace H2Core
 {
 
 const char* Sample::__class_name = "Sample";
 const char* Sample::__loop_modes[] = { "forward", "reverse", "pingpong" };
+int Sample::__playback_rate = 0;
 
 #ifdef H2CORE_HAVE_RUBBERBAND
 static double compute_pitch_scale( const Sample::Rubberband& r );
@@ -47,9 +55,14 @@ static RubberBand::RubberBandStretcher::Options compute_rubberband_options( cons
 Sample::Sample( const QString& filepath,  int frames, int sample_rate, float* data_l, float* data_r ) : Object( __class_name ),
 	__filepath( filepath ),
 	__frames( frames ),
+	__resident_frames( frames ),
 	__sample_rate( sample_rate ),
 	__data_l( data_l ),
 	__data_r( data_r ),
+	__channels( ( data_l!=0 && data_l==data_r ) ? 1 : 2 ),
+	__pcm_l( 0 ),
+	__pcm_r( 0 ),
+	__buffer( 0 ),
 	__is_modified( false )
 {
 	/*
@@ -65,17 +78,43 @@ Sample::Sample( const QString& filepath,  int frames, int sample_rate, float* da
 Sample::Sample( Sample* other ): Object( __class_name ),
 	__filepath( other->get_filepath() ),
 	__frames( other->get_frames() ),
+	__resident_frames( other->get_resident_frames() ),
+	__stream_path( other->__stream_path ),
 	__sample_rate( other->get_sample_rate() ),
 	__data_l( 0 ),
 	__data_r( 0 ),
+	__channels( other->get_channels() ),
+	__pcm_l( 0 ),
+	__pcm_r( 0 ),
+	__buffer( other->__buffer ),
 	__is_modified( other->get_is_modified() ),
 	__loops( other->__loops ),
 	__rubberband( other->__rubberband )
 {
-	__data_l = new float[__frames];
-	__data_r = new float[__frames];
-	memcpy( __data_l, other->get_data_l(), __frames );
-	memcpy( __data_r, other->get_data_r(), __frames );
+	if( __buffer ) {
+		// pooled frames are shared, not copied
+		SamplePool::retain( __buffer );
+		__data_l = other->get_data_l();
+		__data_r = other->get_data_r();
+		__pcm_l = other->get_pcm_l();
+		__pcm_r = other->get_pcm_r();
+	} else if( other->is_compact() ) {
+		__pcm_l = alloc_pcm( __resident_frames );
+		memcpy( __pcm_l, other->get_pcm_l(), __resident_frames * sizeof( short ) );
+		__pcm_r = __pcm_l;
+		if( !is_mono() ) {
+			__pcm_r = alloc_pcm( __resident_frames );
+			memcpy( __pcm_r, other->get_pcm_r(), __resident_frames * sizeof( short ) );
+		}
+	} else {
+		__data_l = alloc_data( __resident_frames );
+		memcpy( __data_l, other->get_data_l(), __resident_frames * sizeof( float ) );
+		__data_r = __data_l;
+		if( !is_mono() ) {
+			__data_r = alloc_data( __resident_frames );
+			memcpy( __data_r, other->get_data_r(), __resident_frames * sizeof( float ) );
+		}
+	}
 	EnvelopePoint pt;
 	PanEnvelope* pan = other->get_pan_envelope();
 	for( int i=0; i<pan->size(); i++ ) __pan_envelope.push_back( pan->at( i ) );
@@ -86,23 +125,138 @@ Sample::Sample( Sample* other ): Object( __class_name ),
 
 Sample::~Sample()
 {
-	if( __data_l!=0 ) delete[] __data_l;
-	if( __data_r!=0 ) delete[] __data_r;
+	__free_data();
+}
+
+float* Sample::alloc_data( int frames )
+{
+	float* data = new float[ frames + 2 * SAMPLE_GUARD_FRAMES ];
+	memset( data, 0, SAMPLE_GUARD_FRAMES * sizeof( float ) );
+	memset( data + SAMPLE_GUARD_FRAMES + frames, 0, SAMPLE_GUARD_FRAMES * sizeof( float ) );
+	return data + SAMPLE_GUARD_FRAMES;
+}
+
+void Sample::free_data( float* data )
+{
+	if( data!=0 ) delete[] ( data - SAMPLE_GUARD_FRAMES );
+}
+
+void Sample::free_data( float* data_l, float* data_r )
+{
+	free_data( data_l );
+	if( data_r!=data_l ) free_data( data_r );
+}
+
+short* Sample::alloc_pcm( int frames )
+{
+	short* pcm = new short[ frames + 2 * SAMPLE_GUARD_FRAMES ];
+	memset( pcm, 0, SAMPLE_GUARD_FRAMES * sizeof( short ) );
+	memset( pcm + SAMPLE_GUARD_FRAMES + frames, 0, SAMPLE_GUARD_FRAMES * sizeof( short ) );
+	return pcm + SAMPLE_GUARD_FRAMES;
+}
+
+void Sample::free_pcm( short* pcm_l, short* pcm_r )
+{
+	if( pcm_l!=0 ) delete[] ( pcm_l - SAMPLE_GUARD_FRAMES );
+	if( pcm_r!=0 && pcm_r!=pcm_l ) delete[] ( pcm_r - SAMPLE_GUARD_FRAMES );
+}
+
+void Sample::__free_data()
+{
+	if( __buffer ) {
+		SamplePool::release( __buffer );
+		__buffer = 0;
+	} else {
+		free_data( __data_l, __data_r );
+		free_pcm( __pcm_l, __pcm_r );
+	}
+}
+
+void Sample::__attach( SampleBuffer* buffer )
+{
+	__free_data();
+	__frames = buffer->frames;
+	__resident_frames = buffer->resident_frames;
+	__sample_rate = buffer->sample_rate;
+	__data_l = buffer->data_l;
+	__data_r = buffer->data_r;
+	__channels = buffer->channels;
+	__pcm_l = buffer->pcm_l;
+	__pcm_r = buffer->pcm_r;
+	__stream_path = ( is_streamed() ? __filepath.toLocal8Bit() : QByteArray() );
+	__buffer = buffer;
+}
+
+void Sample::__share( SampleBuffer* buffer )
+{
+	buffer->frames = __frames;
+	buffer->resident_frames = __resident_frames;
+	buffer->sample_rate = __sample_rate;
+	buffer->data_l = __data_l;
+	buffer->data_r = __data_r;
+	buffer->channels = __channels;
+	buffer->pcm_l = __pcm_l;
+	buffer->pcm_r = __pcm_r;
+	buffer->is_modified = __is_modified;
+	// owned by the buffer from now on
+	__data_l = __data_r = 0;
+	__pcm_l = __pcm_r = 0;
+	__attach( SamplePool::share( buffer ) );
+}
+
+void Sample::__detach()
+{
+	if( !__buffer && !is_compact() ) return;
+	float* data_l = alloc_data( __resident_frames );
+	float* data_r = ( is_mono() ? data_l : alloc_data( __resident_frames ) );
+	if( is_compact() ) {
+		for( int i=0; i<__resident_frames; i++ ) data_l[i] = __pcm_l[i] * SAMPLE_PCM_SCALE;
+		if( !is_mono() ) for( int i=0; i<__resident_frames; i++ ) data_r[i] = __pcm_r[i] * SAMPLE_PCM_SCALE;
+	} else {
+		memcpy( data_l, __data_l, __resident_frames * sizeof( float ) );
+		if( !is_mono() ) memcpy( data_r, __data_r, __resident_frames * sizeof( float ) );
+	}
+	__free_data();
+	__data_l = data_l;
+	__data_r = data_r;
+	__pcm_l = __pcm_r = 0;
 }
 
-Sample* Sample::load( const QString& filepath )
+void Sample::__split_channels()
+{
+	if( !is_mono() ) return;
+	__detach();
+	__data_r = alloc_data( __resident_frames );
+	memcpy( __data_r, __data_l, __resident_frames * sizeof( float ) );
+	__channels = 2;
+}
+
+Sample* Sample::load( const QString& filepath, bool for_playback )
 {
 	if( !Filesystem::file_readable( filepath ) ) {
 		ERRORLOG( QString( "Unable to read %1" ).arg( filepath ) );
 		return 0;
 	}
 	Sample* sample = new Sample( filepath );
-	sample->load();
+	sample->load( for_playback );
 	return sample;
 }
 
 Sample* Sample::load( const QString& filepath, const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan )
 {
+	// rubberband output depends on the song tempo, it is not pooled
+	if( !rubber.use ) {
+		SampleBuffer* buffer = SamplePool::acquire( filepath, false, false, 0, loops, velocity, pan );
+		if( buffer ) {
+			Sample* sample = new Sample( filepath );
+			sample->__attach( buffer );
+			sample->__loops = buffer->loops;
+			sample->__velocity_envelope = buffer->velocity;
+			sample->__pan_envelope = buffer->pan;
+			sample->__is_modified = buffer->is_modified;
+			return sample;
+		}
+	}
 	Sample* sample = Sample::load( filepath );
 	if( !sample ) return 0;
 	sample->apply( loops, rubber, velocity, pan );
@@ -111,6 +265,8 @@ Sample* Sample::load( const QString& filepath, const Loops& loops, const Rubberb
 
 void Sample::apply( const Loops& loops, const Rubberband& rubber, const VelocityEnvelope& velocity, const PanEnvelope& pan )
 {
+	// the transformations need every frame, as floats
+	if( is_streamed() || is_compact() ) load();
 	apply_loops( loops );
 	apply_velocity( velocity );
 	apply_pan( pan );
@@ -119,15 +275,64 @@ void Sample::apply( const Loops& loops, const Rubberband& rubber, const Velocity
 #else
 	exec_rubberband_cli( rubber );
 #endif
+	// rubberband output depends on the song tempo, it is not pooled
+	if( !rubber.use && !__buffer ) __share( new SampleBuffer( __filepath, false, false, 0, __loops, __velocity_envelope, __pan_envelope ) );
+}
+
+void Sample::load( bool for_playback )
+{
+	Preferences* pref = Preferences::get_instance();
+	bool streamed = for_playback && pref->m_bSampleStreaming;
+	// the streamed frames are read from disk as floats
+	bool compact = for_playback && !streamed && pref->m_bCompactSamples;
+	// converted once, the sampler does not need to interpolate the unpitched notes
+	int rate = ( for_playback && !streamed && pref->m_bResampleSamples ) ? __playback_rate : 0;
+	// another instrument, drumkit or song may hold the frames already
+	SampleBuffer* buffer = SamplePool::acquire( __filepath, streamed, compact, rate, Loops(), VelocityEnvelope(), PanEnvelope() );
+	if ( buffer ) {
+		__attach( buffer );
+		return;
+	}
+	buffer = new SampleBuffer( __filepath, streamed, compact, rate, Loops(), VelocityEnvelope(), PanEnvelope() );
+	if ( for_playback && !streamed
+		 && SampleCache::map( __filepath, rate, compact, &buffer->frames, &buffer->sample_rate, &buffer->channels, &buffer->data_l, &buffer->data_r, &buffer->pcm_l, &buffer->pcm_r, &buffer->mapping, &buffer->mapping_size ) ) {
+		buffer->resident_frames = buffer->frames;
+		__attach( SamplePool::share( buffer ) );
+		return;
+	}
+	if ( !__decode( streamed, compact ) ) {
+		delete buffer;
+		return;
+	}
+	int source_rate = __sample_rate;
+	if ( rate && __sample_rate != rate ) __convert_rate( rate );
+	// mapped instead of decoded and converted next time
+	if ( for_playback && !streamed ) SampleCache::store( __filepath, rate, compact, __frames, __sample_rate, source_rate, __channels, __data_l, __data_r, __pcm_l, __pcm_r );
+	__share( buffer );
 }
 
-void Sample::load()
+/** split the interleaved frames read from a sample file into its channels, \a data_r is \a data_l if mono */
+template<typename T>
+static void deinterleave( const T* buffer, int channels, int frames, T* data_l, T* data_r )
 {
+	if ( channels == 1 ) {
+		memcpy( data_l, buffer, frames * sizeof( T ) );
+	} else if ( channels == SAMPLE_CHANNELS ) {
+		for ( int i = 0; i < frames; i++ ) {
+			data_l[i] = buffer[i * SAMPLE_CHANNELS];
+			data_r[i] = buffer[i * SAMPLE_CHANNELS + 1];
+		}
+	}
+}
+
+bool Sample::__decode( bool streamed, bool compact )
+{
+	Preferences* pref = Preferences::get_instance();
 	SF_INFO sound_info;
 	SNDFILE* file = sf_open( __filepath.toLocal8Bit(), SFM_READ, &sound_info );
 	if ( !file ) {
 		ERRORLOG( QString( "[Sample::load] Error loading file %1" ).arg( __filepath ) );
-		return;
+		return false;
 	}
 	if ( sound_info.channels > SAMPLE_CHANNELS ) {
 		WARNINGLOG( QString( "can't handle %1 channels, only 2 will be used" ).arg( sound_info.channels ) );
@@ -138,110 +343,227 @@ void Sample::load()
 		sound_info.frames = ( std::numeric_limits<int>::max()/sound_info.channels );
 	}
 
-	float* buffer = new float[ sound_info.frames * sound_info.channels ];
-	//memset( buffer, 0, sound_info.frames *sound_info.channels );
-	sf_count_t count = sf_read_float( file, buffer, sound_info.frames * sound_info.channels );
+	// a streamed sample keeps its first frames, the sampler reads the others from disk
+	int resident_frames = sound_info.frames;
+	if ( streamed ) {
+		int preload = ( int )( ( double )pref->m_nStreamingPreload * sound_info.samplerate / 1000.0 );
+		if ( preload < SAMPLE_MIN_RESIDENT_FRAMES ) preload = SAMPLE_MIN_RESIDENT_FRAMES;
+		if ( preload < resident_frames ) resident_frames = preload;
+	}
+
+	// the frames of a 16 bit file lose nothing as 16 bit integers
+	int subformat = sound_info.format & SF_FORMAT_SUBMASK;
+	bool pcm = compact && ( subformat == SF_FORMAT_PCM_16 || subformat == SF_FORMAT_PCM_S8 || subformat == SF_FORMAT_PCM_U8 );
+	float* buffer = 0;
+	short* pcm_buffer = 0;
+	sf_count_t count;
+	if ( pcm ) {
+		pcm_buffer = new short[ resident_frames * sound_info.channels ];
+		count = sf_read_short( file, pcm_buffer, resident_frames * sound_info.channels );
+	} else {
+		buffer = new float[ resident_frames * sound_info.channels ];
+		//memset( buffer, 0, sound_info.frames *sound_info.channels );
+		count = sf_read_float( file, buffer, resident_frames * sound_info.channels );
+	}
 	sf_close( file );
 	if( count==0 ) WARNINGLOG( QString( "%1 is an empty sample" ).arg( __filepath ) );
 
 	unload();
 
-	__data_l = new float[ sound_info.frames ];
-	__data_r = new float[ sound_info.frames ];
+	// a mono sample keeps a single channel, both data channels point to it
+	__channels = sound_info.channels;
 	__frames = sound_info.frames;
+	__resident_frames = resident_frames;
 	__sample_rate = sound_info.samplerate;
+	if ( is_streamed() ) __stream_path = __filepath.toLocal8Bit();
 
-	if ( sound_info.channels == 1 ) {
-		memcpy( __data_l, buffer, __frames * sizeof( float ) );
-		memcpy( __data_r, buffer, __frames * sizeof( float ) );
-	} else if ( sound_info.channels == SAMPLE_CHANNELS ) {
-		for ( int i = 0; i < __frames; i++ ) {
-			__data_l[i] = buffer[i * SAMPLE_CHANNELS];
-			__data_r[i] = buffer[i * SAMPLE_CHANNELS + 1];
-		}
+	if ( pcm ) {
+		__pcm_l = alloc_pcm( resident_frames );
+		__pcm_r = ( is_mono() ? __pcm_l : alloc_pcm( resident_frames ) );
+		deinterleave( pcm_buffer, sound_info.channels, resident_frames, __pcm_l, __pcm_r );
+	} else {
+		__data_l = alloc_data( resident_frames );
+		__data_r = ( is_mono() ? __data_l : alloc_data( resident_frames ) );
+		deinterleave( buffer, sound_info.channels, resident_frames, __data_l, __data_r );
 	}
 	delete[] buffer;
+	delete[] pcm_buffer;
+	return true;
 }
 
-bool Sample::apply_loops( const Loops& lo )
+/**
+ * blackman windowed sinc weights of the load time resampler, row p holds the 2*RESAMPLE_HALF_TAPS
+ * weights of the input frames around the fractional position p/RESAMPLE_PHASES
+ * \param cutoff the cutoff frequency relative to the input nyquist frequency
+ */
+static float* resample_table( double cutoff )
 {
-	if( __loops == lo ) return true;
-	if( lo.start_frame<0 ) {
-		ERRORLOG( QString( "start_frame %1 < 0 is not allowed" ).arg( lo.start_frame ) );
-		return false;
-	}
-	if( lo.loop_frame<lo.start_frame ) {
-		ERRORLOG( QString( "loop_frame %1 < start_frame %2 is not allowed" ).arg( lo.loop_frame ).arg( lo.start_frame ) );
-		return false;
-	}
-	if( lo.end_frame<lo.loop_frame ) {
-		ERRORLOG( QString( "end_frame %1 < loop_frame %2 is not allowed" ).arg( lo.end_frame ).arg( lo.loop_frame ) );
-		return false;
+	int taps = 2 * RESAMPLE_HALF_TAPS;
+	float* table = new float[ ( RESAMPLE_PHASES + 1 ) * taps ];
+	for ( int p=0; p<=RESAMPLE_PHASES; p++ ) {
+		float* row = table + p * taps;
+		double mu = ( double )p / RESAMPLE_PHASES;
+		double sum = 0;
+		for ( int t=0; t<taps; t++ ) {
+			double x = t - ( RESAMPLE_HALF_TAPS - 1 ) - mu;
+			double window = 0.42 + 0.5 * cos( M_PI * x / RESAMPLE_HALF_TAPS ) + 0.08 * cos( 2 * M_PI * x / RESAMPLE_HALF_TAPS );
+			double sinc = ( x == 0 ? cutoff : sin( M_PI * cutoff * x ) / ( M_PI * x ) );
+			row[t] = window * sinc;
+			sum += row[t];
+		}
+		// unity gain at every phase
+		for ( int t=0; t<taps; t++ ) row[t] /= sum;
 	}
-	if( lo.end_frame>__frames ) {
-		ERRORLOG( QString( "end_frame %1 > __frames %2 is not allowed" ).arg( lo.end_frame ).arg( __frames ) );
-		return false;
+	return table;
+}
+
+/** resample the \a frames of \a in into the \a new_frames of \a out, reading \a step input frames per output frame */
+static void resample_channel( const float* in, int frames, float* out, int new_frames, double step, const float* table )
+{
+	int taps = 2 * RESAMPLE_HALF_TAPS;
+	for ( int i=0; i<new_frames; i++ ) {
+		double pos = i * step;
+		int idx = ( int )pos;
+		double phase = ( pos - idx ) * RESAMPLE_PHASES;
+		int p = ( int )phase;
+		float f = phase - p;
+		const float* row_a = table + p * taps;
+		const float* row_b = row_a + taps;
+		int first = idx - ( RESAMPLE_HALF_TAPS - 1 );
+		int t_min = ( first < 0 ? -first : 0 );
+		int t_max = ( first + taps > frames ? frames - first : taps );
+		float v = 0;
+		for ( int t=t_min; t<t_max; t++ ) v += in[first + t] * ( row_a[t] + f * ( row_b[t] - row_a[t] ) );
+		out[i] = v;
 	}
-	if( lo.count<0 ) {
-		ERRORLOG( QString( "count %1 < 0 is not allowed" ).arg( lo.count ) );
-		return false;
+}
+
+void Sample::__convert_rate( int rate )
+{
+	bool compact = is_compact();
+	__detach();
+	double step = ( double )__sample_rate / rate;
+	int frames = ( int )ceil( __frames / step );
+	// below the lower of both nyquist frequencies
+	float* table = resample_table( ( step > 1.0 ? 1.0 / step : 1.0 ) * RESAMPLE_BANDWIDTH );
+	float* data_l = alloc_data( frames );
+	float* data_r = ( is_mono() ? data_l : alloc_data( frames ) );
+	resample_channel( __data_l, __frames, data_l, frames, step, table );
+	if ( !is_mono() ) resample_channel( __data_r, __frames, data_r, frames, step, table );
+	delete[] table;
+	__free_data();
+	__data_l = data_l;
+	__data_r = data_r;
+	__frames = __resident_frames = frames;
+	__sample_rate = rate;
+	if ( compact ) __compact();
+}
+
+/** round \a data to 16 bit integers, clipping what the conversion pushed beyond full scale */
+static void compact_channel( const float* data, int frames, short* pcm )
+{
+	for ( int i=0; i<frames; i++ ) {
+		float v = floorf( data[i] * 32768.0f + 0.5f );
+		if ( v > 32767.0f ) v = 32767.0f;
+		if ( v < -32768.0f ) v = -32768.0f;
+		pcm[i] = ( short )v;
 	}
-	//if( lo == __loops ) return true;
+}
+
+void Sample::__compact()
+{
+	__detach();
+	short* pcm_l = alloc_pcm( __resident_frames );
+	short* pcm_r = ( is_mono() ? pcm_l : alloc_pcm( __resident_frames ) );
+	compact_channel( __data_l, __resident_frames, pcm_l );
+	if ( !is_mono() ) compact_channel( __data_r, __resident_frames, pcm_r );
+	__free_data();
+	__data_l = __data_r = 0;
+	__pcm_l = pcm_l;
+	__pcm_r = pcm_r;
+}
 
+/** copy the frames of a channel through the loop transformation, \a new_data holds \a new_length frames */
+static void loop_channel( const Sample::Loops& lo, const float* data, float* new_data, int new_length )
+{
 	bool full_loop = lo.start_frame==lo.loop_frame;
 	int full_length =  lo.end_frame - lo.start_frame;
 	int loop_length =  lo.end_frame - lo.loop_frame;
-	int new_length = full_length + loop_length * lo.count;
-
-	float* new_data_l = new float[ new_length ];
-	float* new_data_r = new float[ new_length ];
 
 	// copy full_length frames to new_data
-	if ( lo.mode==Loops::REVERSE && ( lo.count==0 || full_loop ) ) {
+	if ( lo.mode==Sample::Loops::REVERSE && ( lo.count==0 || full_loop ) ) {
 		if( full_loop ) {
 			// copy end => start
-			for( int i=0, j=lo.end_frame; i<full_length; i++, j-- ) new_data_l[i]=__data_l[j];
-			for( int i=0, j=lo.end_frame; i<full_length; i++, j-- ) new_data_r[i]=__data_r[j];
+			for( int i=0, j=lo.end_frame; i<full_length; i++, j-- ) new_data[i]=data[j];
 		} else {
 			// copy start => loop
 			int to_loop = lo.loop_frame - lo.start_frame;
-			memcpy( new_data_l, __data_l+lo.start_frame, sizeof( float )*to_loop );
-			memcpy( new_data_r, __data_r+lo.start_frame, sizeof( float )*to_loop );
+			memcpy( new_data, data+lo.start_frame, sizeof( float )*to_loop );
 			// copy end => loop
-			for( int i=to_loop, j=lo.end_frame; i<full_length; i++, j-- ) new_data_l[i]=__data_l[j];
-			for( int i=to_loop, j=lo.end_frame; i<full_length; i++, j-- ) new_data_r[i]=__data_r[j];
+			for( int i=to_loop, j=lo.end_frame; i<full_length; i++, j-- ) new_data[i]=data[j];
 		}
 	} else {
 		// copy start => end
-		memcpy( new_data_l, __data_l+lo.start_frame, sizeof( float )*full_length );
-		memcpy( new_data_r, __data_r+lo.start_frame, sizeof( float )*full_length );
+		memcpy( new_data, data+lo.start_frame, sizeof( float )*full_length );
 	}
 	// copy the loops
 	if( lo.count>0 ) {
 		int x = full_length;
-		bool forward = ( lo.mode==Loops::FORWARD );
-		bool ping_pong = ( lo.mode==Loops::PINGPONG );
+		bool forward = ( lo.mode==Sample::Loops::FORWARD );
+		bool ping_pong = ( lo.mode==Sample::Loops::PINGPONG );
 		for( int i=0; i<lo.count; i++ ) {
 			if ( forward ) {
 				// copy loop => end
-				memcpy( &new_data_l[x], __data_l+lo.loop_frame, sizeof( float )*loop_length );
-				memcpy( &new_data_r[x], __data_r+lo.loop_frame, sizeof( float )*loop_length );
+				memcpy( &new_data[x], data+lo.loop_frame, sizeof( float )*loop_length );
 			} else {
 				// copy end => loop
-				for( int i=lo.end_frame, y=x; i>lo.loop_frame; i--, y++ ) new_data_l[y]=__data_l[i];
-				for( int i=lo.end_frame, y=x; i>lo.loop_frame; i--, y++ ) new_data_r[y]=__data_r[i];
+				for( int i=lo.end_frame, y=x; i>lo.loop_frame; i--, y++ ) new_data[y]=data[i];
 			}
 			x+=loop_length;
 			if( ping_pong ) forward=!forward;
 		}
 		assert( x==new_length );
 	}
+}
+
+bool Sample::apply_loops( const Loops& lo )
+{
+	if( __loops == lo ) return true;
+	if( lo.start_frame<0 ) {
+		ERRORLOG( QString( "start_frame %1 < 0 is not allowed" ).arg( lo.start_frame ) );
+		return false;
+	}
+	if( lo.loop_frame<lo.start_frame ) {
+		ERRORLOG( QString( "loop_frame %1 < start_frame %2 is not allowed" ).arg( lo.loop_frame ).arg( lo.start_frame ) );
+		return false;
+	}
+	if( lo.end_frame<lo.loop_frame ) {
+		ERRORLOG( QString( "end_frame %1 < loop_frame %2 is not allowed" ).arg( lo.end_frame ).arg( lo.loop_frame ) );
+		return false;
+	}
+	if( lo.end_frame>__frames ) {
+		ERRORLOG( QString( "end_frame %1 > __frames %2 is not allowed" ).arg( lo.end_frame ).arg( __frames ) );
+		return false;
+	}
+	if( lo.count<0 ) {
+		ERRORLOG( QString( "count %1 < 0 is not allowed" ).arg( lo.count ) );
+		return false;
+	}
+	//if( lo == __loops ) return true;
+
+	int new_length = lo.end_frame - lo.start_frame + ( lo.end_frame - lo.loop_frame ) * lo.count;
+	float* new_data_l = alloc_data( new_length );
+	loop_channel( lo, __data_l, new_data_l, new_length );
+	float* new_data_r = new_data_l;
+	if( !is_mono() ) {
+		new_data_r = alloc_data( new_length );
+		loop_channel( lo, __data_r, new_data_r, new_length );
+	}
 	__loops = lo;
-	delete __data_l;
-	delete __data_r;
+	__free_data();
 	__data_l = new_data_l;
 	__data_r = new_data_r;
-	__frames = new_length;
+	__frames = __resident_frames = new_length;
 	__is_modified = true;
 	return true;
 }
@@ -255,6 +577,7 @@ void Sample::apply_velocity( const VelocityEnvelope& v )
 	if( v.empty() && __velocity_envelope.empty() ) return;
 	__velocity_envelope.clear();
 	if ( v.size() > 0 ) {
+		__detach();
 		float inv_resolution = __frames / 841.0F;
 		for ( int i = 1; i < v.size(); i++ ) {
 			float y = ( 91 - v[i - 1].value ) / 91.0F;
@@ -266,7 +589,7 @@ void Sample::apply_velocity( const VelocityEnvelope& v )
 			float step = ( y - k ) / length;;
 			for ( int z = start_frame ; z < end_frame; z++ ) {
 				__data_l[z] = __data_l[z] * y;
-				__data_r[z] = __data_r[z] * y;
+				if( !is_mono() ) __data_r[z] = __data_r[z] * y;
 				y-=step;
 			}
 		}
@@ -281,6 +604,8 @@ void Sample::apply_pan( const PanEnvelope& p )
 	if( p.empty() && __pan_envelope.empty() ) return;
 	__pan_envelope.clear();
 	if ( p.size() > 0 ) {
+		// the pan changes the channels apart
+		__split_channels();
 		float inv_resolution = __frames / 841.0F;
 		for ( int i = 1; i < p.size(); i++ ) {
 			float y = ( 45 - p[i - 1].value ) / 45.0F;
@@ -412,17 +737,17 @@ void Sample::apply_rubberband( const Rubberband& rb )
 
 	// DEBUGLOG( QString( "%1 frames processed, %2 frames retrieved" ).arg( __frames ).arg( retrieved ) );
 	// final data buffers
-	delete __data_l;
-	delete __data_r;
-	__data_l = new float[ retrieved ];
-	__data_r = new float[ retrieved ];
+	__free_data();
+	__data_l = alloc_data( retrieved );
+	__data_r = alloc_data( retrieved );
 	memcpy( __data_l, out_data_l, retrieved*sizeof( float ) );
 	memcpy( __data_r, out_data_r, retrieved*sizeof( float ) );
 	delete out_data_l;
 	delete out_data_r;
 	// update sample
+	__channels = 2;
 	__rubberband = rb;
-	__frames = retrieved;
+	__frames = __resident_frames = retrieved;
 	__is_modified = true;
 #endif
 }
@@ -475,17 +800,21 @@ bool Sample::exec_rubberband_cli( const Rubberband& rb )
 			return false;
 		}
 
-		Sample* rubberbanded = Sample::load( rubberResultPath.toLocal8Bit() );
-		if( rubberbanded==0 ) {
+		// a temporary file, decoded apart from the SamplePool
+		Sample* rubberbanded = new Sample( rubberResultPath );
+		if( !rubberbanded->__decode( false, false ) ) {
+			delete rubberbanded;
 			return false;
 		}
 		if( QFile( outfilePath ).remove() );
 //			_INFOLOG("remove outfile");
 		if( QFile( rubberResultPath ).remove() );
 //			_INFOLOG("remove rubberResultFile");
-		__frames = rubberbanded->get_frames();
+		__free_data();
+		__frames = __resident_frames = rubberbanded->get_frames();
 		__data_l = rubberbanded->get_data_l();
 		__data_r = rubberbanded->get_data_r();
+		__channels = rubberbanded->get_channels();
 		rubberbanded->__data_l = 0;
 		rubberbanded->__data_r = 0;
 		__is_modified = true;
@@ -506,10 +835,14 @@ Sample::Loops::LoopMode Sample::parse_loop_mode( const QString& string )
 
 bool Sample::write( const QString& path, int format )
 {
+	if ( is_streamed() ) {
+		___ERRORLOG( QString( "%1 is streamed, its frames are not all in memory" ).arg( __filepath ) );
+		return false;
+	}
 	float* obuf = new float[ SAMPLE_CHANNELS * __frames ];
 	for ( int i = 0; i < __frames; ++i ) {
-		float value_l = __data_l[i];
-		float value_r = __data_r[i];
+		float value_l = get_value_l( i );
+		float value_r = get_value_r( i );
 		if ( value_l > 1.f ) value_l = 1.f;
 		else if ( value_l < -1.f ) value_l = -1.f;
 		else if ( value_r > 1.f ) value_r = 1.f;
@@ -0,0 +1,240 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <hydrogen/basics/sample_cache.h>
+
+#include <cstdio>
+#include <cstring>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+#include <hydrogen/Preferences.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/helpers/filesystem.h>
+
+#define SAMPLE_CACHE_VERSION    4
+#define SAMPLE_CACHE_SUFFIX     ".h2pcm"
+
+namespace H2Core
+{
+
+const char* SampleCache::__class_name = "SampleCache";
+QMutex SampleCache::__mutex;
+
+QString SampleCache::__cache_file( const QString& filepath, int rate, bool compact )
+{
+	QByteArray key = QCryptographicHash::hash( QFileInfo( filepath ).absoluteFilePath().toUtf8(), QCryptographicHash::Md5 ).toHex();
+	// the variants of a file live side by side, switching the rate or the compact option back finds them again
+	return Filesystem::sample_cache_dir() + "/" + QString( key ) + QString( "-%1%2" ).arg( rate ).arg( compact ? "c" : "" ) + SAMPLE_CACHE_SUFFIX;
+}
+
+size_t SampleCache::__file_size( int frames, int channels, int frame_size )
+{
+	return sizeof( Header ) + ( channels * ( size_t )frames + ( channels + 1 ) * SAMPLE_GUARD_FRAMES ) * frame_size;
+}
+
+/** return a copy of the \a frames frames of \a channel in a channel allocated like Sample::alloc_data() or Sample::alloc_pcm() */
+template<typename T>
+static T* copy_channel( const T* channel, int frames, T* ( *alloc )( int ) )
+{
+	T* copy = alloc( frames );
+	memcpy( copy, channel, frames * sizeof( T ) );
+	return copy;
+}
+
+bool SampleCache::map( const QString& filepath, int rate, bool compact, int* frames, int* sample_rate, int* channels, float** data_l, float** data_r, short** pcm_l, short** pcm_r, void** mapping, size_t* mapping_size )
+{
+#ifdef WIN32
+	return false;
+#else
+	if ( Preferences::get_instance()->m_nSampleCacheSize <= 0 ) return false;
+	QByteArray path = __cache_file( filepath, rate, compact ).toLocal8Bit();
+	int fd = ::open( path.constData(), O_RDONLY );
+	if ( fd < 0 ) return false;
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || ( size_t )st.st_size < sizeof( Header ) ) {
+		::close( fd );
+		return false;
+	}
+	int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+	// read the whole file now rather than on the first page faults
+	flags |= MAP_POPULATE;
+#endif
+	void* addr = mmap( 0, st.st_size, PROT_READ, flags, fd, 0 );
+	::close( fd );
+	if ( addr == MAP_FAILED ) return false;
+
+	// a changed sample file, or frames at another rate, are decoded again, store() replaces the stale file
+	const Header* header = ( const Header* )addr;
+	QFileInfo source( filepath );
+	if ( memcmp( header->magic, "H2SC", 4 ) != 0
+		 || header->version != SAMPLE_CACHE_VERSION
+		 || header->frames < 0
+		 || ( header->channels != 1 && header->channels != 2 )
+		 || ( header->frame_size != ( int )sizeof( float ) && !( compact && header->frame_size == ( int )sizeof( short ) ) )
+		 || __file_size( header->frames, header->channels, header->frame_size ) != ( size_t )st.st_size
+		 || header->source_size != source.size()
+		 || header->source_time != ( long long )source.lastModified().toTime_t()
+		 || header->sample_rate != ( rate ? rate : header->source_rate ) ) {
+		munmap( addr, st.st_size );
+		return false;
+	}
+	// the modification times tell which files were used last
+	utime( path.constData(), 0 );
+
+	char* left = ( char* )addr + sizeof( Header ) + SAMPLE_GUARD_FRAMES * header->frame_size;
+	char* right = ( header->channels == 1 ? left : left + ( size_t )( header->frames + SAMPLE_GUARD_FRAMES ) * header->frame_size );
+	*frames = header->frames;
+	*sample_rate = header->sample_rate;
+	*channels = header->channels;
+	*data_l = *data_r = 0;
+	*pcm_l = *pcm_r = 0;
+	if ( header->frame_size == ( int )sizeof( short ) ) {
+		*pcm_l = ( short* )left;
+		*pcm_r = ( short* )right;
+	} else {
+		*data_l = ( float* )left;
+		*data_r = ( float* )right;
+	}
+	*mapping = addr;
+	*mapping_size = st.st_size;
+
+#ifdef MADV_WILLNEED
+	madvise( addr, st.st_size, MADV_WILLNEED );
+#endif
+	// the audio thread must not page fault, or wait for the pages to be read again
+	if ( mlock( addr, st.st_size ) != 0 ) {
+		// samples are loaded by several threads
+		static QAtomicInt warned( 0 );
+		if ( warned.testAndSetOrdered( 0, 1 ) ) {
+			_WARNINGLOG( "unable to lock cached samples in memory, copying them instead" );
+		}
+		if ( *pcm_l ) {
+			*pcm_l = copy_channel( *pcm_l, *frames, Sample::alloc_pcm );
+			*pcm_r = ( *channels == 1 ? *pcm_l : copy_channel( *pcm_r, *frames, Sample::alloc_pcm ) );
+		} else {
+			*data_l = copy_channel( *data_l, *frames, Sample::alloc_data );
+			*data_r = ( *channels == 1 ? *data_l : copy_channel( *data_r, *frames, Sample::alloc_data ) );
+		}
+		munmap( addr, st.st_size );
+		*mapping = 0;
+		*mapping_size = 0;
+	}
+	return true;
+#endif
+}
+
+void SampleCache::unmap( void* mapping, size_t mapping_size )
+{
+#ifndef WIN32
+	// unlocked as well
+	munmap( mapping, mapping_size );
+#endif
+}
+
+void SampleCache::store( const QString& filepath, int rate, bool compact, int frames, int sample_rate, int source_rate, int channels, const float* data_l, const float* data_r, const short* pcm_l, const short* pcm_r )
+{
+#ifndef WIN32
+	int frame_size = ( pcm_l ? sizeof( short ) : sizeof( float ) );
+	const char* left = ( pcm_l ? ( const char* )pcm_l : ( const char* )data_l );
+	const char* right = ( pcm_l ? ( const char* )pcm_r : ( const char* )data_r );
+	long long max_size = ( long long )Preferences::get_instance()->m_nSampleCacheSize * 1024 * 1024;
+	if ( max_size <= 0 || ( long long )__file_size( frames, channels, frame_size ) > max_size ) return;
+
+	Header header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, "H2SC", 4 );
+	header.version = SAMPLE_CACHE_VERSION;
+	header.frames = frames;
+	header.sample_rate = sample_rate;
+	header.channels = channels;
+	header.source_rate = source_rate;
+	header.frame_size = frame_size;
+	QFileInfo source( filepath );
+	header.source_size = source.size();
+	header.source_time = source.lastModified().toTime_t();
+	float zeros[ SAMPLE_GUARD_FRAMES ];
+	memset( zeros, 0, sizeof( zeros ) );
+	qint64 guard_size = SAMPLE_GUARD_FRAMES * frame_size;
+	qint64 data_size = ( qint64 )frames * frame_size;
+
+	QMutexLocker lock( &__mutex );
+	if ( !Filesystem::path_usable( Filesystem::sample_cache_dir(), true, true ) ) {
+		_ERRORLOG( QString( "unable to use %1" ).arg( Filesystem::sample_cache_dir() ) );
+		return;
+	}
+	// written aside then renamed, a mapped file is never rewritten
+	QString path = __cache_file( filepath, rate, compact );
+	QString tmp_path = path + ".tmp";
+	QFile file( tmp_path );
+	if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
+		_ERRORLOG( QString( "unable to write %1" ).arg( tmp_path ) );
+		return;
+	}
+	bool ok = file.write( ( const char* )&header, sizeof( header ) ) == sizeof( header )
+			  && file.write( ( const char* )zeros, guard_size ) == guard_size
+			  && file.write( left, data_size ) == data_size
+			  && file.write( ( const char* )zeros, guard_size ) == guard_size
+			  && ( channels == 1
+				   || ( file.write( right, data_size ) == data_size
+						&& file.write( ( const char* )zeros, guard_size ) == guard_size ) );
+	file.close();
+	if ( !ok || ::rename( tmp_path.toLocal8Bit().constData(), path.toLocal8Bit().constData() ) != 0 ) {
+		_ERRORLOG( QString( "unable to cache %1 in %2" ).arg( filepath ).arg( path ) );
+		QFile::remove( tmp_path );
+		return;
+	}
+	__evict( max_size );
+#endif
+}
+
+void SampleCache::__evict( long long max_size )
+{
+	// most recently used first
+	QList<QFileInfo> files = QDir( Filesystem::sample_cache_dir() ).entryInfoList( QStringList( "*" SAMPLE_CACHE_SUFFIX ), QDir::Files, QDir::Time );
+	long long size = 0;
+	for ( int i=0; i<files.size(); i++ ) {
+		size += files[i].size();
+		if ( size > max_size ) {
+			_INFOLOG( QString( "evict %1" ).arg( files[i].fileName() ) );
+			QFile::remove( files[i].absoluteFilePath() );
+		}
+	}
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
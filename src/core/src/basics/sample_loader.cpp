@@ -0,0 +1,160 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/basics/sample_loader.h>
+
+#include <pthread.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include <hydrogen/Preferences.h>
+
+namespace H2Core
+{
+
+const char* SampleLoader::__class_name = "SampleLoader";
+
+SampleLoader::SampleLoader() : Object( __class_name ),
+	__next_job( 0 )
+{
+}
+
+SampleLoader::~SampleLoader()
+{
+	for ( unsigned i=0; i<__jobs.size(); i++ ) {
+		if ( !__jobs[i].in_place ) delete __jobs[i].sample;
+	}
+}
+
+int SampleLoader::add( const QString& filepath, bool for_playback )
+{
+	Job job;
+	job.filepath = filepath;
+	job.for_playback = for_playback;
+	job.transformed = false;
+	job.sample = 0;
+	job.in_place = false;
+	__jobs.push_back( job );
+	return __jobs.size() - 1;
+}
+
+int SampleLoader::add( const QString& filepath, const Sample::Loops& loops, const Sample::Rubberband& rubber, const Sample::VelocityEnvelope& velocity, const Sample::PanEnvelope& pan )
+{
+	Job job;
+	job.filepath = filepath;
+	job.for_playback = false;
+	job.transformed = true;
+	job.loops = loops;
+	job.rubberband = rubber;
+	job.velocity = velocity;
+	job.pan = pan;
+	job.sample = 0;
+	job.in_place = false;
+	__jobs.push_back( job );
+	return __jobs.size() - 1;
+}
+
+int SampleLoader::add( Sample* sample, bool for_playback )
+{
+	Job job;
+	job.filepath = sample->get_filepath();
+	job.for_playback = for_playback;
+	job.transformed = false;
+	job.sample = sample;
+	job.in_place = true;
+	__jobs.push_back( job );
+	return __jobs.size() - 1;
+}
+
+Sample* SampleLoader::take( int job )
+{
+	Sample* sample = __jobs[job].sample;
+	if ( !__jobs[job].in_place ) __jobs[job].sample = 0;
+	return sample;
+}
+
+void SampleLoader::__load( Job& job )
+{
+	if ( job.in_place ) {
+		job.sample->load( job.for_playback );
+	} else if ( job.transformed ) {
+		job.sample = Sample::load( job.filepath, job.loops, job.rubberband, job.velocity, job.pan );
+	} else {
+		job.sample = Sample::load( job.filepath, job.for_playback );
+	}
+}
+
+void SampleLoader::__work()
+{
+	int n = __jobs.size();
+	for ( int i = __next_job.fetchAndAddOrdered( 1 ); i < n; i = __next_job.fetchAndAddOrdered( 1 ) ) {
+		Job& job = __jobs[i];
+		// left to the calling thread, see run()
+		if ( job.transformed && job.rubberband.use ) continue;
+		__load( job );
+	}
+}
+
+void* SampleLoader::__worker_thread( void* param )
+{
+	( ( SampleLoader* )param )->__work();
+	return 0;
+}
+
+void SampleLoader::run()
+{
+	if ( __jobs.empty() ) return;
+	int threads = Preferences::get_instance()->m_nLoaderThreads;
+	if ( threads < 1 ) {
+#ifndef WIN32
+		// one per core
+		threads = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+		if ( threads < 1 ) threads = 1;
+	}
+	if ( threads > SAMPLE_LOADER_MAX_THREADS ) threads = SAMPLE_LOADER_MAX_THREADS;
+	if ( threads > ( int )__jobs.size() ) threads = __jobs.size();
+
+	__next_job.fetchAndStoreOrdered( 0 );
+	// the calling thread works as well
+	std::vector<pthread_t> workers;
+	for ( int i = 1; i < threads; i++ ) {
+		pthread_t thread;
+		if ( pthread_create( &thread, 0, __worker_thread, this ) != 0 ) {
+			ERRORLOG( QString( "Can't create loader thread %1" ).arg( i ) );
+			break;
+		}
+		workers.push_back( thread );
+	}
+	__work();
+	for ( unsigned i = 0; i < workers.size(); i++ ) pthread_join( workers[i], 0 );
+
+	for ( unsigned i = 0; i < __jobs.size(); i++ ) {
+		if ( __jobs[i].transformed && __jobs[i].rubberband.use ) __load( __jobs[i] );
+	}
+	INFOLOG( QString( "%1 samples loaded by %2 threads" ).arg( __jobs.size() ).arg( workers.size() + 1 ) );
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -0,0 +1,175 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/basics/sample_pool.h>
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
+
+#include <hydrogen/basics/sample_cache.h>
+
+namespace H2Core
+{
+
+const char* SamplePool::__class_name = "SamplePool";
+QMutex SamplePool::__mutex;
+std::vector<SampleBuffer*> SamplePool::__buffers;
+
+static bool same_envelope( const std::vector<Sample::EnvelopePoint>& a, const std::vector<Sample::EnvelopePoint>& b )
+{
+	if ( a.size()!=b.size() ) return false;
+	for ( int i=0; i<a.size(); i++ ) {
+		if ( a[i].frame!=b[i].frame || a[i].value!=b[i].value ) return false;
+	}
+	return true;
+}
+
+SampleBuffer::SampleBuffer( const QString& filepath, bool streamed, bool compact, int rate, const Sample::Loops& loops, const Sample::VelocityEnvelope& velocity, const Sample::PanEnvelope& pan ) :
+	filepath( filepath ),
+	streamed( streamed ),
+	compact( compact ),
+	rate( rate ),
+	loops( loops ),
+	velocity( velocity ),
+	pan( pan ),
+	frames( 0 ),
+	resident_frames( 0 ),
+	sample_rate( 0 ),
+	channels( 2 ),
+	data_l( 0 ),
+	data_r( 0 ),
+	pcm_l( 0 ),
+	pcm_r( 0 ),
+	mapping( 0 ),
+	mapping_size( 0 ),
+	is_modified( false ),
+	refs( 1 )
+{
+	QFileInfo source( filepath );
+	source_size = source.size();
+	source_time = source.lastModified().toTime_t();
+}
+
+SampleBuffer::~SampleBuffer()
+{
+	if ( mapping ) {
+		SampleCache::unmap( mapping, mapping_size );
+	} else {
+		Sample::free_data( data_l, data_r );
+		Sample::free_pcm( pcm_l, pcm_r );
+	}
+}
+
+bool SamplePool::__matches( const SampleBuffer* buffer, const QString& filepath, bool streamed, bool compact, int rate, const Sample::Loops& loops, const Sample::VelocityEnvelope& velocity, const Sample::PanEnvelope& pan )
+{
+	return ( buffer->streamed==streamed
+			 && buffer->compact==compact
+			 && buffer->rate==rate
+			 && buffer->filepath==filepath
+			 && buffer->loops==loops
+			 && same_envelope( buffer->velocity, velocity )
+			 && same_envelope( buffer->pan, pan ) );
+}
+
+SampleBuffer* SamplePool::acquire( const QString& filepath, bool streamed, bool compact, int rate, const Sample::Loops& loops, const Sample::VelocityEnvelope& velocity, const Sample::PanEnvelope& pan )
+{
+	QFileInfo source( filepath );
+	long long source_size = source.size();
+	long long source_time = source.lastModified().toTime_t();
+	QMutexLocker lock( &__mutex );
+	for ( int i=0; i<__buffers.size(); i++ ) {
+		SampleBuffer* buffer = __buffers[i];
+		if ( !__matches( buffer, filepath, streamed, compact, rate, loops, velocity, pan ) ) continue;
+		// edited on disk, the buffer stays with the samples already using it
+		if ( buffer->source_size!=source_size || buffer->source_time!=source_time ) continue;
+		buffer->refs++;
+		return buffer;
+	}
+	return 0;
+}
+
+SampleBuffer* SamplePool::share( SampleBuffer* buffer )
+{
+	QMutexLocker lock( &__mutex );
+	for ( int i=0; i<__buffers.size(); i++ ) {
+		SampleBuffer* other = __buffers[i];
+		if ( !__matches( other, buffer->filepath, buffer->streamed, buffer->compact, buffer->rate, buffer->loops, buffer->velocity, buffer->pan ) ) continue;
+		if ( other->source_size!=buffer->source_size || other->source_time!=buffer->source_time ) continue;
+		// loaded by another thread meanwhile
+		other->refs++;
+		delete buffer;
+		return other;
+	}
+	__buffers.push_back( buffer );
+	return buffer;
+}
+
+void SamplePool::retain( SampleBuffer* buffer )
+{
+	QMutexLocker lock( &__mutex );
+	buffer->refs++;
+}
+
+void SamplePool::release( SampleBuffer* buffer )
+{
+	QMutexLocker lock( &__mutex );
+	if ( --buffer->refs > 0 ) return;
+	for ( int i=0; i<__buffers.size(); i++ ) {
+		if ( __buffers[i]==buffer ) {
+			__buffers.erase( __buffers.begin() + i );
+			break;
+		}
+	}
+	delete buffer;
+}
+
+int SamplePool::get_buffer_count()
+{
+	QMutexLocker lock( &__mutex );
+	return __buffers.size();
+}
+
+int SamplePool::get_mono_buffer_count()
+{
+	QMutexLocker lock( &__mutex );
+	int count = 0;
+	for ( int i=0; i<__buffers.size(); i++ ) {
+		if ( __buffers[i]->channels==1 ) count++;
+	}
+	return count;
+}
+
+long long SamplePool::get_size()
+{
+	QMutexLocker lock( &__mutex );
+	long long size = 0;
+	for ( int i=0; i<__buffers.size(); i++ ) {
+		SampleBuffer* buffer = __buffers[i];
+		size += ( long long )buffer->resident_frames * ( buffer->pcm_l ? sizeof( short ) : sizeof( float ) ) * buffer->channels;
+	}
+	return size;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
@@ -25,6 +25,7 @@
 #include <cassert>
 
 #include <hydrogen/basics/adsr.h>
+#include <hydrogen/basics/bus.h>
 #include <hydrogen/LocalFileMng.h>
 #include <hydrogen/Preferences.h>
 
@@ -32,6 +33,7 @@
 #include <hydrogen/globals.h>
 #include <hydrogen/basics/song.h>
 #include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/sample_loader.h>
 #include <hydrogen/basics/instrument.h>
 #include <hydrogen/basics/instrument_list.h>
 #include <hydrogen/basics/instrument_layer.h>
@@ -66,6 +68,7 @@ Song::Song( const QString& name, const QString& author, float bpm, float volume
 	, __pattern_list( NULL )
 	, __pattern_group_sequence( NULL )
 	, __instrument_list( NULL )
+	, __bus_count( 0 )
 	, __filename( "" )
 	, __is_loop_enabled( false )
 	, __humanize_time_value( 0.0 )
@@ -74,6 +77,7 @@ Song::Song( const QString& name, const QString& author, float bpm, float volume
 	, __song_mode( PATTERN_MODE )
 {
 	INFOLOG( QString( "INIT '%1'" ).arg( __name ) );
+	for ( int i = 0; i < MAX_BUSES; ++i ) __buses[i] = NULL;
 
 	//m_bDelayFXEnabled = false;
 	//m_fDelayFXWetLevel = 0.8;
@@ -99,9 +103,27 @@ Song::~Song()
 
 	delete __instrument_list;
 
+	for ( int i = 0; i < __bus_count; ++i ) {
+		delete __buses[i];
+	}
+
 	INFOLOG( QString( "DESTROY '%1'" ).arg( __name ) );
 }
 
+int Song::add_bus( Bus* bus )
+{
+	if ( __bus_count >= MAX_BUSES ) {
+		ERRORLOG( QString( "Too many buses, '%1' not added" ).arg( bus->get_name() ) );
+		delete bus;
+		return -1;
+	}
+	__buses[__bus_count] = bus;
+	++__bus_count;
+	// the sampler caches the bus of the playing notes
+	InstrumentList::bump_generation();
+	return __bus_count - 1;
+}
+
 void Song::purge_instrument( Instrument* I )
 {
 	for ( int nPattern = 0; nPattern < ( int )__pattern_list->size(); ++nPattern ) {
@@ -109,6 +131,13 @@ void Song::purge_instrument( Instrument* I )
 	}
 }
 
+void Song::find_replacements( const std::map<Instrument*, Instrument*>& replacements, std::vector<Note*>& notes, std::vector<Instrument*>& instruments ) const
+{
+	for ( int nPattern = 0; nPattern < ( int )__pattern_list->size(); ++nPattern ) {
+		__pattern_list->get( nPattern )->find_replacements( replacements, notes, instruments );
+	}
+}
+
 
 ///Load a song from file
 Song* Song::load( const QString& filename )
@@ -157,9 +186,7 @@ Song* Song::get_default_song()
 	pList->add( pNewInstr );
 	song->set_instrument_list( pList );
 
-#ifdef H2CORE_HAVE_JACK
 	Hydrogen::get_instance()->renameJackPorts();
-#endif
 
 	PatternList* patternList = new PatternList();
 	Pattern* emptyPattern = new Pattern();
@@ -420,6 +447,24 @@ Song* SongReader::readSong( const QString& filename )
 	song->set_humanize_velocity_value( fHumanizeVelocityValue );
 	song->set_swing_factor( fSwingFactor );
 
+	// Bus list
+	QDomNode busListNode = songNode.firstChildElement( "busList" );
+	if ( ! busListNode.isNull() ) {
+		QDomNode busNode = busListNode.firstChildElement( "bus" );
+		while ( ! busNode.isNull() ) {
+			Bus* pBus = new Bus( LocalFileMng::readXmlString( busNode, "name", "Bus" ) );
+			pBus->set_volume( LocalFileMng::readXmlFloat( busNode, "volume", 1.0 ) );
+			pBus->set_muted( LocalFileMng::readXmlBool( busNode, "isMuted", false ) );
+			pBus->set_pan_l( LocalFileMng::readXmlFloat( busNode, "pan_L", 1.0 ) );
+			pBus->set_pan_r( LocalFileMng::readXmlFloat( busNode, "pan_R", 1.0 ) );
+			for ( int nFX = 0; nFX < MAX_FX; ++nFX ) {
+				pBus->set_fx_level( LocalFileMng::readXmlFloat( busNode, QString( "FX%1Level" ).arg( nFX + 1 ), 0.0 ), nFX );
+			}
+			song->add_bus( pBus );
+			busNode = busNode.nextSiblingElement( "bus" );
+		}
+	}
+
 
 
 	/*
@@ -438,6 +483,10 @@ Song* SongReader::readSong( const QString& filename )
 	if ( ( ! instrumentListNode.isNull()  ) ) {
 		// INSTRUMENT NODE
 		int instrumentList_count = 0;
+		// the layer samples are decoded all at once, once the instruments are read
+		SampleLoader loader;
+		std::vector<InstrumentLayer*> loaderLayers;
+		std::vector<Instrument*> loaderInstruments;
 		QDomNode instrumentNode;
 		instrumentNode = instrumentListNode.firstChildElement( "instrument" );
 		while ( ! instrumentNode.isNull()  ) {
@@ -472,6 +521,9 @@ Song* SongReader::readSong( const QString& filename )
 			QString sMidiOutNote = LocalFileMng::readXmlString( instrumentNode, "midiOutNote", "60", false, false );
 			int nMuteGroup = sMuteGroup.toInt();
 			bool isStopNote = LocalFileMng::readXmlBool( instrumentNode, "isStopNote", false );
+			int nMaxVoices = LocalFileMng::readXmlInt( instrumentNode, "maxVoices", 0, false, false );
+			int nBus = LocalFileMng::readXmlInt( instrumentNode, "bus", -1, false, false );
+			QString sSampleSelection = LocalFileMng::readXmlString( instrumentNode, "sampleSelectionAlgo", "VELOCITY", false, false );
 			int nMidiOutChannel = sMidiOutChannel.toInt();
 			int nMidiOutNote = sMidiOutNote.toInt();
 
@@ -500,6 +552,15 @@ Song* SongReader::readSong( const QString& filename )
 			pInstrument->set_gain( fGain );
 			pInstrument->set_mute_group( nMuteGroup );
 			pInstrument->set_stop_notes( isStopNote );
+			pInstrument->set_max_voices( nMaxVoices );
+			pInstrument->set_bus( nBus < song->get_bus_count() ? nBus : -1 );
+			if ( sSampleSelection == "ROUND_ROBIN" ) {
+				pInstrument->set_sample_selection_alg( Instrument::ROUND_ROBIN );
+			} else if ( sSampleSelection == "RANDOM" ) {
+				pInstrument->set_sample_selection_alg( Instrument::RANDOM );
+			} else {
+				pInstrument->set_sample_selection_alg( Instrument::VELOCITY );
+			}
 			pInstrument->set_midi_out_channel( nMidiOutChannel );
 			pInstrument->set_midi_out_note( nMidiOutNote );
 
@@ -520,14 +581,14 @@ Song* SongReader::readSong( const QString& filename )
 				if ( !QFile( sFilename ).exists() && !drumkitPath.isEmpty() ) {
 					sFilename = drumkitPath + "/" + sFilename;
 				}
-				Sample* pSample = Sample::load( sFilename );
+				Sample* pSample = Sample::load( sFilename, true );
 				if ( pSample == NULL ) {
 					// nel passaggio tra 0.8.2 e 0.9.0 il drumkit di default e' cambiato.
 					// Se fallisce provo a caricare il corrispettivo file in formato flac
 //					warningLog( "[readSong] Error loading sample: " + sFilename + " not found. Trying to load a flac..." );
 					sFilename = sFilename.left( sFilename.length() - 4 );
 					sFilename += ".flac";
-					pSample = Sample::load( sFilename );
+					pSample = Sample::load( sFilename, true );
 				}
 				if ( pSample == NULL ) {
 					ERRORLOG( "Error loading sample: " + sFilename + " not found" );
@@ -575,9 +636,8 @@ Song* SongReader::readSong( const QString& filename )
 						ro.use = false;
 					}
 
-					Sample* pSample = NULL;
 					if ( !sIsModified ) {
-						pSample = Sample::load( sFilename );
+						loader.add( sFilename, true );
 					} else {
 						Sample::EnvelopePoint pt;
 
@@ -600,18 +660,18 @@ Song* SongReader::readSong( const QString& filename )
 							panNode = panNode.nextSiblingElement( "pan" );
 						}
 
-						pSample = Sample::load( sFilename, lo, ro, velocity, pan );
-					}
-					if ( pSample == NULL ) {
-						ERRORLOG( "Error loading sample: " + sFilename + " not found" );
-						pInstrument->set_muted( true );
+						loader.add( sFilename, lo, ro, velocity, pan );
 					}
+					// its sample is set once decoded
+					Sample* pSample = NULL;
 					InstrumentLayer* pLayer = new InstrumentLayer( pSample );
 					pLayer->set_start_velocity( fMin );
 					pLayer->set_end_velocity( fMax );
 					pLayer->set_gain( fGain );
 					pLayer->set_pitch( fPitch );
 					pInstrument->set_layer( pLayer, nLayer );
+					loaderLayers.push_back( pLayer );
+					loaderInstruments.push_back( pInstrument );
 					nLayer++;
 
 					layerNode = ( QDomNode ) layerNode.nextSiblingElement( "layer" );
@@ -621,6 +681,15 @@ Song* SongReader::readSong( const QString& filename )
 			instrumentList->add( pInstrument );
 			instrumentNode = ( QDomNode ) instrumentNode.nextSiblingElement( "instrument" );
 		}
+		loader.run();
+		for ( int nJob = 0; nJob < loader.size(); nJob++ ) {
+			Sample* pSample = loader.take( nJob );
+			if ( pSample == NULL ) {
+				ERRORLOG( "Error loading sample: " + loader.get_filepath( nJob ) + " not found" );
+				loaderInstruments[ nJob ]->set_muted( true );
+			}
+			loaderLayers[ nJob ]->set_sample( pSample );
+		}
 		if ( instrumentList_count == 0 ) {
 			WARNINGLOG( "0 instruments?" );
 		}
@@ -0,0 +1,187 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/command_queue.h>
+
+#include <hydrogen/basics/note.h>
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/instrument_layer.h>
+
+#include <QtCore/QMutexLocker>
+
+namespace H2Core
+{
+
+const char* CommandQueue::__class_name = "CommandQueue";
+
+CommandQueue::CommandQueue()
+		: Object( __class_name )
+		, __read_index( 0 )
+		, __write_index( 0 )
+		, __retired_read_index( 0 )
+		, __retired_write_index( 0 )
+		, __deferred_count( 0 )
+{
+}
+
+
+CommandQueue::~CommandQueue()
+{
+	collect_garbage();
+	// the audio thread is gone
+	for ( int i = 0; i < __deferred_count; ++i ) {
+		__delete_retired( __deferred[ i ] );
+	}
+}
+
+
+bool CommandQueue::push_command( const Command& cmd )
+{
+	QMutexLocker mx( &__producer_mutex );
+
+	int nWrite = __write_index;
+	int nNext = ( nWrite + 1 ) % MAX_COMMANDS;
+	if ( nNext == __read_index.fetchAndAddAcquire( 0 ) ) {
+		return false;
+	}
+	__commands[ nWrite ] = cmd;
+	// publish the slot only once it is completely written
+	__write_index.fetchAndStoreRelease( nNext );
+	return true;
+}
+
+
+bool CommandQueue::pop_command( Command& cmd )
+{
+	int nRead = __read_index;
+	if ( nRead == __write_index.fetchAndAddAcquire( 0 ) ) {
+		return false;
+	}
+	cmd = __commands[ nRead ];
+	__read_index.fetchAndStoreRelease( ( nRead + 1 ) % MAX_COMMANDS );
+	return true;
+}
+
+
+void CommandQueue::retire( RetiredType type, void* ptr )
+{
+	if ( ptr == NULL ) {
+		return;
+	}
+	Retired r;
+	r.type = type;
+	r.ptr = ptr;
+
+	// keep the retirement order, the deferred objects go first
+	flush_retired();
+	if ( __deferred_count == 0 ) {
+		int nWrite = __retired_write_index;
+		int nNext = ( nWrite + 1 ) % MAX_COMMANDS;
+		if ( nNext != __retired_read_index.fetchAndAddAcquire( 0 ) ) {
+			__retired[ nWrite ] = r;
+			__retired_write_index.fetchAndStoreRelease( nNext );
+			return;
+		}
+	}
+	// nobody collected for a long time, wait for room rather than deleting here
+	if ( __deferred_count == MAX_COMMANDS ) {
+		count_incident( INCIDENT_RETIRED_LEAKED );
+		return;
+	}
+	__deferred[ __deferred_count++ ] = r;
+}
+
+
+void CommandQueue::flush_retired()
+{
+	if ( __deferred_count == 0 ) {
+		return;
+	}
+	int nMoved = 0;
+	int nWrite = __retired_write_index;
+	int nRead = __retired_read_index.fetchAndAddAcquire( 0 );
+	while ( nMoved < __deferred_count && ( nWrite + 1 ) % MAX_COMMANDS != nRead ) {
+		__retired[ nWrite ] = __deferred[ nMoved++ ];
+		nWrite = ( nWrite + 1 ) % MAX_COMMANDS;
+	}
+	if ( nMoved == 0 ) {
+		return;
+	}
+	__retired_write_index.fetchAndStoreRelease( nWrite );
+	for ( int i = nMoved; i < __deferred_count; ++i ) {
+		__deferred[ i - nMoved ] = __deferred[ i ];
+	}
+	__deferred_count -= nMoved;
+}
+
+
+void CommandQueue::collect_garbage()
+{
+	QMutexLocker mx( &__producer_mutex );
+
+	int nRead = __retired_read_index;
+	while ( nRead != __retired_write_index.fetchAndAddAcquire( 0 ) ) {
+		__delete_retired( __retired[ nRead ] );
+		nRead = ( nRead + 1 ) % MAX_COMMANDS;
+		__retired_read_index.fetchAndStoreRelease( nRead );
+	}
+}
+
+
+void CommandQueue::report_incidents()
+{
+	static const char* messages[ INCIDENT_COUNT ] = {
+		"%1 retired objects leaked, the ring and the list were full",
+		"%1 retired instruments leaked, too many of them were playing",
+		"%1 commands of an unexpected type ignored",
+		"%1 notes dropped, no free voice slot",
+		"render threads late in %1 cycles"
+	};
+	for ( int i = 0; i < INCIDENT_COUNT; ++i ) {
+		int nCount = __incidents[ i ].fetchAndStoreOrdered( 0 );
+		if ( nCount ) {
+			ERRORLOG( QString( messages[ i ] ).arg( nCount ) );
+		}
+	}
+}
+
+
+void CommandQueue::__delete_retired( const Retired& r )
+{
+	switch ( r.type ) {
+	case RETIRED_NOTE:
+		delete static_cast<Note*>( r.ptr );
+		break;
+	case RETIRED_SAMPLE:
+		delete static_cast<Sample*>( r.ptr );
+		break;
+	case RETIRED_LAYER:
+		delete static_cast<InstrumentLayer*>( r.ptr );
+		break;
+	case RETIRED_INSTRUMENT:
+		delete static_cast<Instrument*>( r.ptr );
+		break;
+	}
+}
+
+};
@@ -40,6 +40,9 @@ EventQueue::EventQueue()
 		: Object( __class_name )
 		, __read_index( 0 )
 		, __write_index( 0 )
+		, __add_midi_note_read_index( 0 )
+		, __add_midi_note_write_index( 0 )
+		, __add_midi_notes_dropped( 0 )
 {
 	__instance = this;
 
@@ -82,4 +85,35 @@ Event EventQueue::pop_event()
 	return __events_buffer[ nIndex ];
 }
 
+
+void EventQueue::push_add_midi_note( const AddMidiNoteVector& noteAction )
+{
+	int nWrite = __add_midi_note_write_index;
+	int nNext = ( nWrite + 1 ) % MAX_EVENTS;
+	if ( nNext == __add_midi_note_read_index.fetchAndAddAcquire( 0 ) ) {
+		// may be the audio thread, reported by the GUI
+		__add_midi_notes_dropped.fetchAndAddOrdered( 1 );
+		return;
+	}
+	__add_midi_notes[ nWrite ] = noteAction;
+	// publish the slot only once it is completely written
+	__add_midi_note_write_index.fetchAndStoreRelease( nNext );
+}
+
+
+bool EventQueue::pop_add_midi_note( AddMidiNoteVector& noteAction )
+{
+	int nDropped = __add_midi_notes_dropped.fetchAndStoreOrdered( 0 );
+	if ( nDropped ) {
+		WARNINGLOG( QString( "recorded notes queue full, %1 notes not added to the patterns" ).arg( nDropped ) );
+	}
+	int nRead = __add_midi_note_read_index;
+	if ( nRead == __add_midi_note_write_index.fetchAndAddAcquire( 0 ) ) {
+		return false;
+	}
+	noteAction = __add_midi_notes[ nRead ];
+	__add_midi_note_read_index.fetchAndStoreRelease( ( nRead + 1 ) % MAX_EVENTS );
+	return true;
+}
+
 };
@@ -18,6 +18,7 @@
 #define PLAYLISTS       "/playlists"
 #define DEMOS           "/demo_songs"
 #define XSD             "/xsd"
+#define SAMPLE_CACHE    "/cache/samples"
 #define TMP             "/hydrogen"
 
 // files
@@ -376,6 +377,10 @@ QString Filesystem::xsd_dir()
 {
 	return __sys_data_path + XSD;
 }
+QString Filesystem::sample_cache_dir()
+{
+	return __usr_data_path + SAMPLE_CACHE;
+}
 QString Filesystem::tmp_dir()
 {
 	return QDir::tempPath() + TMP;
@@ -502,6 +507,7 @@ void Filesystem::info()
 	INFOLOG( QString( "Songs dir                  : %1" ).arg( songs_dir() ) );
 	INFOLOG( QString( "Patterns dir               : %1" ).arg( patterns_dir() ) );
 	INFOLOG( QString( "Playlists dir              : %1" ).arg( playlists_dir() ) );
+	INFOLOG( QString( "Sample cache dir           : %1" ).arg( sample_cache_dir() ) );
 	INFOLOG( QString( "User core cfg file         : %1" ).arg( usr_core_config() ) );
 	INFOLOG( QString( "User gui cfg file          : %1" ).arg( usr_gui_config() ) );
 }
@@ -32,7 +32,7 @@
 #include <pthread.h>
 #include <cassert>
 #include <cstdio>
-#include <deque>
+#include <vector>
 #include <queue>
 #include <iostream>
 #include <ctime>
@@ -52,10 +52,14 @@
 #include <hydrogen/basics/instrument_list.h>
 #include <hydrogen/basics/instrument_layer.h>
 #include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/sample_loader.h>
+#include <hydrogen/basics/sample_pool.h>
 #include <hydrogen/hydrogen.h>
 #include <hydrogen/basics/pattern.h>
 #include <hydrogen/basics/pattern_list.h>
 #include <hydrogen/basics/note.h>
+#include <hydrogen/basics/note_pool.h>
+#include <hydrogen/basics/note_queue.h>
 #include <hydrogen/helpers/filesystem.h>
 #include <hydrogen/fx/LadspaFX.h>
 #include <hydrogen/fx/Effects.h>
@@ -68,6 +72,7 @@
 #include <hydrogen/IO/TransportInfo.h>
 #include <hydrogen/Preferences.h>
 #include <hydrogen/sampler/Sampler.h>
+#include <hydrogen/sampler/mix_kernels.h>
 #include <hydrogen/midi_map.h>
 #include <hydrogen/playlist.h>
 
@@ -88,8 +93,6 @@ namespace H2Core
 // GLOBALS
 
 // info
-float m_fMasterPeak_L = 0.0f;		///< Master peak (left channel)
-float m_fMasterPeak_R = 0.0f;		///< Master peak (right channel)
 float m_fProcessTime = 0.0f;		///< time used in process function
 float m_fMaxProcessTime = 0.0f;		///< max ms usable in process with no xrun
 //~ info
@@ -124,20 +127,8 @@ QMutex mutex_OutputPointer;     ///< Mutex for audio output pointer, allows mult
 MidiInput *m_pMidiDriver = NULL;	///< MIDI input
 MidiOutput *m_pMidiDriverOut = NULL;	///< MIDI output
 
-// overload the the > operator of Note objects for priority_queue
-struct compare_pNotes {
-	   bool operator() (Note* pNote1, Note* pNote2) {
-			  return (pNote1->get_humanize_delay()
-					  + pNote1->get_position() * m_pAudioDriver->m_transport.m_nTickSize)
-							>
-							(pNote2->get_humanize_delay()
-							 + pNote2->get_position() * m_pAudioDriver->m_transport.m_nTickSize);
-	   }
-};
-
-/// Song Note FIFO
-std::priority_queue<Note*, std::deque<Note*>, compare_pNotes > m_songNoteQueue;
-std::deque<Note*> m_midiNoteQueue;	///< Midi Note FIFO
+NoteQueue* m_pSongNoteQueue = NULL;	///< Song Note FIFO, ordered on start frame
+std::vector<Note*> m_midiNoteQueue;	///< Midi Note FIFO, never grown past its reserved size by the audio thread
 
 Song *m_pSong;				///< Current song
 PatternList* m_pNextPatterns;		///< Next pattern (used only in Pattern mode)
@@ -168,10 +159,6 @@ int  m_audioEngineState = STATE_UNINITIALIZED;	///< Audio engine state
 
 
 
-#ifdef H2CORE_HAVE_LADSPA
-float m_fFXPeak_L[MAX_FX];
-float m_fFXPeak_R[MAX_FX];
-#endif
 
 
 int m_nPatternStartTick = -1;
@@ -215,6 +202,7 @@ void audioEngine_seek( long long nFrames, bool bLoopMode = false );
 void audioEngine_restartAudioDrivers();
 void audioEngine_startAudioDrivers();
 void audioEngine_stopAudioDrivers();
+void audioEngine_resampleSamples();
 
 
 inline timeval currentTime2()
@@ -276,6 +264,7 @@ void audioEngine_init()
 	   }
 
 	   m_pSong = NULL;
+	   m_pSongNoteQueue = new NoteQueue();
 	   m_pPlayingPatterns = new PatternList();
 	   m_pNextPatterns = new PatternList();
 	   m_nSongPos = -1;
@@ -288,6 +277,9 @@ void audioEngine_init()
 	   m_pMainBuffer_L = NULL;
 	   m_pMainBuffer_R = NULL;
 
+	   // at most a command queue of realtime notes per cycle
+	   m_midiNoteQueue.reserve( MAX_COMMANDS );
+
 	   srand( time( NULL ) );
 
 	   // Create metronome instrument
@@ -321,20 +313,22 @@ void audioEngine_destroy()
 			  ___ERRORLOG( "Error the audio engine is not in INITIALIZED state" );
 			  return;
 	   }
-	   AudioEngine::get_instance()->get_sampler()->stop_playing_notes();
 
 	   AudioEngine::get_instance()->lock( RIGHT_HERE );
 	   ___INFOLOG( "*** Hydrogen audio engine shutdown ***" );
 
+	   AudioEngine::get_instance()->get_sampler()->stop_playing_notes();
+
 	   // delete all copied notes in the song notes queue
-	   while ( !m_songNoteQueue.empty() ) {
-			  m_songNoteQueue.top()->get_instrument()->dequeue();
-			  delete m_songNoteQueue.top();
-			  m_songNoteQueue.pop();
+	   while ( !m_pSongNoteQueue->empty() ) {
+			  m_pSongNoteQueue->top()->get_instrument()->dequeue();
+			  delete m_pSongNoteQueue->top();
+			  m_pSongNoteQueue->pop();
 	   }
 	   // delete all copied notes in the midi notes queue
 	   for ( unsigned i = 0; i < m_midiNoteQueue.size(); ++i ) {
 			  Note *note = m_midiNoteQueue[i];
+			  note->get_instrument()->dequeue();
 			  delete note;
 			  note = NULL;
 	   }
@@ -345,6 +339,9 @@ void audioEngine_destroy()
 
 	   EventQueue::get_instance()->push_event( EVENT_STATE, STATE_UNINITIALIZED );
 
+	   delete m_pSongNoteQueue;
+	   m_pSongNoteQueue = NULL;
+
 	   delete m_pPlayingPatterns;
 	   m_pPlayingPatterns = NULL;
 
@@ -382,8 +379,6 @@ int audioEngine_start( bool bLockEngine, unsigned nTotalFrames )
 			  return 0;	// FIXME!!
 	   }
 
-	   m_fMasterPeak_L = 0.0f;
-	   m_fMasterPeak_R = 0.0f;
 	   m_pAudioDriver->m_transport.m_nFrames = nTotalFrames;	// reset total frames
 	   m_nSongPos = -1;
 	   m_nPatternStartTick = -1;
@@ -425,16 +420,14 @@ void audioEngine_stop( bool bLockEngine )
 	   m_audioEngineState = STATE_READY;
 	   EventQueue::get_instance()->push_event( EVENT_STATE, STATE_READY );
 
-	   m_fMasterPeak_L = 0.0f;
-	   m_fMasterPeak_R = 0.0f;
 	   //	m_nPatternTickPosition = 0;
 	   m_nPatternStartTick = -1;
 
 	   // delete all copied notes in the song notes queue
-	   while(!m_songNoteQueue.empty()){
-			  m_songNoteQueue.top()->get_instrument()->dequeue();
-			  delete m_songNoteQueue.top();
-			  m_songNoteQueue.pop();
+	   while(!m_pSongNoteQueue->empty()){
+			  m_pSongNoteQueue->top()->get_instrument()->dequeue();
+			  delete m_pSongNoteQueue->top();
+			  m_pSongNoteQueue->pop();
 	   }
 	   /*	// delete all copied notes in the playing notes queue
   for (unsigned i = 0; i < m_playingNotesQueue.size(); ++i) {
@@ -447,6 +440,7 @@ void audioEngine_stop( bool bLockEngine )
 	   // delete all copied notes in the midi notes queue
 	   for ( unsigned i = 0; i < m_midiNoteQueue.size(); ++i ) {
 			  Note *note = m_midiNoteQueue[i];
+			  note->get_instrument()->dequeue();
 			  delete note;
 	   }
 	   m_midiNoteQueue.clear();
@@ -509,9 +503,9 @@ inline void audioEngine_process_playNotes( unsigned long nframes )
 			framepos = m_nRealtimeFrames;
 		}
 
-		// reading from m_songNoteQueue
-		while ( !m_songNoteQueue.empty() ) {
-				Note *pNote = m_songNoteQueue.top();
+		// reading from m_pSongNoteQueue
+		while ( !m_pSongNoteQueue->empty() ) {
+				Note *pNote = m_pSongNoteQueue->top();
 
 				// verifico se la nota rientra in questo ciclo
 				unsigned int noteStartInFrames =
@@ -560,7 +554,7 @@ inline void audioEngine_process_playNotes( unsigned long nframes )
 					  */
 					 Instrument * noteInstrument = pNote->get_instrument();
 					 if ( noteInstrument->is_stop_notes() ){
-							Note *pOffNote = new Note( noteInstrument,
+							Note *pOffNote = new ( NotePool::get_instance() ) Note( noteInstrument,
 												0.0,
 												0.0,
 												0.0,
@@ -573,12 +567,15 @@ inline void audioEngine_process_playNotes( unsigned long nframes )
 					 }
 
 					 AudioEngine::get_instance()->get_sampler()->note_on( pNote );
-					 m_songNoteQueue.pop(); // rimuovo la nota dalla lista di note
+					 m_pSongNoteQueue->pop(); // rimuovo la nota dalla lista di note
 					 pNote->get_instrument()->dequeue();
-					 // raise noteOn event
-					 int nInstrument = m_pSong->get_instrument_list()->index( pNote->get_instrument() );
+					 // raise noteOn event, the sampler already knows where a playing note goes
+					 int nInstrument;
 					 if( pNote->get_note_off() ){
+						nInstrument = m_pSong->get_instrument_list()->index( pNote->get_instrument() );
 						delete pNote;
+					 } else {
+						nInstrument = AudioEngine::get_instance()->get_sampler()->get_voice_track( pNote );
 					 }
 
 					 EventQueue::get_instance()->push_event( EVENT_NOTEON, nInstrument );
@@ -685,16 +682,17 @@ void audioEngine_clearNoteQueue()
 	   //___INFOLOG( "clear notes...");
 
 	   // delete all copied notes in the song notes queue
-	   while (!m_songNoteQueue.empty()) {
-			  m_songNoteQueue.top()->get_instrument()->dequeue();
-			  delete m_songNoteQueue.top();
-			  m_songNoteQueue.pop();
+	   while (!m_pSongNoteQueue->empty()) {
+			  m_pSongNoteQueue->top()->get_instrument()->dequeue();
+			  delete m_pSongNoteQueue->top();
+			  m_pSongNoteQueue->pop();
 	   }
 
 	   AudioEngine::get_instance()->get_sampler()->stop_playing_notes();
 
 	   // delete all copied notes in the midi notes queue
 	   for ( unsigned i = 0; i < m_midiNoteQueue.size(); ++i ) {
+			  m_midiNoteQueue[i]->get_instrument()->dequeue();
 			  delete m_midiNoteQueue[i];
 	   }
 	   m_midiNoteQueue.clear();
@@ -706,6 +704,7 @@ void audioEngine_clearNoteQueue()
 /// Clear all audio buffers
 inline void audioEngine_process_clearAudioBuffers( uint32_t nFrames )
 {
+	   // the driver is rarely swapped, the outputs are always written
 	   QMutexLocker mx( &mutex_OutputPointer );
 
 	   // clear main out Left and Right
@@ -722,23 +721,9 @@ inline void audioEngine_process_clearAudioBuffers( uint32_t nFrames )
 			  memset( m_pMainBuffer_R, 0, nFrames * sizeof( float ) );
 	   }
 
-#ifdef H2CORE_HAVE_JACK
-	   JackOutput* jo = dynamic_cast<JackOutput*>(m_pAudioDriver);
-	   if( jo && jo->has_track_outs() ) {
-			  float* buf;
-			  int k;
-			  for( k=0 ; k<jo->getNumTracks() ; ++k ) {
-					 buf = jo->getTrackOut_L(k);
-					 if( buf ) {
-							memset( buf, 0, nFrames * sizeof( float ) );
-					 }
-					 buf = jo->getTrackOut_R(k);
-					 if( buf ) {
-							memset( buf, 0, nFrames * sizeof( float ) );
-					 }
-			  }
+	   if ( m_pAudioDriver ) {
+			  m_pAudioDriver->clearTrackOuts( nFrames );
 	   }
-#endif
 
 	   mx.unlock();
 
@@ -769,7 +754,10 @@ int audioEngine_process( uint32_t nframes, void* /*arg*/ )
 			  return 0;
 	   }
 
-
+	   // Note starts, previews and instrument swaps arrive through the
+	   // command queue, the song and pattern edits of the GUI still hold
+	   // the engine for a short while, the cycle waits for them rather than
+	   // playing silence.
 	   AudioEngine::get_instance()->lock( RIGHT_HERE );
 
 	   if( m_audioEngineState < STATE_READY) {
@@ -777,6 +765,8 @@ int audioEngine_process( uint32_t nframes, void* /*arg*/ )
 			  return 0;
 	   }
 
+	   AudioEngine::get_instance()->process_commands();
+
 	   if ( m_nBufferSize != nframes ) {
 			  ___INFOLOG(
 								   QString( "Buffer size changed. Old size = %1, new size = %2" )
@@ -789,6 +779,7 @@ int audioEngine_process( uint32_t nframes, void* /*arg*/ )
 	   // m_pAudioDriver->bpm updates Song->__bpm. (!!(Calls audioEngine_seek))
 	   audioEngine_process_transport();
 	   audioEngine_process_checkBPMChanged(); // m_pSong->__bpm decides tick size
+	   m_pSongNoteQueue->set_tick_size( m_pAudioDriver->m_transport.m_nTickSize );
 
 	   bool sendPatternChange = false;
 	   // always update note queue.. could come from pattern or realtime input
@@ -817,6 +808,10 @@ int audioEngine_process( uint32_t nframes, void* /*arg*/ )
 			  sendPatternChange = true;
 	   }
 
+	   // levels of this cycle, published once the master is metered
+	   Meters* pMeters = AudioEngine::get_instance()->get_meters();
+	   pMeters->begin_cycle( nframes );
+
 	   // play all notes
 	   audioEngine_process_playNotes( nframes );
 
@@ -860,35 +855,20 @@ int audioEngine_process( uint32_t nframes, void* /*arg*/ )
 								   buf_L = pFX->m_pBuffer_L;
 								   buf_R = buf_L;
 							}
-							for ( unsigned i = 0; i < nframes; ++i ) {
-								   m_pMainBuffer_L[ i ] += buf_L[ i ];
-								   m_pMainBuffer_R[ i ] += buf_R[ i ];
-								   if ( buf_L[ i ] > m_fFXPeak_L[nFX] )
-										  m_fFXPeak_L[nFX] = buf_L[ i ];
-								   if ( buf_R[ i ] > m_fFXPeak_R[nFX] )
-										  m_fFXPeak_R[nFX] = buf_R[ i ];
-							}
+							mix_add( buf_L, 1.0f, m_pMainBuffer_L, nframes );
+							mix_add( buf_R, 1.0f, m_pMainBuffer_R, nframes );
+							pMeters->meter_fx( nFX, buf_L, buf_R, nframes );
 					 }
 			  }
 	   }
 #endif
 	   timeval ladspaTime_end = currentTime2();
 
-	   // update master peaks
-	   float val_L;
-	   float val_R;
+	   // master levels, then hand the levels of the cycle over to the GUI
 	   if ( m_audioEngineState >= STATE_READY ) {
-			  for ( unsigned i = 0; i < nframes; ++i ) {
-					 val_L = m_pMainBuffer_L[i];
-					 val_R = m_pMainBuffer_R[i];
-					 if ( val_L > m_fMasterPeak_L ) {
-							m_fMasterPeak_L = val_L;
-					 }
-					 if ( val_R > m_fMasterPeak_R ) {
-							m_fMasterPeak_R = val_R;
-					 }
-			  }
+			  pMeters->meter_master( m_pMainBuffer_L, m_pMainBuffer_R, nframes );
 	   }
+	   pMeters->publish( m_pSong->get_instrument_list()->size(), m_pSong->get_bus_count() );
 
 	   // update total frames number
 	   if ( m_audioEngineState == STATE_PLAYING ) {
@@ -983,15 +963,41 @@ void audioEngine_setupLadspaFX( unsigned nBufferSize )
 
 void audioEngine_renameJackPorts()
 {
-#ifdef H2CORE_HAVE_JACK
-	   // renames jack ports
-	   if ( m_pSong == NULL ) {
+	   // creates or renames the track outputs of any driver
+	   if ( m_pSong == NULL || m_pAudioDriver == NULL ) {
 			  return;
 	   }
-	   if ( m_pAudioDriver->class_name() == JackOutput::class_name() ) {
-			  static_cast< JackOutput* >( m_pAudioDriver )->makeTrackOutputs( m_pSong );
+	   m_pAudioDriver->makeTrackOutputs( m_pSong );
+}
+
+
+
+void audioEngine_resampleSamples()
+{
+	   // reload the song samples at the driver rate, the pool and the cache
+	   // hand out the converted frames of the files already seen at that rate.
+	   // they are reloaded in place, the engine is locked and the new driver
+	   // is not running yet so no note reads them meanwhile
+	   SampleLoader loader;
+	   InstrumentList *pInstrList = m_pSong->get_instrument_list();
+	   for ( unsigned nInstr = 0; nInstr < pInstrList->size(); ++nInstr ) {
+			  Instrument *pInstr = pInstrList->get( nInstr );
+			  for ( int nLayer = 0; nLayer < MAX_LAYERS; nLayer++ ) {
+					 InstrumentLayer *pLayer = pInstr->get_layer( nLayer );
+					 if ( pLayer == NULL ) continue;
+					 Sample *pSample = pLayer->get_sample();
+					 // transformed and streamed samples keep the rate of their file: the
+					 // samples loaded through Sample::load( filepath, loops, rubber, ... )
+					 // have loop frames and envelopes at that rate, they are still
+					 // interpolated by the sampler
+					 if ( pSample == NULL || pSample->get_is_modified() || pSample->is_streamed() ) continue;
+					 loader.add( pSample, true );
+			  }
 	   }
-#endif
+	   loader.run();
+	   ___INFOLOG( QString( "%1 samples converted to %2 Hz" )
+				   .arg( loader.size() )
+				   .arg( Sample::get_playback_rate() ) );
 }
 
 
@@ -1141,16 +1147,16 @@ inline int audioEngine_updateNoteQueue( unsigned nFrames )
 			  }
 
 
-			  // midi events now get put into the m_songNoteQueue as well,
+			  // midi events now get put into the m_pSongNoteQueue as well,
 			  // based on their timestamp
 			  while ( m_midiNoteQueue.size() > 0 ) {
 					 Note *note = m_midiNoteQueue[0];
 
 					 if ( ( int )note->get_position() <= tick ) {
 							// printf ("tick=%d  pos=%d\n", tick, note->getPosition());
-							m_midiNoteQueue.pop_front();
-							note->get_instrument()->enqueue();
-							m_songNoteQueue.push( note );
+							// a few notes at most, shifting them does not allocate
+							m_midiNoteQueue.erase( m_midiNoteQueue.begin() );
+							m_pSongNoteQueue->push( note );
 					 } else {
 							break;
 					 }
@@ -1306,7 +1312,7 @@ inline int audioEngine_updateNoteQueue( unsigned nFrames )
 							m_pMetronomeInstrument->set_volume(
 												 Preferences::get_instance()->m_fMetronomeVolume
 												 );
-							Note *pMetronomeNote = new Note( m_pMetronomeInstrument,
+							Note *pMetronomeNote = new ( NotePool::get_instance() ) Note( m_pMetronomeInstrument,
 															 tick,
 															 fVelocity,
 															 0.5,
@@ -1315,7 +1321,7 @@ inline int audioEngine_updateNoteQueue( unsigned nFrames )
 															 fPitch
 															 );
 							m_pMetronomeInstrument->enqueue();
-							m_songNoteQueue.push( pMetronomeNote );
+							m_pSongNoteQueue->push( pMetronomeNote );
 					 }
 			  }
 
@@ -1346,7 +1352,7 @@ inline int audioEngine_updateNoteQueue( unsigned nFrames )
 												 noteAction.b_isInstrumentMode = false;
 												 noteAction.b_isMidi = false;
 												 noteAction.b_noteExist = false;
-												 EventQueue::get_instance()->m_addMidiNoteVector.push_back(noteAction);
+												 EventQueue::get_instance()->push_add_midi_note( noteAction );
 										  }
 								   }
 							}
@@ -1388,13 +1394,13 @@ inline int audioEngine_updateNoteQueue( unsigned nFrames )
 										  if((tick == 0) && (nOffset < 0)) {
 												 nOffset = 0;
 										  }
-										  Note *pCopiedNote = new Note( pNote );
+										  Note *pCopiedNote = new ( NotePool::get_instance() ) Note( pNote );
 										  pCopiedNote->set_position( tick );
 
 										  // humanize time
 										  pCopiedNote->set_humanize_delay( nOffset );
 										  pNote->get_instrument()->enqueue();
-										  m_songNoteQueue.push( pCopiedNote );
+										  m_pSongNoteQueue->push( pCopiedNote );
 										  //pCopiedNote->dumpInfo();
 								   }
 							}
@@ -1482,10 +1488,16 @@ void audioEngine_noteOn( Note *note )
 	   if ( ( m_audioEngineState != STATE_READY )
 					 && ( m_audioEngineState != STATE_PLAYING ) ) {
 			  ___ERRORLOG( "Error the audio engine is not in READY state" );
-			  delete note;
+			  AudioEngine::get_instance()->get_command_queue()->retire( CommandQueue::RETIRED_NOTE, note );
+			  return;
+	   }
+	   if ( m_midiNoteQueue.size() == m_midiNoteQueue.capacity() ) {
+			  AudioEngine::get_instance()->get_command_queue()->retire( CommandQueue::RETIRED_NOTE, note );
 			  return;
 	   }
 
+	   // queued from now on, its instrument is not retired under it
+	   note->get_instrument()->enqueue();
 	   m_midiNoteQueue.push_back( note );
 }
 
@@ -1689,6 +1701,28 @@ void audioEngine_startAudioDrivers()
 #endif
 	   }
 
+	   // follow the max notes preference, the driver is not running yet so the
+	   // notes left over from the previous one can be dropped to free the pool
+	   int nPoolCapacity = preferencesMng->m_nMaxNotes + NOTE_POOL_HEADROOM;
+	   if ( NotePool::get_instance()->get_capacity() != nPoolCapacity ) {
+			  audioEngine_clearNoteQueue();
+	   }
+	   if ( !NotePool::get_instance()->resize( nPoolCapacity ) ) {
+			  ___WARNINGLOG( QString( "Note pool in use, keeping %1 slots instead of %2" )
+							 .arg( NotePool::get_instance()->get_capacity() )
+							 .arg( nPoolCapacity ) );
+	   }
+	   // a voice slot per pooled note, the sampler never adds them while playing
+	   AudioEngine::get_instance()->get_sampler()->reserve_voices( NotePool::get_instance()->get_capacity() );
+
+	   // the samples follow the driver rate, the engine is locked while they are converted
+	   if ( Sample::get_playback_rate() != ( int )m_pAudioDriver->getSampleRate() ) {
+			  Sample::set_playback_rate( m_pAudioDriver->getSampleRate() );
+			  if ( m_pSong && preferencesMng->m_bResampleSamples ) {
+					 audioEngine_resampleSamples();
+			  }
+	   }
+
 	   // change the current audio engine state
 	   if ( m_pSong == NULL ) {
 			  m_audioEngineState = STATE_PREPARED;
@@ -1734,9 +1768,7 @@ void audioEngine_startAudioDrivers()
 					 ___ERRORLOG( "m_pMainBuffer_R == NULL" );
 			  }
 
-#ifdef H2CORE_HAVE_JACK
 			  audioEngine_renameJackPorts();
-#endif
 
 			  audioEngine_setupLadspaFX( m_pAudioDriver->getBufferSize() );
 	   }
@@ -1933,6 +1965,7 @@ void Hydrogen::addRealtimeNote( int instrument,
 				int msg1 )
 {
 	   UNUSED( pitch );
+	   UNUSED( noteOff );
 
 	   Preferences *pref = Preferences::get_instance();
 	   unsigned int realcolumn = 0;
@@ -1942,9 +1975,9 @@ void Hydrogen::addRealtimeNote( int instrument,
 	   bool hearnote = forcePlay;
 	   int currentPatternNumber;
 
+	   // recorded on this thread, the patterns and the transport are shared with the GUI
 	   AudioEngine::get_instance()->lock( RIGHT_HERE );
 
-
 	   Song *song = getSong();
 	   if ( !pref->__playselectedinstrument ){
 			  if ( instrument >= ( int )song->get_instrument_list()->size() ) {
@@ -2129,7 +2162,7 @@ void Hydrogen::addRealtimeNote( int instrument,
 												 noteAction.b_isInstrumentMode = replaceExisting;
 												 noteAction.b_isMidi = true;
 												 noteAction.b_noteExist = replaceExisting;
-												 EventQueue::get_instance()->m_addMidiNoteVector.push_back(noteAction);
+												 EventQueue::get_instance()->push_add_midi_note( noteAction );
 												 continue;
 										  }
 										  if( ( pNote->get_just_recorded() == false ) && (static_cast<int>( pNote->get_position() ) >= postdelete && pNote->get_position() < column + predelete +1 )){
@@ -2151,7 +2184,7 @@ void Hydrogen::addRealtimeNote( int instrument,
 												 noteAction.b_isInstrumentMode = replaceExisting;
 												 noteAction.b_isMidi = true;
 												 noteAction.b_noteExist = replaceExisting;
-												 EventQueue::get_instance()->m_addMidiNoteVector.push_back(noteAction);
+												 EventQueue::get_instance()->push_add_midi_note( noteAction );
 										  }
 								   }
 								   continue;
@@ -2182,7 +2215,7 @@ void Hydrogen::addRealtimeNote( int instrument,
 								   noteAction.b_isInstrumentMode = false;
 								   noteAction.b_isMidi = false;
 								   noteAction.b_noteExist = replaceExisting;
-								   EventQueue::get_instance()->m_addMidiNoteVector.push_back(noteAction);
+								   EventQueue::get_instance()->push_add_midi_note( noteAction );
 								   continue;
 							}
 
@@ -2203,7 +2236,7 @@ void Hydrogen::addRealtimeNote( int instrument,
 								   noteAction.b_isInstrumentMode = false;
 								   noteAction.b_isMidi = false;
 								   noteAction.b_noteExist = replaceExisting;
-								   EventQueue::get_instance()->m_addMidiNoteVector.push_back(noteAction);
+								   EventQueue::get_instance()->push_add_midi_note( noteAction );
 							}
 					 }
 			  }
@@ -2243,7 +2276,7 @@ void Hydrogen::addRealtimeNote( int instrument,
 							noteAction.b_isInstrumentMode = false;
 							noteAction.b_isMidi = true;
 							noteAction.b_noteExist = bNoteAlreadyExist;
-							EventQueue::get_instance()->m_addMidiNoteVector.push_back(noteAction);
+							EventQueue::get_instance()->push_add_midi_note( noteAction );
 
 							// hear note if its not in the future
 							if ( pref->getHearNewNotes()
@@ -2268,7 +2301,7 @@ void Hydrogen::addRealtimeNote( int instrument,
 							noteAction.b_isInstrumentMode = true;
 							noteAction.b_isMidi = true;
 							noteAction.b_noteExist = bNoteAlreadyExist;
-							EventQueue::get_instance()->m_addMidiNoteVector.push_back(noteAction);
+							EventQueue::get_instance()->push_add_midi_note( noteAction );
 
 							// hear note if its not in the future
 							if ( pref->getHearNewNotes()
@@ -2281,55 +2314,57 @@ void Hydrogen::addRealtimeNote( int instrument,
 			  hearnote = true;
 	   }
 
+	   // only a copy of the note goes to the audio thread, which starts it at the next cycle
+	   Command cmd;
+	   cmd.type = COMMAND_REALTIME_NOTE;
+	   cmd.position = realcolumn;
+	   cmd.velocity = velocity;
+	   cmd.pan_l = pan_L;
+	   cmd.pan_r = pan_R;
 	   if ( !pref->__playselectedinstrument ){
-			  if ( hearnote && instrRef ) {
-					 Note *note2 = new Note( instrRef,
-											 realcolumn,
-											 velocity,
-											 pan_L,
-											 pan_R,
-											 -1,
-											 0 );
-					 midi_noteOn( note2 );
-			  }
-	   }else
-	   {
-			  if ( hearnote  ) {
-					 Note *note2 = new Note( song->get_instrument_list()->get( getSelectedInstrumentNumber()),
-											 realcolumn,
-											 velocity,
-											 pan_L,
-											 pan_R,
-											 -1,
-											 0 );
-
-					 int divider = msg1 / 12;
-					 Note::Octave octave = (Note::Octave)(divider -3);
-					 Note::Key notehigh = (Note::Key)(msg1 - (12 * divider));
-
-					 //ERRORLOG( QString( "octave: %1, note: %2, instrument %3" ).arg( octave ).arg(notehigh).arg(instrument));
-					 note2->set_midi_info( notehigh, octave, msg1 );
-					 midi_noteOn( note2 );
-			  }
-
+			  cmd.value = m_nInstrumentLookupTable[ instrument ];
+			  cmd.key = -1;
+			  hearnote = hearnote && ( instrRef != NULL );
+	   } else {
+			  cmd.value = getSelectedInstrumentNumber();
+			  cmd.key = msg1;
 	   }
 
-
 	   AudioEngine::get_instance()->unlock(); // unlock the audio engine
-}
-
-
 
-float Hydrogen::getMasterPeak_L()
-{
-	   return m_fMasterPeak_L;
+	   if ( hearnote ) {
+			  AudioEngine::get_instance()->post_command( cmd );
+	   }
 }
 
 
 
-float Hydrogen::getMasterPeak_R()
+void Hydrogen::playRealtimeNote( int instrument,
+				unsigned position,
+				float velocity,
+				float pan_L,
+				float pan_R,
+				int msg1 )
 {
-	   return m_fMasterPeak_R;
+	   // the instrument at that place now, the drumkit may have been switched meanwhile
+	   if ( m_pSong == NULL
+			|| instrument < 0 || instrument >= ( int )m_pSong->get_instrument_list()->size() ) {
+			  return;
+	   }
+	   Note *note2 = new ( NotePool::get_instance() ) Note( m_pSong->get_instrument_list()->get( instrument ),
+							   position,
+							   velocity,
+							   pan_L,
+							   pan_R,
+							   -1,
+							   0 );
+	   if ( msg1 >= 0 ) {
+			  int divider = msg1 / 12;
+			  Note::Octave octave = (Note::Octave)(divider -3);
+			  Note::Key notehigh = (Note::Key)(msg1 - (12 * divider));
+			  note2->set_midi_info( notehigh, octave, msg1 );
+	   }
+	   midi_noteOn( note2 );
 }
 
 
@@ -2433,12 +2468,13 @@ void Hydrogen::restartDrivers()
 
 
 /// Export a song to a wav file, returns the elapsed time in mSec
-void Hydrogen::startExportSong( const QString& filename, int rate, int depth )
+void Hydrogen::startExportSong( const QString& filename, int rate, int depth, bool stems )
 {
 	   if ( getState() == STATE_PLAYING ) {
 			  sequencer_stop();
 	   }
-	   AudioEngine::get_instance()->get_sampler()->stop_playing_notes();
+	   // the audio thread owns the playing notes
+	   AudioEngine::get_instance()->get_sampler()->queue_stop_playing_notes();
 	   Preferences *pPref = Preferences::get_instance();
 
 	   m_oldEngineMode = m_pSong->get_mode();
@@ -2456,7 +2492,7 @@ void Hydrogen::startExportSong( const QString& filename, int rate, int depth )
  */
 
 
-	   m_pAudioDriver = new DiskWriterDriver( audioEngine_process, nSamplerate, filename, depth);
+	   m_pAudioDriver = new DiskWriterDriver( audioEngine_process, nSamplerate, filename, depth, stems );
 
 
 	   // reset
@@ -2475,6 +2511,7 @@ void Hydrogen::startExportSong( const QString& filename, int rate, int depth )
 
 	   m_pMainBuffer_L = m_pAudioDriver->getOut_L();
 	   m_pMainBuffer_R = m_pAudioDriver->getOut_R();
+	   m_pAudioDriver->makeTrackOutputs( m_pSong );
 
 	   audioEngine_setupLadspaFX( m_pAudioDriver->getBufferSize() );
 
@@ -2542,20 +2579,6 @@ MidiOutput* Hydrogen::getMidiOutput()
 
 
 
-void Hydrogen::setMasterPeak_L( float value )
-{
-	   m_fMasterPeak_L = value;
-}
-
-
-
-void Hydrogen::setMasterPeak_R( float value )
-{
-	   m_fMasterPeak_R = value;
-}
-
-
-
 int Hydrogen::getState()
 {
 	   return m_audioEngineState;
@@ -2589,16 +2612,8 @@ float Hydrogen::getMaxProcessTime()
 
 int Hydrogen::loadDrumkit( Drumkit *drumkitInfo )
 {
-	   int old_ae_state = m_audioEngineState;
-	   if( m_audioEngineState >= STATE_READY ) {
-			  m_audioEngineState = STATE_PREPARED;
-	   }
-
 	   INFOLOG( drumkitInfo->get_name() );
 	   m_currentDrumkit = drumkitInfo->get_name();
-	   LocalFileMng fileMng;
-	   QString sDrumkitPath = Filesystem::drumkit_path_search( drumkitInfo->get_name() );
-
 
 	   //current instrument list
 	   InstrumentList *songInstrList = m_pSong->get_instrument_list();
@@ -2606,46 +2621,23 @@ int Hydrogen::loadDrumkit( Drumkit *drumkitInfo )
 	   //new instrument list
 	   InstrumentList *pDrumkitInstrList = drumkitInfo->get_instruments();
 
-	   /*
-  If the old drumkit is bigger then the new drumkit,
-  delete all instruments with a bigger pos then
-  pDrumkitInstrList->size(). Otherwise the instruments
-  from our old instrumentlist with
-  pos > pDrumkitInstrList->size() stay in the
-  new instrumentlist
-
- wolke: info!
-  this has moved to the end of this function
-  because we get lost objects in memory
-  now:
-  1. the new drumkit will loaded
-  2. all not used instruments will complete deleted
-
- old funktion:
- while ( pDrumkitInstrList->size() < songInstrList->size() )
- {
-  songInstrList->del(songInstrList->size() - 1);
- }
- */
-
-	   //needed for the new delete function
-	   int instrumentDiff =  songInstrList->size() - pDrumkitInstrList->size();
-
+	   // decode the samples of every instrument at once
+	   SampleLoader loader;
+	   std::vector<int> loaderJobs;
+	   for ( unsigned nInstr = 0; nInstr < pDrumkitInstrList->size(); ++nInstr ) {
+			  loaderJobs.push_back( Instrument::queue_samples_from( &loader, drumkitInfo, pDrumkitInstrList->get( nInstr ) ) );
+	   }
+	   loader.run();
+	   INFOLOG( QString( "%1 sample buffers (%2 mono) use %3 kB" )
+				.arg( SamplePool::get_buffer_count() )
+				.arg( SamplePool::get_mono_buffer_count() )
+				.arg( SamplePool::get_size() / 1024 ) );
+
+	   // the new instruments are built aside, the song keeps playing the current ones meanwhile
+	   InstrumentList *pNewInstrList = new InstrumentList();
+	   std::vector<Instrument*> replaced;
+	   std::map<Instrument*, Instrument*> replacements;
 	   for ( unsigned nInstr = 0; nInstr < pDrumkitInstrList->size(); ++nInstr ) {
-			  Instrument *pInstr = NULL;
-			  if ( nInstr < songInstrList->size() ) {
-					 //instrument exists already
-					 pInstr = songInstrList->get( nInstr );
-					 assert( pInstr );
-			  } else {
-					 pInstr = new Instrument();
-					 // The instrument isn't playing yet; no need for locking
-					 // :-) - Jakob Lund.  AudioEngine::get_instance()->lock(
-					 // "Hydrogen::loadDrumkit" );
-					 songInstrList->add( pInstr );
-					 // AudioEngine::get_instance()->unlock();
-			  }
-
 			  Instrument *pNewInstr = pDrumkitInstrList->get( nInstr );
 			  assert( pNewInstr );
 			  INFOLOG( QString( "Loading instrument (%1 of %2) [%3]" )
@@ -2653,29 +2645,74 @@ int Hydrogen::loadDrumkit( Drumkit *drumkitInfo )
 					   .arg( pDrumkitInstrList->size() )
 					   .arg( pNewInstr->get_name() ) );
 
-			  // creo i nuovi layer in base al nuovo strumento
-			  // Moved code from here right into the Instrument class - Jakob Lund.
-			  pInstr->load_from( drumkitInfo, pNewInstr );
-	   }
-
-
-	   //wolke: new delete funktion
-	   if ( instrumentDiff >=0	){
-			  for ( int i = 0; i < instrumentDiff ; i++ ){
-					 removeInstrument(
-										  m_pSong->get_instrument_list()->size() - 1,
-										  true
-										  );
+			  Instrument *pInstr = new Instrument();
+			  if ( nInstr < songInstrList->size() ) {
+					 // the notes of the patterns move to the instrument at the same index,
+					 // which keeps the song settings the drumkit doesn't define
+					 Instrument *pOldInstr = songInstrList->get( nInstr );
+					 for ( int nFX = 0; nFX < MAX_FX; ++nFX ) {
+							pInstr->set_fx_level( pOldInstr->get_fx_level( nFX ), nFX );
+					 }
+					 pInstr->set_bus( pOldInstr->get_bus() );
+					 pInstr->set_stop_notes( pOldInstr->is_stop_notes() );
+					 pInstr->set_active( pOldInstr->is_active() );
+					 pInstr->set_soloed( pOldInstr->is_soloed() );
+					 replaced.push_back( pOldInstr );
+					 replacements[ pOldInstr ] = pInstr;
+			  }
+			  pInstr->load_from( drumkitInfo, pNewInstr, false, &loader, loaderJobs[ nInstr ] );
+			  pNewInstrList->add( pInstr );
+	   }
+
+	   // the instruments past the drumkit ones stay as long as a pattern uses them
+	   PatternList *pPatternList = m_pSong->get_pattern_list();
+	   std::vector<Instrument*> retired( replaced );
+	   for ( unsigned nInstr = pDrumkitInstrList->size(); nInstr < songInstrList->size(); ++nInstr ) {
+			  Instrument *pOldInstr = songInstrList->get( nInstr );
+			  bool bReferenced = false;
+			  for ( int nPattern = 0; nPattern < ( int )pPatternList->size() && !bReferenced; ++nPattern ) {
+					 bReferenced = pPatternList->get( nPattern )->references( pOldInstr );
+			  }
+			  if ( bReferenced ) {
+					 pNewInstrList->add( pOldInstr );
+			  } else {
+					 retired.push_back( pOldInstr );
 			  }
 	   }
 
-#ifdef H2CORE_HAVE_JACK
+	   // the audio thread only reads the patterns, recorded notes are added from the
+	   // event queue on this thread, so the notes to remap are found before locking
+	   std::vector<Note*> remappedNotes;
+	   std::vector<Instrument*> remappedInstruments;
+	   m_pSong->find_replacements( replacements, remappedNotes, remappedInstruments );
+
+	   // published at once, the audio thread only waits for the pattern notes to be remapped
 	   AudioEngine::get_instance()->lock( RIGHT_HERE );
+	   for ( unsigned i = 0; i < remappedNotes.size(); ++i ) {
+			  remappedNotes[ i ]->set_instrument( remappedInstruments[ i ] );
+	   }
+	   m_pSong->set_instrument_list( pNewInstrList );
+	   InstrumentList::bump_generation();
 	   renameJackPorts();
 	   AudioEngine::get_instance()->unlock();
-#endif
 
-	   m_audioEngineState = old_ae_state;
+	   // the replaced instruments are deleted once their ringing notes are done
+	   while ( songInstrList->size() ) {
+			  songInstrList->del( 0 );
+	   }
+	   delete songInstrList;
+	   for ( unsigned i = 0; i < retired.size(); ++i ) {
+			  Command cmd;
+			  cmd.type = COMMAND_RETIRE_INSTRUMENT;
+			  cmd.instrument = retired[ i ];
+			  AudioEngine::get_instance()->post_command( cmd );
+	   }
+
+	   if ( getSelectedInstrumentNumber() >= ( int )pNewInstrList->size() ) {
+			  setSelectedInstrumentNumber( std::max( 0, ( int )pNewInstrList->size() - 1 ) );
+	   }
+	   // this will force a GUI update.
+	   EventQueue::get_instance()->push_event( EVENT_SELECTED_INSTRUMENT_CHANGED, -1 );
 
 	   return 0;	//ok
 }
@@ -2845,28 +2882,6 @@ void Hydrogen::setPatternPos( int pos )
 
 
 
-void Hydrogen::getLadspaFXPeak( int nFX, float *fL, float *fR )
-{
-#ifdef H2CORE_HAVE_LADSPA
-	   ( *fL ) = m_fFXPeak_L[nFX];
-	   ( *fR ) = m_fFXPeak_R[nFX];
-#else
-	   ( *fL ) = 0;
-	   ( *fR ) = 0;
-#endif
-}
-
-
-
-void Hydrogen::setLadspaFXPeak( int nFX, float fL, float fR )
-{
-#ifdef H2CORE_HAVE_LADSPA
-	   m_fFXPeak_L[nFX] = fL;
-	   m_fFXPeak_R[nFX] = fR;
-#endif
-}
-
-
 void Hydrogen::onTapTempoAccelEvent()
 {
 #ifndef WIN32
@@ -3034,14 +3049,12 @@ void Hydrogen::setSelectedInstrumentNumber( int nInstrument )
 }
 
 
-#ifdef H2CORE_HAVE_JACK
 void Hydrogen::renameJackPorts()
 {
-	   if( Preferences::get_instance()->m_bJackTrackOuts == true ){
+	   if( m_pAudioDriver && m_pAudioDriver->has_track_outs() ){
 			  audioEngine_renameJackPorts();
 	   }
 }
-#endif
 
 
 ///BeatCounter
@@ -3376,7 +3389,7 @@ void Hydrogen::__kill_instruments()
 void Hydrogen::__panic()
 {
 	   sequencer_stop();
-	   AudioEngine::get_instance()->get_sampler()->stop_playing_notes();
+	   AudioEngine::get_instance()->get_sampler()->queue_stop_playing_notes();
 }
 
 int Hydrogen::__get_selected_PatterNumber()
@@ -22,6 +22,7 @@
 
 #include "hydrogen/version.h"
 #include <hydrogen/basics/adsr.h>
+#include <hydrogen/basics/bus.h>
 #include <hydrogen/hydrogen.h>
 #include <hydrogen/h2_exception.h>
 #include <hydrogen/basics/instrument.h>
@@ -1250,6 +1251,25 @@ int SongWriter::writeSong( Song *song, const QString& filename )
 	LocalFileMng::writeXmlString( songNode, "humanize_velocity", QString("%1").arg( song->get_humanize_velocity_value() ) );
 	LocalFileMng::writeXmlString( songNode, "swing_factor", QString("%1").arg( song->get_swing_factor() ) );
 
+	// bus list
+	if ( song->get_bus_count() > 0 ) {
+		QDomNode busListNode = doc.createElement( "busList" );
+		for ( int nBus = 0; nBus < song->get_bus_count(); nBus++ ) {
+			Bus *pBus = song->get_bus( nBus );
+			QDomNode busNode = doc.createElement( "bus" );
+			LocalFileMng::writeXmlString( busNode, "name", pBus->get_name() );
+			LocalFileMng::writeXmlString( busNode, "volume", QString("%1").arg( pBus->get_volume() ) );
+			LocalFileMng::writeXmlBool( busNode, "isMuted", pBus->is_muted() );
+			LocalFileMng::writeXmlString( busNode, "pan_L", QString("%1").arg( pBus->get_pan_l() ) );
+			LocalFileMng::writeXmlString( busNode, "pan_R", QString("%1").arg( pBus->get_pan_r() ) );
+			for ( int nFX = 0; nFX < MAX_FX; nFX++ ) {
+				LocalFileMng::writeXmlString( busNode, QString( "FX%1Level" ).arg( nFX + 1 ), QString("%1").arg( pBus->get_fx_level( nFX ) ) );
+			}
+			busListNode.appendChild( busNode );
+		}
+		songNode.appendChild( busListNode );
+	}
+
 	// instrument list
 	QDomNode instrumentListNode = doc.createElement( "instrumentList" );
 	unsigned nInstrument = song->get_instrument_list()->size();
@@ -1289,6 +1309,15 @@ int SongWriter::writeSong( Song *song, const QString& filename )
 
 		LocalFileMng::writeXmlString( instrumentNode, "muteGroup", QString("%1").arg( instr->get_mute_group() ) );
 		LocalFileMng::writeXmlBool( instrumentNode, "isStopNote", instr->is_stop_notes() );
+		LocalFileMng::writeXmlString( instrumentNode, "maxVoices", QString("%1").arg( instr->get_max_voices() ) );
+		LocalFileMng::writeXmlString( instrumentNode, "bus", QString("%1").arg( instr->get_bus() ) );
+		QString sSampleSelection = "VELOCITY";
+		if ( instr->get_sample_selection_alg() == Instrument::ROUND_ROBIN ) {
+			sSampleSelection = "ROUND_ROBIN";
+		} else if ( instr->get_sample_selection_alg() == Instrument::RANDOM ) {
+			sSampleSelection = "RANDOM";
+		}
+		LocalFileMng::writeXmlString( instrumentNode, "sampleSelectionAlgo", sSampleSelection );
 
 		LocalFileMng::writeXmlString( instrumentNode, "midiOutChannel", QString("%1").arg( instr->get_midi_out_channel() ) );
 		LocalFileMng::writeXmlString( instrumentNode, "midiOutNote", QString("%1").arg( instr->get_midi_out_note() ) );
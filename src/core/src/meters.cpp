@@ -0,0 +1,205 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/meters.h>
+#include <hydrogen/sampler/mix_kernels.h>
+
+#include <cmath>
+#include <cstring>
+
+// the running levels restart anyway past this many frames, when nobody reads them
+#define METER_MAX_FRAMES	( 1 << 20 )
+
+namespace H2Core
+{
+
+const char* Meters::__class_name = "Meters";
+
+Meters::Meters()
+		: Object( __class_name )
+		, __back( 0 )
+		, __front( 2 )
+		, __middle( 1 )
+{
+	__true_peak_history_L = new float[ MAX_BUFFER_SIZE + METER_TRUE_PEAK_TAPS - 1 ];
+	__true_peak_history_R = new float[ MAX_BUFFER_SIZE + METER_TRUE_PEAK_TAPS - 1 ];
+	memset( __true_peak_history_L, 0, ( METER_TRUE_PEAK_TAPS - 1 ) * sizeof( float ) );
+	memset( __true_peak_history_R, 0, ( METER_TRUE_PEAK_TAPS - 1 ) * sizeof( float ) );
+
+	// Hann windowed sinc, each phase interpolates a point between the two middle taps
+	const int nHalf = METER_TRUE_PEAK_TAPS / 2;
+	for ( int nPhase = 0; nPhase < METER_TRUE_PEAK_PHASES; ++nPhase ) {
+		double fFraction = ( double )( nPhase + 1 ) / ( METER_TRUE_PEAK_PHASES + 1 );
+		double fSum = 0.0;
+		for ( int k = 0; k < METER_TRUE_PEAK_TAPS; ++k ) {
+			double t = k - ( nHalf - 1 ) - fFraction;
+			double fSinc = ( t == 0.0 ? 1.0 : sin( M_PI * t ) / ( M_PI * t ) );
+			double fWindow = 0.5 * ( 1.0 + cos( M_PI * t / nHalf ) );
+			__true_peak_taps[ nPhase ][ k ] = fSinc * fWindow;
+			fSum += fSinc * fWindow;
+		}
+		for ( int k = 0; k < METER_TRUE_PEAK_TAPS; ++k ) {
+			__true_peak_taps[ nPhase ][ k ] /= fSum;
+		}
+	}
+
+	memset( __levels, 0, sizeof( __levels ) );
+	__clear();
+}
+
+Meters::~Meters()
+{
+	delete[] __true_peak_history_L;
+	delete[] __true_peak_history_R;
+}
+
+void Meters::__clear()
+{
+	memset( __instruments, 0, sizeof( __instruments ) );
+	memset( __buses, 0, sizeof( __buses ) );
+	memset( __fx, 0, sizeof( __fx ) );
+	memset( &__master, 0, sizeof( __master ) );
+	__true_peak_l = 0.0f;
+	__true_peak_r = 0.0f;
+	__frames = 0;
+}
+
+void Meters::begin_cycle( int nFrames )
+{
+	// the reader took everything published so far
+	if ( !( __middle.fetchAndAddAcquire( 0 ) & __fresh_bit ) || __frames > METER_MAX_FRAMES ) {
+		__clear();
+	}
+	__frames += nFrames;
+}
+
+void Meters::__accumulate( Accumulator& acc, const float* pL, const float* pR, float fGain_L, float fGain_R, int nFrames )
+{
+	float fPeak_L = 0.0f;
+	float fPeak_R = 0.0f;
+	float fSum_L = 0.0f;
+	float fSum_R = 0.0f;
+	mix_meter( pL, nFrames, &fPeak_L, &fSum_L );
+	mix_meter( pR, nFrames, &fPeak_R, &fSum_R );
+
+	fPeak_L *= fabsf( fGain_L );
+	fPeak_R *= fabsf( fGain_R );
+	if ( fPeak_L > acc.peak_l ) {
+		acc.peak_l = fPeak_L;
+	}
+	if ( fPeak_R > acc.peak_r ) {
+		acc.peak_r = fPeak_R;
+	}
+	acc.sum_l += fSum_L * fGain_L * fGain_L;
+	acc.sum_r += fSum_R * fGain_R * fGain_R;
+}
+
+void Meters::meter_instrument( int nInstrument, const float* pL, const float* pR, int nFrames )
+{
+	if ( nInstrument < 0 || nInstrument >= MAX_INSTRUMENTS ) {
+		return;
+	}
+	__accumulate( __instruments[ nInstrument ], pL, pR, 1.0f, 1.0f, nFrames );
+}
+
+void Meters::meter_bus( int nBus, const float* pL, const float* pR, float fGain_L, float fGain_R, int nFrames )
+{
+	if ( nBus < 0 || nBus >= MAX_BUSES ) {
+		return;
+	}
+	__accumulate( __buses[ nBus ], pL, pR, fGain_L, fGain_R, nFrames );
+}
+
+void Meters::meter_fx( int nFX, const float* pL, const float* pR, int nFrames )
+{
+	if ( nFX < 0 || nFX >= MAX_FX ) {
+		return;
+	}
+	__accumulate( __fx[ nFX ], pL, pR, 1.0f, 1.0f, nFrames );
+}
+
+void Meters::meter_master( const float* pL, const float* pR, int nFrames )
+{
+	__accumulate( __master, pL, pR, 1.0f, 1.0f, nFrames );
+	__true_peak_l = __true_peak( pL, __true_peak_history_L, nFrames, __true_peak_l );
+	__true_peak_r = __true_peak( pR, __true_peak_history_R, nFrames, __true_peak_r );
+}
+
+float Meters::__true_peak( const float* pIn, float* pHistory, int nFrames, float fPeak )
+{
+	// the filter delays the points by half its length, the last frames wait for the next cycle
+	memcpy( pHistory + METER_TRUE_PEAK_TAPS - 1, pIn, nFrames * sizeof( float ) );
+	for ( int i = 0; i < nFrames; ++i ) {
+		for ( int nPhase = 0; nPhase < METER_TRUE_PEAK_PHASES; ++nPhase ) {
+			float fValue = fabsf( mix_dot( pHistory + i, __true_peak_taps[ nPhase ], METER_TRUE_PEAK_TAPS ) );
+			if ( fValue > fPeak ) {
+				fPeak = fValue;
+			}
+		}
+	}
+	memmove( pHistory, pHistory + nFrames, ( METER_TRUE_PEAK_TAPS - 1 ) * sizeof( float ) );
+	return fPeak;
+}
+
+void Meters::__level( const Accumulator& acc, MeterLevel& level )
+{
+	level.peak_l = acc.peak_l;
+	level.peak_r = acc.peak_r;
+	level.rms_l = ( __frames > 0 ? sqrtf( acc.sum_l / __frames ) : 0.0f );
+	level.rms_r = ( __frames > 0 ? sqrtf( acc.sum_r / __frames ) : 0.0f );
+}
+
+void Meters::publish( int nInstruments, int nBuses )
+{
+	MeterLevels& levels = __levels[ __back ];
+
+	levels.instruments = ( nInstruments < MAX_INSTRUMENTS ? nInstruments : MAX_INSTRUMENTS );
+	for ( int i = 0; i < levels.instruments; ++i ) {
+		__level( __instruments[ i ], levels.instrument[ i ] );
+	}
+	levels.buses = ( nBuses < MAX_BUSES ? nBuses : MAX_BUSES );
+	for ( int i = 0; i < levels.buses; ++i ) {
+		__level( __buses[ i ], levels.bus[ i ] );
+	}
+	for ( int i = 0; i < MAX_FX; ++i ) {
+		__level( __fx[ i ], levels.fx[ i ] );
+	}
+	__level( __master, levels.master );
+	// the frames themselves are points of the signal too
+	levels.true_peak_l = ( __true_peak_l > __master.peak_l ? __true_peak_l : __master.peak_l );
+	levels.true_peak_r = ( __true_peak_r > __master.peak_r ? __true_peak_r : __master.peak_r );
+
+	__back = __middle.fetchAndStoreOrdered( __back | __fresh_bit ) & ~__fresh_bit;
+}
+
+bool Meters::update_levels()
+{
+	if ( !( __middle.fetchAndAddAcquire( 0 ) & __fresh_bit ) ) {
+		return false;
+	}
+	__front = __middle.fetchAndStoreOrdered( __front ) & ~__fresh_bit;
+	return true;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
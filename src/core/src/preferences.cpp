@@ -185,6 +185,14 @@ Preferences::Preferences()
 	m_bUseMetronome = false;
 	m_fMetronomeVolume = 0.5;
 	m_nMaxNotes = 256;
+	m_nRenderThreads = 1;
+	m_nVoiceStealing = 0;
+	m_bSampleStreaming = false;
+	m_nStreamingPreload = 250;
+	m_nSampleCacheSize = 1024;
+	m_nLoaderThreads = 0;
+	m_bCompactSamples = false;
+	m_bResampleSamples = false;
 	m_nBufferSize = 1024;
 	m_nSampleRate = 44100;
 
@@ -200,6 +208,7 @@ Preferences::Preferences()
 
 	//___  alsa audio driver properties ___
 	m_sAlsaAudioDevice = QString("hw:0");
+	m_nAlsaChannels = 2;
 
 	//___  jack driver properties ___
 	m_sJackPortName1 = QString("alsa_pcm:playback_1");
@@ -471,6 +480,14 @@ void Preferences::loadPreferences( bool bGlobal )
 				m_bUseMetronome = LocalFileMng::readXmlBool( audioEngineNode, "use_metronome", m_bUseMetronome );
 				m_fMetronomeVolume = LocalFileMng::readXmlFloat( audioEngineNode, "metronome_volume", 0.5f );
 				m_nMaxNotes = LocalFileMng::readXmlInt( audioEngineNode, "maxNotes", m_nMaxNotes );
+				m_nRenderThreads = LocalFileMng::readXmlInt( audioEngineNode, "renderThreads", m_nRenderThreads );
+				m_nVoiceStealing = LocalFileMng::readXmlInt( audioEngineNode, "voiceStealing", m_nVoiceStealing );
+				m_bSampleStreaming = LocalFileMng::readXmlBool( audioEngineNode, "sampleStreaming", m_bSampleStreaming );
+				m_nStreamingPreload = LocalFileMng::readXmlInt( audioEngineNode, "streamingPreload", m_nStreamingPreload );
+				m_nSampleCacheSize = LocalFileMng::readXmlInt( audioEngineNode, "sampleCacheSize", m_nSampleCacheSize );
+				m_nLoaderThreads = LocalFileMng::readXmlInt( audioEngineNode, "loaderThreads", m_nLoaderThreads );
+				m_bCompactSamples = LocalFileMng::readXmlBool( audioEngineNode, "compactSamples", m_bCompactSamples );
+				m_bResampleSamples = LocalFileMng::readXmlBool( audioEngineNode, "resampleSamples", m_bResampleSamples );
 				m_nBufferSize = LocalFileMng::readXmlInt( audioEngineNode, "buffer_size", m_nBufferSize );
 				m_nSampleRate = LocalFileMng::readXmlInt( audioEngineNode, "samplerate", m_nSampleRate );
 
@@ -521,6 +538,7 @@ void Preferences::loadPreferences( bool bGlobal )
 					recreate = true;
 				} else {
 					m_sAlsaAudioDevice = LocalFileMng::readXmlString( alsaAudioDriverNode, "alsa_audio_device", m_sAlsaAudioDevice );
+					m_nAlsaChannels = LocalFileMng::readXmlInt( alsaAudioDriverNode, "alsa_channels", m_nAlsaChannels );
 				}
 
 				/// MIDI DRIVER ///
@@ -823,6 +841,14 @@ void Preferences::savePreferences()
 		LocalFileMng::writeXmlString( audioEngineNode, "use_metronome", m_bUseMetronome ? "true": "false" );
 		LocalFileMng::writeXmlString( audioEngineNode, "metronome_volume", QString("%1").arg( m_fMetronomeVolume ) );
 		LocalFileMng::writeXmlString( audioEngineNode, "maxNotes", QString("%1").arg( m_nMaxNotes ) );
+		LocalFileMng::writeXmlString( audioEngineNode, "renderThreads", QString("%1").arg( m_nRenderThreads ) );
+		LocalFileMng::writeXmlString( audioEngineNode, "voiceStealing", QString("%1").arg( m_nVoiceStealing ) );
+		LocalFileMng::writeXmlString( audioEngineNode, "sampleStreaming", m_bSampleStreaming ? "true": "false" );
+		LocalFileMng::writeXmlString( audioEngineNode, "streamingPreload", QString("%1").arg( m_nStreamingPreload ) );
+		LocalFileMng::writeXmlString( audioEngineNode, "sampleCacheSize", QString("%1").arg( m_nSampleCacheSize ) );
+		LocalFileMng::writeXmlString( audioEngineNode, "loaderThreads", QString("%1").arg( m_nLoaderThreads ) );
+		LocalFileMng::writeXmlString( audioEngineNode, "compactSamples", m_bCompactSamples ? "true": "false" );
+		LocalFileMng::writeXmlString( audioEngineNode, "resampleSamples", m_bResampleSamples ? "true": "false" );
 		LocalFileMng::writeXmlString( audioEngineNode, "buffer_size", QString("%1").arg( m_nBufferSize ) );
 		LocalFileMng::writeXmlString( audioEngineNode, "samplerate", QString("%1").arg( m_nSampleRate ) );
 
@@ -881,6 +907,7 @@ void Preferences::savePreferences()
 		QDomNode alsaAudioDriverNode = doc.createElement( "alsa_audio_driver" );
 		{
 			LocalFileMng::writeXmlString( alsaAudioDriverNode, "alsa_audio_device", m_sAlsaAudioDevice );
+			LocalFileMng::writeXmlString( alsaAudioDriverNode, "alsa_channels", QString("%1").arg( m_nAlsaChannels ) );
 		}
 		audioEngineNode.appendChild( alsaAudioDriverNode );
 
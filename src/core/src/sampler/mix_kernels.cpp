@@ -0,0 +1,381 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/sampler/mix_kernels.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#define H2_MIX_SSE
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define H2_MIX_SSE2
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define H2_MIX_NEON
+#endif
+
+namespace H2Core
+{
+
+void mix_apply_envelope( const float* in, const float* env, float* out, int n )
+{
+	int i = 0;
+#if defined(H2_MIX_SSE)
+	for ( ; i + 4 <= n; i += 4 ) {
+		_mm_storeu_ps( out + i, _mm_mul_ps( _mm_loadu_ps( in + i ), _mm_loadu_ps( env + i ) ) );
+	}
+#elif defined(H2_MIX_NEON)
+	for ( ; i + 4 <= n; i += 4 ) {
+		vst1q_f32( out + i, vmulq_f32( vld1q_f32( in + i ), vld1q_f32( env + i ) ) );
+	}
+#endif
+	for ( ; i < n; ++i ) {
+		out[i] = in[i] * env[i];
+	}
+}
+
+#if defined(H2_MIX_SSE2)
+/** the lower four 16 bit values of x, sign extended and converted to float */
+static inline __m128 widen_lo( __m128i x )
+{
+	return _mm_cvtepi32_ps( _mm_srai_epi32( _mm_unpacklo_epi16( x, x ), 16 ) );
+}
+
+/** the upper four 16 bit values of x, sign extended and converted to float */
+static inline __m128 widen_hi( __m128i x )
+{
+	return _mm_cvtepi32_ps( _mm_srai_epi32( _mm_unpackhi_epi16( x, x ), 16 ) );
+}
+#endif
+
+void mix_apply_envelope_s16( const short* in, float scale, const float* env, float* out, int n )
+{
+	int i = 0;
+#if defined(H2_MIX_SSE2)
+	__m128 s = _mm_set1_ps( scale );
+	for ( ; i + 8 <= n; i += 8 ) {
+		__m128i x = _mm_loadu_si128( ( const __m128i* )( in + i ) );
+		_mm_storeu_ps( out + i, _mm_mul_ps( _mm_mul_ps( widen_lo( x ), s ), _mm_loadu_ps( env + i ) ) );
+		_mm_storeu_ps( out + i + 4, _mm_mul_ps( _mm_mul_ps( widen_hi( x ), s ), _mm_loadu_ps( env + i + 4 ) ) );
+	}
+#elif defined(H2_MIX_NEON)
+	float32x4_t s = vdupq_n_f32( scale );
+	for ( ; i + 8 <= n; i += 8 ) {
+		int16x8_t x = vld1q_s16( in + i );
+		float32x4_t lo = vcvtq_f32_s32( vmovl_s16( vget_low_s16( x ) ) );
+		float32x4_t hi = vcvtq_f32_s32( vmovl_s16( vget_high_s16( x ) ) );
+		vst1q_f32( out + i, vmulq_f32( vmulq_f32( lo, s ), vld1q_f32( env + i ) ) );
+		vst1q_f32( out + i + 4, vmulq_f32( vmulq_f32( hi, s ), vld1q_f32( env + i + 4 ) ) );
+	}
+#endif
+	for ( ; i < n; ++i ) {
+		out[i] = ( in[i] * scale ) * env[i];
+	}
+}
+
+void mix_add( const float* in, float gain, float* out, int n )
+{
+	int i = 0;
+#if defined(H2_MIX_SSE)
+	__m128 g = _mm_set1_ps( gain );
+	for ( ; i + 4 <= n; i += 4 ) {
+		__m128 v = _mm_mul_ps( _mm_loadu_ps( in + i ), g );
+		_mm_storeu_ps( out + i, _mm_add_ps( _mm_loadu_ps( out + i ), v ) );
+	}
+#elif defined(H2_MIX_NEON)
+	float32x4_t g = vdupq_n_f32( gain );
+	for ( ; i + 4 <= n; i += 4 ) {
+		// no vmlaq, it may be fused and round differently
+		float32x4_t v = vmulq_f32( vld1q_f32( in + i ), g );
+		vst1q_f32( out + i, vaddq_f32( vld1q_f32( out + i ), v ) );
+	}
+#endif
+	for ( ; i < n; ++i ) {
+		out[i] += in[i] * gain;
+	}
+}
+
+void mix_scatter( const float* in, const MixSend* sends, int nSends, int n )
+{
+	int i = 0;
+#if defined(H2_MIX_SSE)
+	for ( ; i + 4 <= n; i += 4 ) {
+		__m128 x = _mm_loadu_ps( in + i );
+		for ( int k = 0; k < nSends; ++k ) {
+			__m128 v = _mm_mul_ps( x, _mm_set1_ps( sends[k].gain ) );
+			_mm_storeu_ps( sends[k].out + i, _mm_add_ps( _mm_loadu_ps( sends[k].out + i ), v ) );
+		}
+	}
+#elif defined(H2_MIX_NEON)
+	for ( ; i + 4 <= n; i += 4 ) {
+		float32x4_t x = vld1q_f32( in + i );
+		for ( int k = 0; k < nSends; ++k ) {
+			float32x4_t v = vmulq_f32( x, vdupq_n_f32( sends[k].gain ) );
+			vst1q_f32( sends[k].out + i, vaddq_f32( vld1q_f32( sends[k].out + i ), v ) );
+		}
+	}
+#endif
+	for ( ; i < n; ++i ) {
+		float x = in[i];
+		for ( int k = 0; k < nSends; ++k ) {
+			sends[k].out[i] += x * sends[k].gain;
+		}
+	}
+}
+
+void mix_meter( const float* in, int n, float* peak, float* sum_squares )
+{
+	int i = 0;
+	float fPeak = *peak;
+	float fSum = 0.0f;
+#if defined(H2_MIX_SSE)
+	const __m128 sign = _mm_set1_ps( -0.0f );
+	__m128 p = _mm_set1_ps( fPeak );
+	__m128 sum = _mm_setzero_ps();
+	for ( ; i + 4 <= n; i += 4 ) {
+		__m128 x = _mm_loadu_ps( in + i );
+		p = _mm_max_ps( p, _mm_andnot_ps( sign, x ) );
+		sum = _mm_add_ps( sum, _mm_mul_ps( x, x ) );
+	}
+	// horizontal max and sum of the four lanes
+	p = _mm_max_ps( p, _mm_shuffle_ps( p, p, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	p = _mm_max_ps( p, _mm_shuffle_ps( p, p, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	_mm_store_ss( &fPeak, p );
+	sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+	sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+	_mm_store_ss( &fSum, sum );
+#elif defined(H2_MIX_NEON)
+	float32x4_t p = vdupq_n_f32( fPeak );
+	float32x4_t sum = vdupq_n_f32( 0.0f );
+	for ( ; i + 4 <= n; i += 4 ) {
+		float32x4_t x = vld1q_f32( in + i );
+		p = vmaxq_f32( p, vabsq_f32( x ) );
+		sum = vaddq_f32( sum, vmulq_f32( x, x ) );
+	}
+	// horizontal max and sum of the four lanes
+	float32x2_t p2 = vpmax_f32( vget_low_f32( p ), vget_high_f32( p ) );
+	p2 = vpmax_f32( p2, p2 );
+	fPeak = vget_lane_f32( p2, 0 );
+	float32x2_t sum2 = vadd_f32( vget_low_f32( sum ), vget_high_f32( sum ) );
+	fSum = vget_lane_f32( vpadd_f32( sum2, sum2 ), 0 );
+#else
+	// same summation order as the vector versions
+	float lanes[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for ( ; i + 4 <= n; i += 4 ) {
+		for ( int k = 0; k < 4; ++k ) {
+			float x = in[i + k];
+			float a = ( x < 0.0f ? -x : x );
+			if ( a > fPeak ) {
+				fPeak = a;
+			}
+			lanes[k] += x * x;
+		}
+	}
+	fSum = ( lanes[0] + lanes[2] ) + ( lanes[1] + lanes[3] );
+#endif
+	for ( ; i < n; ++i ) {
+		float x = in[i];
+		float a = ( x < 0.0f ? -x : x );
+		if ( a > fPeak ) {
+			fPeak = a;
+		}
+		fSum += x * x;
+	}
+	*peak = fPeak;
+	*sum_squares += fSum;
+}
+
+float mix_dot( const float* a, const float* b, int n )
+{
+#if defined(H2_MIX_SSE)
+	__m128 sum = _mm_setzero_ps();
+	for ( int i = 0; i < n; i += 4 ) {
+		sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( a + i ), _mm_loadu_ps( b + i ) ) );
+	}
+	// horizontal sum of the four lanes
+	sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+	sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+	float result;
+	_mm_store_ss( &result, sum );
+	return result;
+#elif defined(H2_MIX_NEON)
+	float32x4_t sum = vdupq_n_f32( 0.0f );
+	for ( int i = 0; i < n; i += 4 ) {
+		sum = vaddq_f32( sum, vmulq_f32( vld1q_f32( a + i ), vld1q_f32( b + i ) ) );
+	}
+	float32x2_t sum2 = vadd_f32( vget_low_f32( sum ), vget_high_f32( sum ) );
+	return vget_lane_f32( vpadd_f32( sum2, sum2 ), 0 );
+#else
+	// same summation order as the vector versions
+	float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for ( int i = 0; i < n; i += 4 ) {
+		sum[0] += a[i] * b[i];
+		sum[1] += a[i + 1] * b[i + 1];
+		sum[2] += a[i + 2] * b[i + 2];
+		sum[3] += a[i + 3] * b[i + 3];
+	}
+	return ( sum[0] + sum[2] ) + ( sum[1] + sum[3] );
+#endif
+}
+
+float mix_dot_s16( const short* a, const float* b, int n )
+{
+#if defined(H2_MIX_SSE2)
+	__m128 sum = _mm_setzero_ps();
+	for ( int i = 0; i < n; i += 4 ) {
+		__m128 x = widen_lo( _mm_loadl_epi64( ( const __m128i* )( a + i ) ) );
+		sum = _mm_add_ps( sum, _mm_mul_ps( x, _mm_loadu_ps( b + i ) ) );
+	}
+	// horizontal sum of the four lanes
+	sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+	sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+	float result;
+	_mm_store_ss( &result, sum );
+	return result;
+#elif defined(H2_MIX_NEON)
+	float32x4_t sum = vdupq_n_f32( 0.0f );
+	for ( int i = 0; i < n; i += 4 ) {
+		float32x4_t x = vcvtq_f32_s32( vmovl_s16( vld1_s16( a + i ) ) );
+		sum = vaddq_f32( sum, vmulq_f32( x, vld1q_f32( b + i ) ) );
+	}
+	float32x2_t sum2 = vadd_f32( vget_low_f32( sum ), vget_high_f32( sum ) );
+	return vget_lane_f32( vpadd_f32( sum2, sum2 ), 0 );
+#else
+	// same summation order as the vector versions
+	float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for ( int i = 0; i < n; i += 4 ) {
+		sum[0] += a[i] * b[i];
+		sum[1] += a[i + 1] * b[i + 1];
+		sum[2] += a[i + 2] * b[i + 2];
+		sum[3] += a[i + 3] * b[i + 3];
+	}
+	return ( sum[0] + sum[2] ) + ( sum[1] + sum[3] );
+#endif
+}
+
+#if defined(H2_MIX_NEON)
+/** transpose the 4x4 matrix whose rows are r0 to r3 */
+static inline void transpose4( float32x4_t& r0, float32x4_t& r1, float32x4_t& r2, float32x4_t& r3 )
+{
+	float32x4x2_t t02 = vzipq_f32( r0, r2 );
+	float32x4x2_t t13 = vzipq_f32( r1, r3 );
+	float32x4x2_t lo = vzipq_f32( t02.val[0], t13.val[0] );
+	float32x4x2_t hi = vzipq_f32( t02.val[1], t13.val[1] );
+	r0 = lo.val[0];
+	r1 = lo.val[1];
+	r2 = hi.val[0];
+	r3 = hi.val[1];
+}
+#endif
+
+void mix_filter_lanes( MixFilterLane* lanes, int n )
+{
+	int i = 0;
+#if defined(H2_MIX_SSE)
+	// a register holds the same frame of the four lanes, the lanes are
+	// loaded and stored four frames at a time through a transposition
+	__m128 cut = _mm_setr_ps( lanes[0].cutoff, lanes[1].cutoff, lanes[2].cutoff, lanes[3].cutoff );
+	__m128 res = _mm_setr_ps( lanes[0].resonance, lanes[1].resonance, lanes[2].resonance, lanes[3].resonance );
+	__m128 bp = _mm_setr_ps( lanes[0].bp, lanes[1].bp, lanes[2].bp, lanes[3].bp );
+	__m128 lp = _mm_setr_ps( lanes[0].lp, lanes[1].lp, lanes[2].lp, lanes[3].lp );
+	for ( ; i + 4 <= n; i += 4 ) {
+		__m128 x[4];
+		for ( int k = 0; k < 4; ++k ) {
+			x[k] = _mm_loadu_ps( lanes[k].buffer + i );
+		}
+		_MM_TRANSPOSE4_PS( x[0], x[1], x[2], x[3] );
+		for ( int k = 0; k < 4; ++k ) {
+			bp = _mm_add_ps( _mm_mul_ps( res, bp ), _mm_mul_ps( cut, _mm_sub_ps( x[k], lp ) ) );
+			lp = _mm_add_ps( lp, _mm_mul_ps( cut, bp ) );
+			x[k] = lp;
+		}
+		_MM_TRANSPOSE4_PS( x[0], x[1], x[2], x[3] );
+		for ( int k = 0; k < 4; ++k ) {
+			_mm_storeu_ps( lanes[k].buffer + i, x[k] );
+		}
+	}
+	float state[4];
+	_mm_storeu_ps( state, bp );
+	for ( int k = 0; k < 4; ++k ) lanes[k].bp = state[k];
+	_mm_storeu_ps( state, lp );
+	for ( int k = 0; k < 4; ++k ) lanes[k].lp = state[k];
+#elif defined(H2_MIX_NEON)
+	float state[4];
+	for ( int k = 0; k < 4; ++k ) state[k] = lanes[k].cutoff;
+	float32x4_t cut = vld1q_f32( state );
+	for ( int k = 0; k < 4; ++k ) state[k] = lanes[k].resonance;
+	float32x4_t res = vld1q_f32( state );
+	for ( int k = 0; k < 4; ++k ) state[k] = lanes[k].bp;
+	float32x4_t bp = vld1q_f32( state );
+	for ( int k = 0; k < 4; ++k ) state[k] = lanes[k].lp;
+	float32x4_t lp = vld1q_f32( state );
+	for ( ; i + 4 <= n; i += 4 ) {
+		float32x4_t x[4];
+		for ( int k = 0; k < 4; ++k ) {
+			x[k] = vld1q_f32( lanes[k].buffer + i );
+		}
+		transpose4( x[0], x[1], x[2], x[3] );
+		for ( int k = 0; k < 4; ++k ) {
+			bp = vaddq_f32( vmulq_f32( res, bp ), vmulq_f32( cut, vsubq_f32( x[k], lp ) ) );
+			lp = vaddq_f32( lp, vmulq_f32( cut, bp ) );
+			x[k] = lp;
+		}
+		transpose4( x[0], x[1], x[2], x[3] );
+		for ( int k = 0; k < 4; ++k ) {
+			vst1q_f32( lanes[k].buffer + i, x[k] );
+		}
+	}
+	vst1q_f32( state, bp );
+	for ( int k = 0; k < 4; ++k ) lanes[k].bp = state[k];
+	vst1q_f32( state, lp );
+	for ( int k = 0; k < 4; ++k ) lanes[k].lp = state[k];
+#endif
+	// the remaining frames, a lane after the other
+	for ( int k = 0; k < MIX_FILTER_LANES; ++k ) {
+		MixFilterLane& lane = lanes[k];
+		float fBp = lane.bp;
+		float fLp = lane.lp;
+		for ( int j = i; j < n; ++j ) {
+			fBp = lane.resonance * fBp + lane.cutoff * ( lane.buffer[j] - fLp );
+			fLp = fLp + lane.cutoff * fBp;
+			lane.buffer[j] = fLp;
+		}
+		lane.bp = fBp;
+		lane.lp = fLp;
+	}
+}
+
+const char* mix_kernels_name()
+{
+#if defined(H2_MIX_SSE)
+	return "SSE";
+#elif defined(H2_MIX_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
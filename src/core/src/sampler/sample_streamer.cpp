@@ -0,0 +1,230 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <hydrogen/sampler/sample_streamer.h>
+
+#include <cstring>
+
+namespace H2Core
+{
+
+const char* SampleStreamer::__class_name = "SampleStreamer";
+
+SampleStreamer::SampleStreamer( int streams ) : Object( __class_name ),
+	__stream_count( streams ),
+	__streams( 0 ),
+	__quit( 0 ),
+	__underruns( 0 ),
+	__prefetch_frames( 0 ),
+	__active_streams( 0 )
+{
+	__streams = new Stream[ __stream_count ];
+	for ( int i=0; i<__stream_count; i++ ) {
+		Stream* s = &__streams[i];
+		s->sample = 0;
+		s->path[0] = 0;
+		s->start = 0;
+		s->frames = 0;
+		s->ring_l = 0;
+		s->ring_r = 0;
+		s->file = 0;
+		s->channels = 0;
+		s->end = 0;
+	}
+	__buffer.resize( STREAM_CHUNK_FRAMES * 2 );
+	if ( pthread_create( &__thread_handle, 0, __io_thread, this ) != 0 ) {
+		ERRORLOG( "Can't create the sample streaming thread" );
+		__quit.fetchAndStoreRelease( 1 );
+	}
+	INFOLOG( QString( "streaming samples for %1 voices" ).arg( __stream_count ) );
+}
+
+SampleStreamer::~SampleStreamer()
+{
+	if ( __quit.fetchAndStoreOrdered( 1 ) == 0 ) {
+		pthread_join( __thread_handle, 0 );
+	}
+	for ( int i=0; i<__stream_count; i++ ) {
+		Stream* s = &__streams[i];
+		if ( s->file ) sf_close( s->file );
+		delete[] s->ring_l;
+		delete[] s->ring_r;
+	}
+	delete[] __streams;
+}
+
+void SampleStreamer::open( int stream, const Sample* sample )
+{
+	if ( stream >= __stream_count ) return;
+	Stream* s = &__streams[stream];
+	s->sample = sample;
+	s->request.fetchAndAddOrdered( 1 );
+	strncpy( s->path, sample->get_stream_path(), STREAM_PATH_MAX - 1 );
+	s->path[STREAM_PATH_MAX - 1] = 0;
+	s->start = sample->get_resident_frames() - STREAM_OVERLAP_FRAMES;
+	s->frames = sample->get_frames();
+	s->read_pos.fetchAndStoreOrdered( s->start );
+	s->request.fetchAndAddOrdered( 1 );
+}
+
+void SampleStreamer::close( int stream )
+{
+	if ( stream >= __stream_count || __streams[stream].sample==0 ) return;
+	Stream* s = &__streams[stream];
+	s->sample = 0;
+	s->request.fetchAndAddOrdered( 1 );
+	s->path[0] = 0;
+	s->frames = 0;
+	s->request.fetchAndAddOrdered( 1 );
+}
+
+int SampleStreamer::get_data( int stream, int from, const float** data_l, const float** data_r )
+{
+	if ( stream >= __stream_count ) return 0;
+	Stream* s = &__streams[stream];
+	if ( s->served.fetchAndAddAcquire( 0 ) != s->request.fetchAndAddAcquire( 0 ) ) return 0;
+	int write_pos = s->write_pos.fetchAndAddAcquire( 0 );
+	if ( from < s->start || from >= write_pos || from < write_pos - STREAM_RING_FRAMES ) return 0;
+	s->read_pos.fetchAndStoreOrdered( from );
+	int idx = from & ( STREAM_RING_FRAMES - 1 );
+	*data_l = s->ring_l + idx;
+	*data_r = s->ring_r + idx;
+	int frames = write_pos - from;
+	if ( frames > STREAM_RING_FRAMES + STREAM_MIRROR_FRAMES - idx ) frames = STREAM_RING_FRAMES + STREAM_MIRROR_FRAMES - idx;
+	return frames;
+}
+
+void* SampleStreamer::__io_thread( void* param )
+{
+	( ( SampleStreamer* )param )->__run();
+	return 0;
+}
+
+void SampleStreamer::__run()
+{
+	int underruns = 0;
+	while ( __quit.fetchAndAddAcquire( 0 ) == 0 ) {
+		bool busy = false;
+		int active = 0;
+		int prefetch = STREAM_RING_FRAMES;
+		for ( int i=0; i<__stream_count; i++ ) {
+			Stream* s = &__streams[i];
+			if ( __service( s ) ) busy = true;
+			if ( s->file ) {
+				int ahead = s->write_pos.fetchAndAddAcquire( 0 ) - s->read_pos.fetchAndAddAcquire( 0 );
+				if ( ahead < prefetch ) prefetch = ahead;
+				active++;
+			}
+		}
+		__active_streams.fetchAndStoreRelease( active );
+		__prefetch_frames.fetchAndStoreRelease( active ? prefetch : 0 );
+		if ( underruns != get_underruns() ) {
+			underruns = get_underruns();
+			WARNINGLOG( QString( "%1 streamed voices missed frames, the disk is too slow or the preload too short" ).arg( underruns ) );
+		}
+		if ( !busy ) usleep( STREAM_IDLE_USLEEP );
+	}
+}
+
+bool SampleStreamer::__service( Stream* s )
+{
+	int request = s->request.fetchAndAddAcquire( 0 );
+	if ( request & 1 ) return false;    // being posted
+
+	if ( s->served.fetchAndAddAcquire( 0 ) != request ) {
+		// copy the request, it may be posted again meanwhile
+		char path[STREAM_PATH_MAX];
+		memcpy( path, s->path, STREAM_PATH_MAX );
+		path[STREAM_PATH_MAX - 1] = 0;
+		int start = s->start;
+		int frames = s->frames;
+		if ( s->request.fetchAndAddAcquire( 0 ) != request ) return true;
+
+		if ( s->file ) {
+			sf_close( s->file );
+			s->file = 0;
+		}
+		if ( path[0] ) {
+			if ( s->ring_l==0 ) {
+				s->ring_l = new float[ STREAM_RING_FRAMES + STREAM_MIRROR_FRAMES ];
+				s->ring_r = new float[ STREAM_RING_FRAMES + STREAM_MIRROR_FRAMES ];
+			}
+			SF_INFO info;
+			s->file = sf_open( path, SFM_READ, &info );
+			if ( s->file && sf_seek( s->file, start, SEEK_SET ) != start ) {
+				sf_close( s->file );
+				s->file = 0;
+			}
+			if ( !s->file ) {
+				ERRORLOG( QString( "Unable to stream %1 from frame %2" ).arg( path ).arg( start ) );
+			} else {
+				s->channels = info.channels;
+				s->end = frames;
+				if ( ( int )__buffer.size() < STREAM_CHUNK_FRAMES * s->channels ) __buffer.resize( STREAM_CHUNK_FRAMES * s->channels );
+			}
+		}
+		s->write_pos.fetchAndStoreOrdered( start );
+		s->served.fetchAndStoreOrdered( request );
+		return true;
+	}
+
+	if ( !s->file ) return false;
+	int write_pos = s->write_pos.fetchAndAddAcquire( 0 );
+	int space = STREAM_RING_FRAMES - ( write_pos - s->read_pos.fetchAndAddAcquire( 0 ) );
+	if ( space < STREAM_CHUNK_FRAMES + SAMPLE_GUARD_FRAMES ) return false;
+
+	int frames = s->end - write_pos;
+	if ( frames > STREAM_CHUNK_FRAMES ) frames = STREAM_CHUNK_FRAMES;
+	sf_count_t count = sf_readf_float( s->file, &__buffer[0], frames );
+	if ( count < 0 ) count = 0;
+	int channels = s->channels;
+	for ( int i=0; i<count; i++ ) {
+		float l = __buffer[ i * channels ];
+		__write_frame( s, write_pos + i, l, ( channels > 1 ? __buffer[ i * channels + 1 ] : l ) );
+	}
+	write_pos += count;
+	if ( count < frames || write_pos >= s->end ) {
+		// done with the file, zeros for the interpolation to read past the end
+		for ( int i=0; i<SAMPLE_GUARD_FRAMES; i++ ) __write_frame( s, write_pos + i, 0.0, 0.0 );
+		write_pos += SAMPLE_GUARD_FRAMES;
+		sf_close( s->file );
+		s->file = 0;
+	}
+	s->write_pos.fetchAndStoreOrdered( write_pos );
+	return true;
+}
+
+void SampleStreamer::__write_frame( Stream* s, int pos, float l, float r )
+{
+	int idx = pos & ( STREAM_RING_FRAMES - 1 );
+	s->ring_l[idx] = l;
+	s->ring_r[idx] = r;
+	if ( idx < STREAM_MIRROR_FRAMES ) {
+		s->ring_l[ STREAM_RING_FRAMES + idx ] = l;
+		s->ring_r[ STREAM_RING_FRAMES + idx ] = r;
+	}
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
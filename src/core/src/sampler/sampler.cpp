@@ -20,20 +20,27 @@
  *
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cmath>
+#include <cstring>
+#include <ctime>
+#include <sched.h>
 
 #include <hydrogen/IO/AudioOutput.h>
-#include <hydrogen/IO/JackOutput.h>
 
 #include <hydrogen/basics/adsr.h>
 #include <hydrogen/audio_engine.h>
+#include <hydrogen/command_queue.h>
 #include <hydrogen/globals.h>
 #include <hydrogen/hydrogen.h>
 #include <hydrogen/basics/instrument.h>
 #include <hydrogen/basics/instrument_list.h>
 #include <hydrogen/basics/instrument_layer.h>
 #include <hydrogen/basics/note.h>
+#include <hydrogen/basics/bus.h>
+#include <hydrogen/basics/note_pool.h>
 #include <hydrogen/Preferences.h>
 #include <hydrogen/basics/sample.h>
 #include <hydrogen/basics/song.h>
@@ -44,6 +51,9 @@
 
 #include <hydrogen/fx/Effects.h>
 #include <hydrogen/sampler/Sampler.h>
+#include <hydrogen/sampler/mix_kernels.h>
+#include <hydrogen/sampler/sample_streamer.h>
+#include <hydrogen/sampler/sinc_table.h>
 
 #include <iostream>
 #include <QDebug>
@@ -58,17 +68,96 @@ Sampler::Sampler()
 		, __main_out_L( NULL )
 		, __main_out_R( NULL )
 		, __preview_instrument( NULL )
+		, __posted_preview_instrument( NULL )
+		, __job_frames( 0 )
+		, __job_song( NULL )
+		, __job( 0 )
+		, __next_target( 0 )
+		, __targets_done( 0 )
+		, __quit( 0 )
+		, __driver_generation( 0 )
+		, __stolen_voices( 0 )
+		, __streamer( NULL )
 {
 	INFOLOG( "INIT" );
 		__interpolateMode = LINEAR;
 	__main_out_L = new float[ MAX_BUFFER_SIZE ];
 	__main_out_R = new float[ MAX_BUFFER_SIZE ];
 
+	// a slot per playing note, see reserve_voices()
+	int nVoices = Preferences::get_instance()->m_nMaxNotes + NOTE_POOL_HEADROOM;
+	__filter_bp_L.resize( nVoices, 0.0 );
+	__filter_bp_R.resize( nVoices, 0.0 );
+	__filter_lp_L.resize( nVoices, 0.0 );
+	__filter_lp_R.resize( nVoices, 0.0 );
+	__voice_routes.resize( nVoices );
+	__free_voices.reserve( nVoices );
+	for ( int i = nVoices - 1; i >= 0; --i ) {
+		__free_voices.push_back( i );
+	}
+	__voice_results.reserve( nVoices );
+	__playing_notes_queue.reserve( nVoices );
+	__queuedNoteOffs.reserve( nVoices );
+	__key_targets.reserve( MAX_INSTRUMENTS + 1 );
+	__track_out_L.reserve( MAX_INSTRUMENTS );
+	__track_out_R.reserve( MAX_INSTRUMENTS );
+	__dying_instruments.reserve( MAX_INSTRUMENTS );
+	for ( int i = 0; i < MAX_MUTE_GROUPS; ++i ) {
+		__mute_group_voices[ i ] = NULL;
+	}
+	for ( int i = 0; i < SAMPLER_MIDI_KEYS; ++i ) {
+		__key_voices[ i ] = NULL;
+	}
+	INFOLOG( QString( "using %1 mix kernels" ).arg( mix_kernels_name() ) );
+	if ( Preferences::get_instance()->m_bSampleStreaming ) {
+		__streamer = new SampleStreamer( nVoices );
+	}
+
+	// the audio thread renders with the first target, straight into the main outs
+	__targets.push_back( __create_target( false ) );
+#ifdef Q_OS_MACX
+	semaphore_create( mach_task_self(), &__job_finished, SYNC_POLICY_FIFO, 0 );
+#else
+	sem_init( &__job_finished, 0, 0 );
+#endif
+	int nThreads = Preferences::get_instance()->m_nRenderThreads;
+	if ( nThreads < 1 ) nThreads = 1;
+	if ( nThreads > SAMPLER_MAX_RENDER_THREADS ) nThreads = SAMPLER_MAX_RENDER_THREADS;
+	for ( int i = 1; i < nThreads; ++i ) {
+		Worker* pWorker = new Worker;
+		pWorker->sampler = this;
+		pWorker->index = i;
+		pWorker->sleeping = 0;
+		pWorker->driver_generation = 0;
+#ifdef Q_OS_MACX
+		semaphore_create( mach_task_self(), &pWorker->wake, SYNC_POLICY_FIFO, 0 );
+#else
+		sem_init( &pWorker->wake, 0, 0 );
+#endif
+		__targets.push_back( __create_target( true ) );
+		if ( pthread_create( &pWorker->thread, NULL, __worker_thread, pWorker ) != 0 ) {
+			ERRORLOG( QString( "Can't create render thread %1" ).arg( i ) );
+			__delete_target( __targets.back(), true );
+			__targets.pop_back();
+#ifdef Q_OS_MACX
+			semaphore_destroy( mach_task_self(), pWorker->wake );
+#else
+			sem_destroy( &pWorker->wake );
+#endif
+			delete pWorker;
+			break;
+		}
+		__workers.push_back( pWorker );
+	}
+	__target_loads.resize( __targets.size(), 0 );
+	INFOLOG( QString( "rendering voices with %1 threads" ).arg( __targets.size() ) );
+
 	// instrument used in file preview
 	QString sEmptySampleFilename = Filesystem::empty_sample();
 	__preview_instrument = new Instrument( EMPTY_INSTR_ID, sEmptySampleFilename );
 	__preview_instrument->set_volume( 0.8 );
 	__preview_instrument->set_layer( new InstrumentLayer( Sample::load( sEmptySampleFilename ) ), 0 );
+	__posted_preview_instrument = __preview_instrument;
 
 }
 
@@ -77,11 +166,43 @@ Sampler::~Sampler()
 {
 	INFOLOG( "DESTROY" );
 
+	// stop the render threads
+	__quit.fetchAndStoreOrdered( 1 );
+	__job.fetchAndAddOrdered( 1 );
+	for ( unsigned i = 0; i < __workers.size(); ++i ) {
+		__wake_worker( __workers[ i ] );
+	}
+	for ( unsigned i = 0; i < __workers.size(); ++i ) {
+		pthread_join( __workers[ i ]->thread, NULL );
+#ifdef Q_OS_MACX
+		semaphore_destroy( mach_task_self(), __workers[ i ]->wake );
+#else
+		sem_destroy( &__workers[ i ]->wake );
+#endif
+		delete __workers[ i ];
+	}
+	__workers.clear();
+#ifdef Q_OS_MACX
+	semaphore_destroy( mach_task_self(), __job_finished );
+#else
+	sem_destroy( &__job_finished );
+#endif
+	for ( unsigned i = 0; i < __targets.size(); ++i ) {
+		__delete_target( __targets[ i ], i != 0 );
+	}
+	__targets.clear();
+	delete __streamer;
+	__streamer = NULL;
+
 	delete[] __main_out_L;
 	delete[] __main_out_R;
 
 	delete __preview_instrument;
 	__preview_instrument = NULL;
+	for ( unsigned i = 0; i < __dying_instruments.size(); ++i ) {
+		delete __dying_instruments[ i ];
+	}
+	__dying_instruments.clear();
 }
 
 // perche' viene passata anche la canzone? E' davvero necessaria?
@@ -97,24 +218,120 @@ void Sampler::process( uint32_t nFrames, Song* pSong )
 	// Track output queues are zeroed by
 	// audioEngine_process_clearAudioBuffers()
 
-	// Max notes limit
+	// Max notes limit, note_on() keeps to it unless it was just lowered
 	int m_nMaxNotes = Preferences::get_instance()->m_nMaxNotes;
-	while ( ( int )__playing_notes_queue.size() > m_nMaxNotes ) {
-		Note *oldNote = __playing_notes_queue[ 0 ];
-		__playing_notes_queue.erase( __playing_notes_queue.begin() );
-		oldNote->get_instrument()->dequeue();
-		delete oldNote;	// FIXME: send note-off instead of removing the note from the list?
+	while ( __count_voices( NULL ) > m_nMaxNotes ) {
+		Note *pVictim = __find_victim( NULL, false );
+		if ( pVictim == NULL ) break;
+		__steal_voice( pVictim );
 	}
 
 
+	// the first target mixes straight into the main outs and the FX buffers
+	RenderTarget* pMain = __targets[ 0 ];
+	pMain->main_L = __main_out_L;
+	pMain->main_R = __main_out_R;
+#ifdef H2CORE_HAVE_LADSPA
+	for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
+		LadspaFX *pFX = Effects::get_instance()->getLadspaFX( nFX );
+		pMain->fx_L[ nFX ] = ( pFX ? pFX->m_pBuffer_L : NULL );
+		pMain->fx_R[ nFX ] = ( pFX ? pFX->m_pBuffer_R : NULL );
+	}
+#endif
+
+	// track outputs, the driver may hand out new buffers each cycle
+	__track_out_L.clear();
+	__track_out_R.clear();
+	if ( audio_output->has_track_outs() ) {
+		int nTracks = pSong->get_instrument_list()->size();
+		for ( int nTrack = 0; nTrack < nTracks; ++nTrack ) {
+			__track_out_L.push_back( audio_output->getTrackOut_L( nTrack ) );
+			__track_out_R.push_back( audio_output->getTrackOut_R( nTrack ) );
+		}
+	}
+
+	// only resolved again once the instrument list or the FX levels changed
+	int nGeneration = InstrumentList::get_generation();
+	for ( unsigned i = 0; i < __playing_notes_queue.size(); ++i ) {
+		__route_voice( __playing_notes_queue[ i ], pSong, nGeneration );
+	}
+
 	// eseguo tutte le note nella lista di note in esecuzione
+	unsigned nNotes = __playing_notes_queue.size();
+	__voice_results.resize( nNotes );
+	bool bParallel = __assign_voices( pSong );
+	__job_frames = nFrames;
+	__job_song = pSong;
+	if ( bParallel ) {
+		// the workers follow the scheduling of the thread running the jobs
+		if ( __driver_generation.fetchAndAddAcquire( 0 ) == 0 || !pthread_equal( __driver_thread, pthread_self() ) ) {
+			__driver_thread = pthread_self();
+			__driver_generation.fetchAndAddOrdered( 1 );
+		}
+		// a late worker of the previous job may take a target as soon as they are reset
+		__targets_done.fetchAndStoreOrdered( 0 );
+		__next_target.fetchAndStoreOrdered( 0 );
+		__job.fetchAndAddOrdered( 1 );
+		for ( unsigned i = 0; i < __workers.size(); ++i ) {
+			__wake_worker( __workers[ i ] );
+		}
+		// whatever target is left, then sleep until the one still rendered is done
+		if ( !__render_targets() ) {
+			__wait_job( nFrames, audio_output->getSampleRate() );
+		}
+	} else {
+		__render_voices( 0 );
+	}
+	if ( bParallel ) {
+		// always summed in the same order, the mix does not depend on the timing
+		for ( unsigned nTarget = 1; nTarget < __targets.size(); ++nTarget ) {
+			if ( __target_loads[ nTarget ] == 0 ) continue;
+			RenderTarget* pTarget = __targets[ nTarget ];
+			mix_add( pTarget->main_L, 1.0f, __main_out_L, nFrames );
+			mix_add( pTarget->main_R, 1.0f, __main_out_R, nFrames );
+#ifdef H2CORE_HAVE_LADSPA
+			for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
+				if ( pMain->fx_L[ nFX ] == NULL ) continue;
+				mix_add( pTarget->fx_L[ nFX ], 1.0f, pMain->fx_L[ nFX ], nFrames );
+				mix_add( pTarget->fx_R[ nFX ], 1.0f, pMain->fx_R[ nFX ], nFrames );
+			}
+#endif
+			for ( unsigned nBus = 0; nBus < MAX_BUSES; ++nBus ) {
+				if ( !pTarget->bus_used[ nBus ] ) continue;
+				if ( !pMain->bus_used[ nBus ] ) {
+					memcpy( pMain->bus_L[ nBus ], pTarget->bus_L[ nBus ], nFrames * sizeof( float ) );
+					memcpy( pMain->bus_R[ nBus ], pTarget->bus_R[ nBus ], nFrames * sizeof( float ) );
+					pMain->bus_used[ nBus ] = true;
+					continue;
+				}
+				mix_add( pTarget->bus_L[ nBus ], 1.0f, pMain->bus_L[ nBus ], nFrames );
+				mix_add( pTarget->bus_R[ nBus ], 1.0f, pMain->bus_R[ nBus ], nFrames );
+			}
+		}
+	}
+	__mix_buses( pSong, nFrames );
+
+	// midi note on of the notes started in this cycle
+	MidiOutput* pMidiOut = Hydrogen::get_instance()->getMidiOutput();
+	for ( unsigned nTarget = 0; nTarget < __targets.size(); ++nTarget ) {
+		std::vector<Note*>& midiNotes = __targets[ nTarget ]->midi_notes;
+		if ( pMidiOut != NULL ) {
+			for ( unsigned n = 0; n < midiNotes.size(); ++n ) {
+				pMidiOut->handleQueueNote( midiNotes[ n ] );
+			}
+		}
+		midiNotes.clear();
+	}
+
 	unsigned i = 0;
+	unsigned nVoice = 0;
 	Note* pNote;
 	while ( i < __playing_notes_queue.size() ) {
 		pNote = __playing_notes_queue[ i ];		// recupero una nuova nota
-		unsigned res = __render_note( pNote, nFrames, pSong );
+		unsigned res = __voice_results[ nVoice++ ];
 		if ( res == 1 ) {	// la nota e' finita
 			__playing_notes_queue.erase( __playing_notes_queue.begin() + i );
+			__free_voice( pNote );
 			pNote->get_instrument()->dequeue();
 			__queuedNoteOffs.push_back( pNote );
 //			delete pNote;
@@ -126,18 +343,341 @@ void Sampler::process( uint32_t nFrames, Song* pSong )
 
 	//Queue midi note off messages for notes that have a length specified for them
 
-	while ( !__queuedNoteOffs.empty() ) {
-		pNote =  __queuedNoteOffs[0];
-		MidiOutput* midiOut = Hydrogen::get_instance()->getMidiOutput();
+	CommandQueue* pCommands = AudioEngine::get_instance()->get_command_queue();
+	MidiOutput* midiOut = Hydrogen::get_instance()->getMidiOutput();
+	for ( unsigned n = 0; n < __queuedNoteOffs.size(); ++n ) {
+		pNote = __queuedNoteOffs[ n ];
 		if( midiOut != NULL ){
 			midiOut->handleQueueNoteOff( pNote->get_instrument()->get_midi_out_channel(), pNote->get_midi_key(),  pNote->get_midi_velocity() );
 
 		}
-		__queuedNoteOffs.erase( __queuedNoteOffs.begin() );
-		if( pNote != NULL) delete pNote;
-		pNote = NULL;
-	}//while
+		// deleted outside of the audio thread
+		pCommands->retire( CommandQueue::RETIRED_NOTE, pNote );
+	}
+	__queuedNoteOffs.clear();
+
+	if ( !__dying_instruments.empty() ) {
+		__retire_instruments();
+	}
+}
+
+void Sampler::__retire_instruments()
+{
+	CommandQueue* pCommands = AudioEngine::get_instance()->get_command_queue();
+	unsigned nKept = 0;
+	for ( unsigned i = 0; i < __dying_instruments.size(); ++i ) {
+		Instrument* pInstr = __dying_instruments[ i ];
+		if ( pInstr->is_queued() == 0 ) {
+			pCommands->retire( CommandQueue::RETIRED_INSTRUMENT, pInstr );
+		} else {
+			__dying_instruments[ nKept++ ] = pInstr;
+		}
+	}
+	__dying_instruments.resize( nKept );
+}
+
+Sampler::RenderTarget* Sampler::__create_target( bool own_outputs )
+{
+	RenderTarget* target = new RenderTarget;
+	target->main_L = ( own_outputs ? new float[ MAX_BUFFER_SIZE ] : NULL );
+	target->main_R = ( own_outputs ? new float[ MAX_BUFFER_SIZE ] : NULL );
+	for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
+		target->fx_L[ nFX ] = ( own_outputs ? new float[ MAX_BUFFER_SIZE ] : NULL );
+		target->fx_R[ nFX ] = ( own_outputs ? new float[ MAX_BUFFER_SIZE ] : NULL );
+	}
+	for ( unsigned nBus = 0; nBus < MAX_BUSES; ++nBus ) {
+		target->bus_L[ nBus ] = new float[ MAX_BUFFER_SIZE ];
+		target->bus_R[ nBus ] = new float[ MAX_BUFFER_SIZE ];
+		target->bus_used[ nBus ] = false;
+	}
+	target->envelope = new float[ MAX_BUFFER_SIZE ];
+	target->voice_L = new float[ MAX_BUFFER_SIZE ];
+	target->voice_R = new float[ MAX_BUFFER_SIZE ];
+	target->resampled_L = new float[ MAX_BUFFER_SIZE ];
+	target->resampled_R = new float[ MAX_BUFFER_SIZE ];
+	target->instrument_L = new float[ MAX_BUFFER_SIZE ];
+	target->instrument_R = new float[ MAX_BUFFER_SIZE ];
+	for ( int i = 0; i < SAMPLER_FILTER_VOICES; ++i ) {
+		target->filter_L[ i ] = new float[ MAX_BUFFER_SIZE ];
+		target->filter_R[ i ] = new float[ MAX_BUFFER_SIZE ];
+	}
+	target->filter_pad = new float[ MAX_BUFFER_SIZE ];
+	memset( target->filter_pad, 0, MAX_BUFFER_SIZE * sizeof( float ) );
+	target->filtered_count = 0;
+	target->filter_voice = false;
+	target->midi_notes.reserve( Preferences::get_instance()->m_nMaxNotes + NOTE_POOL_HEADROOM );
+	target->voices.reserve( Preferences::get_instance()->m_nMaxNotes + NOTE_POOL_HEADROOM );
+	return target;
+}
+
+void Sampler::__delete_target( RenderTarget* target, bool own_outputs )
+{
+	if ( own_outputs ) {
+		delete[] target->main_L;
+		delete[] target->main_R;
+		for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
+			delete[] target->fx_L[ nFX ];
+			delete[] target->fx_R[ nFX ];
+		}
+	}
+	for ( unsigned nBus = 0; nBus < MAX_BUSES; ++nBus ) {
+		delete[] target->bus_L[ nBus ];
+		delete[] target->bus_R[ nBus ];
+	}
+	delete[] target->envelope;
+	delete[] target->voice_L;
+	delete[] target->voice_R;
+	delete[] target->resampled_L;
+	delete[] target->resampled_R;
+	delete[] target->instrument_L;
+	delete[] target->instrument_R;
+	for ( int i = 0; i < SAMPLER_FILTER_VOICES; ++i ) {
+		delete[] target->filter_L[ i ];
+		delete[] target->filter_R[ i ];
+	}
+	delete[] target->filter_pad;
+	delete target;
+}
+
+bool Sampler::__assign_voices( Song* pSong )
+{
+	unsigned nNotes = __playing_notes_queue.size();
+	std::fill( __target_loads.begin(), __target_loads.end(), 0 );
+	for ( unsigned t = 0; t < __targets.size(); ++t ) {
+		__targets[ t ]->voices.clear();
+	}
+	bool bSerial = ( __targets.size() == 1 || nNotes < 2 );
+
+	// the notes of an instrument share its track outputs and its instrument buffer,
+	// they all go to the target of the first one, chosen as the least busy
+	if ( !bSerial ) {
+		__key_targets.assign( pSong->get_instrument_list()->size() + 1, -1 );
+	}
+	for ( unsigned i = 0; i < nNotes; ++i ) {
+		int nInstrument = __voice_routes[ __playing_notes_queue[ i ]->get_voice() ].instrument;
+		int nTarget = 0;
+		if ( !bSerial ) {
+			int nKey = nInstrument + 1;	// the notes not in the song share the first key
+			nTarget = __key_targets[ nKey ];
+			if ( nTarget == -1 ) {
+				nTarget = 0;
+				for ( unsigned t = 1; t < __target_loads.size(); ++t ) {
+					if ( __target_loads[ t ] < __target_loads[ nTarget ] ) nTarget = t;
+				}
+				__key_targets[ nKey ] = nTarget;
+			}
+		}
+		__targets[ nTarget ]->voices.push_back( std::make_pair( nInstrument, i ) );
+		__target_loads[ nTarget ]++;
+	}
+
+	// the voices of an instrument are rendered one after the other
+	for ( unsigned t = 0; t < __targets.size(); ++t ) {
+		std::sort( __targets[ t ]->voices.begin(), __targets[ t ]->voices.end() );
+	}
+	return ( __target_loads[ 0 ] != ( int )nNotes );
+}
+
+void Sampler::__render_voices( int nTarget )
+{
+	RenderTarget* target = __targets[ nTarget ];
+	uint32_t nFrames = __job_frames;
+	// bus buffers are cleared by the first voice going to them
+	for ( unsigned nBus = 0; nBus < MAX_BUSES; ++nBus ) {
+		target->bus_used[ nBus ] = false;
+	}
+	if ( nTarget != 0 ) {
+		if ( __target_loads[ nTarget ] == 0 ) return;
+		memset( target->main_L, 0, nFrames * sizeof( float ) );
+		memset( target->main_R, 0, nFrames * sizeof( float ) );
+#ifdef H2CORE_HAVE_LADSPA
+		for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
+			if ( __targets[ 0 ]->fx_L[ nFX ] == NULL ) continue;
+			memset( target->fx_L[ nFX ], 0, nFrames * sizeof( float ) );
+			memset( target->fx_R[ nFX ], 0, nFrames * sizeof( float ) );
+		}
+#endif
+	}
+
+	std::vector< std::pair<int, unsigned> >& voices = target->voices;
+	float* pVoice_L = target->voice_L;
+	float* pVoice_R = target->voice_R;
+	unsigned n = 0;
+	while ( n < voices.size() ) {
+		int nInstrument = voices[ n ].first;
+		int nBus = __voice_routes[ __playing_notes_queue[ voices[ n ].second ]->get_voice() ].bus;
+		memset( target->instrument_L, 0, nFrames * sizeof( float ) );
+		memset( target->instrument_R, 0, nFrames * sizeof( float ) );
+		for ( ; n < voices.size() && voices[ n ].first == nInstrument; ++n ) {
+			unsigned i = voices[ n ].second;
+			Note* pNote = __playing_notes_queue[ i ];
+			// a filtered voice is rendered into the next lanes and waits for the following ones
+			target->filter_voice = pNote->get_instrument()->is_filter_active();
+			if ( target->filter_voice ) {
+				target->voice_L = target->filter_L[ target->filtered_count ];
+				target->voice_R = target->filter_R[ target->filtered_count ];
+			}
+			__voice_results[ i ] = __render_note( pNote, nFrames, __job_song, target );
+			target->voice_L = pVoice_L;
+			target->voice_R = pVoice_R;
+			if ( target->filtered_count == SAMPLER_FILTER_VOICES ) {
+				__filter_voices( __job_song, target );
+			}
+		}
+		// the instrument buffer is complete once its last voices are filtered
+		__filter_voices( __job_song, target );
+		__mix_instrument( nInstrument, nBus, nFrames, target );
+	}
+	target->filter_voice = false;
+}
+
+void Sampler::__mix_instrument( int nInstrument, int nBus, uint32_t nFrames, RenderTarget* target )
+{
+	float *pOut_L = target->main_L;
+	float *pOut_R = target->main_R;
+	if ( nBus != -1 ) {
+		pOut_L = target->bus_L[ nBus ];
+		pOut_R = target->bus_R[ nBus ];
+		if ( !target->bus_used[ nBus ] ) {
+			memset( pOut_L, 0, nFrames * sizeof( float ) );
+			memset( pOut_R, 0, nFrames * sizeof( float ) );
+			target->bus_used[ nBus ] = true;
+		}
+	}
+	mix_add( target->instrument_L, 1.0f, pOut_L, nFrames );
+	mix_add( target->instrument_R, 1.0f, pOut_R, nFrames );
+
+	// before the bus, notes not in the song (preview) are not metered
+	AudioEngine::get_instance()->get_meters()->meter_instrument( nInstrument, target->instrument_L, target->instrument_R, nFrames );
+}
+
+void* Sampler::__worker_thread( void* param )
+{
+	Worker* pWorker = ( Worker* )param;
+	Sampler* pSampler = pWorker->sampler;
+	Object *__object = pSampler;
+
+	int nSeen = pSampler->__job.fetchAndAddAcquire( 0 );
+	while ( true ) {
+		// the next job is usually a period away, spin a bit before sleeping
+		int nSpins = 0;
+		while ( pSampler->__job.fetchAndAddAcquire( 0 ) == nSeen && nSpins < SAMPLER_RENDER_SPINS ) {
+			++nSpins;
+		}
+		if ( pSampler->__job.fetchAndAddAcquire( 0 ) == nSeen ) {
+			// announce the sleep, then check again: either the next job shows up
+			// here or __wake_worker() sees the flag and posts
+			pWorker->sleeping.fetchAndStoreOrdered( 1 );
+			if ( pSampler->__job.fetchAndAddOrdered( 0 ) == nSeen
+				 || pWorker->sleeping.fetchAndStoreOrdered( 0 ) == 0 ) {
+				// no job yet, or it came with a post already on its way
+#ifdef Q_OS_MACX
+				while ( semaphore_wait( pWorker->wake ) != KERN_SUCCESS ) {}
+#else
+				while ( sem_wait( &pWorker->wake ) != 0 ) {}
+#endif
+			}
+		}
+		nSeen = pSampler->__job.fetchAndAddAcquire( 0 );
+		if ( pSampler->__quit.fetchAndAddAcquire( 0 ) ) break;
+		if ( pSampler->__render_targets() ) {
+			// the audio thread waits for the last target
+#ifdef Q_OS_MACX
+			semaphore_signal( pSampler->__job_finished );
+#else
+			sem_post( &pSampler->__job_finished );
+#endif
+		}
+		// once the job is done, the driver only changes when restarted
+		__follow_driver( pWorker );
+	}
+	return NULL;
+}
+
+
+
+bool Sampler::__render_targets()
+{
+	int nTargets = __targets.size();
+	bool bLast = false;
+	for ( ;; ) {
+		int nTarget = __next_target.fetchAndAddOrdered( 1 );
+		if ( nTarget >= nTargets ) break;
+		__render_voices( nTarget );
+		bLast = ( __targets_done.fetchAndAddOrdered( 1 ) == nTargets - 1 );
+	}
+	return bLast;
+}
+
+
+
+void Sampler::__wait_job( uint32_t nFrames, unsigned nSampleRate )
+{
+	// a period, a second if the rate is unknown
+	uint64_t nPeriod = ( nSampleRate ? ( uint64_t )nFrames * 1000000000LL / nSampleRate : 1000000000LL );
+#ifdef Q_OS_MACX
+	mach_timespec_t bound;
+	bound.tv_sec = nPeriod / 1000000000LL;
+	bound.tv_nsec = nPeriod % 1000000000LL;
+	if ( semaphore_timedwait( __job_finished, bound ) == KERN_SUCCESS ) return;
+#else
+	struct timespec bound;
+	clock_gettime( CLOCK_REALTIME, &bound );
+	uint64_t nNsec = bound.tv_nsec + nPeriod;
+	bound.tv_sec += nNsec / 1000000000LL;
+	bound.tv_nsec = nNsec % 1000000000LL;
+	for ( ;; ) {
+		if ( sem_timedwait( &__job_finished, &bound ) == 0 ) return;
+		if ( errno == ETIMEDOUT ) break;
+	}
+#endif
+	// the workers still write into their targets, the cycle can't go on without them
+	AudioEngine::get_instance()->get_command_queue()->count_incident( CommandQueue::INCIDENT_LATE_JOB );
+#ifdef Q_OS_MACX
+	while ( semaphore_wait( __job_finished ) != KERN_SUCCESS ) {}
+#else
+	while ( sem_wait( &__job_finished ) != 0 ) {}
+#endif
+}
+
+
+
+void Sampler::__follow_driver( Worker* worker )
+{
+	Sampler* pSampler = worker->sampler;
+	Object *__object = pSampler;
+	int nGeneration = pSampler->__driver_generation.fetchAndAddAcquire( 0 );
+	if ( nGeneration == worker->driver_generation ) return;
+	worker->driver_generation = nGeneration;
+
+	int nPolicy;
+	struct sched_param sched;
+	if ( pthread_getschedparam( pSampler->__driver_thread, &nPolicy, &sched ) != 0 ) return;
+	if ( nPolicy == SCHED_FIFO || nPolicy == SCHED_RR ) {
+		// just below the driver thread, which sleeps while the workers render
+		sched.sched_priority = std::max( sched.sched_priority - 1, sched_get_priority_min( nPolicy ) );
+	} else {
+		// the driver is not realtime, neither are the workers
+		nPolicy = SCHED_OTHER;
+		sched.sched_priority = 0;
+	}
+	if ( pthread_setschedparam( pthread_self(), nPolicy, &sched ) != 0 ) {
+		__WARNINGLOG( QString( "Can't set the scheduling of render thread %1" ).arg( worker->index ) );
+	}
+}
+
+
 
+void Sampler::__wake_worker( Worker* worker )
+{
+	// only the flag owner posts, so every post matches exactly one wait
+	if ( worker->sleeping.fetchAndStoreOrdered( 0 ) == 1 ) {
+#ifdef Q_OS_MACX
+		semaphore_signal( worker->wake );
+#else
+		sem_post( &worker->wake );
+#endif
+	}
 }
 
 
@@ -153,10 +693,9 @@ void Sampler::note_on( Note *note )
 	// mute group
 	int mute_grp = pInstr->get_mute_group();
 	if ( mute_grp != -1 ) {
-		// remove all notes using the same mute group
-		for ( unsigned j = 0; j < __playing_notes_queue.size(); j++ ) {	// delete older note
-			Note *pNote = __playing_notes_queue[ j ];
-			if ( ( pNote->get_instrument() != pInstr )  && ( pNote->get_instrument()->get_mute_group() == mute_grp ) ) {
+		// release the notes of the other instruments of the mute group
+		for ( Note* pNote = __mute_group_voices[ mute_grp ]; pNote; pNote = pNote->get_next_voice( Note::MUTE_GROUP_VOICES ) ) {
+			if ( pNote->get_instrument() != pInstr ) {
 				pNote->get_adsr()->release();
 			}
 		}
@@ -164,30 +703,41 @@ void Sampler::note_on( Note *note )
 
 	//note off notes
 	if( note->get_note_off() ){
-		for ( unsigned j = 0; j < __playing_notes_queue.size(); j++ ) {
-			Note *pNote = __playing_notes_queue[ j ];
-
-			if ( ( pNote->get_instrument() == pInstr ) ) {
-				//ERRORLOG("note_off");
-				pNote->get_adsr()->release();
-			}
+		for ( Note* pNote = *pInstr->get_voices(); pNote; pNote = pNote->get_next_voice( Note::INSTRUMENT_VOICES ) ) {
+			//ERRORLOG("note_off");
+			pNote->get_adsr()->release();
 		}
 	}
 
-	pInstr->enqueue();
+	// only the notes of the playing queue are dequeued once done, a note off note never gets there
 	if( !note->get_note_off() ){
+		pInstr->enqueue();
+		// the layer stays the same for the whole note
+		note->set_selected_layer( pInstr->select_layer( note->get_velocity() ) );
+		__make_room( pInstr );
+		if ( !__alloc_voice( note ) ) {
+			// the slots are only added while the driver is stopped, see reserve_voices()
+			CommandQueue* pCommands = AudioEngine::get_instance()->get_command_queue();
+			pInstr->dequeue();
+			pCommands->retire( CommandQueue::RETIRED_NOTE, note );
+			pCommands->count_incident( CommandQueue::INCIDENT_NOTE_DROPPED );
+			return;
+		}
+		__route_voice( note, Hydrogen::get_instance()->getSong(), InstrumentList::get_generation() );
+		// the disk reads start before the resident frames are played
+		InstrumentLayer *pLayer = ( note->get_selected_layer() == -1 ? NULL : pInstr->get_layer( note->get_selected_layer() ) );
+		if ( __streamer && pLayer && pLayer->get_sample() && pLayer->get_sample()->is_streamed() ) {
+			__streamer->open( note->get_voice(), pLayer->get_sample() );
+		}
 		__playing_notes_queue.push_back( note );
 	} 
 }
 
 void Sampler::midi_keyboard_note_off( int key )
 {
-	for ( unsigned j = 0; j < __playing_notes_queue.size(); j++ ) {
-		Note *pNote = __playing_notes_queue[ j ];
-
-		if ( ( pNote->get_midi_msg() == key) ) {
-			pNote->get_adsr()->release();
-		}
+	if ( key < 0 || key >= SAMPLER_MIDI_KEYS ) return;
+	for ( Note* pNote = __key_voices[ key ]; pNote; pNote = pNote->get_next_voice( Note::KEY_VOICES ) ) {
+		pNote->get_adsr()->release();
 	}
 }
 
@@ -201,21 +751,586 @@ void Sampler::note_off( Note* note )
 {
 
 	Instrument *pInstr = note->get_instrument();
-	// find the notes using the same instrument, and release them
-	for ( unsigned j = 0; j < __playing_notes_queue.size(); j++ ) {
-		Note *pNote = __playing_notes_queue[ j ];
-		if ( pNote->get_instrument() == pInstr ) {
-			pNote->get_adsr()->release();
+	// release the notes using the same instrument
+	for ( Note* pNote = *pInstr->get_voices(); pNote; pNote = pNote->get_next_voice( Note::INSTRUMENT_VOICES ) ) {
+		pNote->get_adsr()->release();
+	}
+}
+
+
+
+void Sampler::queue_note_on( Note *note )
+{
+	Command cmd;
+	cmd.type = COMMAND_NOTE_ON;
+	cmd.note = note;
+	AudioEngine::get_instance()->post_command( cmd );
+}
+
+
+
+void Sampler::queue_note_off( Note *note )
+{
+	Command cmd;
+	cmd.type = COMMAND_NOTE_OFF;
+	cmd.note = note;
+	AudioEngine::get_instance()->post_command( cmd );
+}
+
+
+
+void Sampler::queue_midi_keyboard_note_off( int key )
+{
+	Command cmd;
+	cmd.type = COMMAND_MIDI_KEYBOARD_NOTE_OFF;
+	cmd.value = key;
+	AudioEngine::get_instance()->post_command( cmd );
+}
+
+
+
+void Sampler::queue_stop_playing_notes( Instrument *instr )
+{
+	Command cmd;
+	cmd.type = COMMAND_STOP_PLAYING_NOTES;
+	cmd.instrument = instr;
+	AudioEngine::get_instance()->post_command( cmd );
+}
+
+
+
+void Sampler::handle_command( const Command& cmd )
+{
+	CommandQueue* pCommands = AudioEngine::get_instance()->get_command_queue();
+
+	switch ( cmd.type ) {
+	case COMMAND_NOTE_ON:
+		note_on( cmd.note );
+		// note off notes never get into the playing queue
+		if ( cmd.note->get_note_off() ) {
+			pCommands->retire( CommandQueue::RETIRED_NOTE, cmd.note );
+		}
+		break;
+
+	case COMMAND_NOTE_OFF:
+		note_off( cmd.note );
+		pCommands->retire( CommandQueue::RETIRED_NOTE, cmd.note );
+		break;
+
+	case COMMAND_MIDI_KEYBOARD_NOTE_OFF:
+		midi_keyboard_note_off( cmd.value );
+		break;
+
+	case COMMAND_STOP_PLAYING_NOTES:
+		stop_playing_notes( cmd.instrument );
+		break;
+
+	case COMMAND_PREVIEW_SAMPLE: {
+		InstrumentLayer *pLayer = __preview_instrument->get_layer( 0 );
+		pCommands->retire( CommandQueue::RETIRED_SAMPLE, pLayer->get_sample() );
+		pLayer->set_sample( cmd.sample );
+
+		stop_playing_notes( __preview_instrument );
+		note_on( cmd.note );
+		break;
+	}
+
+	case COMMAND_PREVIEW_INSTRUMENT:
+		stop_playing_notes( __preview_instrument );
+		pCommands->retire( CommandQueue::RETIRED_INSTRUMENT, __preview_instrument );
+		__preview_instrument = cmd.instrument;
+
+		note_on( cmd.note );	// exclusive note
+		break;
+
+	case COMMAND_RETIRE_INSTRUMENT:
+		__retire_instruments();
+		if ( !cmd.instrument->is_queued() ) {
+			pCommands->retire( CommandQueue::RETIRED_INSTRUMENT, cmd.instrument );
+		} else if ( __dying_instruments.size() < __dying_instruments.capacity() ) {
+			// its ringing notes keep playing the old layers
+			__dying_instruments.push_back( cmd.instrument );
+		} else {
+			// never grown here, the instrument is lost rather than deleted under its notes
+			pCommands->count_incident( CommandQueue::INCIDENT_INSTRUMENT_LEAKED );
+		}
+		break;
+
+	default:
+		pCommands->count_incident( CommandQueue::INCIDENT_UNEXPECTED_COMMAND );
+	}
+}
+
+
+void Sampler::reserve_voices( int nVoices )
+{
+	int nSlots = __filter_bp_L.size();
+	if ( nVoices <= nSlots ) return;
+	INFOLOG( QString( "%1 voice slots" ).arg( nVoices ) );
+	__filter_bp_L.resize( nVoices, 0.0 );
+	__filter_bp_R.resize( nVoices, 0.0 );
+	__filter_lp_L.resize( nVoices, 0.0 );
+	__filter_lp_R.resize( nVoices, 0.0 );
+	__voice_routes.resize( nVoices );
+	__voice_results.reserve( nVoices );
+	__playing_notes_queue.reserve( nVoices );
+	__queuedNoteOffs.reserve( nVoices );
+	__free_voices.reserve( nVoices );
+	// the new slots are taken after the free ones
+	__free_voices.insert( __free_voices.begin(), nVoices - nSlots, 0 );
+	for ( int i = 0; i < nVoices - nSlots; ++i ) {
+		__free_voices[ i ] = nVoices - 1 - i;
+	}
+	for ( unsigned t = 0; t < __targets.size(); ++t ) {
+		__targets[ t ]->midi_notes.reserve( nVoices );
+		__targets[ t ]->voices.reserve( nVoices );
+	}
+}
+
+
+bool Sampler::__alloc_voice( Note* note )
+{
+	if ( __free_voices.empty() ) {
+		return false;
+	}
+	int nVoice = __free_voices.back();
+	__free_voices.pop_back();
+	__filter_bp_L[ nVoice ] = 0.0;
+	__filter_bp_R[ nVoice ] = 0.0;
+	__filter_lp_L[ nVoice ] = 0.0;
+	__filter_lp_R[ nVoice ] = 0.0;
+	note->set_voice( nVoice );
+	__voice_routes[ nVoice ].generation = -1;
+
+	Instrument* pInstr = note->get_instrument();
+	note->link_voice( Note::INSTRUMENT_VOICES, pInstr->get_voices() );
+	if ( pInstr->get_mute_group() != -1 ) {
+		note->link_voice( Note::MUTE_GROUP_VOICES, &__mute_group_voices[ pInstr->get_mute_group() ] );
+	}
+	int nKey = note->get_midi_msg();
+	if ( nKey >= 0 && nKey < SAMPLER_MIDI_KEYS ) {
+		note->link_voice( Note::KEY_VOICES, &__key_voices[ nKey ] );
+	}
+	return true;
+}
+
+
+
+void Sampler::__route_voice( Note* note, Song* pSong, int nGeneration )
+{
+	VoiceRoute& route = __voice_routes[ note->get_voice() ];
+	if ( route.generation == nGeneration ) return;
+
+	Instrument* pInstr = note->get_instrument();
+	// no song yet, try again next cycle
+	route.generation = ( pSong ? nGeneration : -1 );
+	route.instrument = ( pSong ? pSong->get_instrument_list()->index( pInstr ) : -1 );
+	int nBus = pInstr->get_bus();
+	route.bus = ( pSong && nBus < pSong->get_bus_count() ? nBus : -1 );
+	for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
+		route.fx_level[ nFX ] = pInstr->get_fx_level( nFX );
+	}
+}
+
+void Sampler::__free_voice( Note* note )
+{
+	if ( note->is_stolen() ) {
+		note->set_stolen( false );
+		__stolen_voices--;
+	}
+	if ( note->get_voice() != -1 ) {
+		if ( __streamer ) __streamer->close( note->get_voice() );
+		__free_voices.push_back( note->get_voice() );
+		note->set_voice( -1 );
+	}
+	for ( int i = 0; i < Note::VOICE_LISTS; ++i ) {
+		note->unlink_voice( ( Note::VoiceList )i );
+	}
+}
+
+
+
+int Sampler::__count_voices( Instrument* instrument )
+{
+	if ( instrument == NULL ) {
+		return __playing_notes_queue.size() - __stolen_voices;
+	}
+	int nVoices = 0;
+	for ( Note* pNote = *instrument->get_voices(); pNote; pNote = pNote->get_next_voice( Note::INSTRUMENT_VOICES ) ) {
+		if ( !pNote->is_stolen() ) nVoices++;
+	}
+	return nVoices;
+}
+
+/// A note not rendered yet has no envelope value, it is about to be heard.
+static inline float voice_level( Note* pNote )
+{
+	float fEnvelope = ( pNote->get_sample_position() == 0 ? 1.0 : pNote->get_adsr()->get_current_value() );
+	return fEnvelope * pNote->get_velocity();
+}
+
+Note* Sampler::__find_victim( Instrument* instrument, bool same_instrument_only )
+{
+	int nPolicy = Preferences::get_instance()->m_nVoiceStealing;
+	Note* pOldest = NULL;
+	Note* pQuietest = NULL;
+	Note* pReleased = NULL;
+	float fQuietest = 0.0;
+
+	if ( same_instrument_only || ( nPolicy == STEAL_SAME_INSTRUMENT && instrument != NULL ) ) {
+		// the newest notes come first, the last match is the oldest one
+		for ( Note* pNote = *instrument->get_voices(); pNote; pNote = pNote->get_next_voice( Note::INSTRUMENT_VOICES ) ) {
+			if ( pNote->is_stolen() ) continue;
+			pOldest = pNote;
+			if ( nPolicy == STEAL_QUIETEST ) {
+				float fLevel = voice_level( pNote );
+				if ( pQuietest == NULL || fLevel <= fQuietest ) {
+					pQuietest = pNote;
+					fQuietest = fLevel;
+				}
+			} else if ( nPolicy == STEAL_RELEASED && pNote->get_adsr()->is_released() ) {
+				pReleased = pNote;
+			}
+		}
+		if ( pQuietest != NULL ) return pQuietest;
+		if ( pReleased != NULL ) return pReleased;
+		if ( pOldest != NULL || same_instrument_only ) return pOldest;
+	}
+
+	// the notes are queued as they start, the first ones are the oldest
+	for ( unsigned i = 0; i < __playing_notes_queue.size(); ++i ) {
+		Note* pNote = __playing_notes_queue[ i ];
+		if ( pNote->is_stolen() ) continue;
+		if ( nPolicy == STEAL_QUIETEST ) {
+			if ( pOldest == NULL ) pOldest = pNote;
+			float fLevel = voice_level( pNote );
+			if ( pQuietest == NULL || fLevel < fQuietest ) {
+				pQuietest = pNote;
+				fQuietest = fLevel;
+			}
+		} else if ( nPolicy == STEAL_RELEASED ) {
+			if ( pOldest == NULL ) pOldest = pNote;
+			if ( pNote->get_adsr()->is_released() ) return pNote;
+		} else {
+			return pNote;
+		}
+	}
+	return ( pQuietest != NULL ? pQuietest : pOldest );
+}
+
+void Sampler::__steal_voice( Note* note )
+{
+	// a hard stop would click, the note ends with its envelope instead
+	note->get_adsr()->fade_out( SAMPLER_STEAL_FADE );
+	note->set_stolen( true );
+	__stolen_voices++;
+}
+
+void Sampler::__make_room( Instrument* instrument )
+{
+	int nMaxVoices = instrument->get_max_voices();
+	if ( nMaxVoices > 0 ) {
+		while ( __count_voices( instrument ) >= nMaxVoices ) {
+			Note* pVictim = __find_victim( instrument, true );
+			if ( pVictim == NULL ) break;
+			__steal_voice( pVictim );
+		}
+	}
+	int nMaxNotes = Preferences::get_instance()->m_nMaxNotes;
+	while ( __count_voices( NULL ) >= nMaxNotes ) {
+		Note* pVictim = __find_victim( instrument, false );
+		if ( pVictim == NULL ) break;
+		__steal_voice( pVictim );
+	}
+}
+
+
+
+void Sampler::__queue_filtered_voice( Note *pNote, int nTrack, int nBufferPos, int nFrames, int nChannels, float cost_L, float cost_R, float cost_track_L, float cost_track_R, RenderTarget* target )
+{
+	assert( target->filtered_count < SAMPLER_FILTER_VOICES );
+	FilteredVoice& voice = target->filtered[ target->filtered_count++ ];
+	voice.note = pNote;
+	voice.track = nTrack;
+	voice.buffer_pos = nBufferPos;
+	voice.frames = nFrames;
+	voice.channels = nChannels;
+	voice.cost_L = cost_L;
+	voice.cost_R = cost_R;
+	voice.cost_track_L = cost_track_L;
+	voice.cost_track_R = cost_track_R;
+}
+
+
+
+void Sampler::__filter_voices( Song* pSong, RenderTarget* target )
+{
+	if ( target->filtered_count == 0 ) return;
+
+	// a lane per channel, a mono voice only has its left one
+	MixFilterLane lanes[ 2 * SAMPLER_FILTER_VOICES ];
+	int frames[ 2 * SAMPLER_FILTER_VOICES ];
+	int nLanes = 0;
+	for ( int v = 0; v < target->filtered_count; ++v ) {
+		const FilteredVoice& voice = target->filtered[ v ];
+		int nVoice = voice.note->get_voice();
+		assert( nVoice != -1 );
+		Instrument* pInstr = voice.note->get_instrument();
+		for ( int c = 0; c < voice.channels; ++c ) {
+			MixFilterLane& lane = lanes[ nLanes ];
+			lane.buffer = ( c == 0 ? target->filter_L[ v ] : target->filter_R[ v ] );
+			lane.cutoff = pInstr->get_filter_cutoff();
+			lane.resonance = pInstr->get_filter_resonance();
+			lane.bp = ( c == 0 ? __filter_bp_L[ nVoice ] : __filter_bp_R[ nVoice ] );
+			lane.lp = ( c == 0 ? __filter_lp_L[ nVoice ] : __filter_lp_R[ nVoice ] );
+			frames[ nLanes ] = voice.frames;
+			++nLanes;
+		}
+	}
+
+	for ( int nFirst = 0; nFirst < nLanes; nFirst += MIX_FILTER_LANES ) {
+		// the lanes missing from the last group are silent
+		MixFilterLane group[ MIX_FILTER_LANES ];
+		int remaining[ MIX_FILTER_LANES ];
+		for ( int k = 0; k < MIX_FILTER_LANES; ++k ) {
+			if ( nFirst + k < nLanes ) {
+				group[ k ] = lanes[ nFirst + k ];
+				remaining[ k ] = frames[ nFirst + k ];
+			} else {
+				remaining[ k ] = 0;
+			}
+		}
+		// the lanes are run together over the frames they all have left, a
+		// lane without any takes the silent pad until the others are done
+		for ( ;; ) {
+			int nFrames = 0;
+			for ( int k = 0; k < MIX_FILTER_LANES; ++k ) {
+				if ( remaining[ k ] > 0 && ( nFrames == 0 || remaining[ k ] < nFrames ) ) nFrames = remaining[ k ];
+			}
+			if ( nFrames == 0 ) break;
+			MixFilterLane run[ MIX_FILTER_LANES ];
+			for ( int k = 0; k < MIX_FILTER_LANES; ++k ) {
+				if ( remaining[ k ] > 0 ) {
+					run[ k ] = group[ k ];
+				} else {
+					run[ k ].buffer = target->filter_pad;
+					run[ k ].cutoff = 0.0;
+					run[ k ].resonance = 0.0;
+					run[ k ].bp = 0.0;
+					run[ k ].lp = 0.0;
+				}
+			}
+			mix_filter_lanes( run, nFrames );
+			for ( int k = 0; k < MIX_FILTER_LANES; ++k ) {
+				if ( remaining[ k ] == 0 ) continue;
+				group[ k ].buffer += nFrames;
+				group[ k ].bp = run[ k ].bp;
+				group[ k ].lp = run[ k ].lp;
+				remaining[ k ] -= nFrames;
+			}
+		}
+		for ( int k = 0; k < MIX_FILTER_LANES && nFirst + k < nLanes; ++k ) {
+			lanes[ nFirst + k ].bp = group[ k ].bp;
+			lanes[ nFirst + k ].lp = group[ k ].lp;
+		}
+	}
+
+	nLanes = 0;
+	for ( int v = 0; v < target->filtered_count; ++v ) {
+		const FilteredVoice& voice = target->filtered[ v ];
+		int nVoice = voice.note->get_voice();
+		__filter_bp_L[ nVoice ] = lanes[ nLanes ].bp;
+		__filter_lp_L[ nVoice ] = lanes[ nLanes ].lp;
+		if ( voice.channels == 2 ) {
+			++nLanes;
+		}
+		// both channels of a mono voice filter the same frames
+		__filter_bp_R[ nVoice ] = lanes[ nLanes ].bp;
+		__filter_lp_R[ nVoice ] = lanes[ nLanes ].lp;
+		++nLanes;
+
+		// to the main mix, the track output and the FX sends in one pass
+		__scatter_voice( voice.note, target->filter_L[ v ], target->filter_R[ v ], voice.track, voice.buffer_pos, voice.frames, voice.channels,
+				 voice.cost_L, voice.cost_R, voice.cost_track_L, voice.cost_track_R, pSong, target );
+	}
+	target->filtered_count = 0;
+}
+
+
+template<> inline float Sampler::__interpolate<Sampler::LINEAR>( const float* p, double mu )
+{
+	return p[0] * ( 1 - mu ) + p[1] * mu;
+}
+
+template<> inline float Sampler::__interpolate<Sampler::COSINE>( const float* p, double mu )
+{
+	return cosine_Interpolate( p[0], p[1], mu );
+}
+
+template<> inline float Sampler::__interpolate<Sampler::THIRD>( const float* p, double mu )
+{
+	return third_Interpolate( p[-1], p[0], p[1], p[2], mu );
+}
+
+template<> inline float Sampler::__interpolate<Sampler::CUBIC>( const float* p, double mu )
+{
+	return cubic_Interpolate( p[-1], p[0], p[1], p[2], mu );
+}
+
+template<> inline float Sampler::__interpolate<Sampler::HERMITE>( const float* p, double mu )
+{
+	return hermite_Interpolate( p[-1], p[0], p[1], p[2], mu );
+}
+
+template<Sampler::InterpolateMode mode>
+inline float Sampler::__interpolate( const short* p, double mu )
+{
+	// every mode is linear in the frames, the result is scaled once
+	float f[ 4 ] = { p[-1], p[0], p[1], p[2] };
+	return __interpolate<mode>( ( const float* )f + 1, mu ) * SAMPLE_PCM_SCALE;
+}
+
+template<Sampler::InterpolateMode mode, int nChannels, typename T>
+double Sampler::__resample( const T* pData_L, const T* pData_R, int nSampleFrames, double fSamplePos, float fStep, float* pOut_L, float* pOut_R, int nFrames )
+{
+	/*
+	 * The guard frames of the sample stand for the missing neighbours at both ends,
+	 * only the frames reaching the last sample frame need a check.
+	 */
+	double fUnchecked = ( nSampleFrames - 2 - fSamplePos ) / fStep;
+	int nUnchecked = ( fUnchecked > 0 ) ? ( int )fUnchecked : 0;
+	if ( nUnchecked > nFrames ) {
+		nUnchecked = nFrames;
+	}
+
+	for ( int i = 0; i < nUnchecked; ++i ) {
+		int nSamplePos = ( int )fSamplePos;
+		double fDiff = fSamplePos - nSamplePos;
+		pOut_L[ i ] = __interpolate<mode>( pData_L + nSamplePos, fDiff );
+		if ( nChannels == 2 ) pOut_R[ i ] = __interpolate<mode>( pData_R + nSamplePos, fDiff );
+		fSamplePos += fStep;
+	}
+
+	for ( int i = nUnchecked; i < nFrames; ++i ) {
+		int nSamplePos = ( int )fSamplePos;
+		if ( ( nSamplePos + 1 ) >= nSampleFrames ) {
+			//we reach the last audioframe.
+			//set this last frame to zero do nothin wrong.
+			pOut_L[ i ] = 0.0;
+			if ( nChannels == 2 ) pOut_R[ i ] = 0.0;
+		} else {
+			double fDiff = fSamplePos - nSamplePos;
+			pOut_L[ i ] = __interpolate<mode>( pData_L + nSamplePos, fDiff );
+			if ( nChannels == 2 ) pOut_R[ i ] = __interpolate<mode>( pData_R + nSamplePos, fDiff );
 		}
+		fSamplePos += fStep;
+	}
+	return fSamplePos;
+}
+
+
+static inline float sinc_dot( const float* p, const float* pRow )
+{
+	return mix_dot( p, pRow, SINC_TAPS );
+}
+
+static inline float sinc_dot( const short* p, const float* pRow )
+{
+	return mix_dot_s16( p, pRow, SINC_TAPS ) * SAMPLE_PCM_SCALE;
+}
+
+template<int nChannels, typename T>
+static double resample_sinc( const T* pData_L, const T* pData_R, int nSampleFrames, double fSamplePos, float fStep, float* pOut_L, float* pOut_R, int nFrames )
+{
+	// the guard frames cover the SINC_TAPS / 2 neighbours at both ends
+	SincTable* pSinc = SincTable::get_instance();
+	int nTable = pSinc->get_table( fStep );
+
+	for ( int i = 0; i < nFrames; ++i ) {
+		int nSamplePos = ( int )fSamplePos;
+		if ( ( nSamplePos + 1 ) >= nSampleFrames ) {
+			pOut_L[ i ] = 0.0;
+			if ( nChannels == 2 ) pOut_R[ i ] = 0.0;
+		} else {
+			const float* pRow = pSinc->get_row( nTable, fSamplePos - nSamplePos );
+			pOut_L[ i ] = sinc_dot( pData_L + nSamplePos + 1 - SINC_TAPS / 2, pRow );
+			if ( nChannels == 2 ) pOut_R[ i ] = sinc_dot( pData_R + nSamplePos + 1 - SINC_TAPS / 2, pRow );
+		}
+		fSamplePos += fStep;
+	}
+	return fSamplePos;
+}
+
+template<>
+double Sampler::__resample<Sampler::SINC, 1, float>( const float* pData_L, const float* pData_R, int nSampleFrames, double fSamplePos, float fStep, float* pOut_L, float* pOut_R, int nFrames )
+{
+	return resample_sinc<1>( pData_L, pData_R, nSampleFrames, fSamplePos, fStep, pOut_L, pOut_R, nFrames );
+}
+
+template<>
+double Sampler::__resample<Sampler::SINC, 2, float>( const float* pData_L, const float* pData_R, int nSampleFrames, double fSamplePos, float fStep, float* pOut_L, float* pOut_R, int nFrames )
+{
+	return resample_sinc<2>( pData_L, pData_R, nSampleFrames, fSamplePos, fStep, pOut_L, pOut_R, nFrames );
+}
+
+template<>
+double Sampler::__resample<Sampler::SINC, 1, short>( const short* pData_L, const short* pData_R, int nSampleFrames, double fSamplePos, float fStep, float* pOut_L, float* pOut_R, int nFrames )
+{
+	return resample_sinc<1>( pData_L, pData_R, nSampleFrames, fSamplePos, fStep, pOut_L, pOut_R, nFrames );
+}
+
+template<>
+double Sampler::__resample<Sampler::SINC, 2, short>( const short* pData_L, const short* pData_R, int nSampleFrames, double fSamplePos, float fStep, float* pOut_L, float* pOut_R, int nFrames )
+{
+	return resample_sinc<2>( pData_L, pData_R, nSampleFrames, fSamplePos, fStep, pOut_L, pOut_R, nFrames );
+}
+
+
+Sampler::resample_fn Sampler::__get_resample( InterpolateMode mode, int nChannels )
+{
+	bool bMono = ( nChannels == 1 );
+	switch( mode ) {
+	case COSINE:
+		return bMono ? __resample<COSINE, 1, float> : __resample<COSINE, 2, float>;
+	case THIRD:
+		return bMono ? __resample<THIRD, 1, float> : __resample<THIRD, 2, float>;
+	case CUBIC:
+		return bMono ? __resample<CUBIC, 1, float> : __resample<CUBIC, 2, float>;
+	case HERMITE:
+		return bMono ? __resample<HERMITE, 1, float> : __resample<HERMITE, 2, float>;
+	case SINC:
+		return bMono ? __resample<SINC, 1, float> : __resample<SINC, 2, float>;
+	case LINEAR:
+	default:
+		return bMono ? __resample<LINEAR, 1, float> : __resample<LINEAR, 2, float>;
+	}
+}
+
+Sampler::resample_pcm_fn Sampler::__get_resample_pcm( InterpolateMode mode, int nChannels )
+{
+	bool bMono = ( nChannels == 1 );
+	switch( mode ) {
+	case COSINE:
+		return bMono ? __resample<COSINE, 1, short> : __resample<COSINE, 2, short>;
+	case THIRD:
+		return bMono ? __resample<THIRD, 1, short> : __resample<THIRD, 2, short>;
+	case CUBIC:
+		return bMono ? __resample<CUBIC, 1, short> : __resample<CUBIC, 2, short>;
+	case HERMITE:
+		return bMono ? __resample<HERMITE, 1, short> : __resample<HERMITE, 2, short>;
+	case SINC:
+		return bMono ? __resample<SINC, 1, short> : __resample<SINC, 2, short>;
+	case LINEAR:
+	default:
+		return bMono ? __resample<LINEAR, 1, short> : __resample<LINEAR, 2, short>;
 	}
-	delete note;
 }
 
 
 /// Render a note
 /// Return 0: the note is not ended
 /// Return 1: the note is ended
-unsigned Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong )
+unsigned Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong, RenderTarget* target )
 {
 	//infoLog( "[renderNote] instr: " + pNote->getInstrument()->m_sName );
 	assert( pSong );
@@ -239,18 +1354,14 @@ unsigned Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong
 	float fLayerGain = 1.0;
 	float fLayerPitch = 0.0;
 
-	// scelgo il sample da usare in base alla velocity
+	// layer chosen by note_on() from the note velocity
 	Sample *pSample = NULL;
-	for ( unsigned nLayer = 0; nLayer < MAX_LAYERS; ++nLayer ) {
-		InstrumentLayer *pLayer = pInstr->get_layer( nLayer );
-		if ( pLayer == NULL ) continue;
-
-		if ( ( pNote->get_velocity() >= pLayer->get_start_velocity() ) && ( pNote->get_velocity() <= pLayer->get_end_velocity() ) ) {
-			pSample = pLayer->get_sample();
-			fLayerGain = pLayer->get_gain();
-			fLayerPitch = pLayer->get_pitch();
-			break;
-		}
+	int nLayer = pNote->get_selected_layer();
+	InstrumentLayer *pLayer = ( nLayer == -1 ? NULL : pInstr->get_layer( nLayer ) );
+	if ( pLayer != NULL ) {
+		pSample = pLayer->get_sample();
+		fLayerGain = pLayer->get_gain();
+		fLayerPitch = pLayer->get_pitch();
 	}
 	if ( !pSample ) {
 		QString dummy = QString( "NULL sample for instrument %1. Note velocity: %2" ).arg( pInstr->get_name() ).arg( pNote->get_velocity() );
@@ -309,7 +1420,9 @@ unsigned Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong
 			// Post-Fader
 			cost_track_L = cost_L * 2;
 		}
-		cost_L = cost_L * pSong->get_volume();	// song volume
+		if ( __voice_routes[ pNote->get_voice() ].bus == -1 ) {
+			cost_L = cost_L * pSong->get_volume();	// song volume, applied by the bus otherwise
+		}
 		cost_L = cost_L * 2; // max pan is 0.5
 
 
@@ -324,7 +1437,9 @@ unsigned Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong
 		// Post-Fader
 			cost_track_R = cost_R * 2;
 		}
-		cost_R = cost_R * pSong->get_volume();	// song pan
+		if ( __voice_routes[ pNote->get_voice() ].bus == -1 ) {
+			cost_R = cost_R * pSong->get_volume();	// song pan
+		}
 		cost_R = cost_R * 2; // max pan is 0.5
 	}
 
@@ -345,15 +1460,14 @@ unsigned Sampler::__render_note( Note* pNote, unsigned nBufferSize, Song* pSong
 	//_INFOLOG( "total pitch: " + to_string( fTotalPitch ) );
 	if( ( int )pNote->get_sample_position() == 0 )
 	{
-		if( Hydrogen::get_instance()->getMidiOutput() != NULL ){
-			Hydrogen::get_instance()->getMidiOutput()->handleQueueNote( pNote );
-		}
+		// sent by process() once every voice is rendered
+		target->midi_notes.push_back( pNote );
 	}
 
 	if ( fTotalPitch == 0.0 && pSample->get_sample_rate() == audio_output->getSampleRate() ) {	// NO RESAMPLE
-				return __render_note_no_resample( pSample, pNote, nBufferSize, nInitialSilence, cost_L, cost_R, cost_track_L, cost_track_R, pSong );
+				return __render_note_no_resample( pSample, pNote, nBufferSize, nInitialSilence, cost_L, cost_R, cost_track_L, cost_track_R, pSong, target );
 	} else {	// RESAMPLE
-				return __render_note_resample( pSample, pNote, nBufferSize, nInitialSilence, cost_L, cost_R, cost_track_L, cost_track_R, fLayerPitch, pSong );
+				return __render_note_resample( pSample, pNote, nBufferSize, nInitialSilence, cost_L, cost_R, cost_track_L, cost_track_R, fLayerPitch, pSong, target );
 	}
 }
 
@@ -366,7 +1480,8 @@ int Sampler::__render_note_no_resample(
 	float cost_R,
 	float cost_track_L,
 	float cost_track_R,
-	Song* pSong
+	Song* pSong,
+	RenderTarget* target
 )
 {
 	AudioOutput* audio_output = Hydrogen::get_instance()->getAudioOutput();
@@ -385,25 +1500,13 @@ int Sampler::__render_note_no_resample(
 		retValue = 0; // the note is not ended yet
 	}
 
-
-	//ADSR *pADSR = pNote->m_pADSR;
-
 	int nInitialBufferPos = nInitialSilence;
 	int nInitialSamplePos = ( int )pNote->get_sample_position();
-	int nSamplePos = nInitialSamplePos;
-	int nTimes = nInitialBufferPos + nAvail_bytes;
-	int nInstrument = pSong->get_instrument_list()->index( pNote->get_instrument() );
+	int nInstrument = __voice_routes[ pNote->get_voice() ].instrument;
 
 	float *pSample_data_L = pSample->get_data_l();
 	float *pSample_data_R = pSample->get_data_r();
 
-	float fInstrPeak_L = pNote->get_instrument()->get_peak_l(); // this value will be reset to 0 by the mixer..
-	float fInstrPeak_R = pNote->get_instrument()->get_peak_r(); // this value will be reset to 0 by the mixer..
-
-	float fADSRValue;
-	float fVal_L;
-	float fVal_R;
-
 	/*
 	 * nInstrument could be -1 if the instrument is not found in the current drumset.
 	 * This happens when someone is using the prelistening function of the soundlibrary.
@@ -413,100 +1516,213 @@ int Sampler::__render_note_no_resample(
 		nInstrument = 0;
 	}
 
-#ifdef H2CORE_HAVE_JACK
-	JackOutput* jao = 0;
-	float *track_out_L = 0;
-	float *track_out_R = 0;
-	if( audio_output->has_track_outs()
-	&& (jao = dynamic_cast<JackOutput*>(audio_output)) ) {
-		track_out_L = jao->getTrackOut_L( nInstrument );
-		track_out_R = jao->getTrackOut_R( nInstrument );
-	}
-#endif
-
-	for ( int nBufferPos = nInitialBufferPos; nBufferPos < nTimes; ++nBufferPos ) {
-		if ( ( nNoteLength != -1 ) && ( nNoteLength <= pNote->get_sample_position() )  ) {
-						if ( pNote->get_adsr()->release() == 0 ) {
-				retValue = 1;	// the note is ended
-			}
-		}
-
-		fADSRValue = pNote->get_adsr()->get_value( 1 );
-		fVal_L = pSample_data_L[ nSamplePos ] * fADSRValue;
-		fVal_R = pSample_data_R[ nSamplePos ] * fADSRValue;
+	// the sample position only moves once the block is rendered
+	bool bRelease = pNote->is_stolen() || ( ( nNoteLength != -1 ) && ( nNoteLength <= pNote->get_sample_position() ) );
 
-		// Low pass resonant filter
-		if ( pNote->get_instrument()->is_filter_active() ) {
-			pNote->compute_lr_values( &fVal_L, &fVal_R );
+	// ADSR envelope
+	ADSR* pADSR = pNote->get_adsr();
+	if ( bRelease && pADSR->release() == 0 ) {
+		retValue = 1;	// the note is ended
+	}
+	pADSR->get_values( 1, target->envelope, nAvail_bytes );
+	if ( bRelease && pADSR->release() == 0 ) {
+		retValue = 1;	// the release ended within the block
+	}
+	// a mono sample is rendered once, in the left voice buffer
+	int nChannels = pSample->get_channels();
+	if ( pSample->is_compact() ) {
+		// the 16 bit frames are widened to float while the envelope is applied
+		mix_apply_envelope_s16( pSample->get_pcm_l() + nInitialSamplePos, SAMPLE_PCM_SCALE, target->envelope, target->voice_L, nAvail_bytes );
+		if ( nChannels == 2 ) {
+			mix_apply_envelope_s16( pSample->get_pcm_r() + nInitialSamplePos, SAMPLE_PCM_SCALE, target->envelope, target->voice_R, nAvail_bytes );
 		}
-
-#ifdef H2CORE_HAVE_JACK
-		if( track_out_L ) {
-			track_out_L[nBufferPos] += fVal_L * cost_track_L;
+	} else {
+		const float *pVoice_L = target->resampled_L;
+		const float *pVoice_R = target->resampled_R;
+		if ( pSample->is_streamed() ) {
+			// a step of 1 copies the frames
+			__read_stream( pSample, pNote, pNote->get_sample_position(), 1.0, __get_resample( LINEAR, nChannels ), nAvail_bytes, target );
+		} else {
+			pVoice_L = pSample_data_L + nInitialSamplePos;
+			pVoice_R = pSample_data_R + nInitialSamplePos;
 		}
-		if( track_out_R ) {
-			track_out_R[nBufferPos] += fVal_R * cost_track_R;
+		mix_apply_envelope( pVoice_L, target->envelope, target->voice_L, nAvail_bytes );
+		if ( nChannels == 2 ) {
+			mix_apply_envelope( pVoice_R, target->envelope, target->voice_R, nAvail_bytes );
 		}
-#endif
+	}
 
-		fVal_L = fVal_L * cost_L;
-		fVal_R = fVal_R * cost_R;
+	if ( target->filter_voice ) {
+		// Low pass resonant filter, run on several voices at once before they are scattered
+		__queue_filtered_voice( pNote, nInstrument, nInitialBufferPos, nAvail_bytes, nChannels, cost_L, cost_R, cost_track_L, cost_track_R, target );
+	} else {
+		// to the main mix, the track output and the FX sends in one pass
+		__scatter_voice( pNote, target->voice_L, target->voice_R, nInstrument, nInitialBufferPos, nAvail_bytes, nChannels, cost_L, cost_R, cost_track_L, cost_track_R, pSong, target );
+	}
 
-		// update instr peak
-		if ( fVal_L > fInstrPeak_L ) {
-			fInstrPeak_L = fVal_L;
-		}
-		if ( fVal_R > fInstrPeak_R ) {
-			fInstrPeak_R = fVal_R;
-		}
+	pNote->update_sample_position( nAvail_bytes );
+
+	return retValue;
+}
 
-		// to main mix
-		__main_out_L[nBufferPos] += fVal_L;
-		__main_out_R[nBufferPos] += fVal_R;
 
-		++nSamplePos;
-	}
-	pNote->update_sample_position( nAvail_bytes );
-	pNote->get_instrument()->set_peak_l( fInstrPeak_L );
-	pNote->get_instrument()->set_peak_r( fInstrPeak_R );
 
+void Sampler::__scatter_voice(
+	Note *pNote,
+	const float* pVoice_L,
+	const float* pVoice_R,
+	int nTrack,
+	int nBufferPos,
+	int nFrames,
+	int nChannels,
+	float cost_L,
+	float cost_R,
+	float cost_track_L,
+	float cost_track_R,
+	Song* pSong,
+	RenderTarget* target
+)
+{
+	// room for the right sends after the left ones, see below
+	MixSend sends_L[ 2 * ( 2 + MAX_FX ) ];
+	MixSend sends_R[ 2 + MAX_FX ];
+	int nSends = 0;
+	const VoiceRoute& route = __voice_routes[ pNote->get_voice() ];
+
+	// the instrument buffer goes to the main mix (or to the bus) once all its voices are rendered
+	sends_L[ nSends ].out = target->instrument_L + nBufferPos;
+	sends_L[ nSends ].gain = cost_L;
+	sends_R[ nSends ].out = target->instrument_R + nBufferPos;
+	sends_R[ nSends ].gain = cost_R;
+	++nSends;
+
+	if ( nTrack < ( int )__track_out_L.size()
+	&& __track_out_L[ nTrack ] && __track_out_R[ nTrack ] ) {
+		sends_L[ nSends ].out = __track_out_L[ nTrack ] + nBufferPos;
+		sends_L[ nSends ].gain = cost_track_L;
+		sends_R[ nSends ].out = __track_out_R[ nTrack ] + nBufferPos;
+		sends_R[ nSends ].gain = cost_track_R;
+		++nSends;
+	}
 
 #ifdef H2CORE_HAVE_LADSPA
-		float masterVol =  pSong->get_volume();
-	// LADSPA
-	for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
+	float masterVol = pSong->get_volume();
+	for ( unsigned nFX = 0; nFX < MAX_FX && route.bus == -1; ++nFX ) {
 		LadspaFX *pFX = Effects::get_instance()->getLadspaFX( nFX );
-
-		float fLevel = pNote->get_instrument()->get_fx_level( nFX );
-
+		float fLevel = route.fx_level[ nFX ];
 		if ( ( pFX ) && ( fLevel != 0.0 ) ) {
 			fLevel = fLevel * pFX->getVolume();
-			float *pBuf_L = pFX->m_pBuffer_L;
-			float *pBuf_R = pFX->m_pBuffer_R;
-
-//			float fFXCost_L = cost_L * fLevel;
-//			float fFXCost_R = cost_R * fLevel;
-			float fFXCost_L = fLevel * masterVol;
-			float fFXCost_R = fLevel * masterVol;
-
-			int nBufferPos = nInitialBufferPos;
-			int nSamplePos = nInitialSamplePos;
-			for ( int i = 0; i < nAvail_bytes; ++i ) {
-				pBuf_L[ nBufferPos ] += pSample_data_L[ nSamplePos ] * fFXCost_L;
-				pBuf_R[ nBufferPos ] += pSample_data_R[ nSamplePos ] * fFXCost_R;
-				++nSamplePos;
-				++nBufferPos;
-			}
+			sends_L[ nSends ].out = target->fx_L[ nFX ] + nBufferPos;
+			sends_L[ nSends ].gain = fLevel * masterVol;
+			sends_R[ nSends ].out = target->fx_R[ nFX ] + nBufferPos;
+			sends_R[ nSends ].gain = fLevel * masterVol;
+			++nSends;
 		}
 	}
-	// ~LADSPA
 #endif
 
-	return retValue;
+	if ( nChannels == 1 ) {
+		// a mono voice is read once and panned into both channels
+		memcpy( sends_L + nSends, sends_R, nSends * sizeof( MixSend ) );
+		mix_scatter( pVoice_L, sends_L, 2 * nSends, nFrames );
+	} else {
+		mix_scatter( pVoice_L, sends_L, nSends, nFrames );
+		mix_scatter( pVoice_R, sends_R, nSends, nFrames );
+	}
+}
+
+
+
+void Sampler::__mix_buses( Song* pSong, uint32_t nFrames )
+{
+	RenderTarget* pMain = __targets[ 0 ];
+	float masterVol = pSong->get_volume();
+	for ( int nBus = 0; nBus < pSong->get_bus_count(); ++nBus ) {
+		if ( !pMain->bus_used[ nBus ] ) continue;
+		Bus *pBus = pSong->get_bus( nBus );
+
+		MixSend sends_L[ 1 + MAX_FX ];
+		MixSend sends_R[ 1 + MAX_FX ];
+		int nSends = 0;
+
+		float fVolume = ( pBus->is_muted() ? 0.0 : pBus->get_volume() * masterVol );
+		sends_L[ nSends ].out = __main_out_L;
+		sends_L[ nSends ].gain = fVolume * pBus->get_pan_l();
+		sends_R[ nSends ].out = __main_out_R;
+		sends_R[ nSends ].gain = fVolume * pBus->get_pan_r();
+		++nSends;
+
+#ifdef H2CORE_HAVE_LADSPA
+		for ( unsigned nFX = 0; nFX < MAX_FX && !pBus->is_muted(); ++nFX ) {
+			LadspaFX *pFX = Effects::get_instance()->getLadspaFX( nFX );
+			float fLevel = pBus->get_fx_level( nFX );
+			if ( ( pFX ) && ( fLevel != 0.0 ) && pMain->fx_L[ nFX ] ) {
+				fLevel = fLevel * pFX->getVolume();
+				sends_L[ nSends ].out = pMain->fx_L[ nFX ];
+				sends_L[ nSends ].gain = fLevel * masterVol;
+				sends_R[ nSends ].out = pMain->fx_R[ nFX ];
+				sends_R[ nSends ].gain = fLevel * masterVol;
+				++nSends;
+			}
+		}
+#endif
+
+		mix_scatter( pMain->bus_L[ nBus ], sends_L, nSends, nFrames );
+		mix_scatter( pMain->bus_R[ nBus ], sends_R, nSends, nFrames );
+		AudioEngine::get_instance()->get_meters()->meter_bus( nBus, pMain->bus_L[ nBus ], pMain->bus_R[ nBus ], sends_L[ 0 ].gain, sends_R[ 0 ].gain, nFrames );
+	}
 }
 
 
 
+double Sampler::__read_stream( Sample* pSample, Note* pNote, double fSamplePos, float fStep, resample_fn resample, int nFrames, RenderTarget* target )
+{
+	int nVoice = pNote->get_voice();
+	int nSampleFrames = pSample->get_frames();
+	int nDone = 0;
+
+	// the resident frames until the stream holds the neighbours the interpolation needs
+	int nSwitch = pSample->get_resident_frames() - STREAM_OVERLAP_FRAMES + SAMPLE_GUARD_FRAMES;
+	if ( fSamplePos < nSwitch ) {
+		int nResident = ( int )ceil( ( nSwitch - fSamplePos ) / fStep );
+		if ( nResident > nFrames ) {
+			nResident = nFrames;
+		}
+		fSamplePos = resample( pSample->get_data_l(), pSample->get_data_r(), nSampleFrames, fSamplePos, fStep, target->resampled_L, target->resampled_R, nResident );
+		nDone = nResident;
+	}
+
+	if ( nDone < nFrames && __streamer && __streamer->get_sample( nVoice ) != pSample ) {
+		// the layer was replaced since note_on()
+		__streamer->open( nVoice, pSample );
+	}
+
+	while ( nDone < nFrames ) {
+		int nFrom = ( int )fSamplePos - SAMPLE_GUARD_FRAMES;
+		const float *pData_L = NULL;
+		const float *pData_R = NULL;
+		int nAvail = ( __streamer ? __streamer->get_data( nVoice, nFrom, &pData_L, &pData_R ) : 0 );
+		int nReady = nFrames - nDone;
+		if ( nFrom + nAvail < nSampleFrames + SAMPLE_GUARD_FRAMES ) {
+			// the frames up to the end are not all there, only use the ones the interpolation can read
+			double fReady = ( nAvail - SAMPLE_GUARD_FRAMES - ( fSamplePos - nFrom ) ) / fStep;
+			if ( fReady <= 0 ) {
+				// underrun, the voice goes on silently so that it is still in time once the frames are read
+				memset( target->resampled_L + nDone, 0, ( nFrames - nDone ) * sizeof( float ) );
+				memset( target->resampled_R + nDone, 0, ( nFrames - nDone ) * sizeof( float ) );
+				if ( __streamer ) __streamer->report_underrun();
+				return fSamplePos + ( nFrames - nDone ) * fStep;
+			}
+			if ( ceil( fReady ) < nReady ) {
+				nReady = ( int )ceil( fReady );
+			}
+		}
+		fSamplePos = nFrom + resample( pData_L, pData_R, nSampleFrames - nFrom, fSamplePos - nFrom, fStep, target->resampled_L + nDone, target->resampled_R + nDone, nReady );
+		nDone += nReady;
+	}
+	return fSamplePos;
+}
+
 int Sampler::__render_note_resample(
 	Sample *pSample,
 	Note *pNote,
@@ -517,7 +1733,8 @@ int Sampler::__render_note_resample(
 	float cost_track_L,
 	float cost_track_R,
 	float fLayerPitch,
-	Song* pSong
+	Song* pSong,
+	RenderTarget* target
 )
 {
 	AudioOutput* audio_output = Hydrogen::get_instance()->getAudioOutput();
@@ -542,23 +1759,13 @@ int Sampler::__render_note_resample(
 		retValue = 0; // the note is not ended yet
 	}
 
-	//	ADSR *pADSR = pNote->m_pADSR;
-
 	int nInitialBufferPos = nInitialSilence;
-	float fInitialSamplePos = pNote->get_sample_position();
 	double fSamplePos = pNote->get_sample_position();
-	int nTimes = nInitialBufferPos + nAvail_bytes;
-	int nInstrument = pSong->get_instrument_list()->index( pNote->get_instrument() );
+	int nInstrument = __voice_routes[ pNote->get_voice() ].instrument;
 
 	float *pSample_data_L = pSample->get_data_l();
 	float *pSample_data_R = pSample->get_data_r();
 
-	float fInstrPeak_L = pNote->get_instrument()->get_peak_l(); // this value will be reset to 0 by the mixer..
-	float fInstrPeak_R = pNote->get_instrument()->get_peak_r(); // this value will be reset to 0 by the mixer..
-
-	float fADSRValue = 1.0;
-	float fVal_L;
-	float fVal_R;
 	int nSampleFrames = pSample->get_frames();
 
 	/*
@@ -570,193 +1777,44 @@ int Sampler::__render_note_resample(
 		nInstrument = 0;
 	}
 
-#ifdef H2CORE_HAVE_JACK
-	JackOutput* jao = 0;
-	float *track_out_L = 0;
-	float *track_out_R = 0;
-	if( audio_output->has_track_outs()
-	&& (jao = dynamic_cast<JackOutput*>(audio_output)) ) {
-		track_out_L = jao->getTrackOut_L( nInstrument );
-		track_out_R = jao->getTrackOut_R( nInstrument );
+	// one kernel per interpolation mode, chosen once for the whole block,
+	// a mono sample is interpolated once, in the left voice buffer
+	int nChannels = pSample->get_channels();
+	resample_fn resample = __get_resample( __interpolateMode, nChannels );
+	if ( pSample->is_streamed() ) {
+		__read_stream( pSample, pNote, fSamplePos, fStep, resample, nAvail_bytes, target );
+	} else if ( pSample->is_compact() ) {
+		__get_resample_pcm( __interpolateMode, nChannels )( pSample->get_pcm_l(), pSample->get_pcm_r(), nSampleFrames, fSamplePos, fStep, target->resampled_L, target->resampled_R, nAvail_bytes );
+	} else {
+		resample( pSample_data_L, pSample_data_R, nSampleFrames, fSamplePos, fStep, target->resampled_L, target->resampled_R, nAvail_bytes );
 	}
-#endif
 
-	for ( int nBufferPos = nInitialBufferPos; nBufferPos < nTimes; ++nBufferPos ) {
-		if ( ( nNoteLength != -1 ) && ( nNoteLength <= pNote->get_sample_position() )  ) {
-						if ( pNote->get_adsr()->release() == 0 ) {
-				retValue = 1;	// the note is ended
-			}
-		}
+	// the sample position only moves once the block is rendered
+	bool bRelease = pNote->is_stolen() || ( ( nNoteLength != -1 ) && ( nNoteLength <= pNote->get_sample_position() ) );
 
-		int nSamplePos = ( int )fSamplePos;
-		double fDiff = fSamplePos - nSamplePos;
-		if ( ( nSamplePos + 1 ) >= nSampleFrames ) {
-			//we reach the last audioframe.
-			//set this last frame to zero do nothin wrong.
-						fVal_L = 0.0;
-						fVal_R = 0.0;
-		} else {
-			// some interpolation methods need 4 frames data.
-				float last_l;
-				float last_r;
-				if ( ( nSamplePos + 2 ) >= nSampleFrames ) {
-					last_l = 0.0;
-					last_r = 0.0;
-				} else {
-					last_l =  pSample_data_L[nSamplePos + 2];
-					last_r =  pSample_data_R[nSamplePos + 2];
-				}
-
-				switch( __interpolateMode ){
-
-						case LINEAR:
-								fVal_L = pSample_data_L[nSamplePos] * (1 - fDiff ) + pSample_data_L[nSamplePos + 1] * fDiff;
-								fVal_R = pSample_data_R[nSamplePos] * (1 - fDiff ) + pSample_data_R[nSamplePos + 1] * fDiff;
-								//fVal_L = linear_Interpolate( pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], fDiff);
-								//fVal_R = linear_Interpolate( pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], fDiff);
-								break;
-						case COSINE:
-								fVal_L = cosine_Interpolate( pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], fDiff);
-								fVal_R = cosine_Interpolate( pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], fDiff);
-								break;
-						case THIRD:
-								fVal_L = third_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-								fVal_R = third_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-								break;
-						case CUBIC:
-								fVal_L = cubic_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-								fVal_R = cubic_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-								break;
-						case HERMITE:
-								fVal_L = hermite_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-								fVal_R = hermite_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-								break;
-				}
-		}
-
-		// ADSR envelope
-		fADSRValue = pNote->get_adsr()->get_value( fStep );
-		fVal_L = fVal_L * fADSRValue;
-		fVal_R = fVal_R * fADSRValue;
-		// Low pass resonant filter
-		if ( pNote->get_instrument()->is_filter_active() ) {
-			pNote->compute_lr_values( &fVal_L, &fVal_R );
-		}
-
-
-
-#ifdef H2CORE_HAVE_JACK
-		if( track_out_L ) {
-			track_out_L[nBufferPos] += fVal_L * cost_track_L;
-		}
-		if( track_out_R ) {
-			track_out_R[nBufferPos] += fVal_R * cost_track_R;
-		}
-#endif
-
-		fVal_L = fVal_L * cost_L;
-		fVal_R = fVal_R * cost_R;
-
-		// update instr peak
-		if ( fVal_L > fInstrPeak_L ) {
-			fInstrPeak_L = fVal_L;
-		}
-		if ( fVal_R > fInstrPeak_R ) {
-			fInstrPeak_R = fVal_R;
-		}
-
-		// to main mix
-		__main_out_L[nBufferPos] += fVal_L;
-		__main_out_R[nBufferPos] += fVal_R;
-
-		fSamplePos += fStep;
+	// ADSR envelope
+	ADSR* pADSR = pNote->get_adsr();
+	if ( bRelease && pADSR->release() == 0 ) {
+		retValue = 1;	// the note is ended
+	}
+	pADSR->get_values( fStep, target->envelope, nAvail_bytes );
+	if ( bRelease && pADSR->release() == 0 ) {
+		retValue = 1;	// the release ended within the block
+	}
+	mix_apply_envelope( target->resampled_L, target->envelope, target->voice_L, nAvail_bytes );
+	if ( nChannels == 2 ) {
+		mix_apply_envelope( target->resampled_R, target->envelope, target->voice_R, nAvail_bytes );
 	}
-	pNote->update_sample_position( nAvail_bytes * fStep );
-	pNote->get_instrument()->set_peak_l( fInstrPeak_L );
-	pNote->get_instrument()->set_peak_r( fInstrPeak_R );
-
-
-
-#ifdef H2CORE_HAVE_LADSPA
-	// LADSPA
-	float masterVol = pSong->get_volume();
-	for ( unsigned nFX = 0; nFX < MAX_FX; ++nFX ) {
-		LadspaFX *pFX = Effects::get_instance()->getLadspaFX( nFX );
-		float fLevel = pNote->get_instrument()->get_fx_level( nFX );
-		if ( ( pFX ) && ( fLevel != 0.0 ) ) {
-			fLevel = fLevel * pFX->getVolume();
-
-			float *pBuf_L = pFX->m_pBuffer_L;
-			float *pBuf_R = pFX->m_pBuffer_R;
-
-//			float fFXCost_L = cost_L * fLevel;
-//			float fFXCost_R = cost_R * fLevel;
-			float fFXCost_L = fLevel * masterVol;
-			float fFXCost_R = fLevel * masterVol;
-
-			int nBufferPos = nInitialBufferPos;
-			float fSamplePos = fInitialSamplePos;
-			for ( int i = 0; i < nAvail_bytes; ++i ) {
-				int nSamplePos = ( int )fSamplePos;
-				double fDiff = fSamplePos - nSamplePos;
-
-				if ( ( nSamplePos + 1 ) >= nSampleFrames ) {
-					//we reach the last audioframe.
-					//set this last frame to zero do nothin wrong.
-					fVal_L = 0.0;
-					fVal_R = 0.0;
-				} else {
-					// some interpolation methods need 4 frames data.
-					float last_l;
-					float last_r;
-					if ( ( nSamplePos + 2 ) >= nSampleFrames ) {
-						last_l = 0.0;
-						last_r = 0.0;
-					}else
-					{
-						last_l =  pSample_data_L[nSamplePos + 2];
-						last_r =  pSample_data_R[nSamplePos + 2];
-					}
-
-					switch( __interpolateMode ){
-
-					case LINEAR:
-						fVal_L = pSample_data_L[nSamplePos] * (1 - fDiff ) + pSample_data_L[nSamplePos + 1] * fDiff;
-						fVal_R = pSample_data_R[nSamplePos] * (1 - fDiff ) + pSample_data_R[nSamplePos + 1] * fDiff;
-						//fVal_L = linear_Interpolate( pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], fDiff);
-						//fVal_R = linear_Interpolate( pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], fDiff);
-						break;
-					case COSINE:
-						fVal_L = cosine_Interpolate( pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], fDiff);
-						fVal_R = cosine_Interpolate( pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], fDiff);
-						break;
-					case THIRD:
-						fVal_L = third_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-						fVal_R = third_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-						break;
-					case CUBIC:
-						fVal_L = cubic_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-						fVal_R = cubic_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-						break;
-					case HERMITE:
-						fVal_L = hermite_Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], last_l, fDiff);
-						fVal_R = hermite_Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], last_r, fDiff);
-						break;
-					}
-					// methode Interpolate produce an extra function call and eat much more time here.
-					// so i deside to code the switch direct in the resampler methode
-					//fVal_L = Interpolate( pSample_data_L[ nSamplePos -1], pSample_data_L[nSamplePos], pSample_data_L[nSamplePos + 1], pSample_data_L[nSamplePos + 2] ,fDiff);
-					//fVal_L = Interpolate( pSample_data_R[ nSamplePos -1], pSample_data_R[nSamplePos], pSample_data_R[nSamplePos + 1], pSample_data_R[nSamplePos + 2] ,fDiff);
-				}
 
-				pBuf_L[ nBufferPos ] += fVal_L * fFXCost_L;
-								pBuf_R[ nBufferPos ] += fVal_R * fFXCost_R;
-				fSamplePos += fStep;
-				++nBufferPos;
-			}
-		}
+	if ( target->filter_voice ) {
+		// Low pass resonant filter, run on several voices at once before they are scattered
+		__queue_filtered_voice( pNote, nInstrument, nInitialBufferPos, nAvail_bytes, nChannels, cost_L, cost_R, cost_track_L, cost_track_R, target );
+	} else {
+		// to the main mix, the track output and the FX sends in one pass
+		__scatter_voice( pNote, target->voice_L, target->voice_R, nInstrument, nInitialBufferPos, nAvail_bytes, nChannels, cost_L, cost_R, cost_track_L, cost_track_R, pSong, target );
 	}
-#endif
+
+	pNote->update_sample_position( nAvail_bytes * fStep );
 
 	return retValue;
 }
@@ -772,23 +1830,31 @@ void Sampler::stop_playing_notes( Instrument* instrument )
 	}
 	*/
 
+	// the notes are deleted outside of the audio thread
+	CommandQueue* pCommands = AudioEngine::get_instance()->get_command_queue();
 	if ( instrument ) { // stop all notes using this instrument
-		for ( unsigned i = 0; i < __playing_notes_queue.size(); ) {
+		if ( !instrument->has_voices() ) return;
+		// a single pass keeping the other notes in order
+		unsigned nKept = 0;
+		for ( unsigned i = 0; i < __playing_notes_queue.size(); ++i ) {
 			Note *pNote = __playing_notes_queue[ i ];
 			assert( pNote );
 			if ( pNote->get_instrument() == instrument ) {
-				delete pNote;
+				__free_voice( pNote );
+				pCommands->retire( CommandQueue::RETIRED_NOTE, pNote );
 				instrument->dequeue();
-				__playing_notes_queue.erase( __playing_notes_queue.begin() + i );
+			} else {
+				__playing_notes_queue[ nKept++ ] = pNote;
 			}
-			++i;
 		}
+		__playing_notes_queue.resize( nKept );
 	} else { // stop all notes
 		// delete all copied notes in the playing notes queue
 		for ( unsigned i = 0; i < __playing_notes_queue.size(); ++i ) {
 			Note *pNote = __playing_notes_queue[i];
 			pNote->get_instrument()->dequeue();
-			delete pNote;
+			__free_voice( pNote );
+			pCommands->retire( CommandQueue::RETIRED_NOTE, pNote );
 		}
 		__playing_notes_queue.clear();
 	}
@@ -799,39 +1865,24 @@ void Sampler::stop_playing_notes( Instrument* instrument )
 /// Preview, uses only the first layer
 void Sampler::preview_sample( Sample* sample, int length )
 {
-	AudioEngine::get_instance()->lock( RIGHT_HERE );
-
-	InstrumentLayer *pLayer = __preview_instrument->get_layer( 0 );
-
-	Sample *pOldSample = pLayer->get_sample();
-	pLayer->set_sample( sample );
-
-	Note *previewNote = new Note( __preview_instrument, 0, 1.0, 0.5, 0.5, length, 0 );
-
-	stop_playing_notes( __preview_instrument );
-	note_on( previewNote );
-	delete pOldSample;
-
-	AudioEngine::get_instance()->unlock();
+	Command cmd;
+	cmd.type = COMMAND_PREVIEW_SAMPLE;
+	cmd.sample = sample;
+	cmd.note = new Note( __posted_preview_instrument, 0, 1.0, 0.5, 0.5, length, 0 );
+	AudioEngine::get_instance()->post_command( cmd );
 }
 
 
 
 void Sampler::preview_instrument( Instrument* instr )
 {
-	Instrument * old_preview;
-	AudioEngine::get_instance()->lock( RIGHT_HERE );
-
-	stop_playing_notes( __preview_instrument );
-
-	old_preview = __preview_instrument;
-	__preview_instrument = instr;
-
-	Note *previewNote = new Note( __preview_instrument, 0, 1.0, 0.5, 0.5, MAX_NOTES, 0 );
+	__posted_preview_instrument = instr;
 
-	note_on( previewNote );	// exclusive note
-	AudioEngine::get_instance()->unlock();
-	delete old_preview;
+	Command cmd;
+	cmd.type = COMMAND_PREVIEW_INSTRUMENT;
+	cmd.instrument = instr;
+	cmd.note = new Note( instr, 0, 1.0, 0.5, 0.5, MAX_NOTES, 0 );
+	AudioEngine::get_instance()->post_command( cmd );
 }
 
 
@@ -875,24 +1926,21 @@ void Sampler::setPlayingNotelength( Instrument* instrument, unsigned long ticks,
 							if( !Preferences::get_instance()->__playselectedinstrument ){
 								if ( pNote->get_instrument() == instrument
 								&& pNote->get_position() == noteOnTick ) {
-									AudioEngine::get_instance()->lock( RIGHT_HERE );
-
+									// a single int store, the engine picks it up
+									// the next time it copies the note
 									if ( ticks >  patternsize )
 										ticks = patternsize - noteOnTick;
 									pNote->set_length( ticks );
 									Hydrogen::get_instance()->getSong()->__is_modified = true;
-									AudioEngine::get_instance()->unlock(); // unlock the audio engine
 								}
 							}else
 							{
 								if ( pNote->get_instrument() == pEngine->getSong()->get_instrument_list()->get( pEngine->getSelectedInstrumentNumber())
 								&& pNote->get_position() == noteOnTick ) {
-									AudioEngine::get_instance()->lock( RIGHT_HERE );
 									if ( ticks >  patternsize )
 										ticks = patternsize - noteOnTick;
 									pNote->set_length( ticks );
 									Hydrogen::get_instance()->getSong()->__is_modified = true;
-									AudioEngine::get_instance()->unlock(); // unlock the audio engine
 								}
 							}
 						}
@@ -905,14 +1953,13 @@ void Sampler::setPlayingNotelength( Instrument* instrument, unsigned long ticks,
 
 bool Sampler::is_instrument_playing( Instrument* instrument )
 {
+	return ( instrument && instrument->has_voices() );
+}
 
-	if ( instrument ) { // stop all notes using this instrument
-		for ( unsigned j = 0; j < __playing_notes_queue.size(); j++ ) {
-			if ( instrument->get_name() == __playing_notes_queue[ j ]->get_instrument()->get_name()){
-				return true;
-			}
-		}
-	}
+int Sampler::get_voice_track( Note* note )
+{
+	if ( note->get_voice() == -1 ) return -1;
+	return __voice_routes[ note->get_voice() ].instrument;
 }
 
 };
@@ -0,0 +1,78 @@
+/*
+ * Hydrogen
+ * Copyright(c) 2002-2008 by Alex >Comix< Cominu [comix@users.sourceforge.net]
+ *
+ * http://www.hydrogen-music.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY, without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <hydrogen/sampler/sinc_table.h>
+
+#include <cmath>
+
+namespace H2Core
+{
+
+const char* SincTable::__class_name = "SincTable";
+SincTable* SincTable::__instance = 0;
+
+/** cutoff of the first table, relative to the input nyquist, leaves room for the transition band */
+#define SINC_CUTOFF     0.9
+
+void SincTable::create_instance()
+{
+	if ( __instance==0 ) {
+		__instance = new SincTable();
+	}
+}
+
+SincTable::SincTable() : Object( __class_name )
+{
+	INFOLOG( QString( "%1 taps, %2 phases, %3 tables" ).arg( SINC_TAPS ).arg( SINC_PHASES ).arg( SINC_CUTOFFS ) );
+	__coefficients = new float[ SINC_CUTOFFS * ( SINC_PHASES + 1 ) * SINC_TAPS ];
+	const int half = SINC_TAPS / 2;
+	for ( int table=0; table<SINC_CUTOFFS; table++ ) {
+		double cutoff = SINC_CUTOFF / ( 1.0 + table * 0.5 );
+		for ( int phase=0; phase<=SINC_PHASES; phase++ ) {
+			double mu = ( double )phase / SINC_PHASES;
+			float* row = __coefficients + ( table * ( SINC_PHASES + 1 ) + phase ) * SINC_TAPS;
+			double sum = 0.0;
+			double taps[ SINC_TAPS ];
+			for ( int k=0; k<SINC_TAPS; k++ ) {
+				// distance from the tap frame to the interpolated position
+				double x = ( k + 1 - half ) - mu;
+				double sinc = ( x==0.0 ? 1.0 : sin( M_PI * cutoff * x ) / ( M_PI * cutoff * x ) );
+				double w = x / half;
+				double window = ( fabs( w )>=1.0 ? 0.0 : 0.42 + 0.5 * cos( M_PI * w ) + 0.08 * cos( 2.0 * M_PI * w ) );
+				taps[k] = cutoff * sinc * window;
+				sum += taps[k];
+			}
+			// unity gain at DC for every phase
+			for ( int k=0; k<SINC_TAPS; k++ ) row[k] = taps[k] / sum;
+		}
+	}
+}
+
+SincTable::~SincTable()
+{
+	__instance = 0;
+	delete[] __coefficients;
+}
+
+};
+
+/* vim: set softtabstop=4 expandtab: */
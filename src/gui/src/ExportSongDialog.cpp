@@ -541,6 +541,9 @@ void ExportSongDialog::setResamplerMode(int index)
 	case 4:
 		AudioEngine::get_instance()->get_sampler()->setInterpolateMode( Sampler::HERMITE );
 		break;
+	case 5:
+		AudioEngine::get_instance()->get_sampler()->setInterpolateMode( Sampler::SINC );
+		break;
 	}
 }
 
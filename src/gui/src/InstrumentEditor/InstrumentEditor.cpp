@@ -29,6 +29,7 @@
 #include <hydrogen/hydrogen.h>
 #include <hydrogen/globals.h>
 #include <hydrogen/basics/adsr.h>
+#include <hydrogen/basics/bus.h>
 #include <hydrogen/basics/sample.h>
 #include <hydrogen/basics/instrument.h>
 #include <hydrogen/basics/instrument_list.h>
@@ -239,6 +240,30 @@ InstrumentEditor::InstrumentEditor( QWidget* pParent )
 	m_pIsStopNoteCheckBox->setToolTip( trUtf8( "Stop the current playing instrument-note before trigger the next note sample." ) );
 	connect( m_pIsStopNoteCheckBox, SIGNAL( toggled( bool ) ), this, SLOT( onIsStopNoteCheckBoxClicked( bool ) ) );
 
+	m_pBusLCD = new LCDDisplay( m_pInstrumentProp, LCDDigit::SMALL_BLUE, 4 );
+	m_pBusLCD->move( 160, 300 );
+	m_pBusLCD->setToolTip( trUtf8( "Group bus the instrument is mixed into" ) );
+
+	m_pAddBusBtn = new Button(
+			m_pInstrumentProp,
+			"/lcd/LCDSpinBox_up_on.png",
+			"/lcd/LCDSpinBox_up_off.png",
+			"/lcd/LCDSpinBox_up_over.png",
+			QSize( 16, 8 )
+	);
+	m_pAddBusBtn->move( 202, 299 );
+	connect( m_pAddBusBtn, SIGNAL( clicked(Button*) ), this, SLOT( busBtnClicked(Button*) ) );
+
+	m_pDelBusBtn = new Button(
+			m_pInstrumentProp,
+			"/lcd/LCDSpinBox_down_on.png",
+			"/lcd/LCDSpinBox_down_off.png",
+			"/lcd/LCDSpinBox_down_over.png",
+			QSize(16,8)
+	);
+	m_pDelBusBtn->move( 202, 308 );
+	connect( m_pDelBusBtn, SIGNAL( clicked(Button*) ), this, SLOT( busBtnClicked(Button*) ) );
+
 //~ Instrument properties
 
 
@@ -422,6 +447,13 @@ void InstrumentEditor::selectedInstrumentChangedEvent()
 			sMuteGroup = "Off";
 		}
                 m_pMuteGroupLCD->setText( sMuteGroup );		
+
+		// instr bus
+		QString sBus = QString("%1").arg( m_pInstrument->get_bus() + 1 );
+		if (m_pInstrument->get_bus() == -1 ) {
+			sBus = "Off";
+		}
+		m_pBusLCD->setText( sBus );
 		
 		// midi out
 		QString sMidiOutChannel = QString("%1").arg( m_pInstrument->get_midi_out_channel()+1);
@@ -716,6 +748,7 @@ void InstrumentEditor::setAutoVelocity()
 			}
 		}
 	}
+	m_pInstrument->update_layer_table();
 }
 
 
@@ -731,12 +764,10 @@ void InstrumentEditor::labelClicked( ClickableLabel* pRef )
 			m_pInstrument->set_name( sNewName );
 			selectedInstrumentChangedEvent();
 
-			#ifdef H2CORE_HAVE_JACK
 						AudioEngine::get_instance()->lock( RIGHT_HERE );
 						Hydrogen *engine = Hydrogen::get_instance();
 						engine->renameJackPorts();
 						AudioEngine::get_instance()->unlock();
-			#endif
 
 			// this will force an update...
 			EventQueue::get_instance()->push_event( EVENT_SELECTED_INSTRUMENT_CHANGED, -1 );
@@ -808,6 +839,31 @@ void InstrumentEditor::muteGroupBtnClicked(Button *pRef)
 	selectedInstrumentChangedEvent();	// force an update
 }
 
+void InstrumentEditor::busBtnClicked(Button *pRef)
+{
+	assert( m_pInstrument );
+
+	Song *pSong = Hydrogen::get_instance()->getSong();
+	int nBus = m_pInstrument->get_bus();
+	if (pRef == m_pAddBusBtn ) {
+		nBus += 1;
+		if ( nBus >= pSong->get_bus_count() ) {
+			// going past the last bus creates a new one
+			nBus = pSong->add_bus( new Bus( QString( "Bus %1" ).arg( pSong->get_bus_count() + 1 ) ) );
+			if ( nBus == -1 ) {
+				return;
+			}
+		}
+	}
+	else if (pRef == m_pDelBusBtn ) {
+		nBus -= 1;
+	}
+	m_pInstrument->set_bus( nBus );
+	pSong->__is_modified = true;
+
+	selectedInstrumentChangedEvent();	// force an update
+}
+
 void InstrumentEditor::onIsStopNoteCheckBoxClicked( bool on )
 {
 	m_pInstrument->set_stop_notes( on );
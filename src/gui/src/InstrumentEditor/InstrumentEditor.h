@@ -69,6 +69,7 @@ class InstrumentEditor : public QWidget, public H2Core::Object, public EventList
 		void labelClicked( ClickableLabel* pRef );
 
 		void muteGroupBtnClicked(Button *pRef);
+		void busBtnClicked(Button *pRef);
 		void onIsStopNoteCheckBoxClicked( bool on );
 		void midiOutChannelBtnClicked(Button *pRef);
 		void midiOutNoteBtnClicked(Button *pRef);
@@ -107,6 +108,11 @@ class InstrumentEditor : public QWidget, public H2Core::Object, public EventList
 		LCDDisplay *m_pMuteGroupLCD;
 		Button *m_pAddMuteGroupBtn;
 		Button *m_pDelMuteGroupBtn;
+
+		// Instrument bus
+		LCDDisplay *m_pBusLCD;
+		Button *m_pAddBusBtn;
+		Button *m_pDelBusBtn;
 		
 		// Instrument midi out
 		LCDDisplay *m_pMidiOutChannelLCD;
@@ -232,7 +232,7 @@ void LayerPreview::mousePressEvent(QMouseEvent *ev)
 		float fVelocity = (float)ev->x() / (float)width();
 
 		Note *note = new Note( m_pInstrument, nPosition, fVelocity, fPan_L, fPan_R, nLength, fPitch );
-		AudioEngine::get_instance()->get_sampler()->note_on(note);
+		AudioEngine::get_instance()->get_sampler()->queue_note_on(note);
 
 		for ( int i = 0; i < MAX_LAYERS; i++ ) {
 			InstrumentLayer *pLayer = m_pInstrument->get_layer( i );
@@ -257,7 +257,7 @@ void LayerPreview::mousePressEvent(QMouseEvent *ev)
 
 		if ( m_pInstrument->get_layer( m_nSelectedLayer ) ) {
 			Note *note = new Note( m_pInstrument , nPosition, m_pInstrument->get_layer( m_nSelectedLayer )->get_end_velocity() - 0.01, fPan_L, fPan_R, nLength, fPitch );
-			AudioEngine::get_instance()->get_sampler()->note_on(note);
+			AudioEngine::get_instance()->get_sampler()->queue_note_on(note);
 		}
 
 		if ( pLayer ) {
@@ -313,12 +313,14 @@ void LayerPreview::mouseMoveEvent( QMouseEvent *ev )
 				if ( m_bGrabLeft ) {
 					if ( fVel < pLayer->get_end_velocity()) {
 						pLayer->set_start_velocity(fVel);
+						m_pInstrument->update_layer_table();
 						showLayerStartVelocity(pLayer, ev);
 					}
 				}
 				else {
 					if ( fVel > pLayer->get_start_velocity()) {
 						pLayer->set_end_velocity( fVel );
+						m_pInstrument->update_layer_table();
 						showLayerEndVelocity(pLayer, ev);
 					}
 				}
@@ -98,15 +98,18 @@ void WaveDisplay::updateDisplay( H2Core::InstrumentLayer *pLayer )
 
 		float fGain = height() / 2.0 * pLayer->get_gain();
 
-		float *pSampleData = pLayer->get_sample()->get_data_l();
+		// a compact sample holds 16 bit frames
+		Sample *pSample = pLayer->get_sample();
+		// a streamed sample only holds its first frames, the others are drawn flat
+		int nResidentFrames = pLayer->get_sample()->get_resident_frames();
 
 		int nSamplePos =0;
 		int nVal;
 		for ( int i = 0; i < width(); ++i ){
 			nVal = 0;
 			for ( int j = 0; j < nScaleFactor; ++j ) {
-				if ( j < nSampleLength ) {
-					int newVal = (int)( pSampleData[ nSamplePos ] * fGain );
+				if ( j < nSampleLength && nSamplePos < nResidentFrames ) {
+					int newVal = (int)( pSample->get_value_l( nSamplePos ) * fGain );
 					if ( newVal > nVal ) {
 						nVal = newVal;
 					}
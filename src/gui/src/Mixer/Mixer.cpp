@@ -32,6 +32,7 @@
 
 #include <hydrogen/audio_engine.h>
 #include <hydrogen/hydrogen.h>
+#include <hydrogen/basics/bus.h>
 #include <hydrogen/basics/instrument.h>
 #include <hydrogen/basics/instrument_list.h>
 #include <hydrogen/basics/song.h>
@@ -83,6 +84,21 @@ Mixer::Mixer( QWidget* pParent )
 //~ fader panel
 
 
+// bus panel, the group buses of the song
+	m_pBusHBox = new QHBoxLayout();
+	m_pBusHBox->setSpacing( 0 );
+	m_pBusHBox->setMargin( 0 );
+
+	m_pBusPanel = new QWidget( NULL );
+	m_pBusPanel->setLayout( m_pBusHBox );
+	m_pBusPanel->hide();
+
+	for ( uint i = 0; i < MAX_BUSES; ++i ) {
+		m_pBusLine[ i ] = NULL;
+	}
+//~ bus panel
+
+
 // fX frame
 	m_pFXFrame = new PixmapWidget( NULL );
 	m_pFXFrame->setFixedSize( 213, height() );
@@ -150,6 +166,7 @@ Mixer::Mixer( QWidget* pParent )
 	pLayout->setMargin( 0 );
 
 	pLayout->addWidget( m_pFaderScrollArea );
+	pLayout->addWidget( m_pBusPanel );
 	pLayout->addWidget( m_pFXFrame );
 	pLayout->addWidget( m_pMasterLine );
 	this->setLayout( pLayout );
@@ -194,6 +211,36 @@ MixerLine* Mixer::createMixerLine( int nInstr )
 }
 
 
+MixerLine* Mixer::createBusLine( int nBus )
+{
+	MixerLine *pMixerLine = new MixerLine( 0 , nBus );
+	pMixerLine->setVolume( 1.0 );
+	pMixerLine->setMuteClicked( false );
+	pMixerLine->setSoloClicked( false );
+
+	connect( pMixerLine, SIGNAL( muteBtnClicked(MixerLine*) ), this, SLOT( busMuteClicked(MixerLine*) ) );
+	connect( pMixerLine, SIGNAL( volumeChanged(MixerLine*) ), this, SLOT( busVolumeChanged(MixerLine*) ) );
+	connect( pMixerLine, SIGNAL( instrumentNameClicked(MixerLine*) ), this, SLOT( busNameClicked(MixerLine*) ) );
+	connect( pMixerLine, SIGNAL( panChanged(MixerLine*) ), this, SLOT( busPanChanged( MixerLine*) ) );
+	connect( pMixerLine, SIGNAL( knobChanged(MixerLine*, int) ), this, SLOT( busKnobChanged( MixerLine*, int) ) );
+
+	return pMixerLine;
+}
+
+
+
+int Mixer::findBusLineByRef(MixerLine* ref)
+{
+	for (int i = 0; i < MAX_BUSES; i++) {
+		if (m_pBusLine[i] == ref) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+
 void Mixer::muteClicked(MixerLine* ref)
 {
 	int nLine = findMixerLineByRef(ref);
@@ -319,7 +366,7 @@ void Mixer::noteOnClicked( MixerLine* ref )
 
 	const float fPitch = 0.0f;
 	Note *note = new Note( instrList->get(nLine), 0, 1.0, 0.5f, 0.5f, -1, fPitch );
-	AudioEngine::get_instance()->get_sampler()->note_on(note);
+	AudioEngine::get_instance()->get_sampler()->queue_note_on(note);
 
 	Hydrogen::get_instance()->setSelectedInstrumentNumber(nLine);
 }
@@ -338,7 +385,7 @@ void Mixer::noteOnClicked( MixerLine* ref )
 
 	const float fPitch = 0.0f;
 	Note *note = new Note( instrList->get( nLine ), 0, 1.0, 0.5, 0.5, -1, fPitch );
-	AudioEngine::get_instance()->get_sampler()->note_off(note);
+	AudioEngine::get_instance()->get_sampler()->queue_note_off(note);
 
 	Hydrogen::get_instance()->setSelectedInstrumentNumber(nLine);
 }
@@ -398,6 +445,10 @@ void Mixer::updateMixer()
 
 	float fallOff = pPref->getMixerFalloffSpeed();
 
+	// levels metered by the engine since the previous update, NULL if none
+	Meters *pMeters = AudioEngine::get_instance()->get_meters();
+	const MeterLevels *pLevels = ( pMeters->update_levels() ? &pMeters->get_levels() : NULL );
+
 	uint nMuteClicked = 0;
 	uint nInstruments = pInstrList->size();
 	for ( unsigned nInstr = 0; nInstr < MAX_INSTRUMENTS; ++nInstr ) {
@@ -430,11 +481,12 @@ void Mixer::updateMixer()
 			Instrument *pInstr = pInstrList->get( nInstr );
 			assert( pInstr );
 
-			float fNewPeak_L = pInstr->get_peak_l();
-			pInstr->set_peak_l( 0.0f );	// reset instrument peak
-
-			float fNewPeak_R = pInstr->get_peak_r();
-			pInstr->set_peak_r( 0.0f );	// reset instrument peak
+			float fNewPeak_L = 0.0f;
+			float fNewPeak_R = 0.0f;
+			if ( pLevels && (int)nInstr < pLevels->instruments ) {
+				fNewPeak_L = pLevels->instrument[ nInstr ].peak_l;
+				fNewPeak_R = pLevels->instrument[ nInstr ].peak_r;
+			}
 
 			float fNewVolume = pInstr->get_volume();
 			bool bMuted = pInstr->is_muted();
@@ -525,13 +577,11 @@ void Mixer::updateMixer()
 	}
 
 
-	// update MasterPeak
+	// update MasterPeak, between the frames too
 	float oldPeak_L = m_pMasterLine->getPeak_L();
-	float newPeak_L = pEngine->getMasterPeak_L();
-	pEngine->setMasterPeak_L(0.0);
+	float newPeak_L = ( pLevels ? pLevels->true_peak_l : 0.0f );
 	float oldPeak_R = m_pMasterLine->getPeak_R();
-	float newPeak_R = pEngine->getMasterPeak_R();
-	pEngine->setMasterPeak_R(0.0);
+	float newPeak_R = ( pLevels ? pLevels->true_peak_r : 0.0f );
 
 	if (!bShowPeaks) {
 		newPeak_L = 0.0;
@@ -562,6 +612,8 @@ void Mixer::updateMixer()
 	}
 	m_pMasterLine->updateMixerLine();
 
+	updateBusLines( pLevels, fallOff, bShowPeaks );
+
 
 #ifdef H2CORE_HAVE_LADSPA
 	// LADSPA
@@ -569,8 +621,8 @@ void Mixer::updateMixer()
 		LadspaFX *pFX = Effects::get_instance()->getLadspaFX( nFX );
 		if ( pFX ) {
 			m_pLadspaFXLine[nFX]->setName( pFX->getPluginName() );
-			float fNewPeak_L = 0.0;
-			float fNewPeak_R = 0.0;
+			float fNewPeak_L = ( pLevels ? pLevels->fx[ nFX ].peak_l : 0.0f );
+			float fNewPeak_R = ( pLevels ? pLevels->fx[ nFX ].peak_r : 0.0f );
 
 			float fOldPeak_L = 0.0;
 			float fOldPeak_R = 0.0;
@@ -594,6 +646,136 @@ void Mixer::updateMixer()
 
 
 
+void Mixer::updateBusLines( const MeterLevels* pLevels, float fallOff, bool bShowPeaks )
+{
+	Song *pSong = Hydrogen::get_instance()->getSong();
+	int nBuses = pSong->get_bus_count();
+
+	for ( int nBus = 0; nBus < MAX_BUSES; ++nBus ) {
+		if ( nBus >= nBuses ) {
+			delete m_pBusLine[ nBus ];
+			m_pBusLine[ nBus ] = NULL;
+			continue;
+		}
+		if ( m_pBusLine[ nBus ] == NULL ) {
+			m_pBusLine[ nBus ] = createBusLine( nBus );
+			m_pBusHBox->addWidget( m_pBusLine[ nBus ] );
+		}
+		MixerLine *pLine = m_pBusLine[ nBus ];
+		Bus *pBus = pSong->get_bus( nBus );
+
+		float fNewPeak_L = 0.0f;
+		float fNewPeak_R = 0.0f;
+		if ( pLevels && nBus < pLevels->buses ) {
+			fNewPeak_L = pLevels->bus[ nBus ].peak_l;
+			fNewPeak_R = pLevels->bus[ nBus ].peak_r;
+		}
+
+		if (!bShowPeaks) {
+			fNewPeak_L = 0.0f;
+			fNewPeak_R = 0.0f;
+		}
+
+		float fOldPeak_L = pLine->getPeak_L();
+		float fOldPeak_R = pLine->getPeak_R();
+		pLine->setPeak_L( fNewPeak_L >= fOldPeak_L ? fNewPeak_L : fOldPeak_L / fallOff );
+		pLine->setPeak_R( fNewPeak_R >= fOldPeak_R ? fNewPeak_R : fOldPeak_R / fallOff );
+
+		pLine->setVolume( pBus->get_volume() );
+		pLine->setMuteClicked( pBus->is_muted() );
+		pLine->setName( pBus->get_name() );
+
+		float fPanValue = 0.0;
+		if ( pBus->get_pan_r() == 1.0 ) {
+			fPanValue = 1.0 - ( pBus->get_pan_l() / 2.0 );
+		}
+		else {
+			fPanValue = pBus->get_pan_r() / 2.0;
+		}
+		pLine->setPan( fPanValue );
+
+		for (uint nFX = 0; nFX < MAX_FX; nFX++) {
+			pLine->setFXLevel( nFX, pBus->get_fx_level( nFX ) );
+		}
+
+		pLine->updateMixerLine();
+	}
+
+	m_pBusPanel->setFixedWidth( MIXER_STRIP_WIDTH * nBuses );
+	m_pBusPanel->setVisible( nBuses > 0 );
+}
+
+
+
+void Mixer::busMuteClicked(MixerLine* ref)
+{
+	Bus *pBus = Hydrogen::get_instance()->getSong()->get_bus( findBusLineByRef( ref ) );
+	if ( pBus ) {
+		pBus->set_muted( ref->isMuteClicked() );
+	}
+}
+
+
+
+void Mixer::busVolumeChanged(MixerLine* ref)
+{
+	Bus *pBus = Hydrogen::get_instance()->getSong()->get_bus( findBusLineByRef( ref ) );
+	if ( pBus ) {
+		pBus->set_volume( ref->getVolume() );
+	}
+}
+
+
+
+void Mixer::busPanChanged(MixerLine* ref)
+{
+	Bus *pBus = Hydrogen::get_instance()->getSong()->get_bus( findBusLineByRef( ref ) );
+	if ( pBus == NULL ) {
+		return;
+	}
+
+	float panValue = ref->getPan();
+	if (panValue >= 0.5) {
+		pBus->set_pan_l( (1.0 - panValue) * 2 );
+		pBus->set_pan_r( 1.0 );
+	}
+	else {
+		pBus->set_pan_l( 1.0 );
+		pBus->set_pan_r( panValue * 2 );
+	}
+}
+
+
+
+void Mixer::busKnobChanged(MixerLine* ref, int nKnob)
+{
+	Bus *pBus = Hydrogen::get_instance()->getSong()->get_bus( findBusLineByRef( ref ) );
+	if ( pBus == NULL ) {
+		return;
+	}
+	pBus->set_fx_level( ref->getFXLevel(nKnob), nKnob );
+	QString sInfo = trUtf8( "Set bus FX %1 level ").arg( nKnob + 1 );
+	( HydrogenApp::get_instance() )->setStatusBarMessage( sInfo+ QString( "[%1]" ).arg( ref->getFXLevel(nKnob), 0, 'f', 2 ), 2000 );
+}
+
+
+
+void Mixer::busNameClicked(MixerLine* ref)
+{
+	Bus *pBus = Hydrogen::get_instance()->getSong()->get_bus( findBusLineByRef( ref ) );
+	if ( pBus == NULL ) {
+		return;
+	}
+	bool bIsOkPressed;
+	QString sNewName = QInputDialog::getText( this, "Hydrogen", trUtf8( "New bus name" ), QLineEdit::Normal, pBus->get_name(), &bIsOkPressed );
+	if ( bIsOkPressed ) {
+		pBus->set_name( sNewName );
+		Hydrogen::get_instance()->getSong()->__is_modified = true;
+	}
+}
+
+
+
 /// show event
 void Mixer::showEvent ( QShowEvent *ev )
 {
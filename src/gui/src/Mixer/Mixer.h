@@ -39,6 +39,11 @@ class MasterMixerLine;
 class LadspaFXMixerLine;
 class PixmapWidget;
 
+namespace H2Core
+{
+	struct MeterLevels;
+}
+
 class Mixer : public QWidget, public EventListener, public H2Core::Object
 {
     H2_OBJECT
@@ -74,6 +79,11 @@ class Mixer : public QWidget, public EventListener, public H2Core::Object
 		void ladspaActiveBtnClicked( LadspaFXMixerLine* ref );
 		void ladspaEditBtnClicked( LadspaFXMixerLine *ref );
 		void ladspaVolumeChanged( LadspaFXMixerLine* ref);
+		void busMuteClicked(MixerLine* ref);
+		void busVolumeChanged(MixerLine* ref);
+		void busPanChanged(MixerLine* ref);
+		void busKnobChanged(MixerLine* ref, int nKnob);
+		void busNameClicked(MixerLine* ref);
 
 	private:
 		QHBoxLayout *m_pFaderHBox;
@@ -87,12 +97,19 @@ class Mixer : public QWidget, public EventListener, public H2Core::Object
 		QWidget *m_pFaderPanel;
 		MixerLine *m_pMixerLine[MAX_INSTRUMENTS];
 
+		QWidget *m_pBusPanel;
+		QHBoxLayout *m_pBusHBox;
+		MixerLine *m_pBusLine[MAX_BUSES];
+
 		PixmapWidget *m_pFXFrame;
 
 		QTimer *m_pUpdateTimer;
 
 		uint findMixerLineByRef(MixerLine* ref);
 		MixerLine* createMixerLine( int );
+		int findBusLineByRef(MixerLine* ref);
+		MixerLine* createBusLine( int );
+		void updateBusLines( const H2Core::MeterLevels* pLevels, float fallOff, bool bShowPeaks );
 
 		// Implements EventListener interface
 		virtual void noteOnEvent( int nInstrument );
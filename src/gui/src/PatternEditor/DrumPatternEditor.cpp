@@ -323,7 +323,7 @@ void DrumPatternEditor::addOrDeleteNoteAction(	int nColumn,
 		// hear note
 		if ( listen && !isNoteOff ) {
 			Note *pNote2 = new Note( pSelectedInstrument, 0, fVelocity, fPan_L, fPan_R, nLength, fPitch);
-			AudioEngine::get_instance()->get_sampler()->note_on(pNote2);
+			AudioEngine::get_instance()->get_sampler()->queue_note_on(pNote2);
 		}
 	}
 	pSong->__is_modified = true;
@@ -1228,9 +1228,7 @@ void DrumPatternEditor::functionMoveInstrumentAction( int nSourceInstrument,  in
 
         pInstrumentList->move( nSourceInstrument, nTargetInstrument );
 
-		#ifdef H2CORE_HAVE_JACK
 		engine->renameJackPorts();
-		#endif
 
 		AudioEngine::get_instance()->unlock();
 		engine->setSelectedInstrumentNumber( nTargetInstrument );
@@ -1245,9 +1243,7 @@ void  DrumPatternEditor::functionDropInstrumentUndoAction( int nTargetInstrument
 	pEngine->removeInstrument( nTargetInstrument, false );
 	
 	AudioEngine::get_instance()->lock( RIGHT_HERE );
-#ifdef H2CORE_HAVE_JACK
 	pEngine->renameJackPorts();
-#endif
 	AudioEngine::get_instance()->unlock();
 	updateEditor();
 }
@@ -1275,9 +1271,7 @@ void  DrumPatternEditor::functionDropInstrumentRedoAction( QString sDrumkitName,
 		AudioEngine::get_instance()->lock( RIGHT_HERE );
 		pEngine->getSong()->get_instrument_list()->add( pNewInstrument );
 
-		#ifdef H2CORE_HAVE_JACK
 		pEngine->renameJackPorts();
-		#endif
 
 		AudioEngine::get_instance()->unlock();
 		//move instrument to the position where it was dropped
@@ -1319,9 +1313,7 @@ void DrumPatternEditor::functionDeleteInstrumentUndoAction( std::list< H2Core::N
 	AudioEngine::get_instance()->lock( RIGHT_HERE );
 	pEngine->getSong()->get_instrument_list()->add( pNewInstrument );
 
-	#ifdef H2CORE_HAVE_JACK
 	pEngine->renameJackPorts();
-	#endif
 
 	AudioEngine::get_instance()->unlock();	// unlock the audio engine
 
@@ -1360,9 +1352,7 @@ void DrumPatternEditor::functionAddEmptyInstrumentUndo()
 	pEngine->removeInstrument( pEngine->getSong()->get_instrument_list()->size() -1 , false );
 	
 	AudioEngine::get_instance()->lock( RIGHT_HERE );
-#ifdef H2CORE_HAVE_JACK
 	pEngine->renameJackPorts();
-#endif
 	AudioEngine::get_instance()->unlock();
 	updateEditor();
 }
@@ -1386,9 +1376,7 @@ void DrumPatternEditor::functionAddEmptyInstrumentRedo()
 	Instrument *pNewInstr = new Instrument( nID, "New instrument");
 	pList->add( pNewInstr );
 	
-	#ifdef H2CORE_HAVE_JACK
 	Hydrogen::get_instance()->renameJackPorts();
-	#endif
 	
 	AudioEngine::get_instance()->unlock();
 
@@ -685,7 +685,7 @@ void PianoRollEditor::addOrDeleteNoteAction( int nColumn,
 		if ( pref->getHearNewNotes() && !noteOff ) {
 			Note *pNote2 = new Note( pSelectedInstrument, 0, fVelocity, fPan_L, fPan_R, nLength, fPitch);
 			pNote2->set_key_octave( pressednotekey, pressedoctave );
-			AudioEngine::get_instance()->get_sampler()->note_on(pNote2);
+			AudioEngine::get_instance()->get_sampler()->queue_note_on(pNote2);
 		}
 	}
 	pSong->__is_modified = true;
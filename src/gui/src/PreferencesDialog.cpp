@@ -364,8 +364,11 @@ void PreferencesDialog::on_okBtn_clicked()
 	// metronome
 	pPref->m_fMetronomeVolume = (metronomeVolumeSpinBox->value()) / 100.0;
 
-	// maxVoices
-	pPref->m_nMaxNotes = maxVoicesTxt->value();
+	// maxVoices, the note pool follows it when the drivers are restarted
+	if ( pPref->m_nMaxNotes != maxVoicesTxt->value() ) {
+		pPref->m_nMaxNotes = maxVoicesTxt->value();
+		m_bNeedDriverRestart = true;
+	}
 
 	if ( m_pMidiDriverComboBox->currentText() == "ALSA" ) {
 		pPref->m_sMidiDriver = "ALSA";
@@ -722,6 +725,9 @@ void PreferencesDialog::on_resampleComboBox_currentIndexChanged ( int index )
 	case 4:
 		AudioEngine::get_instance()->get_sampler()->setInterpolateMode( Sampler::HERMITE );
 		break;
+	case 5:
+		AudioEngine::get_instance()->get_sampler()->setInterpolateMode( Sampler::SINC );
+		break;
 	}
 
 }
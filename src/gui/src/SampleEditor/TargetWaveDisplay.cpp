@@ -197,8 +197,10 @@ void TargetWaveDisplay::updateDisplay( H2Core::InstrumentLayer *pLayer )
 
 		float fGain = (height() - 8) / 2.0 * pLayer->get_gain();
 
-		float *pSampleDatal = pLayer->get_sample()->get_data_l();
-		float *pSampleDatar = pLayer->get_sample()->get_data_r();
+		// a compact sample holds 16 bit frames
+		Sample *pSample = pLayer->get_sample();
+		// a streamed sample only holds its first frames, the others are drawn flat
+		int nResidentFrames = pLayer->get_sample()->get_resident_frames();
 		int nSamplePos = 0;
 		int nVall;
 		int nValr;
@@ -206,21 +208,23 @@ void TargetWaveDisplay::updateDisplay( H2Core::InstrumentLayer *pLayer )
 			nVall = 0;
 			nValr = 0;
 			for ( int j = 0; j < nScaleFactor; ++j ) {
-				if ( j < nSampleLength ) {
-					if ( pSampleDatal[ nSamplePos ] < 0 ){
-						int newVal = static_cast<int>( pSampleDatal[ nSamplePos ] * -fGain );
+				if ( j < nSampleLength && nSamplePos < nResidentFrames ) {
+					float fVall = pSample->get_value_l( nSamplePos );
+					float fValr = pSample->get_value_r( nSamplePos );
+					if ( fVall < 0 ){
+						int newVal = static_cast<int>( fVall * -fGain );
 						nVall = newVal;
 					}else
 					{
-						int newVal = static_cast<int>( pSampleDatal[ nSamplePos ] * fGain );
+						int newVal = static_cast<int>( fVall * fGain );
 						nVall = newVal;
 					}
-					if ( pSampleDatar[ nSamplePos ] > 0 ){
-						int newVal = static_cast<int>( pSampleDatar[ nSamplePos ] * -fGain );
+					if ( fValr > 0 ){
+						int newVal = static_cast<int>( fValr * -fGain );
 						nValr = newVal;
 					}else
 					{
-						int newVal = static_cast<int>( pSampleDatar[ nSamplePos ] * fGain );
+						int newVal = static_cast<int>( fValr * fGain );
 						nValr = newVal;
 					}
 				}
@@ -0,0 +1,64 @@
+
+#include "spec.h"
+
+#include <hydrogen/basics/adsr.h>
+
+/** return a random value within [0, max] */
+static float random_value( float max )
+{
+    return max * rand() / RAND_MAX;
+}
+
+/** return a random tick count, zero at times */
+static float random_ticks()
+{
+    return ( rand() % 8==0 ? 0.0 : random_value( 20000.0 ) );
+}
+
+int adsr_values( int log_level )
+{
+    ___INFOLOG( "test ADSR block values against single values" );
+
+    float values[ 512 ];
+    srand( 1 );
+    for( int round=0; round<500; round++ ) {
+        float attack = random_ticks();
+        float decay = random_ticks();
+        float sustain = ( rand() % 8==0 ? 1.0 : random_value( 1.0 ) );
+        float release = random_ticks();
+        H2Core::ADSR* single = new H2Core::ADSR( attack, decay, sustain, release );
+        H2Core::ADSR* block = new H2Core::ADSR( attack, decay, sustain, release );
+        float step = ( rand() % 4==0 ? 1.0 : random_value( 4.0 ) );
+
+        int frames = 0;
+        while( frames<50000 ) {
+            int n = rand() % 513;
+            block->get_values( step, values, n );
+            for( int i=0; i<n; i++ ) {
+                spec( single->get_value( step )==values[i], "get_values should match get_value bit for bit" );
+            }
+            spec( single->get_current_value()==block->get_current_value(), "current values should match" );
+            frames += n;
+
+            // state changes between blocks
+            switch( rand() % 16 ) {
+            case 0:
+                single->attack();
+                block->attack();
+                break;
+            case 1:
+                spec( single->release()==block->release(), "release values should match" );
+                break;
+            case 2: {
+                float ticks = random_ticks();
+                spec( single->fade_out( ticks )==block->fade_out( ticks ), "fade out values should match" );
+                break;
+            }
+            }
+            spec( single->is_released()==block->is_released(), "states should match" );
+        }
+        delete single;
+        delete block;
+    }
+    return EXIT_SUCCESS;
+}
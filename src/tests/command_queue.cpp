@@ -0,0 +1,92 @@
+
+#include "spec.h"
+
+#include <hydrogen/command_queue.h>
+#include <hydrogen/basics/note.h>
+
+/** push count commands numbered from first, return the number pushed */
+static int push_commands( H2Core::CommandQueue* queue, int first, int count )
+{
+    for( int i=0; i<count; i++ ) {
+        H2Core::Command cmd;
+        cmd.type = H2Core::COMMAND_NOTE_OFF;
+        cmd.value = first + i;
+        if( !queue->push_command( cmd ) ) return i;
+    }
+    return count;
+}
+
+/** pop count commands, they must be numbered from first */
+static void pop_commands( H2Core::CommandQueue* queue, int first, int count )
+{
+    H2Core::Command cmd;
+    for( int i=0; i<count; i++ ) {
+        spec( queue->pop_command( cmd ), "a command should be queued" );
+        spec( cmd.type==H2Core::COMMAND_NOTE_OFF, "command type should be kept" );
+        spec( cmd.value==first + i, "commands should pop in push order" );
+    }
+}
+
+int command_queue( int log_level )
+{
+    ___INFOLOG( "test command queue wraparound and retired objects" );
+
+    H2Core::CommandQueue* queue = new H2Core::CommandQueue();
+    H2Core::Command cmd;
+    spec( !queue->pop_command( cmd ), "new queue should be empty" );
+
+    // batches of every size, the indexes wrap many times
+    int n = 0;
+    for( int round=0; round<64; round++ ) {
+        int count = 1 + ( round * 97 ) % ( MAX_COMMANDS - 1 );
+        spec( push_commands( queue, n, count )==count, "commands should fit" );
+        pop_commands( queue, n, count );
+        n += count;
+        spec( !queue->pop_command( cmd ), "queue should be empty" );
+    }
+
+    // one slot always stays free
+    spec( push_commands( queue, n, MAX_COMMANDS )==MAX_COMMANDS - 1, "queue should hold MAX_COMMANDS-1 commands" );
+    pop_commands( queue, n, 10 );
+    n += 10;
+    spec( push_commands( queue, n + MAX_COMMANDS - 11, 20 )==10, "popped slots should be reused" );
+    pop_commands( queue, n, MAX_COMMANDS - 1 );
+    spec( !queue->pop_command( cmd ), "queue should be empty" );
+
+    // retired objects are deleted by the collector, across the ring end
+    queue->retire( H2Core::CommandQueue::RETIRED_NOTE, NULL );
+    for( int round=0; round<5; round++ ) {
+        unsigned objects = H2Core::Object::objects_count();
+        for( int i=0; i<MAX_COMMANDS / 2; i++ ) {
+            queue->retire( H2Core::CommandQueue::RETIRED_NOTE, new H2Core::Note( 0, i, 0.8, 0.5, 0.5, -1, 0 ) );
+        }
+        if( H2Core::Object::count_active() ) {
+            spec( H2Core::Object::objects_count()==objects + MAX_COMMANDS / 2, "retired notes should be alive until collected" );
+        }
+        queue->collect_garbage();
+        if( H2Core::Object::count_active() ) {
+            spec( H2Core::Object::objects_count()==objects, "retired notes should be deleted once collected" );
+        }
+    }
+
+    // nobody collects, the audio thread keeps what does not fit instead of deleting it
+    unsigned objects = H2Core::Object::objects_count();
+    for( int i=0; i<MAX_COMMANDS + 10; i++ ) {
+        queue->retire( H2Core::CommandQueue::RETIRED_NOTE, new H2Core::Note( 0, i, 0.8, 0.5, 0.5, -1, 0 ) );
+    }
+    spec( queue->get_deferred_count()==11, "objects past the ring should be deferred" );
+    if( H2Core::Object::count_active() ) {
+        spec( H2Core::Object::objects_count()==objects + MAX_COMMANDS + 10, "a full ring should not delete in place" );
+    }
+    queue->collect_garbage();
+    spec( queue->get_deferred_count()==11, "collecting should not touch the deferred objects" );
+    queue->flush_retired();
+    spec( queue->get_deferred_count()==0, "deferred objects should move to the ring once collected" );
+    queue->collect_garbage();
+    if( H2Core::Object::count_active() ) {
+        spec( H2Core::Object::objects_count()==objects, "deferred objects should be deleted once collected" );
+    }
+
+    delete queue;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+
+#include "spec.h"
+
+#include <hydrogen/sampler/mix_kernels.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define MIX_TEST_FRAMES 259
+
+/** fill a buffer with values within [-range, range] */
+static void fill( float* buffer, int n, float range )
+{
+    for( int i=0; i<n; i++ ) buffer[i] = range * ( 2.0f * rand() / RAND_MAX - 1.0f );
+}
+
+static bool same( const float* a, const float* b, int n )
+{
+    for( int i=0; i<n; i++ ) {
+        if( a[i]!=b[i] ) return false;
+    }
+    return true;
+}
+
+/** the sum order of the vector implementations, four lanes then the tail */
+static float dot( const float* a, const float* b, int n )
+{
+    float lanes[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    int i = 0;
+    for( ; i + 4<=n; i+=4 ) {
+        for( int k=0; k<4; k++ ) lanes[k] += a[i + k] * b[i + k];
+    }
+    float sum = ( lanes[0] + lanes[2] ) + ( lanes[1] + lanes[3] );
+    for( ; i<n; i++ ) sum += a[i] * b[i];
+    return sum;
+}
+
+int mix_kernels( int log_level )
+{
+    ___INFOLOG( QString( "test mix kernels against plain loops, using %1" ).arg( H2Core::mix_kernels_name() ) );
+
+    // one extra value to test unaligned buffers
+    float in[ MIX_TEST_FRAMES + 1 ];
+    float env[ MIX_TEST_FRAMES + 1 ];
+    float out[ MIX_TEST_FRAMES + 1 ];
+    float out2[ MIX_TEST_FRAMES + 1 ];
+    float ref[ MIX_TEST_FRAMES + 1 ];
+    float ref2[ MIX_TEST_FRAMES + 1 ];
+    float in_f[ MIX_TEST_FRAMES + 1 ];
+    short in_s16[ MIX_TEST_FRAMES + 1 ];
+    float lane_buffers[ MIX_FILTER_LANES ][ MIX_TEST_FRAMES + 1 ];
+    float lane_refs[ MIX_FILTER_LANES ][ MIX_TEST_FRAMES + 1 ];
+
+    srand( 1 );
+    for( int offset=0; offset<2; offset++ ) {
+        for( int n=0; n<=MIX_TEST_FRAMES - 1; n+=( n<20 ? 1 : 17 ) ) {
+            float* pIn = in + offset;
+            float* pEnv = env + offset;
+            float* pOut = out + offset;
+            fill( in, MIX_TEST_FRAMES + 1, 1.5f );
+            fill( env, MIX_TEST_FRAMES + 1, 1.0f );
+
+            // envelope
+            H2Core::mix_apply_envelope( pIn, pEnv, pOut, n );
+            for( int i=0; i<n; i++ ) ref[i] = pIn[i] * pEnv[i];
+            spec( same( pOut, ref, n ), "mix_apply_envelope should match the plain loop" );
+
+            // 16 bit envelope
+            float scale = 1.0f / 32768.0f;
+            for( int i=0; i<MIX_TEST_FRAMES + 1; i++ ) in_s16[i] = ( short )( rand() % 65536 - 32768 );
+            H2Core::mix_apply_envelope_s16( in_s16 + offset, scale, pEnv, pOut, n );
+            for( int i=0; i<n; i++ ) ref[i] = ( in_s16[ offset + i ] * scale ) * pEnv[i];
+            spec( same( pOut, ref, n ), "mix_apply_envelope_s16 should match the plain loop" );
+
+            // add
+            fill( out, MIX_TEST_FRAMES + 1, 1.0f );
+            for( int i=0; i<n; i++ ) ref[i] = pOut[i] + pIn[i] * 0.7f;
+            H2Core::mix_add( pIn, 0.7f, pOut, n );
+            spec( same( pOut, ref, n ), "mix_add should match the plain loop" );
+
+            // scatter to two sends
+            fill( out, MIX_TEST_FRAMES + 1, 1.0f );
+            fill( out2, MIX_TEST_FRAMES + 1, 1.0f );
+            for( int i=0; i<n; i++ ) {
+                ref[i] = pOut[i] + pIn[i] * 0.25f;
+                ref2[i] = out2[i] + pIn[i] * 1.5f;
+            }
+            H2Core::MixSend sends[2] = { { pOut, 0.25f }, { out2, 1.5f } };
+            H2Core::mix_scatter( pIn, sends, 2, n );
+            spec( same( pOut, ref, n ), "mix_scatter should match the plain loop on the first send" );
+            spec( same( out2, ref2, n ), "mix_scatter should match the plain loop on the second send" );
+
+            // meter, the peak and the sum are accumulated
+            float peak = 0.1f;
+            float sum = 0.5f;
+            float ref_peak = 0.1f;
+            for( int i=0; i<n; i++ ) ref_peak = std::max( ref_peak, ( float )fabs( pIn[i] ) );
+            H2Core::mix_meter( pIn, n, &peak, &sum );
+            spec( peak==ref_peak, "mix_meter peak should match the plain loop" );
+            spec( sum==0.5f + dot( pIn, pIn, n ), "mix_meter sum should match the plain loop" );
+
+            // dot products
+            int n4 = n & ~3;
+            spec( H2Core::mix_dot( pIn, pEnv, n4 )==dot( pIn, pEnv, n4 ), "mix_dot should match the plain loop" );
+            for( int i=0; i<n4; i++ ) in_f[i] = in_s16[ offset + i ];
+            spec( H2Core::mix_dot_s16( in_s16 + offset, pEnv, n4 )==dot( in_f, pEnv, n4 ), "mix_dot_s16 should match the plain loop" );
+
+            // resonant filter, each lane with its own parameters and state
+            H2Core::MixFilterLane lanes[ MIX_FILTER_LANES ];
+            for( int k=0; k<MIX_FILTER_LANES; k++ ) {
+                fill( lane_buffers[k], MIX_TEST_FRAMES + 1, 1.0f );
+                memcpy( lane_refs[k], lane_buffers[k], sizeof( lane_refs[k] ) );
+                lanes[k].buffer = lane_buffers[k] + offset;
+                lanes[k].cutoff = 0.2f + 0.15f * k;
+                lanes[k].resonance = 0.9f - 0.1f * k;
+                lanes[k].bp = 0.05f * k;
+                lanes[k].lp = -0.1f * k;
+            }
+            H2Core::mix_filter_lanes( lanes, n );
+            for( int k=0; k<MIX_FILTER_LANES; k++ ) {
+                float cutoff = 0.2f + 0.15f * k;
+                float resonance = 0.9f - 0.1f * k;
+                float bp = 0.05f * k;
+                float lp = -0.1f * k;
+                float* pRef = lane_refs[k] + offset;
+                for( int i=0; i<n; i++ ) {
+                    bp = resonance * bp + cutoff * ( pRef[i] - lp );
+                    lp = lp + cutoff * bp;
+                    pRef[i] = lp;
+                }
+                spec( same( lanes[k].buffer, pRef, n ), "mix_filter_lanes should match the plain loop" );
+                spec( lanes[k].bp==bp && lanes[k].lp==lp, "mix_filter_lanes should leave the state of the plain loop" );
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
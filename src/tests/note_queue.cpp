@@ -0,0 +1,141 @@
+
+#include "spec.h"
+
+#include <hydrogen/basics/note.h>
+#include <hydrogen/basics/note_queue.h>
+
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <vector>
+
+/** the comparator of the song note priority queue the NoteQueue replaced */
+static float tick_size = 1.0;
+struct compare_pNotes {
+    bool operator() ( H2Core::Note* pNote1, H2Core::Note* pNote2 ) {
+        return ( pNote1->get_humanize_delay() + pNote1->get_position() * tick_size )
+               > ( pNote2->get_humanize_delay() + pNote2->get_position() * tick_size );
+    }
+};
+typedef std::priority_queue<H2Core::Note*, std::deque<H2Core::Note*>, compare_pNotes> priority_queue_t;
+
+static float key_of( H2Core::Note* note )
+{
+    return ( note->get_humanize_delay() + note->get_position() * tick_size );
+}
+
+/** the order notes are expected in when their start frames are equal */
+static std::map<H2Core::Note*, unsigned> order;
+static unsigned pushed = 0;
+
+static bool before( H2Core::Note* a, H2Core::Note* b )
+{
+    return ( key_of( a )<key_of( b ) || ( key_of( a )==key_of( b ) && order[a]<order[b] ) );
+}
+
+/**
+ * push count random notes in both queues, positions within [first, first+range)
+ * ticks and humanize delays within [-spread, spread] frames
+ */
+static void push_notes( H2Core::NoteQueue* queue, priority_queue_t& reference, int count, int first, int range, int spread )
+{
+    for( int i=0; i<count; i++ ) {
+        H2Core::Note* note = new H2Core::Note( 0, first + rand() % range, 0.8, 0.5, 0.5, -1, 0 );
+        if( spread>0 ) note->set_humanize_delay( rand() % ( 2 * spread + 1 ) - spread );
+        order[note] = pushed++;
+        queue->push( note );
+        reference.push( note );
+    }
+}
+
+/** pop count notes from both queues, equal start frames must come out in push order */
+static void pop_notes( H2Core::NoteQueue* queue, priority_queue_t& reference, int count )
+{
+    bool first = true;
+    float last_key = 0;
+    unsigned last_order = 0;
+    for( int i=0; i<count; i++ ) {
+        spec( !queue->empty(), "queue should not be empty" );
+        spec( queue->size()==reference.size(), "queue size should match the priority queue" );
+        H2Core::Note* note = queue->top();
+        spec( key_of( note )==key_of( reference.top() ), "start frame should match the priority queue" );
+        if( !first && last_key==key_of( note ) ) {
+            spec( last_order<order[note], "equal start frames should pop in push order" );
+        }
+        queue->pop();
+        // the priority queue has no order for equal start frames, take the same note out
+        std::vector<H2Core::Note*> equal;
+        while( reference.top()!=note ) {
+            equal.push_back( reference.top() );
+            reference.pop();
+        }
+        reference.pop();
+        for( unsigned j=0; j<equal.size(); j++ ) reference.push( equal[j] );
+        first = false;
+        last_key = key_of( note );
+        last_order = order[note];
+        order.erase( note );
+        delete note;
+    }
+}
+
+/**
+ * rebuild the reference with a new tick size, the priority queue comparator reads it,
+ * the queued notes are requeued in their current order
+ */
+static void set_tick_size( H2Core::NoteQueue* queue, priority_queue_t& reference, float value )
+{
+    std::vector<H2Core::Note*> notes;
+    while( !reference.empty() ) {
+        notes.push_back( reference.top() );
+        reference.pop();
+    }
+    std::sort( notes.begin(), notes.end(), before );
+    for( unsigned i=0; i<notes.size(); i++ ) order[ notes[i] ] = pushed++;
+    tick_size = value;
+    queue->set_tick_size( value );
+    for( unsigned i=0; i<notes.size(); i++ ) reference.push( notes[i] );
+}
+
+int note_queue( int log_level )
+{
+    ___INFOLOG( "test note queue order against the priority queue" );
+
+    srand( 1 );
+    H2Core::NoteQueue* queue = new H2Core::NoteQueue();
+    priority_queue_t reference;
+
+    // within the wheel, interleaved
+    set_tick_size( queue, reference, 183.75 );
+    push_notes( queue, reference, 500, 0, 192, 300 );
+    pop_notes( queue, reference, 250 );
+    push_notes( queue, reference, 500, 96, 192, 300 );
+    pop_notes( queue, reference, queue->size() );
+    spec( queue->empty(), "queue should be empty" );
+
+    // far beyond the wheel, through the overflow list
+    push_notes( queue, reference, 1000, 0, 20000, 0 );
+    pop_notes( queue, reference, 100 );
+    push_notes( queue, reference, 100, 0, 50, 2000 );
+    pop_notes( queue, reference, queue->size() );
+
+    // many notes on the same frames, full buckets spill
+    push_notes( queue, reference, 2000, 10, 4, 0 );
+    push_notes( queue, reference, 200, 0, 30, 0 );
+    pop_notes( queue, reference, 1000 );
+    push_notes( queue, reference, 500, 12, 2, 0 );
+    pop_notes( queue, reference, queue->size() );
+
+    // tempo change while notes are queued
+    push_notes( queue, reference, 1500, 0, 768, 500 );
+    pop_notes( queue, reference, 200 );
+    set_tick_size( queue, reference, 91.875 );
+    pop_notes( queue, reference, 300 );
+    set_tick_size( queue, reference, 367.5 );
+    push_notes( queue, reference, 500, 0, 768, 500 );
+    pop_notes( queue, reference, queue->size() );
+    spec( queue->empty(), "queue should be empty" );
+
+    delete queue;
+    return EXIT_SUCCESS;
+}
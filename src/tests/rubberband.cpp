@@ -106,8 +106,8 @@ void rubberband_test( const QString& sample_path ) {
     }
     ___DEBUGLOG( QString( "done.\n  %1 frames processed\n  %2 frames retrieved [ %3 expected ]" ).arg( processed ).arg( retrieved ).arg( sample->get_frames()*time_ratio ) );
     // final data buffers
-    float* data_l = new float[ retrieved ];
-    float* data_r = new float[ retrieved ];
+    float* data_l = H2Core::Sample::alloc_data( retrieved );
+    float* data_r = H2Core::Sample::alloc_data( retrieved );
     for( int i=0; i<retrieved; i++) data_r[i] = data_l[i] = 0.5;
     // feed final data buffers
     memcpy( data_l, out_data_l, retrieved*sizeof(float) );
@@ -0,0 +1,60 @@
+
+#include "spec.h"
+
+#include <hydrogen/basics/sample.h>
+#include <hydrogen/basics/sample_pool.h>
+
+#define BASE_DIR    "./src/tests/data"
+
+int sample_pool( int log_level )
+{
+    ___INFOLOG( "test sample pool reference counting" );
+
+    int buffers = H2Core::SamplePool::get_buffer_count();
+    H2Core::Sample::Loops loops;
+    H2Core::Sample::VelocityEnvelope velocity;
+    H2Core::Sample::PanEnvelope pan;
+
+    // buffers filled by hand
+    QString path = BASE_DIR"/drumkit/kick.wav";
+    H2Core::SampleBuffer* buffer = new H2Core::SampleBuffer( path, false, false, 0, loops, velocity, pan );
+    buffer->frames = buffer->resident_frames = 64;
+    buffer->data_l = H2Core::Sample::alloc_data( 64 );
+    buffer->data_r = H2Core::Sample::alloc_data( 64 );
+    spec( H2Core::SamplePool::acquire( path, false, false, 0, loops, velocity, pan )==0, "nothing should be pooled yet" );
+    spec( H2Core::SamplePool::share( buffer )==buffer, "a new buffer should be pooled" );
+    spec( H2Core::SamplePool::get_buffer_count()==buffers + 1, "the pool should hold the buffer" );
+    spec( H2Core::SamplePool::acquire( path, false, false, 0, loops, velocity, pan )==buffer, "the same file should share the buffer" );
+    spec( buffer->refs==2, "acquire should reference the buffer" );
+    spec( H2Core::SamplePool::acquire( path, false, false, 44100, loops, velocity, pan )==0, "another rate should not share the buffer" );
+    spec( H2Core::SamplePool::acquire( path, false, true, 0, loops, velocity, pan )==0, "compact frames should not share the buffer" );
+    loops.end_frame = 10;
+    spec( H2Core::SamplePool::acquire( path, false, false, 0, loops, velocity, pan )==0, "other loops should not share the buffer" );
+    loops.end_frame = 0;
+
+    // the same frames loaded twice meanwhile
+    H2Core::SampleBuffer* duplicate = new H2Core::SampleBuffer( path, false, false, 0, loops, velocity, pan );
+    spec( H2Core::SamplePool::share( duplicate )==buffer, "a duplicate should give the pooled buffer" );
+    spec( buffer->refs==3, "share should reference the pooled buffer" );
+    H2Core::SamplePool::retain( buffer );
+    spec( buffer->refs==4, "retain should reference the buffer" );
+    for( int i=0; i<3; i++ ) H2Core::SamplePool::release( buffer );
+    spec( H2Core::SamplePool::get_buffer_count()==buffers + 1, "a referenced buffer should stay pooled" );
+    spec( buffer->refs==1, "release should drop a reference" );
+    H2Core::SamplePool::release( buffer );
+    spec( H2Core::SamplePool::get_buffer_count()==buffers, "the last release should free the buffer" );
+
+    // samples loaded from the same file
+    H2Core::Sample* sample = H2Core::Sample::load( path );
+    H2Core::Sample* other = H2Core::Sample::load( path );
+    spec( sample!=0 && other!=0, "samples should load" );
+    spec( H2Core::SamplePool::get_buffer_count()==buffers + 1, "samples of the same file should share one buffer" );
+    spec( sample->get_data_l()==other->get_data_l(), "samples of the same file should share their frames" );
+    delete sample;
+    spec( H2Core::SamplePool::get_buffer_count()==buffers + 1, "the frames should stay with the other sample" );
+    spec( other->get_frames()>0 && other->get_data_l()!=0, "the other sample should keep its frames" );
+    delete other;
+    spec( H2Core::SamplePool::get_buffer_count()==buffers, "the frames should be freed with the last sample" );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+
+#include "spec.h"
+
+#include <hydrogen/audio_engine.h>
+#include <hydrogen/command_queue.h>
+#include <hydrogen/basics/instrument.h>
+#include <hydrogen/basics/note.h>
+#include <hydrogen/basics/note_pool.h>
+#include <hydrogen/sampler/Sampler.h>
+
+/** return a note off note of an instrument, as sent for stop notes and midi note offs */
+static H2Core::Note* note_off( H2Core::Instrument* instrument )
+{
+    H2Core::Note* note = new ( H2Core::NotePool::get_instance() ) H2Core::Note( instrument, 0, 0.0, 0.0, 0.0, -1, 0 );
+    note->set_note_off( true );
+    return note;
+}
+
+int sampler_kit_swap( int log_level )
+{
+    ___INFOLOG( "test sampler kit swap with stop notes" );
+
+    H2Core::AudioEngine::create_instance();
+    H2Core::AudioEngine* engine = H2Core::AudioEngine::get_instance();
+    H2Core::Sampler* sampler = engine->get_sampler();
+    H2Core::CommandQueue* commands = engine->get_command_queue();
+
+    H2Core::Instrument* instrument = new H2Core::Instrument( 1, "stop notes" );
+    instrument->set_stop_notes( true );
+    H2Core::Instrument* playing = new H2Core::Instrument( 2, "playing" );
+
+    // stop notes, played then deleted by the engine
+    for( int i=0; i<100; i++ ) {
+        H2Core::Note* note = note_off( instrument );
+        sampler->note_on( note );
+        delete note;
+    }
+    // midi note offs, posted
+    for( int i=0; i<100; i++ ) {
+        H2Core::Command cmd;
+        cmd.type = H2Core::COMMAND_NOTE_ON;
+        cmd.note = note_off( instrument );
+        sampler->handle_command( cmd );
+    }
+    commands->collect_garbage();
+    spec( !instrument->is_queued(), "note off notes should not keep their instrument queued" );
+
+    // the kit is replaced, the instrument without notes goes right away
+    unsigned objects = H2Core::Object::objects_count();
+    H2Core::Command cmd;
+    cmd.type = H2Core::COMMAND_RETIRE_INSTRUMENT;
+    cmd.instrument = instrument;
+    sampler->handle_command( cmd );
+    commands->collect_garbage();
+    if( H2Core::Object::count_active() ) {
+        spec( H2Core::Object::objects_count()<objects, "the replaced instrument should be deleted" );
+    }
+
+    // an instrument with queued notes waits for them
+    playing->enqueue();
+    objects = H2Core::Object::objects_count();
+    cmd.instrument = playing;
+    sampler->handle_command( cmd );
+    commands->collect_garbage();
+    if( H2Core::Object::count_active() ) {
+        spec( H2Core::Object::objects_count()==objects, "an instrument with queued notes should be kept" );
+    }
+    playing->dequeue();
+
+    // deletes the kept instrument
+    delete engine;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+
+#include "spec.h"
+
+#include <hydrogen/sampler/sinc_table.h>
+
+#include <algorithm>
+#include <cmath>
+
+#define SINC_TEST_FRAMES 4096
+
+/**
+ * resample a sine of frequency f ( cycles per frame ) with a table
+ * at many fractional positions
+ * \param peak set to the greatest output value
+ * \return the greatest error against the sine itself
+ */
+static double interpolate_sine( H2Core::SincTable* sinc, int table, double f, double* peak )
+{
+    static float in[ SINC_TEST_FRAMES ];
+    for( int i=0; i<SINC_TEST_FRAMES; i++ ) in[i] = sin( 2.0 * M_PI * f * i );
+    double error = 0.0;
+    *peak = 0.0;
+    for( int j=0; j<2000; j++ ) {
+        double pos = 100.0 + j * 1.37;
+        int p = ( int )pos;
+        const float* row = sinc->get_row( table, pos - p );
+        double out = 0.0;
+        for( int k=0; k<SINC_TAPS; k++ ) out += row[k] * in[ p + k + 1 - SINC_TAPS / 2 ];
+        *peak = std::max( *peak, fabs( out ) );
+        error = std::max( error, fabs( out - sin( 2.0 * M_PI * f * pos ) ) );
+    }
+    return error;
+}
+
+int sinc_table( int log_level )
+{
+    ___INFOLOG( "test sinc table gain, passband and stopband" );
+
+    H2Core::SincTable::create_instance();
+    H2Core::SincTable* sinc = H2Core::SincTable::get_instance();
+
+    // table choice
+    spec( sinc->get_table( 0.5 )==0, "slower steps should use the first table" );
+    spec( sinc->get_table( 1.0 )==0, "step 1 should use the first table" );
+    spec( sinc->get_table( 100.0 )==SINC_CUTOFFS - 1, "large steps should use the last table" );
+    for( float step=0.5; step<8.0; step+=0.01 ) {
+        spec( sinc->get_table( step )<=sinc->get_table( step + 0.01 ), "tables should follow the step" );
+    }
+
+    // unity gain at DC for every row, including mu close to 1
+    for( int table=0; table<SINC_CUTOFFS; table++ ) {
+        for( int phase=0; phase<SINC_PHASES; phase++ ) {
+            const float* row = sinc->get_row( table, ( phase + 0.49 ) / SINC_PHASES );
+            double sum = 0.0;
+            for( int k=0; k<SINC_TAPS; k++ ) sum += row[k];
+            spec( fabs( sum - 1.0 )<1e-5, "row coefficients should sum to 1" );
+        }
+    }
+
+    double peak;
+    // the first table interpolates a low frequency closely
+    spec( interpolate_sine( sinc, 0, 0.02, &peak )<1e-3, "first table should interpolate a low sine" );
+    for( int table=0; table<SINC_CUTOFFS; table++ ) {
+        // cutoff in cycles per frame, see SincTable::get_table()
+        double cutoff = 0.45 / ( 1.0 + table * 0.5 );
+        interpolate_sine( sinc, table, cutoff / 4.0, &peak );
+        spec( fabs( peak - 1.0 )<0.05, "tables should pass frequencies below their cutoff" );
+        if( table>0 ) {
+            interpolate_sine( sinc, table, 0.45, &peak );
+            spec( peak<0.01, "tables should stop frequencies that would fold back" );
+        }
+    }
+
+    delete sinc;
+    return EXIT_SUCCESS;
+}
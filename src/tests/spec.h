@@ -0,0 +1,19 @@
+#ifndef H2_TESTS_SPEC_H
+#define H2_TESTS_SPEC_H
+
+#include <cstdlib>
+#include <hydrogen/object.h>
+
+/** number of specs that did not hold, main() fails if it is not 0 */
+extern int spec_failures;
+
+/** log the message and count a failure if the condition does not hold */
+static inline void spec( bool cond, const char* msg )
+{
+    if( !cond ) {
+        ___ERRORLOG( QString( " ** SPEC : %1" ).arg( msg ) );
+        spec_failures++;
+    }
+}
+
+#endif // H2_TESTS_SPEC_H
@@ -2,10 +2,20 @@
 #include "hydrogen/logger.h"
 #include "hydrogen/object.h"
 #include "hydrogen/helpers/filesystem.h"
+#include "hydrogen/Preferences.h"
 
 void rubberband_test( const QString& sample_path );
 int xml_drumkit( int log_level );
 int xml_pattern( int log_level );
+int note_queue( int log_level );
+int command_queue( int log_level );
+int mix_kernels( int log_level );
+int sinc_table( int log_level );
+int adsr_values( int log_level );
+int sample_pool( int log_level );
+int sampler_kit_swap( int log_level );
+
+int spec_failures = 0;
 
 int main( int argc, char* argv[] )
 {
@@ -18,12 +28,25 @@ int main( int argc, char* argv[] )
     H2Core::Filesystem::bootstrap( logger, "./data" );
     H2Core::Filesystem::info();
     H2Core::Filesystem::rm( H2Core::Filesystem::tmp_dir(), true );
+    /* Preferences, read when loading samples */
+    H2Core::Preferences::create_instance();
 
     rubberband_test( H2Core::Filesystem::drumkit_path_search( "GMkit" )+"/cym_Jazz.flac" );
-    xml_drumkit( log_level );
-    xml_pattern( log_level );
+    int failed = 0;
+    failed += ( xml_drumkit( log_level )!=EXIT_SUCCESS );
+    failed += ( xml_pattern( log_level )!=EXIT_SUCCESS );
+    failed += ( note_queue( log_level )!=EXIT_SUCCESS );
+    failed += ( command_queue( log_level )!=EXIT_SUCCESS );
+    failed += ( mix_kernels( log_level )!=EXIT_SUCCESS );
+    failed += ( sinc_table( log_level )!=EXIT_SUCCESS );
+    failed += ( adsr_values( log_level )!=EXIT_SUCCESS );
+    failed += ( sample_pool( log_level )!=EXIT_SUCCESS );
+    failed += ( sampler_kit_swap( log_level )!=EXIT_SUCCESS );
+    if( spec_failures ) {
+        ___ERRORLOG( QString( "%1 specs failed" ).arg( spec_failures ) );
+    }
 
     delete logger;
 
-    return EXIT_SUCCESS;
+    return ( failed || spec_failures ) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -1,5 +1,5 @@
 
-#include <unistd.h>
+#include "spec.h"
 #include <hydrogen/helpers/filesystem.h>
 
 #include <hydrogen/basics/drumkit.h>
@@ -11,15 +11,6 @@
 
 #define BASE_DIR    "./src/tests/data"
 
-static void spec( bool cond, const char* msg )
-{
-    if( !cond ) {
-        ___ERRORLOG( QString( " ** SPEC : %1" ).arg( msg ) );
-        sleep( 1 );
-        exit( EXIT_FAILURE );
-    }
-}
-
 static bool check_samples_data( H2Core::Drumkit* dk, bool loaded )
 {
     int count = 0;